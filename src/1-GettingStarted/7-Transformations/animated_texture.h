@@ -0,0 +1,129 @@
+#ifndef ANIMATED_TEXTURE_H
+#define ANIMATED_TEXTURE_H
+
+// Animated GIF texture that decodes one frame at a time with
+// stbi_gif_stream, so memory stays constant however long the animation is.
+//
+// Frames go round a small GL_TEXTURE_2D_ARRAY: each new frame is uploaded into
+// the next layer instead of over the one the GPU may still be sampling from
+// the frame before, so the upload never waits on in-flight draws. Sample it
+// with a sampler2DArray at layer currentLayer().
+//
+// Needs stb_image.h compiled somewhere with STB_IMAGE_IMPLEMENTATION.
+
+#include <glad/glad.h>
+#include "stb_image.h"
+#include <iostream>
+#include <vector>
+
+class AnimatedTexture {
+  public:
+    static const int MAX_CATCH_UP = 3; // frames decoded by one update() at most
+
+    unsigned int texture_array {0};
+    int width  {0};
+    int height {0};
+
+    AnimatedTexture(const char* gif_path, int ring_layers = 3) : ring_layers(ring_layers) {
+      stream = stbi_gif_stream_open(gif_path, &width, &height);
+      if (!stream) {
+        std::cerr << "ERROR::ANIMATED_TEXTURE::GIF_NOT_LOADED " << gif_path << " " << stbi_failure_reason() << std::endl;
+        return;
+      }
+      frame.resize((size_t)width * height * 4);
+
+      glGenTextures(1, &texture_array);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, ring_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+      // show the first frame straight away
+      current_layer = ring_layers - 1;
+      playing = decodeNext();
+      if (playing)
+        upload();
+    }
+
+    ~AnimatedTexture() {
+      if (texture_array) glDeleteTextures(1, &texture_array);
+      stbi_gif_stream_close(stream);
+    }
+
+    AnimatedTexture(const AnimatedTexture&) = delete;
+    AnimatedTexture& operator=(const AnimatedTexture&) = delete;
+
+    bool isValid() const {
+      return stream != nullptr;
+    }
+
+    // Advance playback by dt seconds. Frames whose time has already passed
+    // are decoded but only the latest is uploaded; after a hitch longer
+    // than MAX_CATCH_UP frames the rest is skipped and playback resumes
+    // from there, so a stall (or a paused debugger) doesn't decode its way
+    // through the whole backlog.
+    void update(double dt) {
+      if (!playing) return;
+
+      frame_time += dt;
+      int decoded = 0;
+      while (frame_time >= frame_delay) {
+        if (decoded == MAX_CATCH_UP) {
+          frame_time = 0.0;
+          break;
+        }
+        frame_time -= frame_delay;
+        if (!decodeNext()) {
+          playing = false;
+          break;
+        }
+        ++decoded;
+      }
+      if (decoded)
+        upload();
+    }
+
+    int currentLayer() const {
+      return current_layer;
+    }
+
+    void bind(unsigned int texture_unit) const {
+      glActiveTexture(GL_TEXTURE0 + texture_unit);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+    }
+
+  private:
+    stbi_gif_stream* stream {nullptr};
+    std::vector<unsigned char> frame; // staging for the decoded frame
+    int    ring_layers;
+    int    current_layer {0};
+    double frame_delay   {0.0};       // seconds the decoded frame stays up
+    double frame_time    {0.0};
+    bool   playing       {false};
+
+    // decode the next frame into the staging buffer, looping at the end
+    bool decodeNext() {
+      int delay_ms = 0;
+      int result = stbi_gif_stream_next(stream, frame.data(), &delay_ms);
+      if (result == 0) {
+        stbi_gif_stream_rewind(stream);
+        result = stbi_gif_stream_next(stream, frame.data(), &delay_ms);
+      }
+      if (result != 1) {
+        std::cerr << "ERROR::ANIMATED_TEXTURE::FRAME_NOT_DECODED " << stbi_failure_reason() << std::endl;
+        return false;
+      }
+      // like browsers, treat (near) zero delays as 100 ms
+      frame_delay = (delay_ms <= 10 ? 100 : delay_ms) / 1000.0;
+      return true;
+    }
+
+    void upload() {
+      current_layer = (current_layer + 1) % ring_layers;
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, current_layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, frame.data());
+    }
+};
+#endif
@@ -0,0 +1,473 @@
+#ifndef ASSET_BUNDLE_H
+#define ASSET_BUNDLE_H
+
+// One archive file for all the loose resources (shaders, textures), mapped
+// once at startup instead of opening and reading every file.
+//
+// Layout: a header, the index (one fixed-size record per entry, sorted by
+// name, then the names), and the entries themselves, each starting on its
+// own page. Entries are stored as-is or, when asked for and it pays off,
+// LZ4-compressed (block format). Stored entries are read in place from the
+// mapping, compressed ones are decompressed into the caller's buffer.
+//
+// Build a bundle with AssetBundleWriter (tools/asset_bundler.cpp wraps it),
+// then mount it; Shader, MipChain and TextureAtlas look paths up in the
+// mounted bundle first (readMounted) and fall back to the file system:
+//
+//   AssetBundle bundle;
+//   if (bundle.open("./resources.bundle"))
+//     bundle.mount();
+//   Shader shader("./resources/shaders/vertex.vert", ...); // read from the bundle
+//
+// Names are paths relative to the working directory, with '/' separators
+// and without a leading "./".
+
+#include "file_io.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// LZ4 block format (no frame), so bundles can be checked with the reference
+// tools; a greedy single-probe compressor, which is all asset packing needs.
+class Lz4Block {
+  public:
+    // Compress size bytes onto the end of out; returns the compressed size.
+    static size_t compress(const unsigned char* src, size_t size, std::vector<unsigned char>& out) {
+      size_t start = out.size();
+      std::vector<uint32_t> table(HASH_SIZE, 0); // position + 1 of the last 4 bytes with that hash
+      size_t ip = 0, anchor = 0;
+
+      if (size > MIN_INPUT) {
+        size_t match_limit = size - LAST_LITERALS; // matches end before this
+        size_t start_limit = size - MF_LIMIT;      // and start before this
+        while (ip < start_limit) {
+          uint32_t sequence = read32(src + ip);
+          uint32_t& slot = table[hash(sequence)];
+          size_t candidate = slot;
+          slot = (uint32_t)(ip + 1);
+          if (candidate == 0 || ip - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != sequence) {
+            ++ip;
+            continue;
+          }
+
+          size_t ref = candidate - 1;
+          size_t length = MIN_MATCH;
+          while (ip + length < match_limit && src[ref + length] == src[ip + length])
+            ++length;
+          emitSequence(src + anchor, ip - anchor, ip - ref, length, out);
+          ip += length;
+          anchor = ip;
+        }
+      }
+
+      emitSequence(src + anchor, size - anchor, 0, 0, out);
+      return out.size() - start;
+    }
+
+    // Decompress exactly dst_size bytes; false on any malformed input.
+    static bool decompress(const unsigned char* src, size_t src_size, unsigned char* dst, size_t dst_size) {
+      const unsigned char* end = src + src_size;
+      size_t op = 0;
+      while (src < end) {
+        unsigned token = *src++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(src, end, literals)) return false;
+        if (literals > (size_t)(end - src) || literals > dst_size - op) return false;
+        if (literals) std::memcpy(dst + op, src, literals);
+        src += literals;
+        op  += literals;
+        if (src == end) break; // the last sequence has no match
+
+        if (end - src < 2) return false;
+        size_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(src, end, length)) return false;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > op || length > dst_size - op) return false;
+
+        // byte by byte: the match may overlap what it is producing
+        const unsigned char* match = dst + op - offset;
+        for (size_t i = 0; i < length; ++i)
+          dst[op + i] = match[i];
+        op += length;
+      }
+      return op == dst_size;
+    }
+
+  private:
+    static const size_t MIN_MATCH     = 4;
+    static const size_t LAST_LITERALS = 5;     // the format ends with at least this many literals
+    static const size_t MF_LIMIT      = 12;    // and its last match starts at least this far from the end
+    static const size_t MIN_INPUT     = 13;    // shorter inputs are all literals
+    static const size_t MAX_OFFSET    = 65535;
+    static const int    HASH_BITS     = 16;
+    static const size_t HASH_SIZE     = (size_t)1 << HASH_BITS;
+
+    static uint32_t read32(const unsigned char* p) {
+      uint32_t value;
+      std::memcpy(&value, p, 4);
+      return value;
+    }
+
+    static uint32_t hash(uint32_t sequence) {
+      return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static void writeLength(size_t length, std::vector<unsigned char>& out) {
+      for (; length >= 255; length -= 255)
+        out.push_back(255);
+      out.push_back((unsigned char)length);
+    }
+
+    static bool readLength(const unsigned char*& src, const unsigned char* end, size_t& length) {
+      unsigned char byte;
+      do {
+        if (src == end) return false;
+        byte = *src++;
+        length += byte;
+      } while (byte == 255);
+      return true;
+    }
+
+    // literals, then a match of length (0: none, for the last sequence)
+    static void emitSequence(const unsigned char* literals, size_t literal_count, size_t offset, size_t length,
+                             std::vector<unsigned char>& out) {
+      size_t match_code = length ? length - MIN_MATCH : 0;
+      out.push_back((unsigned char)((std::min<size_t>(literal_count, 15) << 4) | std::min<size_t>(match_code, 15)));
+      if (literal_count >= 15) writeLength(literal_count - 15, out);
+      out.insert(out.end(), literals, literals + literal_count);
+      if (!length) return;
+      out.push_back((unsigned char)(offset & 0xFF));
+      out.push_back((unsigned char)(offset >> 8));
+      if (match_code >= 15) writeLength(match_code - 15, out);
+    }
+};
+
+// an entry's bytes: pointing into the mapping, or into storage when it had
+// to be decompressed
+struct AssetData {
+  const unsigned char* data {nullptr};
+  size_t size {0};
+  std::vector<unsigned char> storage;
+};
+
+class AssetBundle {
+  public:
+    static const uint32_t VERSION   = 1;
+    static const size_t   ALIGNMENT = 4096; // entries start on their own page
+
+    enum Compression : uint32_t { STORED = 0, LZ4 = 1 };
+
+    // one index record; the name follows in the name table
+    struct Entry {
+      uint64_t offset;      // from the start of the file
+      uint64_t stored_size;
+      uint64_t size;        // once decompressed
+      uint64_t hash;        // FileIO::hashBytes of the decompressed bytes
+      uint32_t name_offset; // into the name table
+      uint32_t name_size;
+      uint32_t compression;
+      uint32_t reserved;
+    };
+
+    struct Header {
+      char     magic[4];
+      uint32_t version;
+      uint64_t entry_count;
+      uint64_t names_offset; // the name table, right after the index
+      uint64_t names_size;
+    };
+
+    AssetBundle() = default;
+
+    ~AssetBundle() {
+      close();
+    }
+
+    AssetBundle(const AssetBundle&) = delete;
+    AssetBundle& operator=(const AssetBundle&) = delete;
+
+    // Map the bundle and check its index; report_missing false keeps quiet
+    // when there is no bundle to open.
+    bool open(const char* path, bool report_missing = true) {
+      close();
+      bool found;
+      if (!file.map(path, &found) && !found) {
+        if (report_missing) std::cerr << "ERROR::ASSET_BUNDLE::NOT_FOUND " << path << std::endl;
+        return false;
+      }
+      if (!file.isMapped() || !validate()) {
+        std::cerr << "ERROR::ASSET_BUNDLE::INVALID " << path << std::endl;
+        close();
+        return false;
+      }
+      return true;
+    }
+
+    void close() {
+      if (mounted() == this) mounted() = nullptr;
+      file.unmap();
+      entries = nullptr;
+      entry_count = 0;
+    }
+
+    // the bundle loaders look in first (nullptr: none)
+    static AssetBundle*& mounted() {
+      static AssetBundle* bundle = nullptr;
+      return bundle;
+    }
+
+    void mount() {
+      mounted() = this;
+    }
+
+    // read path from the mounted bundle, if there is one and it has path
+    static bool readMounted(const char* path, AssetData& out) {
+      AssetBundle* bundle = mounted();
+      return bundle && bundle->read(path, out);
+    }
+
+    const Entry* find(const char* path) const {
+      std::string name = normalize(path);
+      const Entry* first = entries;
+      const Entry* last  = entries + entry_count;
+      const Entry* it = std::lower_bound(first, last, name, [this](const Entry& entry, const std::string& key) {
+        return compareName(entry, key) < 0;
+      });
+      return it != last && compareName(*it, name) == 0 ? it : nullptr;
+    }
+
+    bool contains(const char* path) const {
+      return find(path) != nullptr;
+    }
+
+    // Zero-copy view of a stored entry; nullptr for missing or compressed ones.
+    const unsigned char* view(const char* path, size_t& size) const {
+      const Entry* entry = find(path);
+      if (!entry || entry->compression != STORED) return nullptr;
+      size = (size_t)entry->size;
+      return base() + entry->offset;
+    }
+
+    // Any entry: in place when stored, decompressed into out.storage when not.
+    bool read(const char* path, AssetData& out) const {
+      const Entry* entry = find(path);
+      if (!entry) return false;
+      const unsigned char* stored = base() + entry->offset;
+      if (entry->compression == STORED) {
+        out.data = stored;
+        out.size = (size_t)entry->size;
+        return true;
+      }
+      out.storage.resize((size_t)entry->size);
+      if (!Lz4Block::decompress(stored, (size_t)entry->stored_size, out.storage.data(), out.storage.size())) {
+        std::cerr << "ERROR::ASSET_BUNDLE::ENTRY_CORRUPT " << path << std::endl;
+        return false;
+      }
+      out.data = out.storage.data();
+      out.size = out.storage.size();
+      return true;
+    }
+
+    bool readText(const char* path, std::string& text) const {
+      AssetData data;
+      if (!read(path, data)) return false;
+      text.assign((const char*)data.data, data.size);
+      return true;
+    }
+
+    size_t entryCount() const {
+      return (size_t)entry_count;
+    }
+
+    void printStats() const {
+      uint64_t stored = 0, size = 0, compressed = 0;
+      for (uint64_t i = 0; i < entry_count; ++i) {
+        stored += entries[i].stored_size;
+        size   += entries[i].size;
+        compressed += entries[i].compression != STORED;
+      }
+      std::cout << "INFO::ASSET_BUNDLE::" << entry_count << " entries (" << compressed << " LZ4), "
+                << size / 1024 << " KB in " << stored / 1024 << " KB, " << file.size() / 1024 << " KB mapped" << std::endl;
+    }
+
+    // "./a//b\c" -> "a/b/c"
+    static std::string normalize(const char* path) {
+      std::string name;
+      for (const char* c = path; *c; ++c) {
+        char ch = *c == '\\' ? '/' : *c;
+        if (ch == '/' && !name.empty() && name.back() == '/') continue;
+        name.push_back(ch);
+        if (name == "./") name.clear();
+        else if (name.size() >= 3 && name.compare(name.size() - 3, 3, "/./") == 0) name.resize(name.size() - 2);
+      }
+      return name;
+    }
+
+  private:
+    MappedFile   file;
+    const Entry* entries     {nullptr};
+    uint64_t     entry_count {0};
+    const char*  names       {nullptr};
+
+    const unsigned char* base() const { return file.data(); }
+
+    int compareName(const Entry& entry, const std::string& key) const {
+      size_t common = std::min<size_t>(entry.name_size, key.size());
+      int order = std::memcmp(names + entry.name_offset, key.data(), common);
+      if (order != 0) return order;
+      return entry.name_size < key.size() ? -1 : entry.name_size > key.size() ? 1 : 0;
+    }
+
+    // every offset and size must stay inside the mapping
+    bool validate() {
+      size_t mapped_size = file.size();
+      if (mapped_size < sizeof(Header)) return false;
+      Header header;
+      std::memcpy(&header, base(), sizeof(header));
+      if (std::memcmp(header.magic, "ABDL", 4) != 0 || header.version != VERSION) return false;
+      if (header.entry_count > (mapped_size - sizeof(Header)) / sizeof(Entry)) return false;
+      if (header.names_offset > mapped_size || header.names_size > mapped_size - header.names_offset) return false;
+
+      entries     = (const Entry*)(base() + sizeof(Header));
+      entry_count = header.entry_count;
+      names       = (const char*)base() + header.names_offset;
+      for (uint64_t i = 0; i < entry_count; ++i) {
+        const Entry& entry = entries[i];
+        if ((uint64_t)entry.name_offset + entry.name_size > header.names_size) return false;
+        if (entry.offset > mapped_size || entry.stored_size > mapped_size - entry.offset) return false;
+        if (entry.compression == STORED ? entry.stored_size != entry.size : entry.compression != LZ4) return false;
+        // LZ4 expands at most 255:1, so a larger size is corrupt, not just big
+        if (entry.compression == LZ4 && entry.size > entry.stored_size * 255 + 16) return false;
+        // find() binary searches, so the names must be sorted and unique
+        if (i > 0 && compareName(entry, std::string(names + entries[i - 1].name_offset, entries[i - 1].name_size)) <= 0)
+          return false;
+      }
+      return true;
+    }
+};
+
+// Collects files (or bytes) and writes them out as a bundle.
+class AssetBundleWriter {
+  public:
+    // entries whose LZ4 form isn't at least this much smaller are stored
+    static constexpr double MIN_SAVING = 0.1;
+
+    bool addFile(const char* path, bool compress) {
+      std::ifstream file(path, std::ios::binary | std::ios::ate);
+      if (!file) {
+        std::cerr << "ERROR::ASSET_BUNDLE::FILE_NOT_READ " << path << std::endl;
+        return false;
+      }
+      std::vector<unsigned char> bytes((size_t)file.tellg());
+      file.seekg(0);
+      if (!file.read((char*)bytes.data(), bytes.size())) {
+        std::cerr << "ERROR::ASSET_BUNDLE::FILE_NOT_READ " << path << std::endl;
+        return false;
+      }
+      add(path, bytes.data(), bytes.size(), compress);
+      return true;
+    }
+
+    void add(const char* path, const unsigned char* bytes, size_t size, bool compress) {
+      Pending pending;
+      pending.name = AssetBundle::normalize(path);
+      pending.size = size;
+      pending.hash = FileIO::hashBytes(bytes, size);
+      pending.compression = AssetBundle::STORED;
+      if (compress && size > 0) {
+        Lz4Block::compress(bytes, size, pending.stored);
+        if (pending.stored.size() <= size * (1.0 - MIN_SAVING))
+          pending.compression = AssetBundle::LZ4;
+      }
+      if (pending.compression == AssetBundle::STORED)
+        pending.stored.assign(bytes, bytes + size);
+
+      // a later add of the same name replaces the earlier one
+      pending_entries.erase(std::remove_if(pending_entries.begin(), pending_entries.end(),
+                                           [&pending](const Pending& p) { return p.name == pending.name; }),
+                            pending_entries.end());
+      pending_entries.push_back(std::move(pending));
+    }
+
+    bool write(const char* path) {
+      std::sort(pending_entries.begin(), pending_entries.end(),
+                [](const Pending& a, const Pending& b) { return a.name < b.name; });
+
+      AssetBundle::Header header;
+      std::memset((void*)&header, 0, sizeof(header));
+      std::memcpy(header.magic, "ABDL", 4);
+      header.version      = AssetBundle::VERSION;
+      header.entry_count  = pending_entries.size();
+      header.names_offset = sizeof(header) + pending_entries.size() * sizeof(AssetBundle::Entry);
+
+      std::string names;
+      std::vector<AssetBundle::Entry> index(pending_entries.size());
+      for (size_t i = 0; i < pending_entries.size(); ++i) {
+        index[i].name_offset = (uint32_t)names.size();
+        index[i].name_size   = (uint32_t)pending_entries[i].name.size();
+        names += pending_entries[i].name;
+      }
+      header.names_size = names.size();
+
+      uint64_t offset = align(header.names_offset + names.size());
+      for (size_t i = 0; i < pending_entries.size(); ++i) {
+        const Pending& pending = pending_entries[i];
+        index[i].offset      = offset;
+        index[i].stored_size = pending.stored.size();
+        index[i].size        = pending.size;
+        index[i].hash        = pending.hash;
+        index[i].compression = pending.compression;
+        index[i].reserved    = 0;
+        offset = align(offset + pending.stored.size());
+      }
+
+      bool written = FileIO::writeAtomically(path, [&](std::ofstream& file) {
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)index.data(), index.size() * sizeof(AssetBundle::Entry));
+        file.write(names.data(), names.size());
+        for (size_t i = 0; i < pending_entries.size(); ++i) {
+          pad(file, index[i].offset);
+          file.write((const char*)pending_entries[i].stored.data(), pending_entries[i].stored.size());
+        }
+        pad(file, offset);
+      });
+      if (!written) {
+        std::cerr << "ERROR::ASSET_BUNDLE::NOT_WRITTEN " << path << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    size_t entryCount() const {
+      return pending_entries.size();
+    }
+
+  private:
+    struct Pending {
+      std::string name;
+      uint64_t    size;
+      uint64_t    hash;
+      uint32_t    compression;
+      std::vector<unsigned char> stored;
+    };
+    std::vector<Pending> pending_entries;
+
+    static uint64_t align(uint64_t offset) {
+      return (offset + AssetBundle::ALIGNMENT - 1) & ~(uint64_t)(AssetBundle::ALIGNMENT - 1);
+    }
+
+    static void pad(std::ofstream& file, uint64_t offset) {
+      static const char zeros[AssetBundle::ALIGNMENT] = {};
+      uint64_t at = (uint64_t)file.tellp();
+      if (offset > at) file.write(zeros, (std::streamsize)(offset - at));
+    }
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef CHROME_TRACE_H
+#define CHROME_TRACE_H
+
+// Writes Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev), the
+// format both profilers export:
+//
+//   ChromeTraceWriter trace("cpu_trace.json");
+//   if (!trace.isOpen()) ...;
+//   trace.threadName(1, "render");
+//   trace.complete(1, "draw", start_us, duration_us);
+//   if (!trace.finish()) ...;  // false if anything failed to write
+//
+// Names are JSON-escaped; times are in microseconds.
+
+#include <cstdio>
+
+class ChromeTraceWriter {
+  public:
+    explicit ChromeTraceWriter(const char* path) : file(std::fopen(path, "wb")) {
+      if (file) std::fprintf(file, "{\"traceEvents\":[");
+    }
+
+    ~ChromeTraceWriter() {
+      if (file) std::fclose(file);
+    }
+
+    ChromeTraceWriter(const ChromeTraceWriter&) = delete;
+    ChromeTraceWriter& operator=(const ChromeTraceWriter&) = delete;
+
+    bool isOpen() const {
+      return file != nullptr;
+    }
+
+    // the label of track tid
+    void threadName(int tid, const char* name) {
+      std::fprintf(file, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"",
+                   separator, tid);
+      writeEscaped(name);
+      std::fprintf(file, "\"}}");
+      separator = ",\n";
+    }
+
+    // a scope on track tid; frame, when not negative, goes in its args
+    void complete(int tid, const char* name, double start_us, double duration_us, long long frame = -1) {
+      std::fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"", separator, tid);
+      writeEscaped(name);
+      std::fprintf(file, "\",\"ts\":%.3f,\"dur\":%.3f", start_us, duration_us);
+      if (frame >= 0) std::fprintf(file, ",\"args\":{\"frame\":%lld}", frame);
+      std::fprintf(file, "}");
+      separator = ",\n";
+    }
+
+    // close the event list and the file
+    bool finish() {
+      std::fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+      bool ok = std::fflush(file) == 0;
+      ok = std::fclose(file) == 0 && ok;
+      file = nullptr;
+      return ok;
+    }
+
+  private:
+    FILE*       file;
+    const char* separator {"\n"};
+
+    void writeEscaped(const char* text) {
+      for (; text && *text; ++text) {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\') std::fprintf(file, "\\%c", c);
+        else if (c < 0x20)         std::fprintf(file, "\\u%04x", c);
+        else                       std::fputc(c, file);
+      }
+    }
+};
+#endif
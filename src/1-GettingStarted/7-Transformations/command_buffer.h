@@ -0,0 +1,294 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+// Deferred GL commands, so the CPU side of building a frame (walking the
+// scene, computing transforms, picking state) can run on any thread while
+// the GL calls themselves stay on the one thread that owns the context.
+//
+// A CommandBuffer belongs to one recording thread at a time. Commands are
+// small POD records written back to back into the buffer's own blocks, so
+// recording is a bounds check and a few stores, and two threads recording
+// into their own buffers share nothing:
+//
+//   // worker thread i
+//   CommandBuffer& commands = buffers[i];
+//   commands.reset();
+//   commands.useProgram(program);
+//   commands.uniformMatrix4(transform_location, glm::value_ptr(transform));
+//   commands.drawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+//
+//   // GL thread, after the workers are done
+//   CommandBuffer::execute(buffers, count);  // in buffer order
+//
+// Execution walks every buffer in one loop and drops program, vertex array
+// and texture binds that wouldn't change anything, which is common once
+// several buffers are laid end to end. reset() keeps the blocks, so a buffer
+// reused every frame stops allocating after the first.
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+class CommandBuffer {
+  public:
+    static const size_t BLOCK_SIZE = 64 * 1024; // bytes per block; commands never straddle two
+
+    enum class Type : uint16_t {
+      Clear,
+      UseProgram,
+      BindVertexArray,
+      BindTexture,
+      Uniform1i,
+      Uniform4f,
+      UniformMatrix4,
+      DrawElements,
+      DrawArrays,
+      BindBufferRange,
+    };
+
+    // every command starts with its type and its size, so the executor can
+    // step over it without knowing its layout
+    struct Header {
+      Type     type;
+      uint16_t size;
+    };
+
+    struct ClearCommand           { Header header; GLbitfield mask; GLfloat color[4]; };
+    struct UseProgramCommand      { Header header; GLuint program; };
+    struct BindVertexArrayCommand { Header header; GLuint vertex_array; };
+    struct BindTextureCommand     { Header header; GLuint unit; GLenum target; GLuint texture; };
+    struct Uniform1iCommand       { Header header; GLint location; GLint value; };
+    struct Uniform4fCommand       { Header header; GLint location; GLfloat value[4]; };
+    struct UniformMatrix4Command  { Header header; GLint location; GLfloat value[16]; };
+    struct DrawElementsCommand    { Header header; GLenum mode; GLsizei count; GLenum index_type; GLuint offset; };
+    struct DrawArraysCommand      { Header header; GLenum mode; GLint first; GLsizei count; };
+    struct BindBufferRangeCommand { Header header; GLenum target; GLuint index; GLuint buffer; GLuint offset; GLuint size; };
+
+    CommandBuffer() = default;
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+    CommandBuffer(CommandBuffer&&) = default;
+    CommandBuffer& operator=(CommandBuffer&&) = default;
+
+    // Forget the recorded commands; the blocks are kept for reuse.
+    void reset() {
+      for (Block& block : blocks) block.used = 0;
+      current = 0;
+      commands = 0;
+    }
+
+    size_t commandCount() const {
+      return commands;
+    }
+
+    size_t reservedBytes() const {
+      return blocks.size() * BLOCK_SIZE;
+    }
+
+    void clear(GLbitfield mask, float r, float g, float b, float a) {
+      ClearCommand& command = append<ClearCommand>(Type::Clear);
+      command.mask = mask;
+      command.color[0] = r; command.color[1] = g; command.color[2] = b; command.color[3] = a;
+    }
+
+    void useProgram(GLuint program) {
+      append<UseProgramCommand>(Type::UseProgram).program = program;
+    }
+
+    void bindVertexArray(GLuint vertex_array) {
+      append<BindVertexArrayCommand>(Type::BindVertexArray).vertex_array = vertex_array;
+    }
+
+    void bindTexture(GLuint unit, GLenum target, GLuint texture) {
+      BindTextureCommand& command = append<BindTextureCommand>(Type::BindTexture);
+      command.unit    = unit;
+      command.target  = target;
+      command.texture = texture;
+    }
+
+    void uniform1i(GLint location, GLint value) {
+      Uniform1iCommand& command = append<Uniform1iCommand>(Type::Uniform1i);
+      command.location = location;
+      command.value    = value;
+    }
+
+    void uniform4f(GLint location, float x, float y, float z, float w) {
+      Uniform4fCommand& command = append<Uniform4fCommand>(Type::Uniform4f);
+      command.location = location;
+      command.value[0] = x; command.value[1] = y; command.value[2] = z; command.value[3] = w;
+    }
+
+    // value: 16 floats, column major (glm::value_ptr of a mat4); copied
+    void uniformMatrix4(GLint location, const float* value) {
+      UniformMatrix4Command& command = append<UniformMatrix4Command>(Type::UniformMatrix4);
+      command.location = location;
+      std::memcpy(command.value, value, sizeof(command.value));
+    }
+
+    // offset: byte offset into the bound element buffer
+    void drawElements(GLenum mode, GLsizei count, GLenum index_type, size_t offset) {
+      DrawElementsCommand& command = append<DrawElementsCommand>(Type::DrawElements);
+      command.mode       = mode;
+      command.count      = count;
+      command.index_type = index_type;
+      command.offset     = (GLuint)offset;
+    }
+
+    void drawArrays(GLenum mode, GLint first, GLsizei count) {
+      DrawArraysCommand& command = append<DrawArraysCommand>(Type::DrawArrays);
+      command.mode  = mode;
+      command.first = first;
+      command.count = count;
+    }
+
+    // e.g. a frame's copy of a uniform block (frames_in_flight.h)
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, size_t offset, size_t size) {
+      BindBufferRangeCommand& command = append<BindBufferRangeCommand>(Type::BindBufferRange);
+      command.target = target;
+      command.index  = index;
+      command.buffer = buffer;
+      command.offset = (GLuint)offset;
+      command.size   = (GLuint)size;
+    }
+
+    // Call visit(const Header&) for every command in recording order; the
+    // header is the start of the command struct its type names.
+    template <typename Visitor>
+    void forEach(Visitor& visit) const {
+      for (size_t b = 0; b < blocks.size() && b <= current; ++b) {
+        const unsigned char* at  = blocks[b].data.get();
+        const unsigned char* end = at + blocks[b].used;
+        while (at < end) {
+          const Header& header = *reinterpret_cast<const Header*>(at);
+          visit(header);
+          at += header.size;
+        }
+      }
+    }
+
+    // Replay buffers[0..count) on the calling thread, which must own the GL
+    // context. Redundant binds are skipped across buffer boundaries too.
+    template <typename Buffers>
+    static void execute(const Buffers& buffers, size_t count) {
+      GlExecutor executor;
+      for (size_t i = 0; i < count; ++i)
+        deref(buffers[i]).forEach(executor);
+    }
+
+    static void execute(const CommandBuffer& buffer) {
+      GlExecutor executor;
+      buffer.forEach(executor);
+    }
+
+  private:
+    struct Block {
+      std::unique_ptr<unsigned char[]> data;
+      size_t used {0};
+    };
+
+    std::vector<Block> blocks;
+    size_t current  {0};  // block being appended to
+    size_t commands {0};
+
+    static const CommandBuffer& deref(const CommandBuffer& buffer) { return buffer; }
+    static const CommandBuffer& deref(const CommandBuffer* buffer) { return *buffer; }
+    static const CommandBuffer& deref(const std::unique_ptr<CommandBuffer>& buffer) { return *buffer; }
+
+    // every command is a multiple of 4 bytes, so all of them stay 4-byte aligned
+    template <typename Command>
+    Command& append(Type type) {
+      static_assert(sizeof(Command) % 4 == 0 && sizeof(Command) < BLOCK_SIZE, "command size");
+      if (blocks.empty() || blocks[current].used + sizeof(Command) > BLOCK_SIZE) {
+        if (!blocks.empty()) ++current;
+        if (current == blocks.size()) {
+          blocks.emplace_back();
+          blocks.back().data.reset(new unsigned char[BLOCK_SIZE]);
+        }
+      }
+      Block& block = blocks[current];
+      Command* command = reinterpret_cast<Command*>(block.data.get() + block.used);
+      command->header.type = type;
+      command->header.size = (uint16_t)sizeof(Command);
+      block.used += sizeof(Command);
+      ++commands;
+      return *command;
+    }
+
+    // the last values it set, so repeats can be skipped
+    struct GlExecutor {
+      static const GLuint UNITS = 16; // texture units tracked; binds to others always go through
+
+      GLuint program        {0xFFFFFFFFu};
+      GLuint vertex_array   {0xFFFFFFFFu};
+      GLuint active_unit    {0xFFFFFFFFu};
+      GLenum targets[UNITS]  {};          // 0 until the unit is bound once
+      GLuint textures[UNITS] {};
+
+      void operator()(const Header& header) {
+        switch (header.type) {
+          case Type::Clear: {
+            const ClearCommand& c = reinterpret_cast<const ClearCommand&>(header);
+            glClearColor(c.color[0], c.color[1], c.color[2], c.color[3]);
+            glClear(c.mask);
+            break;
+          }
+          case Type::UseProgram: {
+            const UseProgramCommand& c = reinterpret_cast<const UseProgramCommand&>(header);
+            if (c.program != program) glUseProgram(program = c.program);
+            break;
+          }
+          case Type::BindVertexArray: {
+            const BindVertexArrayCommand& c = reinterpret_cast<const BindVertexArrayCommand&>(header);
+            if (c.vertex_array != vertex_array) glBindVertexArray(vertex_array = c.vertex_array);
+            break;
+          }
+          case Type::BindTexture: {
+            const BindTextureCommand& c = reinterpret_cast<const BindTextureCommand&>(header);
+            bool tracked = c.unit < UNITS;
+            if (tracked && targets[c.unit] == c.target && textures[c.unit] == c.texture) break;
+            if (c.unit != active_unit) glActiveTexture(GL_TEXTURE0 + (active_unit = c.unit));
+            glBindTexture(c.target, c.texture);
+            if (tracked) {
+              targets[c.unit]  = c.target;
+              textures[c.unit] = c.texture;
+            }
+            break;
+          }
+          case Type::Uniform1i: {
+            const Uniform1iCommand& c = reinterpret_cast<const Uniform1iCommand&>(header);
+            glUniform1i(c.location, c.value);
+            break;
+          }
+          case Type::Uniform4f: {
+            const Uniform4fCommand& c = reinterpret_cast<const Uniform4fCommand&>(header);
+            glUniform4f(c.location, c.value[0], c.value[1], c.value[2], c.value[3]);
+            break;
+          }
+          case Type::UniformMatrix4: {
+            const UniformMatrix4Command& c = reinterpret_cast<const UniformMatrix4Command&>(header);
+            glUniformMatrix4fv(c.location, 1, GL_FALSE, c.value);
+            break;
+          }
+          case Type::DrawElements: {
+            const DrawElementsCommand& c = reinterpret_cast<const DrawElementsCommand&>(header);
+            glDrawElements(c.mode, c.count, c.index_type, (const void*)(uintptr_t)c.offset);
+            break;
+          }
+          case Type::DrawArrays: {
+            const DrawArraysCommand& c = reinterpret_cast<const DrawArraysCommand&>(header);
+            glDrawArrays(c.mode, c.first, c.count);
+            break;
+          }
+          case Type::BindBufferRange: {
+            const BindBufferRangeCommand& c = reinterpret_cast<const BindBufferRangeCommand&>(header);
+            glBindBufferRange(c.target, c.index, c.buffer, c.offset, c.size);
+            break;
+          }
+        }
+      }
+    };
+};
+#endif
@@ -0,0 +1,218 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+// Always-on CPU scope profiler, cheap enough to leave in release builds:
+//
+//   while (running) {
+//     { CPU_PROFILE_SCOPE("input");  process_input(window); }
+//     { CPU_PROFILE_SCOPE("update"); ... }
+//   }
+//   CpuProfiler::writeTrace("cpu_trace.json");  // chrome://tracing or ui.perfetto.dev
+//
+// A scope reads the cycle counter when it opens and when it closes and
+// appends one event to a ring owned by the calling thread. The owner is the
+// only writer, so there are no locks or read-modify-writes on that path;
+// the exporter copies a ring from any thread and throws away the events
+// that were overwritten while it copied. Rings keep the last RING_EVENTS
+// scopes of each thread. Build with CPU_PROFILER_DISABLED to compile the
+// scopes out entirely.
+
+#include "chrome_trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_PROFILER_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CPU_PROFILER_RDTSC 1
+#endif
+
+#define CPU_PROFILER_CONCAT_(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_(a, b)
+
+#ifdef CPU_PROFILER_DISABLED
+#define CPU_PROFILE_SCOPE(name) do {} while (0)
+#else
+// name must outlive the trace export (a string literal, usually)
+#define CPU_PROFILE_SCOPE(name) CpuProfiler::Scope CPU_PROFILER_CONCAT(cpu_profile_scope_, __LINE__)(name)
+#endif
+
+class CpuProfiler {
+    struct Ring;
+
+  public:
+    static const uint64_t RING_EVENTS = 1 << 16; // per thread, a power of two
+
+    class Scope {
+      public:
+        explicit Scope(const char* name) : ring(threadRing()), name(name), begin(ticks()) {}
+        ~Scope() {
+          ring.push(name, begin, ticks());
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        Ring&       ring;
+        const char* name;
+        uint64_t    begin;
+    };
+
+    // Label the calling thread in the trace; its ring is created if needed.
+    static void setThreadName(const char* name) {
+      Ring& ring = threadRing();
+      std::lock_guard<std::mutex> lock(registry().mutex);
+      ring.name = name;
+    }
+
+    static uint64_t ticks() {
+#ifdef CPU_PROFILER_RDTSC
+      return __rdtsc();
+#else
+      return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Chrome trace-event JSON of what the rings hold now, one track per
+    // thread; safe to call while other threads keep recording.
+    static bool writeTrace(const char* path) {
+      Registry& reg = registry();
+      double ticks_per_us = ticksPerMicrosecond();
+
+      std::vector<Event> events;
+      std::vector<std::pair<int, std::string> > threads;
+      std::vector<size_t> thread_ends;
+      {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (size_t i = 0; i < reg.rings.size(); ++i) {
+          reg.rings[i]->snapshot(events);
+          threads.push_back(std::make_pair((int)i + 1, reg.rings[i]->name));
+          thread_ends.push_back(events.size());
+        }
+      }
+
+      ChromeTraceWriter file(path);
+      if (!file.isOpen()) {
+        std::cerr << "ERROR::CPU_PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+        return false;
+      }
+      for (size_t t = 0; t < threads.size(); ++t)
+        file.threadName(threads[t].first, threads[t].second.c_str());
+      size_t event = 0;
+      for (size_t t = 0; t < threads.size(); ++t) {
+        for (; event < thread_ends[t]; ++event) {
+          const Event& e = events[event];
+          file.complete(threads[t].first, e.name, (double)(e.begin - reg.start_ticks) / ticks_per_us,
+                        (double)(e.end - e.begin) / ticks_per_us);
+        }
+      }
+      if (!file.finish()) {
+        std::cerr << "ERROR::CPU_PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+        return false;
+      }
+      std::cout << "INFO::CPU_PROFILER::" << events.size() << " scopes from " << threads.size()
+                << " threads written to " << path << std::endl;
+      return true;
+    }
+
+  private:
+    struct Event {
+      const char* name;
+      uint64_t    begin;
+      uint64_t    end;
+    };
+
+    // single-producer ring; fields are relaxed atomics so the exporter's
+    // concurrent copy is well defined (plain stores on x86 and ARM)
+    struct Ring {
+      struct Slot {
+        std::atomic<const char*> name  {nullptr};
+        std::atomic<uint64_t>    begin {0};
+        std::atomic<uint64_t>    end   {0};
+      };
+
+      std::atomic<uint64_t> written {0};
+      std::unique_ptr<Slot[]> slots {new Slot[RING_EVENTS]};
+      std::string name;
+
+      void push(const char* event_name, uint64_t begin, uint64_t end) {
+        uint64_t index = written.load(std::memory_order_relaxed);
+        Slot& slot = slots[index & (RING_EVENTS - 1)];
+        slot.name.store(event_name, std::memory_order_relaxed);
+        slot.begin.store(begin, std::memory_order_relaxed);
+        slot.end.store(end, std::memory_order_relaxed);
+        written.store(index + 1, std::memory_order_release);
+      }
+
+      // append the events still intact after copying them out
+      void snapshot(std::vector<Event>& out) const {
+        uint64_t last  = written.load(std::memory_order_acquire);
+        uint64_t first = last > RING_EVENTS ? last - RING_EVENTS : 0;
+        size_t   start = out.size();
+        for (uint64_t i = first; i < last; ++i) {
+          const Slot& slot = slots[i & (RING_EVENTS - 1)];
+          out.push_back(Event {slot.name.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed),
+                               slot.end.load(std::memory_order_relaxed)});
+        }
+        // the writer may have lapped the oldest slots meanwhile, and may be
+        // part way into the slot after its last published one
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now = written.load(std::memory_order_relaxed) + 1;
+        uint64_t overwritten = now > RING_EVENTS + first ? now - RING_EVENTS - first : 0;
+        if (overwritten > last - first) overwritten = last - first;
+        out.erase(out.begin() + start, out.begin() + start + (size_t)overwritten);
+      }
+    };
+
+    // rings outlive their threads so the exporter still sees finished ones
+    struct Registry {
+      std::mutex mutex;
+      std::vector<std::unique_ptr<Ring> > rings;
+      uint64_t start_ticks {ticks()};
+      std::chrono::steady_clock::time_point start_time {std::chrono::steady_clock::now()};
+    };
+
+    static Registry& registry() {
+      static Registry instance;
+      return instance;
+    }
+
+    static Ring& threadRing() {
+      static thread_local Ring* ring = nullptr;
+      if (!ring) ring = addRing();
+      return *ring;
+    }
+
+    static Ring* addRing() {
+      Registry& reg = registry();
+      std::unique_ptr<Ring> ring(new Ring());
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      ring->name = "thread " + std::to_string(reg.rings.size() + 1);
+      reg.rings.push_back(std::move(ring));
+      return reg.rings.back().get();
+    }
+
+    // the cycle counter's rate, measured against steady_clock since start-up
+    static double ticksPerMicrosecond() {
+#ifdef CPU_PROFILER_RDTSC
+      Registry& reg = registry();
+      std::chrono::steady_clock::time_point min_end = reg.start_time + std::chrono::milliseconds(20);
+      if (std::chrono::steady_clock::now() < min_end) std::this_thread::sleep_until(min_end);
+      double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - reg.start_time).count();
+      return (double)(ticks() - reg.start_ticks) / us;
+#else
+      return 1000.0;
+#endif
+    }
+};
+#endif
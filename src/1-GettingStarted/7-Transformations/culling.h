@@ -0,0 +1,422 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+// Visibility culling for large instance sets, ahead of filling the instance
+// buffer a draw reads:
+//
+//   InstanceBounds bounds;                    // one entry per instance
+//   bounds.push(center, half_size);
+//
+//   Culler culler;
+//   culler.occlusion.begin(view_projection);  // optional: big occluders
+//   culler.occlusion.addOccluder(wall_center, wall_half_size);
+//   const std::vector<uint32_t>& visible = culler.cull(bounds, view_projection);
+//   size_t count = Culler::gather(visible, instance_matrices, mapped_instance_buffer);
+//   glDrawElementsInstanced(..., (GLsizei)count);
+//
+// Matrices are 16 floats, column major (glm::value_ptr of a mat4).
+//
+// The frustum stage tests four instances per step with SSE over the SoA
+// bounds: a bounding sphere test that rejects most of what is outside, then
+// (use_boxes) the tighter box test. Survivors can then be tested against a
+// small depth buffer into which the occluders' boxes were rasterized on the
+// CPU, through a max-depth mip pyramid: an instance is hidden when the
+// nearest point of its box is behind the farthest occluder depth over the
+// screen rectangle it covers. Occluders that cross the near plane are
+// skipped and occludees that do are kept, so the test only ever errs
+// towards drawing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+// Axis-aligned bounds, one array per component so four instances load with
+// one instruction each.
+struct InstanceBounds {
+  std::vector<float> center_x, center_y, center_z;
+  std::vector<float> extent_x, extent_y, extent_z; // half sizes
+  std::vector<float> radius;                       // of the box's bounding sphere
+
+  size_t size() const {
+    return center_x.size();
+  }
+
+  void clear() {
+    center_x.clear(); center_y.clear(); center_z.clear();
+    extent_x.clear(); extent_y.clear(); extent_z.clear();
+    radius.clear();
+  }
+
+  void reserve(size_t count) {
+    center_x.reserve(count); center_y.reserve(count); center_z.reserve(count);
+    extent_x.reserve(count); extent_y.reserve(count); extent_z.reserve(count);
+    radius.reserve(count);
+  }
+
+  void push(const float center[3], const float extent[3]) {
+    center_x.push_back(center[0]); center_y.push_back(center[1]); center_z.push_back(center[2]);
+    extent_x.push_back(extent[0]); extent_y.push_back(extent[1]); extent_z.push_back(extent[2]);
+    radius.push_back(std::sqrt(extent[0] * extent[0] + extent[1] * extent[1] + extent[2] * extent[2]));
+  }
+};
+
+// The six planes (inside: dot(normal, p) + d >= 0) of a view-projection.
+struct Frustum {
+  float planes[6][4];
+
+  // Gribb and Hartmann: each plane is the last row of the matrix plus or
+  // minus one of the others
+  static Frustum fromMatrix(const float* m) {
+    Frustum frustum;
+    for (int i = 0; i < 6; ++i) {
+      int row = i / 2;
+      float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+      float* plane = frustum.planes[i];
+      for (int column = 0; column < 4; ++column)
+        plane[column] = m[column * 4 + 3] + sign * m[column * 4 + row];
+      float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+      if (length > 0.0f)
+        for (int column = 0; column < 4; ++column) plane[column] /= length;
+    }
+    return frustum;
+  }
+};
+
+// Depth buffer of occluder boxes, at a resolution far below the screen's,
+// with a max-depth mip pyramid for testing boxes in a few reads.
+class OcclusionBuffer {
+  public:
+    explicit OcclusionBuffer(int width = 256, int height = 128) : width(width), height(height) {}
+
+    // Start a frame's occluders; depth is cleared to the far plane.
+    void begin(const float* view_projection) {
+      std::memcpy(matrix, view_projection, sizeof(matrix));
+      levels.assign(1, std::vector<float>((size_t)width * height, 1.0f));
+      level_sizes.assign(1, std::make_pair(width, height));
+      occluders = 0;
+      built = false;
+    }
+
+    bool empty() const {
+      return occluders == 0;
+    }
+
+    // Rasterize a box's 12 triangles, keeping the nearest depth per pixel.
+    void addOccluder(const float center[3], const float extent[3]) {
+      if (levels.empty()) return;
+      float screen[8][3];
+      for (int corner = 0; corner < 8; ++corner) {
+        float clip[4];
+        project(center, extent, corner, clip);
+        if (clip[3] < NEAR_W) return; // crosses the near plane: not worth clipping
+        screen[corner][0] = (clip[0] / clip[3] * 0.5f + 0.5f) * width;
+        screen[corner][1] = (clip[1] / clip[3] * 0.5f + 0.5f) * height;
+        screen[corner][2] = clip[2] / clip[3] * 0.5f + 0.5f;
+      }
+      // corner bits: x = 1, y = 2, z = 4
+      static const int faces[6][4] = {{0, 2, 6, 4}, {1, 5, 7, 3}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 6, 7, 5}};
+      for (const int* face : faces) {
+        rasterize(screen[face[0]], screen[face[1]], screen[face[2]]);
+        rasterize(screen[face[0]], screen[face[2]], screen[face[3]]);
+      }
+      ++occluders;
+      built = false;
+    }
+
+    // false only if the whole box is behind occluders
+    bool visible(float center_x, float center_y, float center_z, float extent_x, float extent_y, float extent_z) {
+      if (levels.empty() || occluders == 0) return true;
+      if (!built) buildPyramid();
+
+      const float center[3] = {center_x, center_y, center_z};
+      const float extent[3] = {extent_x, extent_y, extent_z};
+      float min_x, min_y, max_x, max_y, nearest;
+      if (!screenBounds(center, extent, min_x, min_y, max_x, max_y, nearest)) return true;
+      if (max_x < 0.0f || max_y < 0.0f || min_x >= width || min_y >= height) return true; // frustum's call, not ours
+
+      int x0 = std::max(0, (int)min_x), x1 = std::min(width - 1, (int)max_x);
+      int y0 = std::max(0, (int)min_y), y1 = std::min(height - 1, (int)max_y);
+      // the level at which the rectangle spans at most 2x2 texels
+      int level = 0;
+      while (level + 1 < (int)levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        ++level;
+      const std::vector<float>& depth = levels[level];
+      int level_width = level_sizes[level].first;
+      for (int y = y0 >> level; y <= (y1 >> level); ++y)
+        for (int x = x0 >> level; x <= (x1 >> level); ++x)
+          if (nearest <= depth[(size_t)y * level_width + x]) return true;
+      return false;
+    }
+
+  private:
+    static constexpr float NEAR_W = 1e-3f;
+
+    int   width;
+    int   height;
+    float matrix[16];
+    int   occluders {0};
+    bool  built     {false};
+    std::vector<std::vector<float>> levels;         // 0 is full resolution
+    std::vector<std::pair<int, int>> level_sizes;
+
+    // screen rectangle and nearest depth of a box's corners; false if one
+    // is behind the near plane
+    bool screenBounds(const float center[3], const float extent[3], float& min_x, float& min_y, float& max_x,
+                      float& max_y, float& nearest) const {
+#ifdef CULLING_SSE
+      // corner = M * center + M's columns scaled by +-extent; eight corners
+      // as two groups of four, one register per clip component
+      const __m128 sign_x = _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+      const __m128 sign_y = _mm_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+      __m128 clip[4][2];
+      for (int row = 0; row < 4; ++row) {
+        float base = matrix[row] * center[0] + matrix[4 + row] * center[1] + matrix[8 + row] * center[2] + matrix[12 + row];
+        __m128 xy = _mm_add_ps(_mm_add_ps(_mm_set1_ps(base), _mm_mul_ps(sign_x, _mm_set1_ps(matrix[row] * extent[0]))),
+                               _mm_mul_ps(sign_y, _mm_set1_ps(matrix[4 + row] * extent[1])));
+        __m128 z = _mm_set1_ps(matrix[8 + row] * extent[2]);
+        clip[row][0] = _mm_sub_ps(xy, z);
+        clip[row][1] = _mm_add_ps(xy, z);
+      }
+      const __m128 near_w = _mm_set1_ps(NEAR_W), half = _mm_set1_ps(0.5f);
+      if (_mm_movemask_ps(_mm_or_ps(_mm_cmplt_ps(clip[3][0], near_w), _mm_cmplt_ps(clip[3][1], near_w))))
+        return false;
+      __m128 screen[3][2];
+      for (int group = 0; group < 2; ++group) {
+        __m128 inverse_w = _mm_div_ps(_mm_set1_ps(1.0f), clip[3][group]);
+        for (int axis = 0; axis < 3; ++axis)
+          screen[axis][group] = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[axis][group], inverse_w), half), half);
+      }
+      min_x = horizontalMin(_mm_min_ps(screen[0][0], screen[0][1])) * width;
+      max_x = horizontalMax(_mm_max_ps(screen[0][0], screen[0][1])) * width;
+      min_y = horizontalMin(_mm_min_ps(screen[1][0], screen[1][1])) * height;
+      max_y = horizontalMax(_mm_max_ps(screen[1][0], screen[1][1])) * height;
+      nearest = horizontalMin(_mm_min_ps(screen[2][0], screen[2][1]));
+#else
+      min_x = min_y = nearest = 1e30f;
+      max_x = max_y = -1e30f;
+      for (int corner = 0; corner < 8; ++corner) {
+        float clip[4];
+        project(center, extent, corner, clip);
+        if (clip[3] < NEAR_W) return false;
+        float x = (clip[0] / clip[3] * 0.5f + 0.5f) * width;
+        float y = (clip[1] / clip[3] * 0.5f + 0.5f) * height;
+        min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+        nearest = std::min(nearest, clip[2] / clip[3] * 0.5f + 0.5f);
+      }
+#endif
+      return true;
+    }
+
+#ifdef CULLING_SSE
+    static float horizontalMin(__m128 v) {
+      v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+      v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+      return _mm_cvtss_f32(v);
+    }
+
+    static float horizontalMax(__m128 v) {
+      v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+      v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+      return _mm_cvtss_f32(v);
+    }
+#endif
+
+    void project(const float center[3], const float extent[3], int corner, float clip[4]) const {
+      float p[3];
+      for (int axis = 0; axis < 3; ++axis)
+        p[axis] = center[axis] + ((corner >> axis) & 1 ? extent[axis] : -extent[axis]);
+      for (int row = 0; row < 4; ++row)
+        clip[row] = matrix[row] * p[0] + matrix[4 + row] * p[1] + matrix[8 + row] * p[2] + matrix[12 + row];
+    }
+
+    // pixel centers inside the triangle get its depth there, if nearer
+    void rasterize(const float* a, const float* b, const float* c) {
+      float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+      if (std::fabs(area) < 1e-6f) return;
+      int x0 = std::max(0, (int)std::floor(std::min(a[0], std::min(b[0], c[0]))));
+      int x1 = std::min(width - 1, (int)std::ceil(std::max(a[0], std::max(b[0], c[0]))));
+      int y0 = std::max(0, (int)std::floor(std::min(a[1], std::min(b[1], c[1]))));
+      int y1 = std::min(height - 1, (int)std::ceil(std::max(a[1], std::max(b[1], c[1]))));
+      float inverse_area = 1.0f / area;
+      std::vector<float>& depth = levels[0];
+      for (int y = y0; y <= y1; ++y) {
+        float py = y + 0.5f;
+        for (int x = x0; x <= x1; ++x) {
+          float px = x + 0.5f;
+          float w0 = ((b[0] - px) * (c[1] - py) - (b[1] - py) * (c[0] - px)) * inverse_area;
+          float w1 = ((c[0] - px) * (a[1] - py) - (c[1] - py) * (a[0] - px)) * inverse_area;
+          float w2 = 1.0f - w0 - w1;
+          if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+          float z = w0 * a[2] + w1 * b[2] + w2 * c[2];
+          float& stored = depth[(size_t)y * width + x];
+          if (z < stored) stored = std::max(z, 0.0f);
+        }
+      }
+    }
+
+    // each texel of a level holds the farthest depth of the texels below it
+    void buildPyramid() {
+      levels.resize(1);
+      level_sizes.resize(1);
+      while (level_sizes.back().first > 1 || level_sizes.back().second > 1) {
+        int source_width = level_sizes.back().first, source_height = level_sizes.back().second;
+        int level_width = std::max(1, (source_width + 1) / 2), level_height = std::max(1, (source_height + 1) / 2);
+        std::vector<float> level((size_t)level_width * level_height);
+        const std::vector<float>& source = levels.back();
+        for (int y = 0; y < level_height; ++y) {
+          for (int x = 0; x < level_width; ++x) {
+            int sx = x * 2, sy = y * 2;
+            int sx1 = std::min(sx + 1, source_width - 1), sy1 = std::min(sy + 1, source_height - 1);
+            level[(size_t)y * level_width + x] = std::max(
+              std::max(source[(size_t)sy * source_width + sx], source[(size_t)sy * source_width + sx1]),
+              std::max(source[(size_t)sy1 * source_width + sx], source[(size_t)sy1 * source_width + sx1]));
+          }
+        }
+        levels.push_back(std::move(level));
+        level_sizes.push_back(std::make_pair(level_width, level_height));
+      }
+      built = true;
+    }
+};
+
+class Culler {
+  public:
+    struct Stats {
+      size_t tested            {0};
+      size_t frustum_visible   {0};
+      size_t visible           {0};
+      double frustum_ms        {0.0};
+      double occlusion_ms      {0.0};
+    };
+
+    bool use_boxes     {true};  // refine the sphere test with the box test
+    bool use_occlusion {true};  // when occluders were added this frame
+    OcclusionBuffer occlusion;
+
+    // Indices of the instances in bounds that may be visible, ascending.
+    const std::vector<uint32_t>& cull(const InstanceBounds& bounds, const float* view_projection) {
+      Frustum frustum = Frustum::fromMatrix(view_projection);
+      visible_indices.resize(bounds.size());
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      size_t count = cullFrustum(bounds, frustum, 0, bounds.size(), visible_indices.data(), use_boxes);
+      std::chrono::steady_clock::time_point frustum_done = std::chrono::steady_clock::now();
+      stats.tested          = bounds.size();
+      stats.frustum_visible = count;
+
+      if (use_occlusion && !occlusion.empty()) {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+          uint32_t index = visible_indices[i];
+          if (occlusion.visible(bounds.center_x[index], bounds.center_y[index], bounds.center_z[index],
+                                bounds.extent_x[index], bounds.extent_y[index], bounds.extent_z[index]))
+            visible_indices[kept++] = index;
+        }
+        count = kept;
+      }
+      visible_indices.resize(count);
+
+      std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+      stats.visible      = count;
+      stats.frustum_ms   = std::chrono::duration<double, std::milli>(frustum_done - start).count();
+      stats.occlusion_ms = std::chrono::duration<double, std::milli>(done - frustum_done).count();
+      return visible_indices;
+    }
+
+    // Frustum test of instances [begin, end), writing the survivors'
+    // indices to out (room for end - begin); returns how many. Ranges are
+    // independent, so this also runs as parallelFor slices.
+    static size_t cullFrustum(const InstanceBounds& bounds, const Frustum& frustum, size_t begin, size_t end,
+                              uint32_t* out, bool use_boxes) {
+      size_t count = 0;
+      size_t i = begin;
+#ifdef CULLING_SSE
+      __m128 plane[6][4];
+      __m128 abs_plane[6][3];
+      const __m128 sign_mask = _mm_set1_ps(-0.0f);
+      for (int p = 0; p < 6; ++p) {
+        for (int c = 0; c < 4; ++c) plane[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+        for (int c = 0; c < 3; ++c) abs_plane[p][c] = _mm_andnot_ps(sign_mask, plane[p][c]);
+      }
+      for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(&bounds.center_x[i]);
+        __m128 y = _mm_loadu_ps(&bounds.center_y[i]);
+        __m128 z = _mm_loadu_ps(&bounds.center_z[i]);
+        __m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 distance[6];
+        for (int p = 0; p < 6; ++p) {
+          distance[p] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[p][0], x), _mm_mul_ps(plane[p][1], y)),
+                                   _mm_add_ps(_mm_mul_ps(plane[p][2], z), plane[p][3]));
+          inside = _mm_and_ps(inside, _mm_cmpge_ps(distance[p], negative_radius));
+        }
+        int mask = _mm_movemask_ps(inside);
+        if (mask && use_boxes) {
+          __m128 ex = _mm_loadu_ps(&bounds.extent_x[i]);
+          __m128 ey = _mm_loadu_ps(&bounds.extent_y[i]);
+          __m128 ez = _mm_loadu_ps(&bounds.extent_z[i]);
+          for (int p = 0; p < 6; ++p) {
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_plane[p][0], ex), _mm_mul_ps(abs_plane[p][1], ey)),
+                                      _mm_mul_ps(abs_plane[p][2], ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance[p], reach), _mm_setzero_ps()));
+          }
+          mask = _mm_movemask_ps(inside);
+        }
+        for (; mask; mask &= mask - 1) {
+          int lane = 0;
+          while (!((mask >> lane) & 1)) ++lane;
+          out[count++] = (uint32_t)(i + lane);
+        }
+      }
+#endif
+      for (; i < end; ++i)
+        if (insideScalar(bounds, frustum, i, use_boxes)) out[count++] = (uint32_t)i;
+      return count;
+    }
+
+    // Copy the visible instances' data (e.g. their mat4s) to out, which may
+    // be a mapped instance buffer; returns the instance count to draw.
+    template <typename Instance>
+    static size_t gather(const std::vector<uint32_t>& visible, const Instance* instances, Instance* out) {
+      for (size_t i = 0; i < visible.size(); ++i) out[i] = instances[visible[i]];
+      return visible.size();
+    }
+
+    const Stats& lastStats() const {
+      return stats;
+    }
+
+    void printStats() const {
+      double ms = stats.frustum_ms + stats.occlusion_ms;
+      std::cout << "INFO::CULLER::" << stats.visible << " of " << stats.tested << " instances visible ("
+                << stats.frustum_visible << " in the frustum) in " << ms << " ms, "
+                << (ms > 0.0 ? stats.tested / ms : 0.0) << " objects/ms" << std::endl;
+    }
+
+  private:
+    std::vector<uint32_t> visible_indices;
+    Stats stats;
+
+    static bool insideScalar(const InstanceBounds& bounds, const Frustum& frustum, size_t i, bool use_boxes) {
+      for (const float* plane : frustum.planes) {
+        float distance = plane[0] * bounds.center_x[i] + plane[1] * bounds.center_y[i] + plane[2] * bounds.center_z[i] + plane[3];
+        if (distance < -bounds.radius[i]) return false;
+        if (use_boxes && distance + std::fabs(plane[0]) * bounds.extent_x[i] + std::fabs(plane[1]) * bounds.extent_y[i] +
+                         std::fabs(plane[2]) * bounds.extent_z[i] < 0.0f)
+          return false;
+      }
+      return true;
+    }
+};
+#endif
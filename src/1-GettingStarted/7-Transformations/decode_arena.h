@@ -0,0 +1,287 @@
+#ifndef DECODE_ARENA_H
+#define DECODE_ARENA_H
+
+// Bump-pointer arena for stb_image's transient decode buffers (JPEG component
+// planes, inflate output, format conversion, the returned image itself).
+//
+// Include this before stb_image.h in the file that defines
+// STB_IMAGE_IMPLEMENTATION; it routes STBI_MALLOC/STBI_REALLOC_SIZED/STBI_FREE
+// through the arena bound to the calling thread, or plain malloc when none is.
+//
+//   DecodeArena arena;
+//   {
+//     DecodeArena::Scope scope(arena);
+//     unsigned char* data = stbi_load(...);
+//     glTexImage2D(..., data);
+//     stbi_image_free(data);
+//   }
+//   arena.reset();  // O(1), keeps its memory for the next batch
+//
+// The arena also rewinds by itself whenever its last live block is freed, so
+// a loop of load/upload/free reuses the same memory for every image. When a
+// batch spilled over into several chunks, the next rewind merges them into
+// one chunk of the batch's high-water size.
+//
+// Everything allocated from an arena is invalid after reset(), including
+// images that were never freed. Free arena pointers on the thread that owns
+// the arena.
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+class DecodeArena {
+  public:
+    struct Stats {
+      size_t allocations        {0};
+      size_t reallocations      {0};
+      size_t in_place_reallocs  {0}; // grown without copying (stb's inflate buffer)
+      size_t frees              {0};
+      size_t chunks             {0};
+      size_t bytes_in_use       {0};
+      size_t peak_bytes         {0};
+      size_t reserved_bytes     {0}; // total size of the arena's chunks
+    };
+
+    // RAII binding of an arena to the current thread
+    class Scope {
+      public:
+        explicit Scope(DecodeArena& arena) : previous(current()) { current() = &arena; }
+        ~Scope() { current() = previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+      private:
+        DecodeArena* previous;
+    };
+
+    explicit DecodeArena(size_t chunk_size = 8 * 1024 * 1024) : chunk_size(chunk_size) {}
+
+    ~DecodeArena() {
+      trim();
+    }
+
+    DecodeArena(const DecodeArena&) = delete;
+    DecodeArena& operator=(const DecodeArena&) = delete;
+
+    // the arena stb allocations on this thread go to (nullptr: malloc)
+    static DecodeArena*& current() {
+      static thread_local DecodeArena* arena = nullptr;
+      return arena;
+    }
+
+    void reset() {
+      live = 0;
+      stats.bytes_in_use = 0;
+      rewind();
+    }
+
+    // hand every chunk back to the system; nothing may still be allocated
+    void trim() {
+      live = 0;
+      stats.bytes_in_use = 0;
+      freeChunks();
+      rewind();
+    }
+
+    void* allocate(size_t size) {
+      size_t need = HEADER_SIZE + align(size);
+      if (!active || active->used + need > active->size) {
+        if (!nextChunk(need)) return nullptr;
+      }
+
+      Header* header = (Header*)(active->data() + active->used);
+      header->size  = size;
+      header->owner = this;
+      active->used += need;
+      last = header;
+      if (retired_bytes + active->used > high_water) high_water = retired_bytes + active->used;
+
+      ++live;
+      ++stats.allocations;
+      addInUse(size);
+      return payloadOf(header);
+    }
+
+    void* reallocate(void* p, size_t new_size) {
+      if (!p) return allocate(new_size);
+
+      Header* header = headerOf(p);
+      ++stats.reallocations;
+
+      // the most recent allocation can grow or shrink in place
+      if (header == last) {
+        size_t old_need = HEADER_SIZE + align(header->size);
+        size_t new_need = HEADER_SIZE + align(new_size);
+        if (active->used - old_need + new_need <= active->size) {
+          active->used = active->used - old_need + new_need;
+          if (retired_bytes + active->used > high_water) high_water = retired_bytes + active->used;
+          stats.bytes_in_use -= header->size;
+          header->size = new_size;
+          addInUse(new_size);
+          ++stats.in_place_reallocs;
+          return p;
+        }
+      }
+
+      void* q = allocate(new_size);
+      if (!q) return nullptr;
+      std::memcpy(q, p, header->size < new_size ? header->size : new_size);
+      release(p);
+      return q;
+    }
+
+    void release(void* p) {
+      if (!p) return;
+      Header* header = headerOf(p);
+      ++stats.frees;
+
+      if (!header->owner) {
+        std::free(header);
+        return;
+      }
+      stats.bytes_in_use -= header->size;
+      if (--live == 0) {
+        rewind();
+      } else if (header == last) {
+        // freeing the most recent allocation hands its space straight back
+        active->used = (size_t)((unsigned char*)header - active->data());
+        last = nullptr;
+      }
+    }
+
+    // allocation entry points for the stb macros below
+    static void* stbMalloc(size_t size) {
+      DecodeArena* arena = current();
+      return arena ? arena->allocate(size) : plainAllocate(size);
+    }
+
+    static void* stbRealloc(void* p, size_t new_size) {
+      if (!p) return stbMalloc(new_size);
+      Header* header = headerOf(p);
+      if (header->owner) return header->owner->reallocate(p, new_size);
+
+      header = (Header*)std::realloc(header, HEADER_SIZE + new_size);
+      if (!header) return nullptr;
+      header->size = new_size;
+      return payloadOf(header);
+    }
+
+    static void stbFree(void* p) {
+      if (!p) return;
+      Header* header = headerOf(p);
+      if (header->owner)
+        header->owner->release(p);
+      else
+        std::free(header);
+    }
+
+    const Stats& getStats() const { return stats; }
+
+    void printStats() const {
+      std::cout << "INFO::DECODE_ARENA::" << stats.allocations << " allocations, "
+                << stats.reallocations << " reallocations (" << stats.in_place_reallocs << " in place), "
+                << stats.frees << " frees, peak " << stats.peak_bytes / 1024 << " KB, "
+                << stats.reserved_bytes / 1024 << " KB reserved in " << stats.chunks << " chunks" << std::endl;
+    }
+
+  private:
+    // every block carries its size and owning arena (nullptr for malloc
+    // blocks) so free/realloc work no matter which arena is bound now
+    struct Header {
+      size_t       size;
+      DecodeArena* owner;
+    };
+    static const size_t ALIGNMENT   = 16;
+    static const size_t HEADER_SIZE = (sizeof(Header) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    struct Chunk {
+      Chunk* next;
+      size_t size;
+      size_t used;
+      unsigned char* data() { return (unsigned char*)this + CHUNK_HEADER_SIZE; }
+    };
+    static const size_t CHUNK_HEADER_SIZE = (sizeof(Chunk) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    size_t chunk_size;
+    Chunk* first  {nullptr};
+    Chunk* active {nullptr};
+    Header* last  {nullptr}; // most recent live allocation in the active chunk
+    size_t live          {0}; // allocations not yet freed
+    size_t retired_bytes {0}; // used bytes of the chunks before active
+    size_t high_water    {0}; // most chunk bytes used at once since the last rewind
+    Stats stats;
+
+    static size_t align(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+    static Header* headerOf(void* p) { return (Header*)((unsigned char*)p - HEADER_SIZE); }
+    static void* payloadOf(Header* header) { return (unsigned char*)header + HEADER_SIZE; }
+
+    void addInUse(size_t size) {
+      stats.bytes_in_use += size;
+      if (stats.bytes_in_use > stats.peak_bytes) stats.peak_bytes = stats.bytes_in_use;
+    }
+
+    // back to the start of the first chunk; several chunks are first merged
+    // into one big enough for the whole of the last cycle
+    void rewind() {
+      if (first && first->next) {
+        freeChunks();
+        nextChunk(high_water);
+      }
+      active = first;
+      if (active) active->used = 0;
+      last = nullptr;
+      retired_bytes = 0;
+      high_water = 0;
+    }
+
+    void freeChunks() {
+      Chunk* chunk = first;
+      while (chunk) {
+        Chunk* next = chunk->next;
+        std::free(chunk);
+        chunk = next;
+      }
+      first = active = nullptr;
+      stats.reserved_bytes = 0;
+      stats.chunks = 0;
+    }
+
+    // move on to the next chunk, reusing those kept from before a rewind, or
+    // insert a new one; a request bigger than chunk_size gets a chunk its size
+    bool nextChunk(size_t need) {
+      Chunk* next = active ? active->next : first;
+      if (!next || next->size < need) {
+        size_t size = need > chunk_size - CHUNK_HEADER_SIZE ? need : chunk_size - CHUNK_HEADER_SIZE;
+        Chunk* chunk = (Chunk*)std::malloc(CHUNK_HEADER_SIZE + size);
+        if (!chunk) return false;
+        chunk->next = next;
+        chunk->size = size;
+        if (active) active->next = chunk; else first = chunk;
+        stats.reserved_bytes += CHUNK_HEADER_SIZE + size;
+        ++stats.chunks;
+        next = chunk;
+      }
+      if (active) retired_bytes += active->used;
+      active = next;
+      active->used = 0;
+      last = nullptr;
+      return true;
+    }
+
+    static void* plainAllocate(size_t size) {
+      Header* header = (Header*)std::malloc(HEADER_SIZE + size);
+      if (!header) return nullptr;
+      header->size  = size;
+      header->owner = nullptr;
+      return payloadOf(header);
+    }
+};
+
+#if !defined(STBI_MALLOC) && !defined(STBI_FREE) && !defined(STBI_REALLOC) && !defined(STBI_REALLOC_SIZED)
+#define STBI_MALLOC(sz)                   DecodeArena::stbMalloc(sz)
+#define STBI_REALLOC_SIZED(p,oldsz,newsz) DecodeArena::stbRealloc(p,newsz)
+#define STBI_FREE(p)                      DecodeArena::stbFree(p)
+#endif
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+// Renders the scene into an offscreen target whose resolution follows the
+// GPU's frame time. It then upscales the result to the window, so a heavy
+// scene costs sharpness instead of frame rate:
+//
+//   DynamicResolution resolution;
+//   resolution.budget_ms = 12.0;
+//   resolution.resize(framebuffer_width, framebuffer_height);  // and on every resize
+//
+//   // every frame
+//   profiler.beginFrame();
+//   double scene_ms; uint64_t scene_frame;
+//   if (profiler.latest("scene", scene_ms, scene_frame))
+//     resolution.update(scene_ms, scene_frame, profiler.frameIndex());
+//   {
+//     GpuProfiler::Scope scope(profiler, "scene");
+//     resolution.beginScene();  // binds the target, viewport at the render size
+//     ... draw ...
+//   }
+//   resolution.present();       // upscale into the window
+//
+// The target is allocated once at max_scale of the window. A lower scale
+// only renders into a smaller corner of it, so scale changes never
+// reallocate. Scales move in steps of scale_step. Over budget, the scale
+// drops at once to where the pixel count should fit (GPU time is taken to
+// grow with pixels, i.e. with the square of the scale). Well under budget,
+// it climbs back one step at a time. Decisions wait for a few times at the
+// current scale and use their moving average, so a single slow frame
+// doesn't cost resolution. GPU times arrive a few frames late (GpuProfiler
+// reads its queries back late), so a measurement of a frame issued before
+// the last change is ignored. Otherwise the controller would keep reacting
+// to a scale it already left, and oscillate.
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+class DynamicResolution {
+  public:
+    double budget_ms      {14.0};      // GPU time of the scene to stay under (60 Hz with some headroom)
+    float  min_scale      {0.5f};      // of the window's width and height
+    float  max_scale      {1.0f};
+    float  scale_step     {0.05f};
+    double upscale_below  {0.75};      // share of the budget under which the scale may grow
+    double smoothing      {0.25};      // weight of the newest time in the moving average
+    int    min_samples    {3};         // times at a scale before it may change
+    GLenum upscale_filter {GL_LINEAR}; // GL_NEAREST for a blocky upscale
+
+    DynamicResolution() = default;
+
+    ~DynamicResolution() {
+      release();
+    }
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    // (Re)allocate the target for a window framebuffer of width x height;
+    // does nothing when the size is unchanged. A minimized window's 0x0
+    // counts as 1x1. False if the framebuffer isn't complete.
+    bool resize(int width, int height) {
+      width  = std::max(width, 1);
+      height = std::max(height, 1);
+      if (width == window_width && height == window_height && framebuffer) return true;
+      window_width  = width;
+      window_height = height;
+      scale = std::min(std::max(scale, min_scale), max_scale);
+      samples = 0;
+      target_width  = std::max((int)std::ceil(window_width * max_scale), 1);
+      target_height = std::max((int)std::ceil(window_height * max_scale), 1);
+
+      if (!framebuffer) {
+        glGenFramebuffers(1, &framebuffer);
+        glGenTextures(1, &color);
+        glGenRenderbuffers(1, &depth_stencil);
+      }
+      glBindTexture(GL_TEXTURE_2D, color);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, target_width, target_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      glBindRenderbuffer(GL_RENDERBUFFER, depth_stencil);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, target_width, target_height);
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_stencil);
+      GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR::DYNAMIC_RESOLUTION::FRAMEBUFFER_INCOMPLETE 0x" << std::hex << status << std::dec << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    // Feed the controller the scene's GPU time of frame measured_frame;
+    // current_frame is the frame about to be issued. Returns true if the
+    // scale changed (it applies from this frame on).
+    bool update(double gpu_ms, uint64_t measured_frame, uint64_t current_frame) {
+      if (measured_frame < changed_at || measured_frame == last_measured) return false;
+      last_measured = measured_frame;
+      last_gpu_ms = gpu_ms;
+      ++measurements;
+      // the average restarts with each scale, whose times it is about
+      average_ms = samples++ ? average_ms + (gpu_ms - average_ms) * smoothing : gpu_ms;
+      if (samples < (uint64_t)std::max(min_samples, 1)) return false;
+
+      float target = scale;
+      if (average_ms > budget_ms) {
+        target = scale * (float)std::sqrt(budget_ms / average_ms);
+        target = std::floor(target / scale_step + 1e-3f) * scale_step;
+        target = std::min(target, scale - scale_step);
+      } else if (average_ms < budget_ms * upscale_below) {
+        target = scale + scale_step;
+      }
+      target = std::min(std::max(target, min_scale), max_scale);
+      if (std::fabs(target - scale) < scale_step * 0.5f) return false;
+
+      if (target < scale) ++downscales;
+      else ++upscales;
+      scale = target;
+      changed_at = current_frame;
+      samples = 0;
+      return true;
+    }
+
+    // Bind the target with the viewport at the render size.
+    void beginScene() {
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+      glViewport(0, 0, renderWidth(), renderHeight());
+      scale_total += scale;
+      ++frames;
+    }
+
+    // Upscale the rendered corner of the target over all of framebuffer
+    // (the window's, by default), which is left bound with its viewport.
+    void present(GLuint target_framebuffer = 0) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_framebuffer);
+      glBlitFramebuffer(0, 0, renderWidth(), renderHeight(), 0, 0, window_width, window_height, GL_COLOR_BUFFER_BIT,
+                        upscale_filter);
+      glBindFramebuffer(GL_FRAMEBUFFER, target_framebuffer);
+      glViewport(0, 0, window_width, window_height);
+    }
+
+    float currentScale() const {
+      return scale;
+    }
+
+    int renderWidth() const {
+      return std::max((int)std::lround(window_width * scale), 1);
+    }
+
+    int renderHeight() const {
+      return std::max((int)std::lround(window_height * scale), 1);
+    }
+
+    // the target's color texture, e.g. for a custom upscale pass instead of present()
+    GLuint colorTexture() const {
+      return color;
+    }
+
+    // the target's framebuffer, e.g. to import into a FrameGraph
+    GLuint sceneFramebuffer() const {
+      return framebuffer;
+    }
+
+    void release() {
+      if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+      if (color) glDeleteTextures(1, &color);
+      if (depth_stencil) glDeleteRenderbuffers(1, &depth_stencil);
+      framebuffer = color = depth_stencil = 0;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::DYNAMIC_RESOLUTION::scale " << scale << " (" << renderWidth() << "x" << renderHeight()
+                << " of " << window_width << "x" << window_height << ")";
+      if (frames) std::cout << ", " << scale_total / frames << " average over " << frames << " frames";
+      std::cout << ", " << downscales << " down and " << upscales << " up in " << measurements
+                << " measurements against a " << budget_ms << " ms budget";
+      if (measurements) std::cout << ", last scene " << last_gpu_ms << " ms";
+      std::cout << std::endl;
+    }
+
+  private:
+    GLuint framebuffer   {0};
+    GLuint color         {0};
+    GLuint depth_stencil {0};
+    int    window_width  {0};
+    int    window_height {0};
+    int    target_width  {0};
+    int    target_height {0};
+    float  scale         {1.0f};
+
+    uint64_t changed_at    {0};          // frame the current scale applies from
+    uint64_t last_measured {UINT64_MAX};
+    double   average_ms    {0.0};        // of the times measured at this scale
+    uint64_t samples       {0};
+
+    // stats
+    double   last_gpu_ms  {0.0};
+    double   scale_total  {0.0};
+    uint64_t frames       {0};
+    uint64_t measurements {0};
+    uint64_t downscales   {0};
+    uint64_t upscales     {0};
+};
+#endif
@@ -0,0 +1,184 @@
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+// The file handling the loaders and caches share:
+//
+//   MappedFile file;               // a whole file mapped read-only
+//   if (file.map("./resources.bundle"))
+//     use(file.data(), file.size());
+//
+//   FileIO::readFront(path, buffer, size);        // the first size bytes, one read
+//   FileIO::writeAtomically(path, [&](std::ofstream& out) { ... });
+//   FileIO::hashBytes(bytes, size);               // 64-bit content hash
+//
+// writeAtomically writes to "<path>.tmp" and renames that over path, so a
+// write cut short (a crash, a full disk) never leaves a torn file behind
+// for a later run to map or read.
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+  public:
+    MappedFile() = default;
+
+    ~MappedFile() {
+      unmap();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map all of path. False if it can't be opened (found, if given, says
+    // whether it could), is empty or can't be mapped; the previous mapping
+    // is dropped either way.
+    bool map(const char* path, bool* found = nullptr) {
+      unmap();
+      if (found) *found = false;
+#ifdef _WIN32
+      HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (file == INVALID_HANDLE_VALUE) return false;
+      if (found) *found = true;
+      LARGE_INTEGER file_size;
+      if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        view_size = (size_t)file_size.QuadPart;
+      }
+      CloseHandle(file);
+#else
+      int fd = ::open(path, O_RDONLY);
+      if (fd < 0) return false;
+      if (found) *found = true;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) view = nullptr;
+        view_size = (size_t)st.st_size;
+      }
+      ::close(fd);
+#endif
+      if (!view) {
+        unmap();
+        return false;
+      }
+      return true;
+    }
+
+    void unmap() {
+#ifdef _WIN32
+      if (view) UnmapViewOfFile(view);
+      if (mapping) CloseHandle(mapping);
+      mapping = NULL;
+#else
+      if (view) munmap(view, view_size);
+#endif
+      view = nullptr;
+      view_size = 0;
+    }
+
+    void swap(MappedFile& other) {
+#ifdef _WIN32
+      std::swap(mapping, other.mapping);
+#endif
+      std::swap(view, other.view);
+      std::swap(view_size, other.view_size);
+    }
+
+    const unsigned char* data() const { return (const unsigned char*)view; }
+    size_t size() const { return view_size; }
+    bool isMapped() const { return view != nullptr; }
+
+  private:
+#ifdef _WIN32
+    HANDLE mapping {NULL};
+#endif
+    void*  view      {nullptr};
+    size_t view_size {0};
+};
+
+class FileIO {
+  public:
+    // Read up to size bytes from the front of path with a single read;
+    // returns how many were read (0 if it couldn't be opened).
+    static size_t readFront(const char* path, void* buffer, size_t size) {
+#ifdef _WIN32
+      HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (file == INVALID_HANDLE_VALUE) return 0;
+      DWORD read = 0;
+      if (!ReadFile(file, buffer, (DWORD)size, &read, NULL)) read = 0;
+      CloseHandle(file);
+      return (size_t)read;
+#else
+      int fd = ::open(path, O_RDONLY);
+      if (fd < 0) return 0;
+      ssize_t read = pread(fd, buffer, size, 0);
+      ::close(fd);
+      return read > 0 ? (size_t)read : 0;
+#endif
+    }
+
+    // Call write with a stream on "<path>.tmp", then rename that over path.
+    // False (leaving path as it was) if any write or the rename failed.
+    template <typename WriteFn>
+    static bool writeAtomically(const std::string& path, WriteFn write) {
+      std::string temp_path = path + ".tmp";
+      std::error_code error;
+      {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (file) write(file);
+        if (!file) {
+          file.close();
+          std::filesystem::remove(temp_path, error);
+          return false;
+        }
+      }
+      std::filesystem::rename(temp_path, path, error);
+      if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+      }
+      return true;
+    }
+
+    // 64-bit hash of a byte range, 8 bytes a step. Content hashes (asset
+    // bundle entries, image cache keys) all come from this one.
+    static uint64_t hashBytes(const unsigned char* bytes, size_t size) {
+      uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+      size_t i = 0;
+      for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = (hash ^ mix(word)) * 0xFF51AFD7ED558CCDull;
+      }
+      uint64_t tail = 0;
+      if (size > i) std::memcpy(&tail, bytes + i, size - i);
+      return mix(hash ^ mix(tail));
+    }
+
+  private:
+    static uint64_t mix(uint64_t x) {
+      x ^= x >> 33;
+      x *= 0xC4CEB9FE1A85EC53ull;
+      x ^= x >> 29;
+      return x;
+    }
+};
+#endif
@@ -0,0 +1,564 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+// The passes of a frame, declared with what they read and write. The
+// graph orders them, drops the ones nothing needs, puts memory barriers
+// between them and runs them, with their render targets taken from a
+// RenderTargetPool:
+//
+//   FrameGraph graph(pool, (GLADloadproc)glfwGetProcAddress);
+//   // every frame
+//   graph.reset();
+//   FrameGraph::Resource color  = graph.create("color", RenderTargetDesc(w, h, GL_RGBA16F));
+//   FrameGraph::Resource depth  = graph.create("depth", RenderTargetDesc(w, h, GL_DEPTH24_STENCIL8));
+//   FrameGraph::Resource window = graph.importFramebuffer("window", 0, w, h);
+//   graph.addPass("scene", {}, {color, depth}, [&](FrameGraph&) { ... draw ... });
+//   graph.addPass("tonemap", {color}, {window}, [&](FrameGraph& g) {
+//     glBindTexture(GL_TEXTURE_2D, g.texture(color));
+//     ... full-screen draw ...
+//   });
+//   if (graph.compile()) graph.execute();
+//
+// Ordering: the passes that write a resource run in the order they were
+// added, and the passes that only read it run after all of them. Passes
+// may be added in any order that respects that, and among independent
+// passes the one added first runs first.
+//
+// Culling: a pass runs only if it writes an imported resource (the window,
+// a buffer used after the frame), was kept with keepPass(), or writes
+// something a running pass uses. Targets only culled passes touch are
+// never allocated.
+//
+// Outputs: before a pass runs, the framebuffer of its attachment writes is
+// bound with the viewport at their size. A pass writes either transient
+// targets (any number of colors, at most one depth) or one imported
+// framebuffer as attachments, plus any number of resources through image
+// or buffer stores. A pass with no attachment writes (e.g. compute) runs
+// with whatever framebuffer the previous one left bound.
+//
+// Barriers: attachment writes are visible to later passes without help,
+// but image and shader storage stores aren't. A resource written with
+// IMAGE or STORAGE gets a glMemoryBarrier before the next pass that uses
+// it, with the bit for how that pass uses it. Each bit is issued once per
+// store. That needs GL 4.2/4.3 and a loader; a 3.3 context has no stores.
+//
+// Lifetimes: transient targets live from the first pass that uses them
+// to the last one, in execution order. They are acquired from the pool
+// right before the first and released right after the last, so targets
+// whose lifetimes don't overlap can share a texture (see
+// render_target_pool.h). A transient target's contents are undefined
+// when its first pass starts.
+
+#include <glad/glad.h>
+#include "render_target_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GL 4.2/4.3 names glad's 3.3 header doesn't have
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_ELEMENT_ARRAY_BARRIER_BIT
+#define GL_ELEMENT_ARRAY_BARRIER_BIT 0x00000002
+#endif
+#ifndef GL_UNIFORM_BARRIER_BIT
+#define GL_UNIFORM_BARRIER_BIT 0x00000004
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+#ifndef GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_PIXEL_BUFFER_BARRIER_BIT
+#define GL_PIXEL_BUFFER_BARRIER_BIT 0x00000080
+#endif
+#ifndef GL_TEXTURE_UPDATE_BARRIER_BIT
+#define GL_TEXTURE_UPDATE_BARRIER_BIT 0x00000100
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_FRAMEBUFFER_BARRIER_BIT
+#define GL_FRAMEBUFFER_BARRIER_BIT 0x00000400
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+class FrameGraph {
+  public:
+    typedef int Resource; // from create(), importFramebuffer() or importBuffer()
+
+    // How a pass uses a resource. ATTACHMENT is drawing into it when
+    // written and sampling it as a texture when read.
+    enum Usage {
+      ATTACHMENT,
+      IMAGE,    // image load/store
+      STORAGE,  // shader storage buffer
+      INDIRECT, // draw or dispatch indirect commands
+      VERTEX,   // vertex attributes
+      INDEX,    // element indices
+      UNIFORM,  // uniform block
+      COPY      // buffer/texture copies, updates and readbacks
+    };
+
+    struct Access {
+      Resource resource;
+      Usage    usage;
+
+      Access(Resource resource, Usage usage = ATTACHMENT) : resource(resource), usage(usage) {}
+    };
+
+    // Pass a GL loader (e.g. glfwGetProcAddress) on a 4.2+ context for the
+    // graph to issue memory barriers.
+    explicit FrameGraph(RenderTargetPool& pool, GLADloadproc load = nullptr) : pool(pool) {
+      if (load) memoryBarrier = (MemoryBarrierProc)load("glMemoryBarrier");
+    }
+
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    // Forget the previous frame's passes and resources.
+    void reset() {
+      passes.clear();
+      resources.clear();
+      order.clear();
+      compiled = false;
+    }
+
+    // a render target that only lives within the frame
+    Resource create(const char* name, const RenderTargetDesc& desc) {
+      ResourceNode node;
+      node.name = name;
+      node.desc = desc;
+      return add(node);
+    }
+
+    // a framebuffer made elsewhere, e.g. the window's (0)
+    Resource importFramebuffer(const char* name, GLuint framebuffer, int width, int height) {
+      ResourceNode node;
+      node.name = name;
+      node.desc = RenderTargetDesc(width, height, GL_NONE);
+      node.kind = FRAMEBUFFER;
+      node.object = framebuffer;
+      return add(node);
+    }
+
+    // a buffer made elsewhere, for passes that store into it or read it
+    Resource importBuffer(const char* name, GLuint buffer) {
+      ResourceNode node;
+      node.name = name;
+      node.kind = BUFFER;
+      node.object = buffer;
+      return add(node);
+    }
+
+    // Returns the pass's index, for keepPass().
+    int addPass(const char* name, std::initializer_list<Access> reads, std::initializer_list<Access> writes,
+                std::function<void(FrameGraph&)> execute) {
+      Pass pass;
+      pass.name = name;
+      pass.reads.assign(reads.begin(), reads.end());
+      pass.writes.assign(writes.begin(), writes.end());
+      pass.execute = execute;
+      passes.push_back(pass);
+      compiled = false;
+      return (int)passes.size() - 1;
+    }
+
+    // Run pass even if nothing uses what it writes (e.g. it reads back).
+    void keepPass(int pass) {
+      if (pass >= 0 && pass < (int)passes.size()) passes[pass].kept = true;
+    }
+
+    // Check the declarations, then order and cull the passes, and work out
+    // barriers and lifetimes. False, with the reason on std::cerr, if the
+    // frame can't run.
+    bool compile() {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      compiled = validate() && sort();
+      if (compiled) {
+        cull();
+        plan();
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      compile_total += seconds;
+      compile_max = std::max(compile_max, seconds);
+      ++compiles;
+      return compiled;
+    }
+
+    // Run the compiled passes.
+    void execute() {
+      if (!compiled) {
+        std::cerr << "ERROR::FRAME_GRAPH::NOT_COMPILED" << std::endl;
+        return;
+      }
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (int step = 0; step < (int)order.size(); ++step) {
+        Pass& pass = passes[order[step]];
+        for (ResourceNode& resource : resources)
+          if (resource.first == step && resource.kind == TARGET) resource.texture = pool.acquire(resource.desc);
+
+        if (pass.barriers) {
+          if (memoryBarrier) {
+            memoryBarrier(pass.barriers);
+            ++barriers_issued;
+          } else if (!warned_barriers) {
+            std::cerr << "ERROR::FRAME_GRAPH::NO_MEMORY_BARRIER pass " << pass.name
+                      << " needs one; create the graph with a loader on a 4.2+ context" << std::endl;
+            warned_barriers = true;
+          }
+        }
+        bindOutputs(pass);
+        pass.execute(*this);
+
+        for (ResourceNode& resource : resources)
+          if (resource.last == step && resource.kind == TARGET && resource.texture) {
+            pool.release(resource.texture);
+            resource.texture = 0;
+          }
+      }
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      execute_total += seconds;
+      execute_max = std::max(execute_max, seconds);
+      ++executions;
+    }
+
+    // Texture of a transient resource while a pass that uses it runs, or
+    // the object of an imported one.
+    GLuint texture(Resource resource) const {
+      if (resource < 0 || resource >= (int)resources.size()) return 0;
+      const ResourceNode& node = resources[resource];
+      return node.kind == TARGET ? node.texture : node.object;
+    }
+
+    int passCount() const {
+      return (int)passes.size();
+    }
+
+    // passes that will run, in order, after compile()
+    const std::vector<int>& executionOrder() const {
+      return order;
+    }
+
+    const std::string& passName(int pass) const {
+      return passes[pass].name;
+    }
+
+    // glMemoryBarrier bits issued before pass, after compile()
+    GLbitfield passBarriers(int pass) const {
+      return passes[pass].barriers;
+    }
+
+    // average CPU seconds of compile() and execute()
+    double averageCompile() const {
+      return compiles ? compile_total / compiles : 0.0;
+    }
+
+    double averageExecute() const {
+      return executions ? execute_total / executions : 0.0;
+    }
+
+    // the compiled frame's plan, and compile/execute times so far
+    void printStats() const {
+      std::cout << "INFO::FRAME_GRAPH::" << order.size() << " of " << passes.size() << " passes run:";
+      for (int pass : order) {
+        std::cout << " " << passes[pass].name;
+        if (passes[pass].barriers) std::cout << " (barrier 0x" << std::hex << passes[pass].barriers << std::dec << ")";
+      }
+      std::cout << std::endl;
+      bool any_culled = false;
+      for (const Pass& pass : passes)
+        if (!pass.live) {
+          if (!any_culled) std::cout << "INFO::FRAME_GRAPH::culled:";
+          std::cout << " " << pass.name;
+          any_culled = true;
+        }
+      if (any_culled) std::cout << std::endl;
+
+      size_t bytes = 0;
+      for (const ResourceNode& resource : resources) {
+        if (resource.kind != TARGET || resource.first < 0) continue;
+        size_t size = RenderTargetPool::byteSize(resource.desc);
+        bytes += size;
+        std::cout << "INFO::FRAME_GRAPH::  " << resource.name << " " << resource.desc.width << "x" << resource.desc.height
+                  << ", " << size / 1024 << " KiB, passes " << passes[order[resource.first]].name << " to "
+                  << passes[order[resource.last]].name << std::endl;
+      }
+      std::cout << "INFO::FRAME_GRAPH::" << bytes / 1024 << " KiB of transient targets used" << std::endl;
+      if (compiles)
+        std::cout << "INFO::FRAME_GRAPH::compile " << averageCompile() * 1e6 << " us average, " << compile_max * 1e6
+                  << " us worst over " << compiles << " frames" << std::endl;
+      if (executions)
+        std::cout << "INFO::FRAME_GRAPH::execute " << averageExecute() * 1e6 << " us average, " << execute_max * 1e6
+                  << " us worst (CPU, passes included), " << barriers_issued << " barriers issued" << std::endl;
+    }
+
+  private:
+    typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+
+    enum Kind {
+      TARGET,      // transient, from the pool
+      FRAMEBUFFER, // imported
+      BUFFER       // imported
+    };
+
+    struct ResourceNode {
+      std::string      name;
+      RenderTargetDesc desc;
+      Kind             kind    {TARGET};
+      GLuint           object  {0};  // imported
+      GLuint           texture {0};  // transient, while alive
+      std::vector<int> writers;      // passes, in the order they were added
+      int              first   {-1}; // steps of the execution order using it, after compile()
+      int              last    {-1};
+    };
+
+    struct Pass {
+      std::string         name;
+      std::vector<Access> reads;
+      std::vector<Access> writes;
+      std::function<void(FrameGraph&)> execute;
+      bool                kept     {false};
+      bool                live     {false};
+      GLbitfield          barriers {0};
+      std::vector<int>    after;   // passes that must run before this one
+    };
+
+    RenderTargetPool&         pool;
+    MemoryBarrierProc         memoryBarrier {nullptr};
+    std::vector<ResourceNode> resources;
+    std::vector<Pass>         passes;
+    std::vector<int>          order;
+    bool                      compiled {false};
+    bool                      warned_barriers {false};
+
+    // stats
+    double   compile_total   {0.0};
+    double   compile_max     {0.0};
+    double   execute_total   {0.0};
+    double   execute_max     {0.0};
+    uint64_t compiles        {0};
+    uint64_t executions      {0};
+    uint64_t barriers_issued {0};
+
+    Resource add(const ResourceNode& node) {
+      resources.push_back(node);
+      compiled = false;
+      return (Resource)resources.size() - 1;
+    }
+
+    static bool isStore(Usage usage) {
+      return usage == IMAGE || usage == STORAGE;
+    }
+
+    // what a pass using a resource this way must wait for after a store
+    static GLbitfield barrierBit(Usage usage, bool write) {
+      switch (usage) {
+        case ATTACHMENT: return write ? GL_FRAMEBUFFER_BARRIER_BIT : GL_TEXTURE_FETCH_BARRIER_BIT;
+        case IMAGE:      return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        case STORAGE:    return GL_SHADER_STORAGE_BARRIER_BIT;
+        case INDIRECT:   return GL_COMMAND_BARRIER_BIT;
+        case VERTEX:     return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+        case INDEX:      return GL_ELEMENT_ARRAY_BARRIER_BIT;
+        case UNIFORM:    return GL_UNIFORM_BARRIER_BIT;
+        case COPY:       return GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT;
+      }
+      return 0;
+    }
+
+    bool valid(Resource resource, const Pass& pass) const {
+      if (resource >= 0 && resource < (int)resources.size()) return true;
+      std::cerr << "ERROR::FRAME_GRAPH::UNKNOWN_RESOURCE " << resource << " in pass " << pass.name << std::endl;
+      return false;
+    }
+
+    // resource handles, attachment outputs, and every read transient has a writer
+    bool validate() {
+      for (ResourceNode& resource : resources) resource.writers.clear();
+      for (int p = 0; p < (int)passes.size(); ++p) {
+        Pass& pass = passes[p];
+        pass.live = false;
+        pass.barriers = 0;
+        for (const Access& read : pass.reads)
+          if (!valid(read.resource, pass)) return false;
+
+        int attachments = 0, imported = 0, depths = 0;
+        const ResourceNode* first = nullptr;
+        for (const Access& write : pass.writes) {
+          if (!valid(write.resource, pass)) return false;
+          ResourceNode& resource = resources[write.resource];
+          if (resource.writers.empty() || resource.writers.back() != p) resource.writers.push_back(p);
+          if (write.usage != ATTACHMENT) continue;
+          if (resource.kind == BUFFER) {
+            std::cerr << "ERROR::FRAME_GRAPH::BUFFER_AS_ATTACHMENT " << resource.name << " in pass " << pass.name << std::endl;
+            return false;
+          }
+          ++attachments;
+          if (resource.kind == FRAMEBUFFER) ++imported;
+          else if (RenderTargetPool::isDepthFormat(resource.desc.format)) ++depths;
+          if (!first) first = &resource;
+          if (resource.desc.width != first->desc.width || resource.desc.height != first->desc.height) {
+            std::cerr << "ERROR::FRAME_GRAPH::OUTPUT_SIZES_DIFFER in pass " << pass.name << std::endl;
+            return false;
+          }
+        }
+        if ((imported && attachments > 1) || depths > 1) {
+          std::cerr << "ERROR::FRAME_GRAPH::BAD_OUTPUTS pass " << pass.name
+                    << " (one imported framebuffer, or colors and at most one depth)" << std::endl;
+          return false;
+        }
+        if (pass.writes.empty()) {
+          std::cerr << "ERROR::FRAME_GRAPH::NO_OUTPUT pass " << pass.name << std::endl;
+          return false;
+        }
+      }
+      for (const Pass& pass : passes)
+        for (const Access& read : pass.reads) {
+          const ResourceNode& resource = resources[read.resource];
+          if (resource.kind == TARGET && resource.writers.empty()) {
+            std::cerr << "ERROR::FRAME_GRAPH::NEVER_WRITTEN " << resource.name << " read in pass " << pass.name << std::endl;
+            return false;
+          }
+        }
+      return true;
+    }
+
+    static bool writes(const Pass& pass, Resource resource) {
+      for (const Access& write : pass.writes)
+        if (write.resource == resource) return true;
+      return false;
+    }
+
+    // Topological order of all passes, the earliest added first among the
+    // ready ones.
+    bool sort() {
+      for (Pass& pass : passes) pass.after.clear();
+      for (int p = 0; p < (int)passes.size(); ++p) {
+        Pass& pass = passes[p];
+        for (const Access& write : pass.writes) {
+          const std::vector<int>& writers = resources[write.resource].writers;
+          std::vector<int>::const_iterator self = std::find(writers.begin(), writers.end(), p);
+          if (self != writers.begin()) pass.after.push_back(*(self - 1));
+        }
+        for (const Access& read : pass.reads)
+          if (!writes(pass, read.resource))
+            for (int writer : resources[read.resource].writers) pass.after.push_back(writer);
+      }
+
+      order.clear();
+      std::vector<bool> done(passes.size(), false);
+      while (order.size() < passes.size()) {
+        int next = -1;
+        for (int p = 0; p < (int)passes.size() && next < 0; ++p) {
+          if (done[p]) continue;
+          bool ready = true;
+          for (int before : passes[p].after)
+            if (!done[before]) ready = false;
+          if (ready) next = p;
+        }
+        if (next < 0) {
+          std::cerr << "ERROR::FRAME_GRAPH::CYCLE among passes:";
+          for (int p = 0; p < (int)passes.size(); ++p)
+            if (!done[p]) std::cerr << " " << passes[p].name;
+          std::cerr << std::endl;
+          order.clear();
+          return false;
+        }
+        done[next] = true;
+        order.push_back(next);
+      }
+      return true;
+    }
+
+    // Keep the passes that write imported resources or were kept, and,
+    // transitively, the passes they depend on.
+    void cull() {
+      std::vector<int> pending;
+      for (int p = 0; p < (int)passes.size(); ++p) {
+        Pass& pass = passes[p];
+        bool root = pass.kept;
+        for (const Access& write : pass.writes)
+          if (resources[write.resource].kind != TARGET) root = true;
+        if (root) {
+          pass.live = true;
+          pending.push_back(p);
+        }
+      }
+      while (!pending.empty()) {
+        int p = pending.back();
+        pending.pop_back();
+        for (int before : passes[p].after)
+          if (!passes[before].live) {
+            passes[before].live = true;
+            pending.push_back(before);
+          }
+      }
+      std::vector<int> live;
+      for (int pass : order)
+        if (passes[pass].live) live.push_back(pass);
+      order.swap(live);
+    }
+
+    // Barriers and lifetimes along the culled order.
+    void plan() {
+      // per resource: stored into since the last barrier, and the bits issued since
+      std::vector<bool> stored(resources.size(), false);
+      std::vector<GLbitfield> synced(resources.size(), 0);
+      for (ResourceNode& resource : resources) resource.first = resource.last = -1;
+
+      for (int step = 0; step < (int)order.size(); ++step) {
+        Pass& pass = passes[order[step]];
+        for (int w = 0; w < 2; ++w) {
+          const std::vector<Access>& accesses = w ? pass.writes : pass.reads;
+          for (const Access& access : accesses) {
+            ResourceNode& resource = resources[access.resource];
+            if (resource.first < 0) resource.first = step;
+            resource.last = step;
+            if (!stored[access.resource]) continue;
+            GLbitfield bit = barrierBit(access.usage, w == 1);
+            pass.barriers |= bit & ~synced[access.resource];
+          }
+        }
+        // the bits issued here cover every resource stored into so far
+        for (size_t r = 0; r < resources.size(); ++r)
+          if (stored[r]) synced[r] |= pass.barriers;
+        for (const Access& write : pass.writes)
+          if (isStore(write.usage)) {
+            stored[write.resource] = true;
+            synced[write.resource] = 0;
+          }
+      }
+    }
+
+    void bindOutputs(const Pass& pass) {
+      std::vector<GLuint> colors;
+      GLuint depth = 0;
+      const ResourceNode* first = nullptr;
+      for (const Access& write : pass.writes) {
+        if (write.usage != ATTACHMENT) continue;
+        const ResourceNode& resource = resources[write.resource];
+        if (!first) first = &resource;
+        if (resource.kind == FRAMEBUFFER) break;
+        if (RenderTargetPool::isDepthFormat(resource.desc.format)) depth = resource.texture;
+        else colors.push_back(resource.texture);
+      }
+      if (!first) return;
+      if (first->kind == FRAMEBUFFER) glBindFramebuffer(GL_FRAMEBUFFER, first->object);
+      else glBindFramebuffer(GL_FRAMEBUFFER, pool.framebuffer(colors.data(), (int)colors.size(), depth));
+      glViewport(0, 0, first->desc.width, first->desc.height);
+    }
+};
+#endif
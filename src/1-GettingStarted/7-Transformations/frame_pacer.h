@@ -0,0 +1,224 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+// Paces the frame loop to a target rate without burning a core. It also
+// measures frame times, wake-up precision and the CPU the process uses.
+//
+//   FramePacing pacing;
+//   pacing.swap_interval = -1;    // adaptive vsync where supported
+//   pacing.max_fps       = 144.0;
+//
+//   FramePacer pacer;
+//   pacer.begin(pacing);          // with the context current
+//   while (...) {
+//     ... render ...
+//     glfwSwapBuffers(window);
+//     pacer.framePresented();     // records the frame, waits out the cap
+//   }
+//   pacer.printStats();
+//
+// The wait for the next frame sleeps until shortly before it is due and
+// spins the rest. The OS can wake a sleeper late (by up to a timer tick,
+// which is 15.6 ms on a default Windows timer), so the spin margin adapts:
+// a late wake-up widens it at once, and it narrows slowly while wake-ups
+// are on time. Spinning costs CPU, so the margin starts small.
+//
+// Adaptive vsync (swap interval -1, EXT_swap_control_tear) waits for
+// vertical blank like 1 does, except that a frame which missed its
+// blank is shown at once with a tear instead of waiting a whole refresh.
+// Where it isn't supported the pacer falls back to 1.
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// swap_interval 1 is vsync, 0 presents immediately, -1 is adaptive vsync;
+// max_fps > 0 also waits between frames to cap the rate (e.g. with vsync
+// off, or on a driver that ignores it); spin_margin is the starting spin
+// time of that wait, in seconds
+struct FramePacing {
+  int    swap_interval {1};
+  double max_fps       {0.0};
+  double spin_margin   {0.001};
+};
+
+class FramePacer {
+  public:
+    static const int        HISTOGRAM_BUCKETS = 80;     // the last one holds every longer frame
+    static constexpr double BUCKET_SECONDS    = 0.0005; // so the histogram covers 0..40 ms
+    static constexpr double MIN_SPIN_MARGIN   = 0.0002;
+    static constexpr double MAX_SPIN_MARGIN   = 0.02;
+
+    static double now() {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // CPU time used so far by every thread of the process, in seconds
+    static double processCpuSeconds() {
+#if defined(_WIN32)
+      FILETIME creation, exit, kernel, user;
+      if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0.0;
+      uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+      uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+      return (double)(k + u) * 1e-7;
+#else
+      rusage usage;
+      if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+      return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+             (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+    }
+
+    // Context thread: apply the swap interval and start measuring.
+    void begin(const FramePacing& frame_pacing) {
+      pacing = frame_pacing;
+      if (pacing.swap_interval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+          !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+        std::cout << "INFO::FRAME_PACER::NO_ADAPTIVE_VSYNC falling back to vsync" << std::endl;
+        pacing.swap_interval = 1;
+      }
+      glfwSwapInterval(pacing.swap_interval);
+      start();
+    }
+
+    // Start measuring (and pacing, with max_fps) without touching the swap
+    // interval, e.g. when there is no context.
+    void start() {
+      spin_margin  = std::min(std::max(pacing.spin_margin, 0.0), MAX_SPIN_MARGIN);
+      started      = now();
+      started_cpu  = processCpuSeconds();
+      last_present = next_frame = started;
+    }
+
+    void setPacing(const FramePacing& frame_pacing) {
+      pacing = frame_pacing;
+    }
+
+    const FramePacing& framePacing() const {
+      return pacing;
+    }
+
+    // Call right after the swap: records the time since the previous
+    // present and, when max_fps caps the rate, waits until the next frame
+    // is due.
+    void framePresented() {
+      double presented = now();
+      double frame = presented - last_present;
+      last_present = presented;
+      ++histogram[std::min((int)(frame / BUCKET_SECONDS), HISTOGRAM_BUCKETS - 1)];
+      frame_total += frame;
+      frame_max = std::max(frame_max, frame);
+      ++frames;
+
+      if (pacing.max_fps > 0.0) {
+        // a late frame moves the schedule instead of being caught up on
+        next_frame = std::max(next_frame + 1.0 / pacing.max_fps, presented);
+        waitUntil(next_frame);
+      }
+    }
+
+    // Frame time (present to present) at quantile q in [0, 1], to the
+    // histogram's resolution.
+    double percentile(double q) const {
+      if (!frames) return 0.0;
+      uint64_t rank = (uint64_t)(q * (double)(frames - 1)), seen = 0;
+      for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+        seen += histogram[b];
+        if (seen > rank) return std::min((b + 0.5) * BUCKET_SECONDS, frame_max);
+      }
+      return frame_max;
+    }
+
+    uint64_t frameCount() const {
+      return frames;
+    }
+
+    // share of one core the process used since begin()
+    double cpuUse() const {
+      double wall = now() - started;
+      return wall > 0.0 ? (processCpuSeconds() - started_cpu) / wall : 0.0;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::FRAME_PACER::" << frames << " frames, swap interval " << pacing.swap_interval;
+      if (pacing.max_fps > 0.0) std::cout << ", capped at " << pacing.max_fps << " fps";
+      std::cout << ", process CPU " << cpuUse() * 100.0 << "% of a core" << std::endl;
+      if (!frames) return;
+
+      std::cout << "INFO::FRAME_PACER::frame time " << frame_total / frames * 1000.0 << " ms average ("
+                << frames / frame_total << " fps), p50 " << percentile(0.5) * 1000.0 << " ms, p99 "
+                << percentile(0.99) * 1000.0 << " ms, worst " << frame_max * 1000.0 << " ms" << std::endl;
+      if (waits)
+        std::cout << "INFO::FRAME_PACER::" << waits << " waits woke " << late_total / waits * 1e6 << " us late on average, "
+                  << late_max * 1e6 << " us worst; " << spin_total * 1000.0 << " ms spent spinning, margin now "
+                  << spin_margin * 1e6 << " us" << std::endl;
+
+      // buckets holding at least 1% of the frames
+      for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+        if (histogram[b] * 100 < frames) continue;
+        double share = (double)histogram[b] / frames;
+        std::cout << "INFO::FRAME_PACER::  " << b * BUCKET_SECONDS * 1000.0
+                  << (b == HISTOGRAM_BUCKETS - 1 ? "+ ms " : " ms ") << std::string((size_t)(share * 50.0 + 0.5), '#')
+                  << " " << share * 100.0 << "%" << std::endl;
+      }
+    }
+
+  private:
+    FramePacing pacing;
+    double   spin_margin  {0.001};
+    double   started      {0.0};
+    double   started_cpu  {0.0};
+    double   last_present {0.0};
+    double   next_frame   {0.0};
+
+    uint64_t histogram[HISTOGRAM_BUCKETS] {};
+    uint64_t frames      {0};
+    double   frame_total {0.0};
+    double   frame_max   {0.0};
+
+    uint64_t waits       {0};
+    double   late_total  {0.0}; // wake-up past the deadline, after spinning
+    double   late_max    {0.0};
+    double   spin_total  {0.0};
+
+    // sleep until spin_margin before deadline, then spin
+    void waitUntil(double deadline) {
+      double slept_until = now();
+      if (deadline <= slept_until) return;
+      double wake = deadline - spin_margin;
+      if (wake > slept_until) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(wake - slept_until));
+        slept_until = now();
+        double oversleep = slept_until - wake;
+        // widen at once, narrow by 1% a frame
+        spin_margin = std::min(std::max(std::max(oversleep * 1.25, spin_margin * 0.99), MIN_SPIN_MARGIN), MAX_SPIN_MARGIN);
+      }
+      double woke = slept_until;
+      while (woke < deadline) {
+        std::this_thread::yield();
+        woke = now();
+      }
+      spin_total += woke - slept_until;
+      double late = woke - deadline;
+      late_total += late;
+      late_max = std::max(late_max, late);
+      ++waits;
+    }
+};
+#endif
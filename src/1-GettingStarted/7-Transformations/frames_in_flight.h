@@ -0,0 +1,219 @@
+#ifndef FRAMES_IN_FLIGHT_H
+#define FRAMES_IN_FLIGHT_H
+
+// Lets the CPU build frame N+1 while the GPU is still drawing frame N,
+// without either side touching data the other still needs.
+//
+// Per-frame data the CPU writes (uniforms, instance data, streamed
+// vertices) is kept in N copies, one per frame in flight. A fence goes in
+// after each frame's last command. Before the CPU writes copy i again, it
+// waits for the fence of the frame that last used copy i, which is N frames
+// back and usually signaled long before. Updating a buffer the GPU may still
+// be reading would otherwise make the driver stall or copy behind our back;
+// here the only wait is explicit, and it is counted:
+//
+//   FramesInFlight frames_in_flight(2);
+//   DynamicBuffer frame_data;
+//   frame_data.create(GL_UNIFORM_BUFFER, sizeof(FrameData), frames_in_flight.frames());
+//
+//   // every frame
+//   int set = frames_in_flight.beginFrame();   // may wait for the GPU
+//   FrameData* data = (FrameData*)frame_data.map(set);
+//   ... fill data ...
+//   frame_data.unmap();
+//   frame_data.bindRange(0, set);
+//   ... draw ...
+//   frames_in_flight.endFrame();               // fence, before the swap
+//   glfwSwapBuffers(window);
+//
+// The wait also bounds how far the CPU runs ahead of the GPU to N frames,
+// and so how much latency queued frames can add.
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+class FramesInFlight {
+  public:
+    static constexpr int MAX_FRAMES = 3;
+
+    explicit FramesInFlight(int frames = 2) : count(std::min(std::max(frames, 1), MAX_FRAMES)) {}
+
+    ~FramesInFlight() {
+      release();
+    }
+
+    FramesInFlight(const FramesInFlight&) = delete;
+    FramesInFlight& operator=(const FramesInFlight&) = delete;
+
+    int frames() const {
+      return count;
+    }
+
+    // Start a frame: wait until the GPU is done with the frame that last
+    // used this frame's set, and return the set (0..frames()-1) for the
+    // frame's dynamic data.
+    int beginFrame() {
+      current = (int)(frame % (uint64_t)count);
+      GLsync fence = fences[current];
+      last_stall = 0.0;
+      if (fence) {
+        // flush on the first try, so the fence is sure to reach the GPU
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+          std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+          while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(fence, 0, WAIT_TIMEOUT);
+          last_stall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+          stall_total += last_stall;
+          stall_max = std::max(stall_max, last_stall);
+          ++stalled_frames;
+        }
+        if (status == GL_WAIT_FAILED)
+          std::cerr << "ERROR::FRAMES_IN_FLIGHT::WAIT_FAILED" << std::endl;
+        glDeleteSync(fence);
+        fences[current] = 0;
+      }
+      return current;
+    }
+
+    // After the frame's last GL command, before the swap.
+    void endFrame() {
+      if (fences[current]) glDeleteSync(fences[current]);
+      fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      ++frame;
+    }
+
+    // set of the frame between beginFrame() and endFrame()
+    int currentSet() const {
+      return current;
+    }
+
+    // seconds the last beginFrame() waited
+    double lastStall() const {
+      return last_stall;
+    }
+
+    double totalStall() const {
+      return stall_total;
+    }
+
+    // Drop pending fences; call before the context goes away if this
+    // outlives it.
+    void release() {
+      for (int i = 0; i < MAX_FRAMES; ++i) {
+        if (fences[i]) glDeleteSync(fences[i]);
+        fences[i] = 0;
+      }
+    }
+
+    void printStats() const {
+      std::cout << "INFO::FRAMES_IN_FLIGHT::" << count << " frames in flight, " << stalled_frames << " of " << frame
+                << " frames waited for the GPU";
+      if (stalled_frames)
+        std::cout << ", " << stall_total * 1000.0 << " ms in all, " << stall_total / stalled_frames * 1000.0
+                  << " ms average, " << stall_max * 1000.0 << " ms worst";
+      std::cout << std::endl;
+    }
+
+  private:
+    static const GLuint64 WAIT_TIMEOUT = 100000000; // ns per glClientWaitSync before trying again
+
+    int      count;
+    int      current {0};
+    uint64_t frame   {0};
+    GLsync   fences[MAX_FRAMES] {};
+
+    double   last_stall     {0.0};
+    double   stall_total    {0.0};
+    double   stall_max      {0.0};
+    uint64_t stalled_frames {0};
+};
+
+// One buffer holding a copy of some per-frame data for every frame in
+// flight. A copy is only written once FramesInFlight has seen the GPU
+// finish with it, so it is mapped unsynchronized: the driver neither waits
+// nor renames the buffer.
+class DynamicBuffer {
+  public:
+    DynamicBuffer() = default;
+
+    ~DynamicBuffer() {
+      release();
+    }
+
+    DynamicBuffer(const DynamicBuffer&) = delete;
+    DynamicBuffer& operator=(const DynamicBuffer&) = delete;
+
+    // frame_size bytes per copy; copies start on GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    // boundaries so any of them can be bound as a uniform block
+    bool create(GLenum target, size_t frame_size, int frames) {
+      release();
+      GLint alignment = 256;
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      alignment = std::max(alignment, 16);
+      this->target = target;
+      size   = frame_size;
+      stride = (frame_size + (size_t)alignment - 1) / (size_t)alignment * (size_t)alignment;
+      glGenBuffers(1, &buffer);
+      glBindBuffer(target, buffer);
+      glBufferData(target, (GLsizeiptr)(stride * (size_t)frames), NULL, GL_DYNAMIC_DRAW);
+      glBindBuffer(target, 0);
+      if (!buffer) {
+        std::cerr << "ERROR::DYNAMIC_BUFFER::NOT_CREATED" << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    // Map the copy for set (from FramesInFlight::beginFrame) for writing;
+    // everything it held before is discarded. Leaves the buffer bound to
+    // its target until unmap().
+    void* map(int set) {
+      glBindBuffer(target, buffer);
+      void* data = glMapBufferRange(target, offset(set), (GLsizeiptr)size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+      if (!data) {
+        std::cerr << "ERROR::DYNAMIC_BUFFER::MAP_FAILED" << std::endl;
+        glBindBuffer(target, 0);
+      }
+      return data;
+    }
+
+    void unmap() {
+      glUnmapBuffer(target);
+      glBindBuffer(target, 0);
+    }
+
+    // for indexed targets (uniform blocks, transform feedback)
+    void bindRange(GLuint index, int set) const {
+      glBindBufferRange(target, index, buffer, offset(set), (GLsizeiptr)size);
+    }
+
+    GLintptr offset(int set) const {
+      return (GLintptr)(stride * (size_t)set);
+    }
+
+    GLuint id() const {
+      return buffer;
+    }
+
+    size_t frameSize() const {
+      return size;
+    }
+
+    void release() {
+      if (buffer) glDeleteBuffers(1, &buffer);
+      buffer = 0;
+    }
+
+  private:
+    GLenum target {GL_ARRAY_BUFFER};
+    GLuint buffer {0};
+    size_t size   {0};
+    size_t stride {0};
+};
+#endif
@@ -0,0 +1,340 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+// Times named scopes of a frame on both the CPU and the GPU:
+//
+//   GpuProfiler profiler;
+//   while (running) {
+//     profiler.beginFrame();
+//     {
+//       GpuProfiler::Scope scope(profiler, "draw container");
+//       glDrawElements(...);
+//     }
+//     profiler.endFrame();
+//   }
+//   profiler.writeTrace("gpu_trace.json");  // chrome://tracing or ui.perfetto.dev
+//
+// Each scope brackets its GL commands with GL_TIMESTAMP queries, which
+// (unlike GL_TIME_ELAPSED) nest. The queries of a frame are only read back
+// FRAMES_IN_FLIGHT frames later, and only once they are available, so the
+// profiler never waits on the GPU; a frame whose results are still not in
+// by then is dropped instead. Drivers without a timestamp counter get
+// GL_TIME_ELAPSED queries, which can't nest: the innermost open scope has
+// the one running query, its parent's query is suspended until it ends and
+// resumed as a new one, and a scope's time adds up its own queries and its
+// children's. Timer queries are core in 3.3 and llvmpipe implements them,
+// so this also runs in headless CI.
+
+#include <glad/glad.h>
+#include "chrome_trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+class GpuProfiler {
+  public:
+    static const int    FRAMES_IN_FLIGHT  = 4;      // frames between issuing and reading queries
+    static const size_t MAX_TRACE_EVENTS  = 200000; // trace events kept for writeTrace()
+
+    GpuProfiler() {
+      GLint bits = 0;
+      glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+      timestamps = bits > 0;
+      if (timestamps) calibrate();
+    }
+
+    ~GpuProfiler() {
+      release();
+    }
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // RAII scope; name must outlive the profiler (a string literal, usually)
+    class Scope {
+      public:
+        Scope(GpuProfiler& profiler, const char* name) : profiler(profiler) {
+          profiler.beginScope(name);
+        }
+        ~Scope() {
+          profiler.endScope();
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        GpuProfiler& profiler;
+    };
+
+    // Collects the frame issued FRAMES_IN_FLIGHT frames ago and opens a
+    // "frame" scope around everything up to endFrame().
+    void beginFrame() {
+      Frame& frame = frames[frame_index % FRAMES_IN_FLIGHT];
+      if (frame.pending) collect(frame);
+
+      frame.scopes.clear();
+      frame.segments.clear();
+      frame.queries_used = 0;
+      frame.pending      = true;
+      frame.index        = frame_index;
+      open.clear();
+      beginScope("frame");
+    }
+
+    void endFrame() {
+      while (!open.empty()) endScope();
+      ++frame_index;
+    }
+
+    void beginScope(const char* name) {
+      Frame& frame = current();
+      ScopeRecord scope;
+      scope.name   = name;
+      scope.parent = open.empty() ? NO_PARENT : open.back();
+      if (timestamps) {
+        scope.begin_query = nextQuery(frame);
+        glQueryCounter(scope.begin_query, GL_TIMESTAMP);
+      } else {
+        if (!open.empty()) glEndQuery(GL_TIME_ELAPSED); // suspend the parent's
+        beginSegment(frame, frame.scopes.size());
+      }
+      scope.cpu_begin = cpuMicroseconds();
+      open.push_back(frame.scopes.size());
+      frame.scopes.push_back(scope);
+    }
+
+    void endScope() {
+      if (open.empty()) {
+        std::cerr << "ERROR::GPU_PROFILER::END_WITHOUT_BEGIN" << std::endl;
+        return;
+      }
+      Frame& frame = current();
+      ScopeRecord& scope = frame.scopes[open.back()];
+      open.pop_back();
+      scope.cpu_end = cpuMicroseconds();
+      if (timestamps) {
+        scope.end_query = nextQuery(frame);
+        glQueryCounter(scope.end_query, GL_TIMESTAMP);
+      } else {
+        glEndQuery(GL_TIME_ELAPSED);
+        if (!open.empty()) beginSegment(frame, open.back()); // resume the parent's
+      }
+    }
+
+    // Re-measure the offset between the GPU and CPU clocks, which drift apart
+    // over long runs; GPU events in the trace are placed with it.
+    void calibrate() {
+      GLint64 gpu_now = 0;
+      glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+      gpu_to_cpu = cpuMicroseconds() - gpu_now / 1000.0;
+    }
+
+    // GPU milliseconds of a scope in the newest collected frame that had
+    // it, and that frame's index (frameIndex() when it was issued); for
+    // feedback loops, which need to know how old a measurement is.
+    bool latest(const std::string& name, double& gpu_ms, uint64_t& frame) const {
+      std::map<std::string, Totals>::const_iterator it = totals.find(name);
+      if (it == totals.end() || it->second.gpu_count == 0) return false;
+      gpu_ms = it->second.last_gpu_us / 1000.0;
+      frame  = it->second.last_frame;
+      return true;
+    }
+
+    // index of the frame being issued
+    uint64_t frameIndex() const {
+      return frame_index;
+    }
+
+    // Average CPU and GPU milliseconds of a scope over the collected frames.
+    bool average(const std::string& name, double& cpu_ms, double& gpu_ms) const {
+      std::map<std::string, Totals>::const_iterator it = totals.find(name);
+      if (it == totals.end() || it->second.count == 0) return false;
+      cpu_ms = it->second.cpu_us / it->second.count / 1000.0;
+      gpu_ms = it->second.gpu_count ? it->second.gpu_us / it->second.gpu_count / 1000.0 : 0.0;
+      return true;
+    }
+
+    // Chrome trace-event JSON: CPU scopes on thread 1, GPU scopes on thread 2.
+    bool writeTrace(const char* path) const {
+      ChromeTraceWriter file(path);
+      if (!file.isOpen()) {
+        std::cerr << "ERROR::GPU_PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+        return false;
+      }
+      file.threadName(1, "CPU");
+      file.threadName(2, "GPU");
+      for (const TraceEvent& event : trace)
+        file.complete(event.gpu ? 2 : 1, event.name, event.start_us, event.duration_us, (long long)event.frame);
+      if (!file.finish()) {
+        std::cerr << "ERROR::GPU_PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+        return false;
+      }
+      std::cout << "INFO::GPU_PROFILER::" << trace.size() << " trace events written to " << path << std::endl;
+      return true;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::GPU_PROFILER::" << frames_collected << " frames collected, " << frames_dropped
+                << " dropped (" << (timestamps ? "timestamps" : "elapsed time") << ")" << std::endl;
+      for (std::map<std::string, Totals>::const_iterator it = totals.begin(); it != totals.end(); ++it) {
+        double cpu_ms = 0.0, gpu_ms = 0.0;
+        average(it->first, cpu_ms, gpu_ms);
+        std::cout << "INFO::GPU_PROFILER::  " << it->first << ": cpu " << cpu_ms << " ms, gpu "
+                  << (it->second.gpu_count ? std::to_string(gpu_ms) + " ms" : std::string("-")) << std::endl;
+      }
+    }
+
+    // Delete the query objects; call before the context goes away if this outlives it.
+    void release() {
+      for (Frame& frame : frames) {
+        if (!frame.queries.empty())
+          glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+        frame.queries.clear();
+        frame.queries_used = 0;
+        frame.pending      = false;
+      }
+    }
+
+  private:
+    static const size_t NO_PARENT = (size_t)-1;
+
+    struct ScopeRecord {
+      const char* name        {nullptr};
+      size_t      parent      {NO_PARENT}; // index of the enclosing scope
+      GLuint      begin_query {0};         // timestamps only
+      GLuint      end_query   {0};
+      double      cpu_begin   {0.0};
+      double      cpu_end     {0.0};
+    };
+
+    // a GL_TIME_ELAPSED query covering part of a scope
+    struct Segment {
+      size_t scope;
+      GLuint query;
+    };
+
+    // queries are allocated on first use and recycled every FRAMES_IN_FLIGHT frames
+    struct Frame {
+      std::vector<ScopeRecord> scopes;
+      std::vector<Segment>     segments; // without timestamps
+      std::vector<GLuint>      queries;
+      size_t                   queries_used {0};
+      uint64_t                 index        {0};
+      bool                     pending      {false};
+    };
+
+    struct Totals {
+      double   cpu_us      {0.0};
+      double   gpu_us      {0.0};
+      uint64_t count       {0};
+      uint64_t gpu_count   {0};
+      double   last_gpu_us {0.0};
+      uint64_t last_frame  {0};
+    };
+
+    struct TraceEvent {
+      const char* name;
+      double      start_us;
+      double      duration_us;
+      uint64_t    frame;
+      bool        gpu;
+    };
+
+    bool     timestamps       {false};
+    double   gpu_to_cpu       {0.0};   // microseconds to add to a GPU timestamp
+    uint64_t frame_index      {0};
+    uint64_t frames_collected {0};
+    uint64_t frames_dropped   {0};
+    Frame    frames[FRAMES_IN_FLIGHT];
+    std::vector<size_t> open;          // scopes of the current frame not yet ended
+    std::map<std::string, Totals> totals;
+    std::vector<TraceEvent> trace;
+    std::vector<double> elapsed_us;    // per scope of the frame being collected, without timestamps
+
+    Frame& current() {
+      return frames[frame_index % FRAMES_IN_FLIGHT];
+    }
+
+    static double cpuMicroseconds() {
+      return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static GLuint nextQuery(Frame& frame) {
+      if (frame.queries_used == frame.queries.size()) {
+        size_t grow = std::max<size_t>(16, frame.queries.size());
+        frame.queries.resize(frame.queries.size() + grow);
+        glGenQueries((GLsizei)grow, frame.queries.data() + frame.queries_used);
+      }
+      return frame.queries[frame.queries_used++];
+    }
+
+    void beginSegment(Frame& frame, size_t scope) {
+      GLuint query = nextQuery(frame);
+      glBeginQuery(GL_TIME_ELAPSED, query);
+      frame.segments.push_back(Segment {scope, query});
+    }
+
+    // Queries finish in order, so once the last one of the frame is
+    // available all are; if it isn't the frame is dropped, never waited on.
+    void collect(Frame& frame) {
+      frame.pending = false;
+      if (frame.queries_used == 0) return;
+
+      GLuint available = 0;
+      glGetQueryObjectuiv(frame.queries[frame.queries_used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        ++frames_dropped;
+        return;
+      }
+
+      if (!timestamps) {
+        // a scope's own segments, then its children's totals (children come
+        // after their parent, so going backwards they are complete first)
+        elapsed_us.assign(frame.scopes.size(), 0.0);
+        for (const Segment& segment : frame.segments) {
+          GLuint64 elapsed = 0;
+          glGetQueryObjectui64v(segment.query, GL_QUERY_RESULT, &elapsed);
+          elapsed_us[segment.scope] += elapsed / 1000.0;
+        }
+        for (size_t i = frame.scopes.size(); i-- > 0;)
+          if (frame.scopes[i].parent != NO_PARENT) elapsed_us[frame.scopes[i].parent] += elapsed_us[i];
+      }
+
+      for (size_t i = 0; i < frame.scopes.size(); ++i) {
+        const ScopeRecord& scope = frame.scopes[i];
+        Totals& total = totals[scope.name];
+        total.cpu_us += scope.cpu_end - scope.cpu_begin;
+        ++total.count;
+        addEvent(scope.name, scope.cpu_begin, scope.cpu_end - scope.cpu_begin, frame.index, false);
+
+        double gpu_begin = 0.0, gpu_us = 0.0;
+        if (timestamps) {
+          GLuint64 begin = 0, end = 0;
+          glGetQueryObjectui64v(scope.begin_query, GL_QUERY_RESULT, &begin);
+          glGetQueryObjectui64v(scope.end_query, GL_QUERY_RESULT, &end);
+          gpu_begin = begin / 1000.0 + gpu_to_cpu;
+          gpu_us    = end > begin ? (end - begin) / 1000.0 : 0.0;
+        } else {
+          // elapsed queries carry no start time, so line them up with the CPU scope
+          gpu_begin = scope.cpu_begin;
+          gpu_us    = elapsed_us[i];
+        }
+        total.gpu_us += gpu_us;
+        ++total.gpu_count;
+        total.last_gpu_us = gpu_us;
+        total.last_frame  = frame.index;
+        addEvent(scope.name, gpu_begin, gpu_us, frame.index, true);
+      }
+      ++frames_collected;
+    }
+
+    void addEvent(const char* name, double start_us, double duration_us, uint64_t frame, bool gpu) {
+      if (trace.size() < MAX_TRACE_EVENTS)
+        trace.push_back(TraceEvent {name, start_us, duration_us, frame, gpu});
+    }
+};
+#endif
@@ -0,0 +1,351 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+// Persistent cache of decoded images, addressed by the hash of the source
+// file's contents plus the decode options (channels, flip, mips, sRGB, mip
+// filter), so renamed or copied files share entries and edited ones miss.
+//
+// An entry is a small header followed by the raw pixels of every level, each
+// level 64-byte aligned, and is loaded by mapping it: a warm load is a stat
+// of the source, a read of its small ".ref" (size, mtime and content hash,
+// so the source needn't be read and hashed again) and an mmap, and upload()
+// hands the mapped pages straight to glTexImage2D.
+//
+//   ImageCache cache("./.image_cache");
+//   CachedImage image;
+//   if (cache.load("./resources/textures/container.jpg", image))
+//     image.upload();  // into the bound GL_TEXTURE_2D, every level
+//
+// stb's flip setting applies and is part of the key. Needs stb_image.h
+// compiled somewhere with STB_IMAGE_IMPLEMENTATION.
+
+#include <glad/glad.h>
+#include "stb_image.h"
+#include "mip_chain.h"
+#include "file_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// A decoded image with its levels, either mapped from a cache entry or, when
+// the entry could not be written, held in memory.
+class CachedImage {
+  public:
+    int  width       {0};
+    int  height      {0};
+    int  channels    {0};
+    int  level_count {0};
+    bool from_cache  {false}; // mapped from an entry that already existed
+
+    CachedImage() = default;
+
+    ~CachedImage() {
+      unmap();
+    }
+
+    CachedImage(const CachedImage&) = delete;
+    CachedImage& operator=(const CachedImage&) = delete;
+
+    const unsigned char* level(int i) const { return data + levelOffset(i); }
+    int levelWidth(int i) const  { return std::max(1, width >> i); }
+    int levelHeight(int i) const { return std::max(1, height >> i); }
+
+    // glTexImage2D every level into the texture bound to target, straight
+    // from the mapping; a single level leaves the mip chain to the caller
+    void upload(GLenum target = GL_TEXTURE_2D, bool srgb_texture = false) const {
+      if (!data) return;
+      GLenum format;
+      GLint internal_format;
+      MipChain::glFormats(channels, srgb_texture, format, internal_format);
+
+      GLint alignment;
+      glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      for (int i = 0; i < level_count; ++i)
+        glTexImage2D(target, i, internal_format, levelWidth(i), levelHeight(i), 0, format, GL_UNSIGNED_BYTE, level(i));
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+      if (level_count > 1) {
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+      }
+      if (channels <= 2) {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+        glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+      }
+    }
+
+  private:
+    friend class ImageCache;
+
+    static const size_t LEVEL_ALIGNMENT = 64;
+
+    const unsigned char* data {nullptr}; // first level
+    std::vector<unsigned char> owned;    // backing when not mapped
+    MappedFile file;
+
+    size_t levelOffset(int i) const {
+      size_t offset = 0;
+      for (int l = 0; l < i; ++l)
+        offset += alignLevel((size_t)levelWidth(l) * levelHeight(l) * channels);
+      return offset;
+    }
+
+    static size_t alignLevel(size_t size) { return (size + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1); }
+
+    size_t dataSize() const { return levelOffset(level_count); }
+
+    void unmap() {
+      file.unmap();
+      data = nullptr;
+      std::vector<unsigned char>().swap(owned);
+    }
+};
+
+class ImageCache {
+  public:
+    size_t hits   {0};
+    size_t misses {0};
+    double seconds {0.0}; // wall time of every load so far
+
+    explicit ImageCache(const char* cache_dir = "./.image_cache") : cache_dir(cache_dir) {
+      std::error_code error;
+      std::filesystem::create_directories(this->cache_dir, error);
+      if (error)
+        std::cerr << "ERROR::IMAGE_CACHE::DIRECTORY_NOT_CREATED " << cache_dir << " " << error.message() << std::endl;
+    }
+
+    // Load path as desired_channels (0: as in the file), with a full mip
+    // chain built by MipChain when mips is set. A miss decodes, writes the
+    // entry and maps it like a hit would.
+    bool load(const char* path, CachedImage& image, int desired_channels = 0, bool mips = true, bool srgb = true,
+              MipFilter filter = MipFilter::Box) {
+      auto start = std::chrono::steady_clock::now();
+      image.unmap();
+
+      std::error_code error;
+      uintmax_t size = std::filesystem::file_size(path, error);
+      if (error) {
+        std::cerr << "ERROR::IMAGE_CACHE::IMAGE_NOT_FOUND " << path << std::endl;
+        return false;
+      }
+      int64_t time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+      Options options;
+      options.channels = (uint8_t)desired_channels;
+      options.flipped  = (uint8_t)stbi_get_flip_vertically_on_load();
+      options.mips     = mips;
+      // srgb and filter only shape the mip chain; cleared without one, so
+      // every value of them finds the same entry
+      options.srgb     = mips && srgb;
+      options.filter   = mips ? (uint8_t)filter : 0;
+
+      // the source's content hash, from its ref while size and mtime match
+      std::string ref_path = cache_dir + "/" + hex(FileIO::hashBytes((const unsigned char*)path, std::strlen(path))) + ".ref";
+      std::vector<unsigned char> source;
+      uint64_t content_hash;
+      if (!readRef(ref_path, size, time, content_hash)) {
+        if (!readFile(path, source)) return false;
+        content_hash = FileIO::hashBytes(source.data(), source.size());
+        writeRef(ref_path, size, time, content_hash);
+      }
+
+      std::string entry_path = entryPath(content_hash, options);
+      if (map(entry_path, content_hash, options, image)) {
+        image.from_cache = true;
+        ++hits;
+      } else {
+        ++misses;
+        if (source.empty() && !readFile(path, source)) return false;
+        if (!decode(path, source, options, content_hash, entry_path, image)) return false;
+      }
+
+      seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      return true;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::IMAGE_CACHE::" << hits << " hits, " << misses << " misses in " << seconds * 1000.0 << " ms" << std::endl;
+    }
+
+  private:
+    static const uint32_t ENTRY_VERSION = 1;
+    static const size_t   HEADER_SIZE   = 64; // pixels start here, 64-byte aligned
+
+    struct Options {
+      uint8_t channels {0}; // as asked for; 0 keeps the file's
+      uint8_t flipped  {0};
+      uint8_t mips     {1};
+      uint8_t srgb     {1};
+      uint8_t filter   {0};
+    };
+
+    struct EntryHeader {
+      char     magic[4];
+      uint32_t version;
+      uint64_t content_hash;
+      int32_t  width, height, channels, level_count;
+      Options  options;
+      uint8_t  reserved[3];
+      uint64_t data_size;
+    };
+    static_assert(sizeof(EntryHeader) <= HEADER_SIZE, "entry header must fit before the pixels");
+
+    struct RefFile {
+      char     magic[4];
+      uint32_t version;
+      uint64_t source_size;
+      int64_t  source_time;
+      uint64_t content_hash;
+    };
+
+    std::string cache_dir;
+
+    static std::string hex(uint64_t value) {
+      char text[17];
+      std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+      return text;
+    }
+
+    std::string entryPath(uint64_t content_hash, const Options& options) const {
+      char suffix[32];
+      std::snprintf(suffix, sizeof(suffix), "_c%u%s%s%s.img", options.channels, options.flipped ? "_flip" : "",
+                    options.mips ? (options.filter ? "_kaiser" : "_box") : "", options.srgb ? "_srgb" : "");
+      return cache_dir + "/" + hex(content_hash) + suffix;
+    }
+
+    static bool readFile(const char* path, std::vector<unsigned char>& bytes) {
+      std::ifstream file(path, std::ios::binary | std::ios::ate);
+      if (!file) {
+        std::cerr << "ERROR::IMAGE_CACHE::IMAGE_NOT_READ " << path << std::endl;
+        return false;
+      }
+      bytes.resize((size_t)file.tellg());
+      file.seekg(0);
+      if (!file.read((char*)bytes.data(), bytes.size())) {
+        std::cerr << "ERROR::IMAGE_CACHE::IMAGE_NOT_READ " << path << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    static bool readRef(const std::string& ref_path, uintmax_t size, int64_t time, uint64_t& content_hash) {
+      std::ifstream file(ref_path, std::ios::binary);
+      RefFile ref;
+      if (!file || !file.read((char*)&ref, sizeof(ref))) return false;
+      if (std::memcmp(ref.magic, "DREF", 4) != 0 || ref.version != ENTRY_VERSION ||
+          ref.source_size != size || ref.source_time != time)
+        return false;
+      content_hash = ref.content_hash;
+      return true;
+    }
+
+    static void writeRef(const std::string& ref_path, uintmax_t size, int64_t time, uint64_t content_hash) {
+      RefFile ref;
+      std::memcpy(ref.magic, "DREF", 4);
+      ref.version      = ENTRY_VERSION;
+      ref.source_size  = size;
+      ref.source_time  = time;
+      ref.content_hash = content_hash;
+      writeEntry(ref_path, &ref, sizeof(ref), nullptr, 0);
+    }
+
+    // decode the source (already in memory), build its levels and write
+    // them as an entry, then map that
+    bool decode(const char* path, const std::vector<unsigned char>& source, const Options& options, uint64_t content_hash,
+                const std::string& entry_path, CachedImage& image) {
+      int width, height, file_channels;
+      unsigned char* pixels = stbi_load_from_memory(source.data(), (int)source.size(), &width, &height, &file_channels, options.channels);
+      if (!pixels) {
+        std::cerr << "ERROR::IMAGE_CACHE::IMAGE_NOT_LOADED " << path << " " << stbi_failure_reason() << std::endl;
+        return false;
+      }
+
+      image.width       = width;
+      image.height      = height;
+      image.channels    = options.channels ? options.channels : file_channels;
+      image.level_count = options.mips ? MipChain::levelCount(width, height) : 1;
+      image.owned.assign(image.dataSize(), 0);
+      if (options.mips) {
+        MipChain chain;
+        chain.generate(pixels, width, height, image.channels, options.srgb != 0, (MipFilter)options.filter);
+        for (int i = 0; i < image.level_count; ++i)
+          std::memcpy(image.owned.data() + image.levelOffset(i), chain.levels[i].pixels.data(), chain.levels[i].pixels.size());
+      } else {
+        std::memcpy(image.owned.data(), pixels, (size_t)width * height * image.channels);
+      }
+      stbi_image_free(pixels);
+
+      EntryHeader header;
+      std::memset((void*)&header, 0, sizeof(header));
+      std::memcpy(header.magic, "DIMG", 4);
+      header.version      = ENTRY_VERSION;
+      header.content_hash = content_hash;
+      header.width        = image.width;
+      header.height       = image.height;
+      header.channels     = image.channels;
+      header.level_count  = image.level_count;
+      header.options      = options;
+      header.data_size    = image.owned.size();
+      unsigned char padded[HEADER_SIZE] = {};
+      std::memcpy(padded, &header, sizeof(header));
+
+      // serve this load from the mapping too, so its memory is the page
+      // cache's; keep the decoded copy if the entry can't be written
+      if (writeEntry(entry_path, padded, HEADER_SIZE, image.owned.data(), image.owned.size()) &&
+          map(entry_path, content_hash, options, image))
+        return true;
+      image.data = image.owned.data();
+      return true;
+    }
+
+    static bool writeEntry(const std::string& path, const void* head, size_t head_size, const void* body, size_t body_size) {
+      bool written = FileIO::writeAtomically(path, [&](std::ofstream& file) {
+        file.write((const char*)head, head_size);
+        if (body_size) file.write((const char*)body, body_size);
+      });
+      if (!written)
+        std::cerr << "ERROR::IMAGE_CACHE::ENTRY_NOT_WRITTEN " << path << std::endl;
+      return written;
+    }
+
+    // map an entry and check it is the one asked for and whole; image is
+    // only changed when it is
+    static bool map(const std::string& entry_path, uint64_t content_hash, const Options& options, CachedImage& image) {
+      MappedFile file;
+      if (!file.map(entry_path.c_str()) || file.size() < HEADER_SIZE) return false;
+      size_t size = file.size();
+
+      EntryHeader header;
+      std::memcpy(&header, file.data(), sizeof(header));
+      CachedImage shape;
+      shape.width       = header.width;
+      shape.height      = header.height;
+      shape.channels    = header.channels;
+      shape.level_count = header.level_count;
+      bool valid = std::memcmp(header.magic, "DIMG", 4) == 0 && header.version == ENTRY_VERSION &&
+                   header.content_hash == content_hash && std::memcmp(&header.options, &options, sizeof(options)) == 0 &&
+                   header.width > 0 && header.height > 0 && header.channels >= 1 && header.channels <= 4 &&
+                   header.level_count == (options.mips ? MipChain::levelCount(header.width, header.height) : 1) &&
+                   header.data_size == shape.dataSize() && size - HEADER_SIZE >= header.data_size;
+      if (!valid) return false;
+
+      image.unmap();
+      image.file.swap(file);
+      image.width       = header.width;
+      image.height      = header.height;
+      image.channels    = header.channels;
+      image.level_count = header.level_count;
+      image.data        = image.file.data() + HEADER_SIZE;
+      return true;
+    }
+};
+#endif
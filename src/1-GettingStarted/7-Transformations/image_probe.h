@@ -0,0 +1,137 @@
+#ifndef IMAGE_PROBE_H
+#define IMAGE_PROBE_H
+
+// Header-only batch probing of image dimensions/channels for asset indexing.
+// Only the front of each file is read and only its header is parsed (stbi_info
+// picks the parser from the magic bytes); JPEGs whose header runs further are
+// memory-mapped instead of read whole. Files are spread over a pool of worker
+// threads.
+//
+// Needs stb_image.h compiled somewhere with STB_IMAGE_IMPLEMENTATION.
+
+#include "stb_image.h"
+#include "file_io.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// enough for the headers of nearly every PNG/JPEG/etc; a single read of this
+// is several times cheaper per file than mapping it
+#ifndef IMAGE_PROBE_HEAD_BYTES
+#define IMAGE_PROBE_HEAD_BYTES (16 * 1024)
+#endif
+
+struct ImageProbeResult {
+  std::string path;
+  int  width    {0};
+  int  height   {0};
+  int  channels {0};
+  bool ok       {false};
+};
+
+class ImageProbe {
+  public:
+    std::vector<ImageProbeResult> results;
+    double seconds {0.0}; // wall time of the last batch
+
+    // Probe every regular file under dir_path (recursively).
+    // thread_count 0 uses one thread per hardware thread.
+    bool probeDirectory(const char* dir_path, unsigned int thread_count = 0) {
+      std::vector<std::string> paths;
+      std::error_code error;
+
+      std::filesystem::recursive_directory_iterator it(dir_path, error), end;
+      if (error) {
+        std::cerr << "ERROR::IMAGE_PROBE::DIRECTORY_NOT_READ " << dir_path << " " << error.message() << std::endl;
+        return false;
+      }
+      for (; it != end; it.increment(error)) {
+        if (error) break;
+        if (it->is_regular_file(error))
+          paths.push_back(it->path().string());
+      }
+
+      probeFiles(paths, thread_count);
+      return true;
+    }
+
+    void probeFiles(const std::vector<std::string>& paths, unsigned int thread_count = 0) {
+      results.assign(paths.size(), ImageProbeResult());
+      for (size_t i = 0; i < paths.size(); ++i)
+        results[i].path = paths[i];
+
+      if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+      thread_count = (unsigned int)std::min<size_t>(thread_count, std::max<size_t>(1, paths.size()));
+
+      auto start = std::chrono::steady_clock::now();
+
+      // workers pull the next unprobed index until the batch runs out
+      std::atomic<size_t> next {0};
+      auto worker = [this, &next]() {
+        for (size_t i = next++; i < results.size(); i = next++)
+          probeFile(results[i].path, results[i]);
+      };
+
+      std::vector<std::thread> pool;
+      for (unsigned int t = 1; t < thread_count; ++t)
+        pool.emplace_back(worker);
+      worker();
+      for (std::thread& thread : pool)
+        thread.join();
+
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    size_t failedCount() const {
+      return (size_t)std::count_if(results.begin(), results.end(), [](const ImageProbeResult& r) { return !r.ok; });
+    }
+
+    double filesPerSecond() const {
+      return seconds > 0.0 ? results.size() / seconds : 0.0;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::IMAGE_PROBE::" << results.size() << " files (" << failedCount() << " not images) in "
+                << seconds * 1000.0 << " ms, " << filesPerSecond() << " files/sec" << std::endl;
+    }
+
+    // Parse the header of path into result. The first IMAGE_PROBE_HEAD_BYTES
+    // are read directly; only if they start a JPEG whose header runs past
+    // them (e.g. a large EXIF block) is the whole file mapped and parsed
+    // again. Other formats keep their header within the first few hundred
+    // bytes, so anything else that fails there isn't an image.
+    static bool probeFile(const std::string& path, ImageProbeResult& result) {
+      static thread_local stbi_uc head[IMAGE_PROBE_HEAD_BYTES];
+      result.ok = false;
+
+      size_t head_len = FileIO::readFront(path.c_str(), head, sizeof(head));
+      if (head_len > 0)
+        result.ok = parseHeader(head, (long long)head_len, result);
+
+      MappedFile file;
+      if (!result.ok && head_len == sizeof(head) && mayRunPastHead(head) && file.map(path.c_str()))
+        result.ok = parseHeader(file.data(), (long long)file.size(), result);
+      return result.ok;
+    }
+
+  private:
+    // JPEG's SOI marker: its frame header may follow any amount of APPn data
+    static bool mayRunPastHead(const stbi_uc* head) {
+      return head[0] == 0xFF && head[1] == 0xD8;
+    }
+
+    static bool parseHeader(const void* data, long long size, ImageProbeResult& result) {
+      // headers sit at the front, so a >2GB file can be handed over truncated
+      int len = (int)std::min<long long>(size, INT_MAX);
+      return stbi_info_from_memory((const stbi_uc*)data, len, &result.width, &result.height, &result.channels) != 0;
+    }
+};
+#endif
@@ -0,0 +1,497 @@
+#ifndef INDIRECT_RENDERER_H
+#define INDIRECT_RENDERER_H
+
+// Instanced drawing where the GPU decides what gets drawn. Every instance's
+// matrix and bounds live in a buffer uploaded once; each frame the GPU
+// frustum-culls all of them and writes the survivors' matrices and per mesh
+// draw counts itself, so the CPU side of a frame is a handful of GL calls
+// whatever the instance count:
+//
+//   IndirectRenderer renderer((GLADloadproc)glfwGetProcAddress);
+//   renderer.init("./resources/shaders/");
+//   int cube = renderer.addMesh(36, 0, 0);  // index count, first index, base vertex
+//   renderer.setInstances(meshes, models, bounds);
+//
+//   // every frame, with a program using vertex_instanced.vert bound
+//   renderer.cull(view_projection);
+//   renderer.draw(vertex_array);
+//
+// The vertex array supplies the meshes' vertices and GL_UNSIGNED_INT
+// indices; the renderer points attributes 3..6 (the instance mat4) at its
+// own buffer. Matrices are 16 floats, column major (glm::value_ptr of a
+// mat4); bounds are the InstanceBounds of culling.h and take the same test.
+//
+// On GL 4.3 a compute shader (cull_instances.comp) appends visible matrices
+// and bumps DrawElementsIndirectCommand instance counts, and one
+// glMultiDrawElementsIndirect draws every mesh. The examples ask for a 3.3
+// context, which doesn't have those, so there the test runs as transform
+// feedback (cull_instances_tf.vert/.geom) into one range per mesh and a
+// GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query per mesh counts what was
+// kept. Reading a count back right away would stall on the GPU, so that path
+// draws from the previous frame's results: visibility lags one frame
+// behind the camera, which shows as instances popping in a frame late at
+// the edges of the view.
+
+#include <glad/glad.h>
+#include "asset_bundle.h"
+#include "culling.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// GL 4.3 names glad's 3.3 header doesn't have
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+
+class IndirectRenderer {
+  public:
+    static const GLuint MODEL_ATTRIBUTE = 3;  // the instance mat4 takes this location and the next three
+    static const GLuint WORKGROUP_SIZE  = 64; // local_size_x of cull_instances.comp
+
+    bool use_boxes {true}; // refine the sphere test with the box test, as Culler does
+
+    // Pass a GL loader (e.g. glfwGetProcAddress) to cull with compute shaders
+    // when the context is 4.3+; without one, or with allow_compute false,
+    // transform feedback is used.
+    explicit IndirectRenderer(GLADloadproc load = nullptr, bool allow_compute = true) {
+      if (load && allow_compute && hasCompute())
+        compute = loadCompute(load);
+    }
+
+    ~IndirectRenderer() {
+      release();
+    }
+
+    IndirectRenderer(const IndirectRenderer&) = delete;
+    IndirectRenderer& operator=(const IndirectRenderer&) = delete;
+
+    bool isCompute() const {
+      return compute;
+    }
+
+    // Build the culling program from the shaders in shader_directory (with
+    // its trailing slash); false if it doesn't compile.
+    bool init(const std::string& shader_directory) {
+      if (compute) {
+        GLuint shader = compileShader(GL_COMPUTE_SHADER, shader_directory + "cull_instances.comp");
+        cull_program = linkProgram(&shader, 1, nullptr);
+      } else {
+        GLuint shaders[2] = {compileShader(GL_VERTEX_SHADER, shader_directory + "cull_instances_tf.vert"),
+                             compileShader(GL_GEOMETRY_SHADER, shader_directory + "cull_instances_tf.geom")};
+        cull_program = linkProgram(shaders, 2, "visible_model");
+      }
+      if (!cull_program) return false;
+      planes_location     = glGetUniformLocation(cull_program, "planes");
+      use_boxes_location  = glGetUniformLocation(cull_program, "use_boxes");
+      count_location      = glGetUniformLocation(cull_program, "instance_count");
+      return true;
+    }
+
+    // Register a mesh of the vertex array draw() is given; returns its index
+    // for setInstances. first_index counts indices, not bytes.
+    int addMesh(GLuint index_count, GLuint first_index, GLint base_vertex) {
+      Mesh mesh;
+      mesh.index_count = index_count;
+      mesh.first_index = first_index;
+      mesh.base_vertex = base_vertex;
+      meshes.push_back(mesh);
+      return (int)meshes.size() - 1;
+    }
+
+    // Upload count = bounds.size() instances: instance i draws mesh_of[i]
+    // with the matrix at models + 16 * i. Instances are regrouped by mesh on
+    // the way, so every mesh's visible matrices end up in one range.
+    bool setInstances(const uint32_t* mesh_of, const float* models, const InstanceBounds& bounds) {
+      size_t count = bounds.size();
+      for (Mesh& mesh : meshes) mesh.instances = 0;
+      for (size_t i = 0; i < count; ++i) {
+        if (mesh_of[i] >= meshes.size()) {
+          std::cerr << "ERROR::INDIRECT_RENDERER::NO_SUCH_MESH " << mesh_of[i] << " for instance " << i << std::endl;
+          return false;
+        }
+        ++meshes[mesh_of[i]].instances;
+      }
+      GLuint first = 0;
+      for (Mesh& mesh : meshes) {
+        mesh.first_instance = first;
+        first += mesh.instances;
+      }
+
+      // std430 Instance of cull_instances.comp; the same bytes feed the
+      // transform feedback path as vertex attributes
+      std::vector<float> packed(count * INSTANCE_FLOATS);
+      std::vector<GLuint> next(meshes.size());
+      for (size_t m = 0; m < meshes.size(); ++m) next[m] = meshes[m].first_instance;
+      for (size_t i = 0; i < count; ++i) {
+        float* instance = &packed[(size_t)next[mesh_of[i]]++ * INSTANCE_FLOATS];
+        std::memcpy(instance, models + 16 * i, 16 * sizeof(float));
+        instance[16] = bounds.center_x[i]; instance[17] = bounds.center_y[i]; instance[18] = bounds.center_z[i];
+        instance[19] = bounds.radius[i];
+        instance[20] = bounds.extent_x[i]; instance[21] = bounds.extent_y[i]; instance[22] = bounds.extent_z[i];
+        instance[23] = (float)mesh_of[i];
+      }
+
+      if (!instance_buffer) glGenBuffers(1, &instance_buffer);
+      glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+      glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(packed.size() * sizeof(float)), packed.data(), GL_STATIC_DRAW);
+
+      // visible matrices: written by the GPU, read by the draw; transform
+      // feedback alternates between two
+      int sets = compute ? 1 : 2;
+      for (int s = 0; s < sets; ++s) {
+        if (!visible_buffers[s]) glGenBuffers(1, &visible_buffers[s]);
+        glBindBuffer(GL_ARRAY_BUFFER, visible_buffers[s]);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(count * 16 * sizeof(float)), NULL, GL_DYNAMIC_COPY);
+      }
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      if (compute) {
+        // commands start each frame as a copy of these, instance counts at 0
+        std::vector<DrawCommand> commands(meshes.size());
+        for (size_t m = 0; m < meshes.size(); ++m) {
+          commands[m].count          = meshes[m].index_count;
+          commands[m].instance_count = 0;
+          commands[m].first_index    = meshes[m].first_index;
+          commands[m].base_vertex    = meshes[m].base_vertex;
+          commands[m].base_instance  = meshes[m].first_instance;
+        }
+        GLsizeiptr size = (GLsizeiptr)(commands.size() * sizeof(DrawCommand));
+        if (!command_template) glGenBuffers(1, &command_template);
+        if (!command_buffer) glGenBuffers(1, &command_buffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, command_template);
+        glBufferData(GL_COPY_READ_BUFFER, size, commands.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, command_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, commands.data(), GL_DYNAMIC_COPY);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      } else {
+        if (!cull_vertex_array) glGenVertexArrays(1, &cull_vertex_array);
+        glBindVertexArray(cull_vertex_array);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        GLsizei stride = INSTANCE_FLOATS * sizeof(float);
+        for (GLuint a = 0; a < 6; ++a) {
+          glEnableVertexAttribArray(a);
+          glVertexAttribPointer(a, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(uintptr_t)(a * 4 * sizeof(float)));
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        for (int s = 0; s < 2; ++s) {
+          if (!queries[s].empty()) glDeleteQueries((GLsizei)queries[s].size(), queries[s].data());
+          queries[s].assign(meshes.size(), 0);
+          glGenQueries((GLsizei)meshes.size(), queries[s].data());
+        }
+        culled = 0;
+      }
+
+      instance_count = count;
+      prepared_vertex_array = 0;
+      return true;
+    }
+
+    // Cull every instance against view_projection on the GPU. The CPU cost
+    // doesn't depend on the instance count.
+    void cull(const float* view_projection) {
+      if (!cull_program || !instance_count) return;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      Frustum frustum = Frustum::fromMatrix(view_projection);
+      glUseProgram(cull_program);
+      glUniform4fv(planes_location, 6, &frustum.planes[0][0]);
+      glUniform1i(use_boxes_location, use_boxes ? 1 : 0);
+
+      if (compute) {
+        glBindBuffer(GL_COPY_READ_BUFFER, command_template);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, command_buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            (GLsizeiptr)(meshes.size() * sizeof(DrawCommand)));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glUniform1ui(count_location, (GLuint)instance_count);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instance_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, command_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visible_buffers[0]);
+        dispatchCompute((GLuint)((instance_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE), 1, 1);
+        memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+      } else {
+        int set = (int)(culled % 2);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(cull_vertex_array);
+        for (size_t m = 0; m < meshes.size(); ++m) {
+          const Mesh& mesh = meshes[m];
+          if (!mesh.instances) continue;
+          glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, visible_buffers[set],
+                            (GLintptr)mesh.first_instance * 16 * sizeof(float), (GLsizeiptr)mesh.instances * 16 * sizeof(float));
+          glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[set][m]);
+          glBeginTransformFeedback(GL_POINTS);
+          glDrawArrays(GL_POINTS, (GLint)mesh.first_instance, (GLsizei)mesh.instances);
+          glEndTransformFeedback();
+          glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        ++culled;
+      }
+
+      cpu_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Draw what the last cull() kept (with transform feedback, the one
+    // before it) with the program bound by the caller, from vertex_array.
+    void draw(GLuint vertex_array, GLenum mode = GL_TRIANGLES) {
+      if (!instance_count || (!compute && culled == 0)) return;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      glBindVertexArray(vertex_array);
+      if (vertex_array != prepared_vertex_array) {
+        for (GLuint c = 0; c < 4; ++c) {
+          glEnableVertexAttribArray(MODEL_ATTRIBUTE + c);
+          glVertexAttribDivisor(MODEL_ATTRIBUTE + c, 1);
+        }
+        if (compute) pointInstances(visible_buffers[0], 0);
+        prepared_vertex_array = vertex_array;
+      }
+
+      if (compute) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+        multiDrawElementsIndirect(mode, GL_UNSIGNED_INT, NULL, (GLsizei)meshes.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+      } else {
+        int set = (int)((culled >= 2 ? culled - 2 : culled - 1) % 2);
+        for (size_t m = 0; m < meshes.size(); ++m) {
+          const Mesh& mesh = meshes[m];
+          if (!mesh.instances) continue;
+          GLuint visible = queryResult(queries[set][m]);
+          if (!visible) continue;
+          pointInstances(visible_buffers[set], (size_t)mesh.first_instance * 16 * sizeof(float));
+          glDrawElementsInstancedBaseVertex(mode, (GLsizei)mesh.index_count, GL_UNSIGNED_INT,
+                                            (const void*)(uintptr_t)(mesh.first_index * sizeof(GLuint)),
+                                            (GLsizei)visible, mesh.base_vertex);
+        }
+        // the attributes moved with every mesh
+        prepared_vertex_array = 0;
+      }
+      glBindVertexArray(0);
+
+      cpu_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      ++frames;
+    }
+
+    // Instances the last cull() kept. Waits for the GPU to finish culling,
+    // so it is for checks and stats, not for every frame.
+    size_t visibleCount() {
+      size_t visible = 0;
+      if (compute && command_buffer) {
+        std::vector<DrawCommand> commands(meshes.size());
+        glBindBuffer(GL_COPY_READ_BUFFER, command_buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)(commands.size() * sizeof(DrawCommand)), commands.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        for (const DrawCommand& command : commands) visible += command.instance_count;
+      } else if (!compute && culled) {
+        int set = (int)((culled - 1) % 2);
+        for (size_t m = 0; m < meshes.size(); ++m) {
+          if (!meshes[m].instances) continue;
+          GLuint written = 0;
+          glGetQueryObjectuiv(queries[set][m], GL_QUERY_RESULT, &written);
+          visible += written;
+        }
+      }
+      return visible;
+    }
+
+    // Drop every GL object; call before the context goes away if this
+    // outlives it.
+    void release() {
+      if (cull_program) glDeleteProgram(cull_program);
+      if (instance_buffer) glDeleteBuffers(1, &instance_buffer);
+      if (command_buffer) glDeleteBuffers(1, &command_buffer);
+      if (command_template) glDeleteBuffers(1, &command_template);
+      for (int s = 0; s < 2; ++s) {
+        if (visible_buffers[s]) glDeleteBuffers(1, &visible_buffers[s]);
+        if (!queries[s].empty()) glDeleteQueries((GLsizei)queries[s].size(), queries[s].data());
+        visible_buffers[s] = 0;
+        queries[s].clear();
+      }
+      if (cull_vertex_array) glDeleteVertexArrays(1, &cull_vertex_array);
+      cull_program = instance_buffer = command_buffer = command_template = cull_vertex_array = 0;
+      instance_count = 0;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::INDIRECT_RENDERER::" << instance_count << " instances of " << meshes.size() << " meshes, "
+                << (compute ? "compute culling and multi-draw indirect"
+                            : "transform feedback culling (no GL 4.3), drawn a frame late");
+      if (frames)
+        std::cout << ", " << cpu_seconds / frames * 1e6 << " us CPU per frame (cull + draw)";
+      if (stalls)
+        std::cout << ", " << stalls << " draws waited for their counts";
+      std::cout << std::endl;
+    }
+
+  private:
+    typedef void (APIENTRYP DispatchComputeProc)(GLuint groups_x, GLuint groups_y, GLuint groups_z);
+    typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect,
+                                                           GLsizei draw_count, GLsizei stride);
+
+    static const size_t INSTANCE_FLOATS = 24; // mat4, center + radius, extent + mesh
+
+    struct Mesh {
+      GLuint index_count    {0};
+      GLuint first_index    {0};
+      GLint  base_vertex    {0};
+      GLuint first_instance {0}; // of its range in the instance and visible buffers
+      GLuint instances      {0};
+    };
+
+    // layout glMultiDrawElementsIndirect reads
+    struct DrawCommand {
+      GLuint count;
+      GLuint instance_count;
+      GLuint first_index;
+      GLint  base_vertex;
+      GLuint base_instance;
+    };
+
+    bool   compute               {false};
+    GLuint cull_program          {0};
+    GLint  planes_location       {-1};
+    GLint  use_boxes_location    {-1};
+    GLint  count_location        {-1};
+    GLuint instance_buffer       {0};
+    GLuint visible_buffers[2]    {0, 0};
+    GLuint command_buffer        {0};
+    GLuint command_template      {0};
+    GLuint cull_vertex_array     {0};
+    GLuint prepared_vertex_array {0};
+    size_t instance_count        {0};
+    std::vector<Mesh>   meshes;
+    std::vector<GLuint> queries[2]; // transform feedback: primitives written per mesh, per set
+    uint64_t culled {0};            // transform feedback: cull() calls since setInstances
+
+    // stats
+    uint64_t frames      {0};
+    uint64_t stalls      {0};
+    double   cpu_seconds {0.0};
+
+    DispatchComputeProc           dispatchCompute           {nullptr};
+    MemoryBarrierProc             memoryBarrier             {nullptr};
+    MultiDrawElementsIndirectProc multiDrawElementsIndirect {nullptr};
+
+    static bool hasCompute() {
+      GLint major = 0, minor = 0;
+      glGetIntegerv(GL_MAJOR_VERSION, &major);
+      glGetIntegerv(GL_MINOR_VERSION, &minor);
+      return major > 4 || (major == 4 && minor >= 3);
+    }
+
+    bool loadCompute(GLADloadproc load) {
+      dispatchCompute           = (DispatchComputeProc)load("glDispatchCompute");
+      memoryBarrier             = (MemoryBarrierProc)load("glMemoryBarrier");
+      multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+      return dispatchCompute && memoryBarrier && multiDrawElementsIndirect;
+    }
+
+    // instance mat4 attributes of the bound vertex array, at offset bytes
+    // into buffer
+    static void pointInstances(GLuint buffer, size_t offset) {
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      for (GLuint c = 0; c < 4; ++c)
+        glVertexAttribPointer(MODEL_ATTRIBUTE + c, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+                              (const void*)(uintptr_t)(offset + c * 4 * sizeof(float)));
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // a result that isn't in yet (only the very first frames, normally)
+    // is waited for
+    GLuint queryResult(GLuint query) {
+      GLuint available = 0, result = 0;
+      glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) ++stalls;
+      glGetQueryObjectuiv(query, GL_QUERY_RESULT, &result);
+      return result;
+    }
+
+    // a mounted asset bundle is looked in first, as Shader does
+    static bool readSource(const std::string& path, std::string& source) {
+      AssetBundle* bundle = AssetBundle::mounted();
+      if (bundle && bundle->readText(path.c_str(), source)) return true;
+      std::ifstream file(path.c_str(), std::ios_base::in);
+      if (!file) {
+        std::cerr << "ERROR::INDIRECT_RENDERER::FILE_NOT_READ " << path << std::endl;
+        return false;
+      }
+      std::stringstream stream;
+      stream << file.rdbuf();
+      source = stream.str();
+      return true;
+    }
+
+    static GLuint compileShader(GLenum type, const std::string& path) {
+      std::string source;
+      if (!readSource(path, source)) return 0;
+      const char* csource = source.c_str();
+      GLuint shader = glCreateShader(type);
+      glShaderSource(shader, 1, &csource, NULL);
+      glCompileShader(shader);
+      GLint success = 0;
+      glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+      if (!success) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        std::cerr << "ERROR::INDIRECT_RENDERER::SHADER_COMPILATION_ERROR " << path << "\n" << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+      }
+      return shader;
+    }
+
+    // captured: the transform feedback output to record, or null
+    static GLuint linkProgram(const GLuint* shaders, int count, const char* captured) {
+      GLuint program = glCreateProgram();
+      bool compiled = true;
+      for (int i = 0; i < count; ++i) {
+        if (shaders[i]) glAttachShader(program, shaders[i]);
+        else compiled = false;
+      }
+      if (captured) glTransformFeedbackVaryings(program, 1, &captured, GL_INTERLEAVED_ATTRIBS);
+      GLint success = 0;
+      if (compiled) {
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+          char log[1024];
+          glGetProgramInfoLog(program, sizeof(log), NULL, log);
+          std::cerr << "ERROR::INDIRECT_RENDERER::LINKING_ERROR\n" << log << std::endl;
+        }
+      }
+      for (int i = 0; i < count; ++i)
+        if (shaders[i]) glDeleteShader(shaders[i]);
+      if (!success) {
+        glDeleteProgram(program);
+        return 0;
+      }
+      return program;
+    }
+};
+#endif
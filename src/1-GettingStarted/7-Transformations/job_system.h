@@ -0,0 +1,395 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+// Work-stealing job scheduler for per-frame CPU work (animation, culling,
+// command recording, upload preparation):
+//
+//   JobSystem jobs;                                    // one worker per extra core
+//   JobSystem::Job* update = jobs.create([&](JobSystem::Job&) { animate(); });
+//   JobSystem::Job* record = jobs.create([&](JobSystem::Job&) { recordCommands(); });
+//   jobs.addContinuation(update, record);              // record runs after update
+//   jobs.run(update);
+//   jobs.wait(record);                                 // runs jobs itself meanwhile
+//
+//   jobs.parallelFor(objects.size(), 256, [&](size_t begin, size_t end) { ... });
+//
+// Every thread has a Chase-Lev deque: it pushes and pops jobs at the bottom
+// without contention while idle threads steal from the top of a random
+// victim's deque. A job counts itself and its unfinished children; when the
+// count reaches zero its parent is told and its continuations are pushed,
+// so stage graphs need no locks either. Workers that find nothing to do for
+// a while sleep until new work is pushed.
+//
+// Only the thread that created the JobSystem and its workers may create,
+// run or wait on jobs. Jobs come from a per-thread ring of MAX_JOBS; create()
+// takes the next finished one, so a Job* must not be used once the job has
+// finished (wait() on it returning is the last use).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class JobSystem {
+  public:
+    static const int    MAX_JOBS          = 4096; // per thread, a power of two
+    static const int    MAX_CONTINUATIONS = 4;
+    static const size_t PAYLOAD_SIZE      = 64;   // bytes of captured state a job can carry
+
+    struct alignas(64) Job {
+      void (*function)(Job&) {nullptr};
+      Job*                parent  {nullptr};
+      std::atomic<int32_t> unfinished {0};        // itself plus unfinished children
+      int32_t             continuation_count {0};
+      Job*                continuations[MAX_CONTINUATIONS];
+      alignas(16) unsigned char payload[PAYLOAD_SIZE];
+    };
+
+    // workers < 0: one per hardware thread besides the calling one
+    explicit JobSystem(int workers = -1) {
+      if (workers < 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        workers = hardware > 1 ? (int)hardware - 1 : 0;
+      }
+      for (int i = 0; i <= workers; ++i)
+        threads.emplace_back(new ThreadState(i));
+      bindThread(threads[0].get());
+      keep_running.store(true);
+      for (int i = 1; i <= workers; ++i)
+        threads[i]->thread = std::thread(&JobSystem::workerLoop, this, threads[i].get());
+    }
+
+    ~JobSystem() {
+      keep_running.store(false);
+      {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        ++wake_generation;
+      }
+      sleep_condition.notify_all();
+      for (std::unique_ptr<ThreadState>& state : threads)
+        if (state->thread.joinable()) state->thread.join();
+      if (current() && current()->system == this) bindThread(nullptr);
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    int threadCount() const {
+      return (int)threads.size();
+    }
+
+    // A job that calls function(job) when run; function is copied into the
+    // job and must be small and trivially destructible (a lambda capturing
+    // references or pointers). A child keeps parent unfinished until it is.
+    template <typename Function>
+    Job* create(const Function& function, Job* parent = nullptr) {
+      static_assert(sizeof(Function) <= PAYLOAD_SIZE, "job function captures too much; capture a pointer instead");
+      static_assert(std::is_trivially_destructible<Function>::value && std::is_trivially_copyable<Function>::value,
+                    "job function must be trivially copyable and destructible");
+      Job* job = allocate();
+      new (job->payload) Function(function);
+      job->function = [](Job& self) { (*reinterpret_cast<Function*>(self.payload))(self); };
+      job->parent = parent;
+      job->continuation_count = 0;
+      job->unfinished.store(1, std::memory_order_relaxed);
+      if (parent) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+      return job;
+    }
+
+    // continuation is run once job and all its children are done; add them
+    // before running job
+    bool addContinuation(Job* job, Job* continuation) {
+      if (job->continuation_count == MAX_CONTINUATIONS) {
+        std::cerr << "ERROR::JOB_SYSTEM::TOO_MANY_CONTINUATIONS" << std::endl;
+        return false;
+      }
+      job->continuations[job->continuation_count++] = continuation;
+      return true;
+    }
+
+    void run(Job* job) {
+      ThreadState* state = ownState();
+      if (!state->deque.push(job)) {
+        execute(job, state); // deque full: no point queuing, run it now
+        return;
+      }
+      wakeWorker();
+    }
+
+    bool finished(const Job* job) const {
+      return job->unfinished.load(std::memory_order_acquire) == 0;
+    }
+
+    // Run queued (or stolen) jobs until job is finished.
+    void wait(const Job* job) {
+      ThreadState* state = ownState();
+      while (!finished(job)) {
+        if (!executeOne(state)) std::this_thread::yield();
+      }
+    }
+
+    // function(begin, end) over [0, count) in slices of at least batch
+    // items, spread over all threads; returns when every slice is done.
+    template <typename Function>
+    void parallelFor(size_t count, size_t batch, const Function& function) {
+      if (count == 0) return;
+      // keep the number of live jobs well inside the ring
+      batch = std::max(std::max<size_t>(batch, 1), (count + MAX_JOBS / 4 - 1) / (MAX_JOBS / 4));
+      ParallelFor<Function> range = {this, &function, batch, 0, count};
+      Job* root = create(range);
+      run(root);
+      wait(root);
+    }
+
+    struct Stats {
+      uint64_t executed {0};
+      uint64_t stolen   {0};
+    };
+
+    Stats stats() const {
+      Stats total;
+      for (const std::unique_ptr<ThreadState>& state : threads) {
+        total.executed += state->executed.load(std::memory_order_relaxed);
+        total.stolen   += state->stolen.load(std::memory_order_relaxed);
+      }
+      return total;
+    }
+
+    void printStats() const {
+      Stats total = stats();
+      std::cout << "INFO::JOB_SYSTEM::" << threads.size() << " threads, " << total.executed << " jobs run, "
+                << total.stolen << " stolen" << std::endl;
+    }
+
+  private:
+    // Chase-Lev work-stealing deque with a fixed ring (Le, Pop, Cohen and
+    // Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory
+    // Models", 2013)
+    class Deque {
+      public:
+        // owner only
+        bool push(Job* job) {
+          int64_t bottom_index = bottom.load(std::memory_order_relaxed);
+          int64_t top_index    = top.load(std::memory_order_acquire);
+          if (bottom_index - top_index >= MAX_JOBS) return false;
+          jobs[bottom_index & (MAX_JOBS - 1)].store(job, std::memory_order_relaxed);
+          bottom.store(bottom_index + 1, std::memory_order_release);
+          return true;
+        }
+
+        // owner only
+        Job* pop() {
+          int64_t bottom_index = bottom.load(std::memory_order_relaxed) - 1;
+          bottom.store(bottom_index, std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          int64_t top_index = top.load(std::memory_order_relaxed);
+          if (top_index > bottom_index) {
+            bottom.store(bottom_index + 1, std::memory_order_relaxed);
+            return nullptr;
+          }
+          Job* job = jobs[bottom_index & (MAX_JOBS - 1)].load(std::memory_order_relaxed);
+          if (top_index == bottom_index) {
+            // last job: race the thieves for it
+            if (!top.compare_exchange_strong(top_index, top_index + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+              job = nullptr;
+            bottom.store(bottom_index + 1, std::memory_order_relaxed);
+          }
+          return job;
+        }
+
+        // any thread
+        Job* steal() {
+          int64_t top_index = top.load(std::memory_order_acquire);
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          int64_t bottom_index = bottom.load(std::memory_order_acquire);
+          if (top_index >= bottom_index) return nullptr;
+          Job* job = jobs[top_index & (MAX_JOBS - 1)].load(std::memory_order_relaxed);
+          if (!top.compare_exchange_strong(top_index, top_index + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+          return job;
+        }
+
+      private:
+        alignas(64) std::atomic<int64_t> top {0};
+        alignas(64) std::atomic<int64_t> bottom {0};
+        std::atomic<Job*> jobs[MAX_JOBS];
+    };
+
+    struct ThreadState {
+      explicit ThreadState(int index) : index(index), random((uint32_t)index * 2654435761u + 1u) {
+        pool.reset(new Job[MAX_JOBS]);
+      }
+
+      int                   index;
+      JobSystem*            system {nullptr};
+      Deque                 deque;
+      std::unique_ptr<Job[]> pool;
+      uint32_t              next_job {0};
+      uint32_t              random;
+      std::atomic<uint64_t> executed {0};
+      std::atomic<uint64_t> stolen   {0};
+      std::thread           thread;
+    };
+
+    template <typename Function>
+    struct ParallelFor {
+      JobSystem*      system;
+      const Function* function;
+      size_t          batch;
+      size_t          begin;
+      size_t          end;
+
+      // halve the range into child jobs until it is one batch, so idle
+      // threads steal big pieces first
+      void operator()(Job& job) const {
+        if (end - begin <= batch) {
+          (*function)(begin, end);
+          return;
+        }
+        size_t middle = begin + (end - begin) / 2;
+        ParallelFor left = *this, right = *this;
+        left.end = middle;
+        right.begin = middle;
+        system->run(system->create(left, &job));
+        system->run(system->create(right, &job));
+      }
+    };
+
+    std::vector<std::unique_ptr<ThreadState> > threads;
+    std::atomic<bool>       keep_running {false};
+    std::atomic<int>        sleeping {0};
+    std::mutex              sleep_mutex;
+    std::condition_variable sleep_condition;
+    uint64_t                wake_generation {0}; // guarded by sleep_mutex
+
+    static ThreadState*& current() {
+      static thread_local ThreadState* state = nullptr;
+      return state;
+    }
+
+    void bindThread(ThreadState* state) {
+      if (state) state->system = this;
+      current() = state;
+    }
+
+    ThreadState* ownState() const {
+      ThreadState* state = current();
+      if (!state || state->system != this) {
+        std::cerr << "ERROR::JOB_SYSTEM::FOREIGN_THREAD jobs used from a thread that isn't the owner or a worker" << std::endl;
+        std::abort();
+      }
+      return state;
+    }
+
+    // next finished job of the ring, skipping those still queued or running;
+    // when the ring is crowded, run queued jobs to free some up
+    Job* allocate() {
+      ThreadState* state = ownState();
+      for (int tries = 1;; ++tries) {
+        Job* job = &state->pool[state->next_job++ & (MAX_JOBS - 1)];
+        if (finished(job)) return job;
+        if (tries % 8 == 0 && !executeOne(state)) std::this_thread::yield();
+      }
+    }
+
+    void execute(Job* job, ThreadState* state) {
+      job->function(*job);
+      state->executed.fetch_add(1, std::memory_order_relaxed);
+      finish(job);
+    }
+
+    // parent and continuations are read before the count drops, as the job
+    // may be reused the moment it reaches zero
+    void finish(Job* job) {
+      Job* parent = job->parent;
+      int32_t continuation_count = job->continuation_count;
+      Job* continuations[MAX_CONTINUATIONS];
+      std::copy(job->continuations, job->continuations + continuation_count, continuations);
+
+      if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+      for (int32_t i = 0; i < continuation_count; ++i) run(continuations[i]);
+      if (parent) finish(parent);
+    }
+
+    Job* findJob(ThreadState* state) {
+      Job* job = state->deque.pop();
+      if (job) return job;
+      size_t count = threads.size();
+      if (count < 2) return nullptr;
+      // xorshift for the first victim, then everyone else in turn
+      state->random ^= state->random << 13;
+      state->random ^= state->random >> 17;
+      state->random ^= state->random << 5;
+      size_t start = state->random % count;
+      for (size_t i = 0; i < count; ++i) {
+        ThreadState* victim = threads[(start + i) % count].get();
+        if (victim == state) continue;
+        job = victim->deque.steal();
+        if (job) {
+          state->stolen.fetch_add(1, std::memory_order_relaxed);
+          return job;
+        }
+      }
+      return nullptr;
+    }
+
+    bool executeOne(ThreadState* state) {
+      Job* job = findJob(state);
+      if (!job) return false;
+      execute(job, state);
+      return true;
+    }
+
+    // the fence pairs with the one in workerLoop: either the worker sees
+    // the pushed job or this sees the worker asleep
+    void wakeWorker() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleeping.load(std::memory_order_relaxed) == 0) return;
+      {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        ++wake_generation;
+      }
+      sleep_condition.notify_one();
+    }
+
+    void workerLoop(ThreadState* state) {
+      bindThread(state);
+      int idle = 0;
+      while (keep_running.load(std::memory_order_relaxed)) {
+        if (executeOne(state)) {
+          idle = 0;
+          continue;
+        }
+        if (++idle < 64) {
+          std::this_thread::yield();
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        uint64_t generation = wake_generation;
+        sleeping.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        lock.unlock();
+        Job* job = findJob(state);
+        lock.lock();
+        if (!job && keep_running.load(std::memory_order_relaxed))
+          sleep_condition.wait_for(lock, std::chrono::milliseconds(10), [&]() { return wake_generation != generation; });
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
+        lock.unlock();
+        idle = 0;
+        if (job) execute(job, state);
+      }
+      bindThread(nullptr);
+    }
+};
+#endif
@@ -4,7 +4,21 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "shader.h"
+#include "asset_bundle.h"
+#include "decode_arena.h" // must come before stb_image.h to take over its allocations
 #include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION // the headers below include stb_image.h again
+#include "mip_chain.h"
+#include "texture_residency.h"
+#include "gpu_profiler.h"
+#include "cpu_profiler.h"
+#include "render_thread.h"
+#include "command_buffer.h"
+#include "job_system.h"
+#include "frames_in_flight.h"
+#include "dynamic_resolution.h"
+#include "render_target_pool.h"
+#include "frame_graph.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -12,7 +26,7 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 
-void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+int render_main(GLFWwindow *window, RenderThread &render_thread);
 void process_input(GLFWwindow *window);
 
 const unsigned int WINDOW_WIDTH  = 800;
@@ -38,17 +52,65 @@ int main() {
     return -1;
   }
 
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  // the render thread owns the GL context from here on; this thread only
+  // handles events and sends the render thread what it needs of them
+  FramePacing pacing;
+  pacing.swap_interval = -1;  // adaptive vsync where supported, else vsync; 0 to present without waiting
+  pacing.max_fps       = 0.0; // > 0 to cap the frame rate, e.g. when the driver ignores vsync
+
+  RenderThread render_thread;
+  CpuProfiler::setThreadName("events");
+  render_thread.installInputCallbacks(window);
+
+  // the size to start with; after this a snapshot goes out only when input
+  // events arrived, so each one measures the latency of real input
+  InputSnapshot input;
+  glfwGetFramebufferSize(window, &input.framebuffer_width, &input.framebuffer_height);
+  render_thread.pushInput(input);
+  render_thread.start(window, [window](RenderThread &thread) { return render_main(window, thread); }, pacing);
+
+  while (render_thread.running() && !glfwWindowShouldClose(window)) {
+    glfwWaitEventsTimeout(RenderThread::INPUT_INTERVAL);
+    CPU_PROFILE_SCOPE("input"); // opened after the wait, which would dwarf it
+    process_input(window);
+    if (!render_thread.inputPending()) continue;
+
+    glfwGetFramebufferSize(window, &input.framebuffer_width, &input.framebuffer_height);
+    render_thread.pushInput(input);
+  }
+
+  int result = render_thread.stop();
+  render_thread.printStats();
+  CpuProfiler::writeTrace("./cpu_trace.json");
+
+  glfwTerminate();
+  return result;
+}
+
+// Everything that touches GL, on the render thread with the context current.
+int render_main(GLFWwindow *window, RenderThread &render_thread) {
+  CpuProfiler::setThreadName("render");
 
   if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
     std::cerr << "Faild To Initialize GLAD" << std::endl;
     return -1;
   }
 
+  // shaders and textures come out of resources.bundle when there is one
+  // (built with tools/asset_bundler), else from the loose files
+  AssetBundle resource_bundle;
+  if (resource_bundle.open("./resources.bundle", false)) {
+    resource_bundle.mount();
+    resource_bundle.printStats();
+  }
+
   // Build and Compiler Our Shader Program
   // ----------------------------
-  Shader ourShader("./resources/shaders/vertex.vert", "./resources/shaders/fragment.frag");
+  // with ARB_bindless_texture the shader samples through texture handles,
+  // otherwise through one texture array
+  TextureResidency texture_residency((GLADloadproc)glfwGetProcAddress);
+  Shader ourShader("./resources/shaders/vertex.vert", texture_residency.isBindless()
+                   ? "./resources/shaders/fragment_bindless.frag" : "./resources/shaders/fragment.frag");
   // ----------------------------
 
   // vertex data 
@@ -105,108 +167,189 @@ int main() {
   // Load and Create Texture 
   // ----------------------------
 
-  unsigned int texture1, texture2;
-  
-  // texture 1
-  glGenTextures(1, &texture1); 
-  glBindTexture(GL_TEXTURE_2D, texture1); 
-
-  // setting texture "wrapping" parameters
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  // texture 1 and 2 are both kept resident (bindless handles, or layers of
+  // one texture array) and picked by index, so nothing is rebound per frame
 
-  // setting texture "filtering" parameters 
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-  // load image, create texture, generate mipmaps
-  int width, height, nr_channels;
+  // load image (or its cached mip chain)
   stbi_set_flip_vertically_on_load(true);
 
-  unsigned char *data = stbi_load("./resources/textures/container.jpg", &width, &height, &nr_channels, 0);
-  if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
+  // decode both textures out of one reusable arena instead of the global heap
+  DecodeArena texture_arena;
+  DecodeArena::Scope texture_arena_scope(texture_arena);
+
+  MipChain container_mips;
+  int texture1 = -1;
+  if (container_mips.load("./resources/textures/container.jpg")) {
+    texture1 = texture_residency.add(container_mips);
+    container_mips.printStats();
+  }
+  if (texture1 < 0) {
     std::cerr << "Failed To Load Texture" << std::endl;
     return -1;
   }
-  stbi_image_free(data);
-
-  // texture 2
-  glGenTextures(1, &texture2);
-  glBindTexture(GL_TEXTURE_2D, texture2);
-
-  // setting texture "wrapping" parameters
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-  // setting texture "filtering" parameters
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-  // load image, create texture, generate mipmaps
-  data = stbi_load("./resources/textures/awesomeface.png", &width, &height, &nr_channels, 0);
-  if (data) {
-    // note that the awesomeface.png has transparency and thus an alpha channel, so make sure to tell OpenGL the data type is of GL_RGBA
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
+
+  // awesomeface.png has an alpha channel, which the residency keeps as RGBA
+  MipChain face_mips;
+  int texture2 = -1;
+  if (face_mips.load("./resources/textures/awesomeface.png")) {
+    texture2 = texture_residency.add(face_mips);
+    face_mips.printStats();
+  }
+  if (texture2 < 0) {
     std::cerr << "Failed To Load Texture" << std::endl;
     return -1;
   }
-  stbi_image_free(data);
+  texture_arena.printStats();
+
+  texture_residency.build();
+  texture_residency.bind(ourShader.shader_program, 0);
+  texture_residency.printStats();
 
   ourShader.use();  // must activate/use the shader before setting uniforms
-  glUniform1i(glGetUniformLocation(ourShader.shader_program, "texture1"), 0);
-  glUniform1i(glGetUniformLocation(ourShader.shader_program, "texture2"), 1);
+  glUniform1i(glGetUniformLocation(ourShader.shader_program, "texture1"), texture1);
+  glUniform1i(glGetUniformLocation(ourShader.shader_program, "texture2"), texture2);
+
+  // CPU and GPU time per frame and per scope, read back a few frames late;
+  // the CPU_PROFILE_SCOPE stages below stay on in release builds too
+  GpuProfiler profiler;
+
+  // the frame is recorded into a command buffer (which needs no GL, so it
+  // could be filled on any thread) and executed in one go on this one
+  CommandBuffer frame_commands;
+  unsigned int shader_program = ourShader.shader_program;
+
+  // up to two frames queued on the GPU while the CPU builds the next; each
+  // has its own copy of the FrameData block, which the update job writes
+  // straight into mapped buffer memory
+  const GLuint FRAME_DATA_BINDING = 1; // 0 is the texture table's
+  FramesInFlight frames_in_flight(2);
+  DynamicBuffer frame_data;
+  frame_data.create(GL_UNIFORM_BUFFER, sizeof(glm::mat4), frames_in_flight.frames());
+  glUniformBlockBinding(shader_program, glGetUniformBlockIndex(shader_program, "FrameData"), FRAME_DATA_BINDING);
+
+  // the CPU stages of a frame run as jobs on a worker pool
+  JobSystem jobs;
+
+  // the scene renders offscreen at a resolution that follows its GPU time,
+  // measured by the "scene" scope, and is upscaled to the window
+  DynamicResolution dynamic_resolution;
+
+  // the frame's passes, declared anew every frame with what they read and
+  // write; the graph orders them and takes their offscreen targets from
+  // the pool
+  RenderTargetPool render_targets;
+  FrameGraph frame_graph(render_targets, (GLADloadproc)glfwGetProcAddress);
 
   // Render Loop
   // ----------------------------
-  while (!glfwWindowShouldClose(window)) {
-    // process input
-    process_input(window);
+  InputSnapshot input;
+  while (render_thread.running()) {
+    profiler.beginFrame();
+
+    // newest input from the event thread
+    {
+      CPU_PROFILE_SCOPE("input");
+      render_thread.latestInput(input);
+      dynamic_resolution.resize(input.framebuffer_width, input.framebuffer_height);
+    }
+
+    double scene_ms;
+    uint64_t scene_frame;
+    if (profiler.latest("scene", scene_ms, scene_frame))
+      dynamic_resolution.update(scene_ms, scene_frame, profiler.frameIndex());
+
+    // this frame's set of per-frame data, once the GPU is done with the
+    // frame that used it last
+    int frame_set;
+    {
+      CPU_PROFILE_SCOPE("wait_gpu");
+      frame_set = frames_in_flight.beginFrame();
+    }
+    glm::mat4* frame_transform = static_cast<glm::mat4*>(frame_data.map(frame_set));
 
     // render 
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // bind and activate textures 0
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture1); 
-
-    // bind and activate texture 1 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-    
-    glm::mat4 trans = glm::mat4(1.0f);
-    trans = glm::rotate(trans, static_cast<float>(glfwGetTime()), glm::vec3(0.0f, 0.0f, 1.0f));
-    trans = glm::scale(trans, glm::vec3(0.5f, 0.5f, 0.5f));
-
-    unsigned int transfomrLoc = glGetUniformLocation(ourShader.shader_program, "transform");
-    glUniformMatrix4fv(transfomrLoc, 1, GL_FALSE, glm::value_ptr(trans));
-
-    // render container
-    ourShader.use();
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    // update -> record as a task graph; this thread helps run it and then
+    // executes what was recorded
+    JobSystem::Job* update = jobs.create([frame_transform](JobSystem::Job&) {
+      CPU_PROFILE_SCOPE("update");
+      glm::mat4 trans = glm::mat4(1.0f);
+      trans = glm::rotate(trans, static_cast<float>(glfwGetTime()), glm::vec3(0.0f, 0.0f, 1.0f));
+      trans = glm::scale(trans, glm::vec3(0.5f, 0.5f, 0.5f));
+      if (frame_transform) *frame_transform = trans;
+    });
+
+    JobSystem::Job* record = jobs.create([&](JobSystem::Job&) {
+      CPU_PROFILE_SCOPE("record");
+      frame_commands.reset();
+      frame_commands.clear(GL_COLOR_BUFFER_BIT, 0.2f, 0.3f, 0.3f, 1.0f);
+
+      // render container
+      frame_commands.useProgram(shader_program);
+      frame_commands.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frame_data.id(),
+                                     (size_t)frame_data.offset(frame_set), frame_data.frameSize());
+      frame_commands.bindVertexArray(VAO);
+      frame_commands.drawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    });
+
+    jobs.addContinuation(update, record);
+    jobs.run(update);
+    jobs.wait(record);
+    if (frame_transform) frame_data.unmap();
+
+    {
+      CPU_PROFILE_SCOPE("submit");
+      render_targets.beginFrame();
+      frame_graph.reset();
+      FrameGraph::Resource scene = frame_graph.importFramebuffer(
+        "scene", dynamic_resolution.sceneFramebuffer(), dynamic_resolution.renderWidth(), dynamic_resolution.renderHeight());
+      FrameGraph::Resource window =
+        frame_graph.importFramebuffer("window", 0, input.framebuffer_width, input.framebuffer_height);
+
+      frame_graph.addPass("scene", {}, {scene}, [&](FrameGraph&) {
+        GpuProfiler::Scope scope(profiler, "scene");
+        dynamic_resolution.beginScene();
+        CommandBuffer::execute(frame_commands);
+      });
+      frame_graph.addPass("upscale", {scene}, {window}, [&](FrameGraph&) {
+        GpuProfiler::Scope scope(profiler, "upscale");
+        dynamic_resolution.present();
+      });
+      if (frame_graph.compile()) frame_graph.execute();
+    }
+    frames_in_flight.endFrame();
+
+    {
+      CPU_PROFILE_SCOPE("swap");
+      GpuProfiler::Scope scope(profiler, "swap");
+      glfwSwapBuffers(window);
+    }
+    render_thread.framePresented();
+    profiler.endFrame();
   }
   // ----------------------------
 
+  profiler.printStats();
+  profiler.writeTrace("./gpu_trace.json");
+  jobs.printStats();
+  frames_in_flight.printStats();
+  dynamic_resolution.printStats();
+  frame_graph.printStats();
+
   // De-allocating Resources
   // ----------------------------
 
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
   glDeleteBuffers(1, &EBO);
+  texture_residency.release();
+  profiler.release();
+  frame_data.release();
+  frames_in_flight.release();
+  dynamic_resolution.release();
+  render_targets.release();
   
   // ----------------------------
 
-
-  glfwTerminate();
   return 0;
 }
 
@@ -214,7 +357,3 @@ void process_input(GLFWwindow *window) {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     glfwSetWindowShouldClose(window, true);
 }
-
-void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-  glViewport(0, 0, width, height);
-}
@@ -0,0 +1,535 @@
+#ifndef MIP_CHAIN_H
+#define MIP_CHAIN_H
+
+// Mipmap chains built on the CPU, to upload instead of calling
+// glGenerateMipmap (whose filter is up to the driver and works on the
+// sRGB-encoded values as if they were linear).
+//
+// Colour is filtered in linear light: sRGB channels are decoded first and
+// encoded again afterwards, alpha is always linear, and colour is weighted
+// by alpha so transparent texels don't bleed into their neighbours. Box is
+// the 2x2 average (an exact area average for odd sizes); Kaiser is a
+// windowed sinc that keeps the smaller levels sharper. Each level is
+// filtered from the float copy of the one above it, with its rows split
+// over worker threads.
+//
+// load() keeps the chain in "<image>.mips" next to the image, so later runs
+// read every level back instead of decoding and filtering again:
+//
+//   MipChain mips;
+//   if (mips.load("./resources/textures/container.jpg"))
+//     mips.upload();  // into the bound GL_TEXTURE_2D
+//
+// Needs stb_image.h compiled somewhere with STB_IMAGE_IMPLEMENTATION.
+
+#include <glad/glad.h>
+#include "stb_image.h"
+#include "asset_bundle.h"
+#include "file_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_CHAIN_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MIP_CHAIN_NEON
+#include <arm_neon.h>
+#endif
+
+enum class MipFilter { Box, Kaiser };
+
+struct MipLevel {
+  int width  {0};
+  int height {0};
+  std::vector<unsigned char> pixels; // tightly packed rows, MipChain::channels per pixel
+};
+
+class MipChain {
+  public:
+    std::vector<MipLevel> levels;
+    int       channels   {0};
+    bool      srgb       {true};
+    MipFilter filter     {MipFilter::Box};
+    bool      from_cache {false};
+    double    seconds    {0.0}; // wall time of the last load/generate
+
+    // Decode path (from the mounted bundle if it has it; stb's flip setting
+    // applies) and build its chain, or read the cached chain if it was built
+    // from this version of the file with the same settings. thread_count 0 uses one per hardware thread.
+    bool load(const char* path, bool srgb = true, MipFilter filter = MipFilter::Box, unsigned int thread_count = 0) {
+      auto start = std::chrono::steady_clock::now();
+      std::string cache_path = std::string(path) + ".mips";
+
+      CacheHeader key;
+      if (!cacheKey(path, srgb, filter, key)) {
+        std::cerr << "ERROR::MIP_CHAIN::IMAGE_NOT_FOUND " << path << std::endl;
+        return false;
+      }
+
+      from_cache = readCache(cache_path, key);
+      if (!from_cache) {
+        int width, height, file_channels;
+        AssetData bundled;
+        unsigned char* data = AssetBundle::readMounted(path, bundled)
+          ? stbi_load_from_memory(bundled.data, (int)bundled.size, &width, &height, &file_channels, 0)
+          : stbi_load(path, &width, &height, &file_channels, 0);
+        if (!data) {
+          std::cerr << "ERROR::MIP_CHAIN::IMAGE_NOT_LOADED " << path << " " << stbi_failure_reason() << std::endl;
+          return false;
+        }
+        bool ok = generate(data, width, height, file_channels, srgb, filter, thread_count);
+        stbi_image_free(data);
+        if (!ok) return false;
+        writeCache(cache_path, key);
+      }
+
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      return true;
+    }
+
+    // Build the whole chain from a tightly packed level 0 of 1-4 channels
+    // (grey, grey+alpha, RGB, RGBA), down to 1x1.
+    bool generate(const unsigned char* pixels, int width, int height, int channels, bool srgb = true,
+                  MipFilter filter = MipFilter::Box, unsigned int thread_count = 0) {
+      if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+        std::cerr << "ERROR::MIP_CHAIN::INVALID_IMAGE" << std::endl;
+        return false;
+      }
+      auto start = std::chrono::steady_clock::now();
+      this->channels = channels;
+      this->srgb     = srgb;
+      this->filter   = filter;
+      threads = thread_count ? thread_count : std::max(1u, std::thread::hardware_concurrency());
+
+      levels.assign(levelCount(width, height), MipLevel());
+      levels[0].width  = width;
+      levels[0].height = height;
+      levels[0].pixels.assign(pixels, pixels + (size_t)width * height * channels);
+
+      // every level is filtered from the float (linear, premultiplied) copy
+      // of the one above, never from its 8-bit rounding
+      std::vector<float> current, across, next;
+      toLinear(levels[0], current);
+
+      for (size_t i = 1; i < levels.size(); ++i) {
+        const MipLevel& above = levels[i - 1];
+        MipLevel& level = levels[i];
+        level.width  = std::max(1, above.width / 2);
+        level.height = std::max(1, above.height / 2);
+
+        // horizontal then vertical pass; a side that is already 1 is kept
+        if (level.width != above.width) {
+          filterRows(current, above.width, above.height, across, level.width);
+        } else {
+          across.swap(current);
+        }
+        if (level.height != above.height) {
+          filterColumns(across, level.width, above.height, next, level.height);
+        } else {
+          next.swap(across);
+        }
+
+        fromLinear(next, level);
+        current.swap(next);
+      }
+
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      return true;
+    }
+
+    // glTexImage2D every level into the texture bound to target and limit
+    // sampling to them. srgb_texture picks an sRGB internal format so the
+    // sampler decodes colour to linear; grey images are swizzled to grey.
+    void upload(GLenum target = GL_TEXTURE_2D, bool srgb_texture = false) const {
+      if (levels.empty()) return;
+      for (size_t i = 0; i < levels.size(); ++i)
+        uploadLevel(target, (int)i, srgb_texture);
+
+      glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+      glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+      if (channels <= 2) {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+        glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+      }
+    }
+
+    // glTexImage2D just one level, for uploading a chain a few levels at a time
+    void uploadLevel(GLenum target, int level, bool srgb_texture = false) const {
+      GLenum format;
+      GLint internal_format;
+      glFormats(channels, srgb_texture, format, internal_format);
+
+      GLint alignment;
+      glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      const MipLevel& l = levels[level];
+      glTexImage2D(target, level, internal_format, l.width, l.height, 0, format, GL_UNSIGNED_BYTE, l.pixels.data());
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+
+    // pixel format and internal format of a chain with this many channels
+    static void glFormats(int channels, bool srgb_texture, GLenum& format, GLint& internal_format) {
+      static const GLenum formats[4]          = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+      static const GLint  internal_formats[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+      format = formats[channels - 1];
+      internal_format = internal_formats[channels - 1];
+      if (srgb_texture)
+        internal_format = (channels == 2 || channels == 4) ? GL_SRGB8_ALPHA8 : GL_SRGB8;
+    }
+
+    void printStats() const {
+      if (levels.empty()) return;
+      std::cout << "INFO::MIP_CHAIN::" << levels.size() << " levels of " << levels[0].width << "x" << levels[0].height
+                << (from_cache ? " read from cache in " : " generated in ") << seconds * 1000.0 << " ms" << std::endl;
+    }
+
+    static int levelCount(int width, int height) {
+      int count = 1;
+      for (int size = std::max(width, height); size > 1; size /= 2)
+        ++count;
+      return count;
+    }
+
+  private:
+    static constexpr int      KAISER_LOBES        = 3;     // sinc lobes per side, in output pixels
+    static constexpr double   KAISER_BETA         = 4.0;
+    static constexpr size_t   PARALLEL_MIN_PIXELS = 32768; // below this, threads cost more than they save
+    static constexpr uint32_t CACHE_VERSION       = 1;
+    static constexpr int      ENCODE_BUCKETS      = 4096;
+
+    unsigned int threads {1};
+
+    // everything a cached chain depends on, written at the front of the file
+    struct CacheHeader {
+      char     magic[4];
+      uint32_t version;
+      uint64_t source_size;
+      int64_t  source_time;
+      int32_t  width, height, channels, level_count;
+      uint8_t  srgb, filter, flipped, reserved;
+    };
+
+    // source index and weight of every tap of every output sample
+    struct Taps {
+      int count {0};
+      std::vector<int>   index;
+      std::vector<float> weight;
+    };
+
+#if defined(MIP_CHAIN_SSE2)
+    typedef __m128 Vec4;
+    static Vec4 zero4() { return _mm_setzero_ps(); }
+    static Vec4 load4(const float* p) { return _mm_loadu_ps(p); }
+    static void store4(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+    static Vec4 madd4(Vec4 acc, Vec4 v, float w) { return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w))); }
+#elif defined(MIP_CHAIN_NEON)
+    typedef float32x4_t Vec4;
+    static Vec4 zero4() { return vdupq_n_f32(0.0f); }
+    static Vec4 load4(const float* p) { return vld1q_f32(p); }
+    static void store4(float* p, Vec4 v) { vst1q_f32(p, v); }
+    static Vec4 madd4(Vec4 acc, Vec4 v, float w) { return vmlaq_n_f32(acc, v, w); }
+#else
+    struct Vec4 { float v[4]; };
+    static Vec4 zero4() { Vec4 r = {{0.0f, 0.0f, 0.0f, 0.0f}}; return r; }
+    static Vec4 load4(const float* p) { Vec4 r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+    static void store4(float* p, Vec4 v) { std::memcpy(p, v.v, sizeof(v.v)); }
+    static Vec4 madd4(Vec4 acc, Vec4 v, float w) {
+      for (int c = 0; c < 4; ++c) acc.v[c] += v.v[c] * w;
+      return acc;
+    }
+#endif
+
+    // which of the 4 working lanes are sRGB colour and which is alpha (-1: none)
+    int colourLanes() const { return channels >= 3 ? 3 : 1; }
+    int alphaLane() const { return (channels == 2 || channels == 4) ? channels - 1 : -1; }
+
+    // split rows [0, count) over the workers; small jobs stay on this thread
+    template <typename Fn>
+    void parallelRows(int count, size_t row_pixels, Fn fn) const {
+      unsigned int thread_count = (unsigned int)std::min<size_t>(threads, (size_t)count);
+      if ((size_t)count * row_pixels < PARALLEL_MIN_PIXELS || thread_count <= 1) {
+        fn(0, count);
+        return;
+      }
+      std::vector<std::thread> pool;
+      for (unsigned int t = 1; t < thread_count; ++t)
+        pool.emplace_back(fn, (int)((size_t)count * t / thread_count), (int)((size_t)count * (t + 1) / thread_count));
+      fn(0, (int)(count / thread_count));
+      for (std::thread& thread : pool)
+        thread.join();
+    }
+
+    static float srgbToLinear(float v) {
+      return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+
+    // decode: byte -> linear value, sRGB or not. encode: threshold[k] is the
+    // smallest linear value that rounds to sRGB byte k, and bucket[i] the
+    // byte that i / ENCODE_BUCKETS rounds to; the curve climbs less than one
+    // byte per bucket, so a single threshold test finishes each lookup
+    struct Tables {
+      float decode_srgb[256];
+      float decode_linear[256];
+      float threshold[257];
+      unsigned char bucket[ENCODE_BUCKETS];
+    };
+
+    static const Tables& tables() {
+      static const Tables* shared = [] {
+        static Tables t;
+        for (int i = 0; i < 256; ++i) {
+          t.decode_srgb[i]   = srgbToLinear(i / 255.0f);
+          t.decode_linear[i] = i / 255.0f;
+        }
+        t.threshold[0]   = -INFINITY;
+        t.threshold[256] = INFINITY;
+        for (int k = 1; k < 256; ++k) t.threshold[k] = srgbToLinear((k - 0.5f) / 255.0f);
+        for (int i = 0, k = 0; i < ENCODE_BUCKETS; ++i) {
+          while (t.threshold[k + 1] <= (float)i / ENCODE_BUCKETS) ++k;
+          t.bucket[i] = (unsigned char)k;
+        }
+        return &t;
+      }();
+      return *shared;
+    }
+
+    static unsigned char encodeSrgb(const Tables& t, float v) {
+      if (!(v > 0.0f)) return 0;
+      if (v >= 1.0f) return 255;
+      int k = t.bucket[(int)(v * ENCODE_BUCKETS)];
+      return (unsigned char)(k + (t.threshold[k + 1] <= v));
+    }
+
+    static unsigned char encodeLinear(float v) {
+      v = std::min(std::max(v, 0.0f), 1.0f);
+      return (unsigned char)(v * 255.0f + 0.5f);
+    }
+
+    // 8-bit level to 4 floats per pixel, linear and alpha-premultiplied;
+    // lanes past the image's channels are zero
+    void toLinear(const MipLevel& level, std::vector<float>& out) const {
+      const float* decode = srgb ? tables().decode_srgb : tables().decode_linear;
+      int colour = colourLanes(), alpha = alphaLane();
+      out.resize((size_t)level.width * level.height * 4);
+
+      parallelRows(level.height, level.width, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+          const unsigned char* in = level.pixels.data() + (size_t)y * level.width * channels;
+          float* px = out.data() + (size_t)y * level.width * 4;
+          for (int x = 0; x < level.width; ++x, in += channels, px += 4) {
+            float a = alpha >= 0 ? in[alpha] / 255.0f : 1.0f;
+            for (int c = 0; c < colour; ++c)
+              px[c] = decode[in[c]] * a;
+            if (alpha >= 0) px[alpha] = a;
+            for (int c = channels; c < 4; ++c)
+              px[c] = 0.0f;
+          }
+        }
+      });
+    }
+
+    void fromLinear(const std::vector<float>& in, MipLevel& level) const {
+      const Tables& t = tables();
+      int colour = colourLanes(), alpha = alphaLane();
+      level.pixels.resize((size_t)level.width * level.height * channels);
+
+      parallelRows(level.height, level.width, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+          const float* px = in.data() + (size_t)y * level.width * 4;
+          unsigned char* out = level.pixels.data() + (size_t)y * level.width * channels;
+          for (int x = 0; x < level.width; ++x, px += 4, out += channels) {
+            float a = alpha >= 0 ? std::min(std::max(px[alpha], 0.0f), 1.0f) : 1.0f;
+            float unpremultiply = a > 0.0f ? 1.0f / a : 0.0f;
+            for (int c = 0; c < colour; ++c) {
+              float v = px[c] * unpremultiply;
+              out[c] = srgb ? encodeSrgb(t, v) : encodeLinear(v);
+            }
+            if (alpha >= 0) out[alpha] = encodeLinear(a);
+          }
+        }
+      });
+    }
+
+    static double besselI0(double x) {
+      double sum = 1.0, term = 1.0;
+      for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+      }
+      return sum;
+    }
+
+    static double kaiser(double x) {
+      const double pi = 3.14159265358979323846;
+      double t = x / KAISER_LOBES;
+      if (t <= -1.0 || t >= 1.0) return 0.0;
+      double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+      return sinc * besselI0(KAISER_BETA * std::sqrt(1.0 - t * t)) / besselI0(KAISER_BETA);
+    }
+
+    // taps taking src samples to dst (<= src); pixel i covers [i, i+1) and
+    // samples past the edges repeat the edge pixel
+    Taps makeTaps(int src, int dst) const {
+      Taps taps;
+      double scale  = (double)src / dst;
+      double radius = filter == MipFilter::Box ? 0.5 * scale : KAISER_LOBES * scale;
+      for (int d = 0; d < dst; ++d) {
+        double center = (d + 0.5) * scale;
+        taps.count = std::max(taps.count, (int)std::ceil(center + radius) - (int)std::floor(center - radius));
+      }
+      taps.index.assign((size_t)dst * taps.count, 0);
+      taps.weight.assign((size_t)dst * taps.count, 0.0f);
+
+      for (int d = 0; d < dst; ++d) {
+        double center = (d + 0.5) * scale;
+        int first = (int)std::floor(center - radius);
+        int* index = &taps.index[(size_t)d * taps.count];
+        float* weight = &taps.weight[(size_t)d * taps.count];
+        double total = 0.0;
+
+        for (int t = 0; t < taps.count; ++t) {
+          int i = first + t;
+          double w;
+          if (filter == MipFilter::Box) {
+            // overlap of pixel i with the output pixel's footprint
+            w = std::min(i + 1.0, center + radius) - std::max((double)i, center - radius);
+            w = std::max(w, 0.0);
+          } else {
+            w = kaiser((i + 0.5 - center) / scale);
+          }
+          index[t]  = std::min(std::max(i, 0), src - 1);
+          weight[t] = (float)w;
+          total += w;
+        }
+        for (int t = 0; t < taps.count; ++t)
+          weight[t] = (float)(weight[t] / total);
+      }
+      return taps;
+    }
+
+    // width src_w -> dst_w, every row
+    void filterRows(const std::vector<float>& in, int src_w, int rows, std::vector<float>& out, int dst_w) const {
+      Taps taps = makeTaps(src_w, dst_w);
+      out.resize((size_t)dst_w * rows * 4);
+
+      parallelRows(rows, src_w, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+          const float* src = in.data() + (size_t)y * src_w * 4;
+          float* dst = out.data() + (size_t)y * dst_w * 4;
+          for (int x = 0; x < dst_w; ++x) {
+            const int* index = &taps.index[(size_t)x * taps.count];
+            const float* weight = &taps.weight[(size_t)x * taps.count];
+            Vec4 acc = zero4();
+            for (int t = 0; t < taps.count; ++t)
+              acc = madd4(acc, load4(src + (size_t)index[t] * 4), weight[t]);
+            store4(dst + (size_t)x * 4, acc);
+          }
+        }
+      });
+    }
+
+    // height src_h -> dst_h, every column
+    void filterColumns(const std::vector<float>& in, int width, int src_h, std::vector<float>& out, int dst_h) const {
+      Taps taps = makeTaps(src_h, dst_h);
+      size_t stride = (size_t)width * 4;
+      out.resize(stride * dst_h);
+
+      parallelRows(dst_h, (size_t)width * 2, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+          const int* index = &taps.index[(size_t)y * taps.count];
+          const float* weight = &taps.weight[(size_t)y * taps.count];
+          float* dst = out.data() + (size_t)y * stride;
+          for (int x = 0; x < width; ++x) {
+            Vec4 acc = zero4();
+            for (int t = 0; t < taps.count; ++t)
+              acc = madd4(acc, load4(in.data() + (size_t)index[t] * stride + (size_t)x * 4), weight[t]);
+            store4(dst + (size_t)x * 4, acc);
+          }
+        }
+      });
+    }
+
+    bool cacheKey(const char* path, bool srgb, MipFilter filter, CacheHeader& key) const {
+      std::memset(&key, 0, sizeof(key));
+      std::memcpy(key.magic, "MIPS", 4);
+      key.version = CACHE_VERSION;
+
+      // a bundled image is known by its size and content hash instead
+      const AssetBundle* bundle = AssetBundle::mounted();
+      const AssetBundle::Entry* entry = bundle ? bundle->find(path) : nullptr;
+      if (entry) {
+        key.source_size = entry->size;
+        key.source_time = (int64_t)entry->hash;
+      } else {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(path, error);
+        if (error) return false;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error) return false;
+        key.source_size = size;
+        key.source_time = (int64_t)time.time_since_epoch().count();
+      }
+      key.srgb        = srgb;
+      key.filter      = (uint8_t)filter;
+      key.flipped     = (uint8_t)stbi_get_flip_vertically_on_load();
+      return true;
+    }
+
+    bool readCache(const std::string& cache_path, const CacheHeader& key) {
+      std::ifstream file(cache_path, std::ios::binary);
+      if (!file) return false;
+
+      CacheHeader header;
+      if (!file.read((char*)&header, sizeof(header))) return false;
+      if (std::memcmp(header.magic, key.magic, 4) != 0 || header.version != key.version ||
+          header.source_size != key.source_size || header.source_time != key.source_time ||
+          header.srgb != key.srgb || header.filter != key.filter || header.flipped != key.flipped ||
+          header.width <= 0 || header.height <= 0 || header.channels < 1 || header.channels > 4 ||
+          header.level_count != levelCount(header.width, header.height))
+        return false;
+
+      std::vector<MipLevel> cached(header.level_count);
+      int width = header.width, height = header.height;
+      for (MipLevel& level : cached) {
+        level.width  = width;
+        level.height = height;
+        level.pixels.resize((size_t)width * height * header.channels);
+        if (!file.read((char*)level.pixels.data(), level.pixels.size())) return false;
+        width  = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+      }
+
+      levels.swap(cached);
+      channels = header.channels;
+      srgb     = key.srgb != 0;
+      filter   = (MipFilter)key.filter;
+      return true;
+    }
+
+    void writeCache(const std::string& cache_path, CacheHeader header) const {
+      header.width       = levels[0].width;
+      header.height      = levels[0].height;
+      header.channels    = channels;
+      header.level_count = (int32_t)levels.size();
+
+      bool written = FileIO::writeAtomically(cache_path, [&](std::ofstream& file) {
+        file.write((const char*)&header, sizeof(header));
+        for (const MipLevel& level : levels)
+          file.write((const char*)level.pixels.data(), level.pixels.size());
+      });
+      if (!written)
+        std::cerr << "ERROR::MIP_CHAIN::CACHE_NOT_WRITTEN " << cache_path << std::endl;
+    }
+};
+#endif
@@ -0,0 +1,328 @@
+#ifndef RENDER_TARGET_POOL_H
+#define RENDER_TARGET_POOL_H
+
+// Recycles offscreen render targets (textures to attach to framebuffers),
+// keyed by size, format and sample count:
+//
+//   RenderTargetPool pool;
+//   // every frame
+//   pool.beginFrame();
+//   GLuint bright = pool.acquire(RenderTargetDesc(w / 2, h / 2, GL_RGBA16F));
+//   glBindFramebuffer(GL_FRAMEBUFFER, pool.framebuffer(&bright, 1, 0));
+//   ... draw into it, then read it in the next pass ...
+//   pool.release(bright);   // done with it for this frame
+//
+// A target released mid-frame goes straight back to the pool, so a later
+// pass of the same frame that acquires the same kind of target gets the
+// same texture. Transient targets whose lifetimes within a frame don't
+// overlap thus share memory. GL has no way to place two textures of
+// different formats in the same memory, so this only aliases targets of
+// the same description. Targets nothing acquired for max_idle_frames
+// frames are deleted, e.g. the old sizes after a resize.
+//
+// Framebuffers are cached per set of attachments too, so switching passes
+// doesn't create and validate a framebuffer every frame.
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#ifndef GL_DEPTH32F_STENCIL8
+#define GL_DEPTH32F_STENCIL8 0x8CAD
+#endif
+
+struct RenderTargetDesc {
+  int    width   {0};
+  int    height  {0};
+  GLenum format  {GL_RGBA8}; // sized internal format
+  int    samples {1};        // > 1 for a multisampled target
+
+  RenderTargetDesc() = default;
+  RenderTargetDesc(int width, int height, GLenum format, int samples = 1)
+    : width(width), height(height), format(format), samples(samples) {}
+
+  bool operator==(const RenderTargetDesc& other) const {
+    return width == other.width && height == other.height && format == other.format && samples == other.samples;
+  }
+
+  bool operator!=(const RenderTargetDesc& other) const {
+    return !(*this == other);
+  }
+};
+
+class RenderTargetPool {
+  public:
+    struct Stats {
+      size_t   allocated_bytes    {0}; // held by the pool right now, in use or not
+      size_t   peak_bytes         {0}; // most ever held at once
+      size_t   targets            {0};
+      size_t   framebuffers       {0};
+      size_t   frame_bytes        {0}; // acquired this frame, counting each acquire: what no aliasing would hold
+      size_t   peak_frame_bytes   {0};
+      uint64_t allocations        {0}; // targets created, in total
+      uint64_t reuses             {0}; // acquires served by an existing target, in total
+      uint64_t deletions          {0}; // idle targets deleted, in total
+    };
+
+    // alias: hand targets released mid-frame out again in the same frame;
+    // false keeps every target acquired in a frame to itself until the next
+    // beginFrame(), to compare
+    explicit RenderTargetPool(int max_idle_frames = 3, bool alias = true)
+      : max_idle_frames(std::max(max_idle_frames, 0)), alias(alias) {}
+
+    ~RenderTargetPool() {
+      release();
+    }
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    // Once per frame, before the first acquire: deletes targets that were
+    // idle for too long.
+    void beginFrame() {
+      ++frame;
+      stats.frame_bytes = 0;
+      for (size_t i = 0; i < targets.size();) {
+        Target& target = targets[i];
+        target.held = false;
+        if (!target.acquired && frame - target.last_used > (uint64_t)max_idle_frames) {
+          destroy(target);
+          targets[i] = targets.back();
+          targets.pop_back();
+          ++stats.deletions;
+        } else {
+          ++i;
+        }
+      }
+      stats.targets = targets.size();
+    }
+
+    // A texture matching desc that nothing else holds this frame, created
+    // if there is none. 0 if desc can't be created.
+    GLuint acquire(const RenderTargetDesc& desc) {
+      size_t bytes = byteSize(desc);
+      stats.frame_bytes += bytes;
+      stats.peak_frame_bytes = std::max(stats.peak_frame_bytes, stats.frame_bytes);
+
+      for (Target& target : targets) {
+        if (target.acquired || (target.held && !alias) || target.desc != desc) continue;
+        target.acquired = target.held = true;
+        target.last_used = frame;
+        ++stats.reuses;
+        return target.texture;
+      }
+
+      Target target;
+      target.desc = desc;
+      target.texture = create(desc);
+      if (!target.texture) return 0;
+      target.acquired = target.held = true;
+      target.last_used = frame;
+      targets.push_back(target);
+      ++stats.allocations;
+      stats.targets = targets.size();
+      stats.allocated_bytes += bytes;
+      stats.peak_bytes = std::max(stats.peak_bytes, stats.allocated_bytes);
+      return target.texture;
+    }
+
+    // Done with texture for this frame; its contents may be overwritten by
+    // the next pass that acquires it.
+    void release(GLuint texture) {
+      for (Target& target : targets)
+        if (target.texture == texture) {
+          target.acquired = false;
+          return;
+        }
+      std::cerr << "ERROR::RENDER_TARGET_POOL::NOT_FROM_POOL " << texture << std::endl;
+    }
+
+    // Framebuffer with colors[0..color_count) as its color attachments (in
+    // draw buffer order) and depth, a depth or depth-stencil target (or 0),
+    // created on first use. 0 if it isn't complete.
+    GLuint framebuffer(const GLuint* colors, int color_count, GLuint depth) {
+      std::vector<GLuint> key(colors, colors + color_count);
+      key.push_back(depth);
+      std::map<std::vector<GLuint>, GLuint>::iterator it = framebuffers.find(key);
+      if (it != framebuffers.end()) return it->second;
+
+      GLuint fbo;
+      glGenFramebuffers(1, &fbo);
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+      std::vector<GLenum> draw_buffers;
+      for (int i = 0; i < color_count; ++i) {
+        const Target* target = find(colors[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, textureTarget(target), colors[i], 0);
+        draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+      }
+      if (depth) {
+        const Target* target = find(depth);
+        GLenum attachment = target && hasStencil(target->desc.format) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, textureTarget(target), depth, 0);
+      }
+      if (color_count) glDrawBuffers(color_count, draw_buffers.data());
+      else glDrawBuffer(GL_NONE);
+      GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR::RENDER_TARGET_POOL::FRAMEBUFFER_INCOMPLETE 0x" << std::hex << status << std::dec << std::endl;
+        glDeleteFramebuffers(1, &fbo);
+        return 0;
+      }
+      framebuffers[key] = fbo;
+      stats.framebuffers = framebuffers.size();
+      return fbo;
+    }
+
+    // description of a texture from this pool, or nullptr
+    const RenderTargetDesc* desc(GLuint texture) const {
+      const Target* target = find(texture);
+      return target ? &target->desc : nullptr;
+    }
+
+    const Stats& getStats() const {
+      return stats;
+    }
+
+    // Delete every target and framebuffer; call before the context goes
+    // away if this outlives it.
+    void release() {
+      for (Target& target : targets) destroy(target);
+      targets.clear();
+      for (std::map<std::vector<GLuint>, GLuint>::iterator it = framebuffers.begin(); it != framebuffers.end(); ++it)
+        glDeleteFramebuffers(1, &it->second);
+      framebuffers.clear();
+      stats.targets = stats.framebuffers = 0;
+      stats.allocated_bytes = 0;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::RENDER_TARGET_POOL::" << stats.targets << " targets, " << stats.allocated_bytes / 1024
+                << " KiB held, peak " << stats.peak_bytes / 1024 << " KiB; peak acquired in a frame "
+                << stats.peak_frame_bytes / 1024 << " KiB";
+      if (stats.peak_frame_bytes > stats.peak_bytes)
+        std::cout << " (aliasing saved " << (stats.peak_frame_bytes - stats.peak_bytes) / 1024 << " KiB)";
+      std::cout << std::endl;
+      std::cout << "INFO::RENDER_TARGET_POOL::" << stats.allocations << " created, " << stats.reuses << " reused, "
+                << stats.deletions << " deleted idle, " << stats.framebuffers << " framebuffers" << std::endl;
+    }
+
+    static bool isDepthFormat(GLenum format) {
+      return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F ||
+             format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    }
+
+    static bool hasStencil(GLenum format) {
+      return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    }
+
+    // video memory of a target, as far as the format tells
+    static size_t byteSize(const RenderTargetDesc& desc) {
+      FormatInfo info = formatInfo(desc.format);
+      return (size_t)desc.width * (size_t)desc.height * (size_t)info.bytes * (size_t)std::max(desc.samples, 1);
+    }
+
+  private:
+    struct Target {
+      RenderTargetDesc desc;
+      GLuint   texture   {0};
+      bool     acquired  {false}; // between acquire() and release()
+      bool     held      {false}; // acquired at some point this frame
+      uint64_t last_used {0};
+    };
+
+    // what glTexImage2D needs to allocate a format
+    struct FormatInfo {
+      int    bytes  {0};
+      GLenum layout {GL_RGBA};
+      GLenum type   {GL_UNSIGNED_BYTE};
+    };
+
+    int      max_idle_frames;
+    bool     alias;
+    uint64_t frame {0};
+    std::vector<Target> targets;
+    std::map<std::vector<GLuint>, GLuint> framebuffers; // by color attachments, then depth
+    Stats    stats;
+
+    static FormatInfo formatInfo(GLenum format) {
+      switch (format) {
+        case GL_R8:                 return {1, GL_RED, GL_UNSIGNED_BYTE};
+        case GL_RG8:                return {2, GL_RG, GL_UNSIGNED_BYTE};
+        case GL_RGBA8:
+        case GL_SRGB8_ALPHA8:       return {4, GL_RGBA, GL_UNSIGNED_BYTE};
+        case GL_RGB10_A2:           return {4, GL_RGBA, GL_UNSIGNED_BYTE};
+        case GL_R11F_G11F_B10F:     return {4, GL_RGB, GL_FLOAT};
+        case GL_R16F:               return {2, GL_RED, GL_FLOAT};
+        case GL_RG16F:              return {4, GL_RG, GL_FLOAT};
+        case GL_RGBA16F:            return {8, GL_RGBA, GL_FLOAT};
+        case GL_R32F:               return {4, GL_RED, GL_FLOAT};
+        case GL_RG32F:              return {8, GL_RG, GL_FLOAT};
+        case GL_RGBA32F:            return {16, GL_RGBA, GL_FLOAT};
+        case GL_DEPTH_COMPONENT16:  return {2, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT};
+        case GL_DEPTH_COMPONENT24:  return {4, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT};
+        case GL_DEPTH_COMPONENT32F: return {4, GL_DEPTH_COMPONENT, GL_FLOAT};
+        case GL_DEPTH24_STENCIL8:   return {4, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8};
+        case GL_DEPTH32F_STENCIL8:  return {8, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV};
+        default:                    return {};
+      }
+    }
+
+    static GLenum textureTarget(const Target* target) {
+      return target && target->desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    }
+
+    const Target* find(GLuint texture) const {
+      for (const Target& target : targets)
+        if (target.texture == texture) return &target;
+      return nullptr;
+    }
+
+    GLuint create(const RenderTargetDesc& desc) {
+      FormatInfo info = formatInfo(desc.format);
+      if (!info.bytes || desc.width <= 0 || desc.height <= 0) {
+        std::cerr << "ERROR::RENDER_TARGET_POOL::UNSUPPORTED_TARGET 0x" << std::hex << desc.format << std::dec << " "
+                  << desc.width << "x" << desc.height << std::endl;
+        return 0;
+      }
+      GLuint texture;
+      glGenTextures(1, &texture);
+      if (desc.samples > 1) {
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+      } else {
+        GLenum filter = isDepthFormat(desc.format) ? GL_NEAREST : GL_LINEAR;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, info.layout, info.type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+      }
+      return texture;
+    }
+
+    // delete target's texture and every framebuffer it is attached to
+    void destroy(Target& target) {
+      for (std::map<std::vector<GLuint>, GLuint>::iterator it = framebuffers.begin(); it != framebuffers.end();) {
+        if (std::find(it->first.begin(), it->first.end(), target.texture) != it->first.end()) {
+          glDeleteFramebuffers(1, &it->second);
+          it = framebuffers.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      stats.framebuffers = framebuffers.size();
+      stats.allocated_bytes -= byteSize(target.desc);
+      glDeleteTextures(1, &target.texture);
+      target.texture = 0;
+    }
+};
+#endif
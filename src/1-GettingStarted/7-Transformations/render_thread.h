@@ -0,0 +1,206 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+// Runs rendering on its own thread so a blocking swap (vsync) and slow
+// frames don't hold up event handling, and vice versa. The main thread keeps
+// everything GLFW requires of it (events, input, window state) and hands the
+// render thread InputSnapshots through a lock-free SPSC queue; the render
+// thread owns the GL context:
+//
+//   RenderThread render_thread;
+//   render_thread.installInputCallbacks(window); // stamps key, mouse and resize events
+//   render_thread.start(window, render_main);    // int render_main(RenderThread&)
+//   while (render_thread.running() && !glfwWindowShouldClose(window)) {
+//     glfwWaitEventsTimeout(RenderThread::INPUT_INTERVAL);
+//     if (render_thread.inputPending()) render_thread.pushInput(snapshot);
+//   }
+//   int result = render_thread.stop();
+//
+// and inside render_main, once per frame:
+//
+//   render_thread.latestInput(input);
+//   ... draw with input ...
+//   glfwSwapBuffers(window);
+//   render_thread.framePresented();
+//
+// Latency is measured only for frames that took a snapshot carrying an input
+// event, from the moment the main thread received the oldest such event to
+// the moment that frame's swap returned; snapshots that merely repeat the
+// current state would measure how stale it is, not latency. With vsync the
+// frame reaches the screen up to one refresh after that, so this is a lower
+// bound on input-to-photon latency. Swap interval, frame rate cap and frame time
+// stats are the FramePacer's (frame_pacer.h).
+
+#include <GLFW/glfw3.h>
+#include "frame_pacer.h"
+#include "spsc_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+struct InputSnapshot {
+  double event_time         {0.0}; // RenderThread::now() of the oldest input event since the last push; 0: none
+  int    framebuffer_width  {0};
+  int    framebuffer_height {0};
+};
+
+class RenderThread {
+  public:
+    static constexpr double INPUT_INTERVAL = 0.001; // seconds the main thread waits for events between polls
+    static const size_t     INPUT_QUEUE    = 256;   // snapshots; well over a frame's worth at 1 kHz
+
+    struct Stats {
+      uint64_t inputs_dropped {0};   // main thread
+      uint64_t latency_frames {0};   // render thread: frames that took new input events
+      double   latency_total  {0.0};
+      double   latency_max    {0.0};
+    };
+
+    RenderThread() = default;
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator=(const RenderThread&) = delete;
+
+    ~RenderThread() {
+      stop();
+    }
+
+    static double now() {
+      return FramePacer::now();
+    }
+
+    // Main thread: release the context here and make it current on a new
+    // thread that runs body until it returns or stop() is called.
+    bool start(GLFWwindow* window, std::function<int(RenderThread&)> body, FramePacing frame_pacing = FramePacing()) {
+      if (thread.joinable()) {
+        std::cerr << "ERROR::RENDER_THREAD::ALREADY_STARTED" << std::endl;
+        return false;
+      }
+      this->window = window;
+      keep_running.store(true);
+      glfwMakeContextCurrent(NULL);
+      thread = std::thread([this, body, frame_pacing]() {
+        glfwMakeContextCurrent(this->window);
+        pacer.begin(frame_pacing);
+        result = body(*this);
+        glfwMakeContextCurrent(NULL);
+        keep_running.store(false);
+        glfwPostEmptyEvent(); // wake the main thread if it is waiting for events
+      });
+      return true;
+    }
+
+    // Main thread: ask the render loop to finish and wait for it; returns
+    // body's result.
+    int stop() {
+      keep_running.store(false);
+      if (thread.joinable()) thread.join();
+      return result;
+    }
+
+    bool running() const {
+      return keep_running.load();
+    }
+
+    // Main thread: route window's key, mouse and framebuffer size callbacks
+    // to inputEvent(). Uses the window user pointer.
+    void installInputCallbacks(GLFWwindow* window) {
+      glfwSetWindowUserPointer(window, this);
+      glfwSetKeyCallback(window, [](GLFWwindow* w, int, int, int, int) { fromWindow(w)->inputEvent(); });
+      glfwSetMouseButtonCallback(window, [](GLFWwindow* w, int, int, int) { fromWindow(w)->inputEvent(); });
+      glfwSetCursorPosCallback(window, [](GLFWwindow* w, double, double) { fromWindow(w)->inputEvent(); });
+      glfwSetScrollCallback(window, [](GLFWwindow* w, double, double) { fromWindow(w)->inputEvent(); });
+      glfwSetFramebufferSizeCallback(window, [](GLFWwindow* w, int, int) { fromWindow(w)->inputEvent(); });
+    }
+
+    // Main thread: an input event arrived (or polling saw the input state
+    // change); the next snapshot pushed carries its time.
+    void inputEvent() {
+      if (pending_event_time == 0.0) pending_event_time = now();
+    }
+
+    // Main thread: whether an event arrived since the last push.
+    bool inputPending() const {
+      return pending_event_time > 0.0;
+    }
+
+    // Main thread: stamps snapshot with the oldest event not yet pushed. A
+    // snapshot the render thread is too far behind to take is dropped (it
+    // drains the queue every frame and only needs the newest) and its event
+    // time goes with the next one.
+    void pushInput(InputSnapshot snapshot) {
+      snapshot.event_time = pending_event_time;
+      if (!input.push(snapshot)) {
+        ++stats.inputs_dropped;
+        return;
+      }
+      pending_event_time = 0.0;
+    }
+
+    // Render thread: take every queued snapshot, keep the newest in latest;
+    // false (latest untouched) when nothing new arrived. The frame's latency
+    // runs from the oldest event among them.
+    bool latestInput(InputSnapshot& latest) {
+      InputSnapshot snapshot;
+      bool any = false;
+      while (input.pop(snapshot)) {
+        if (snapshot.event_time > 0.0 && (frame_input_time == 0.0 || snapshot.event_time < frame_input_time))
+          frame_input_time = snapshot.event_time;
+        latest = snapshot;
+        any = true;
+      }
+      return any;
+    }
+
+    // Render thread: call right after the swap; records the latency of a
+    // frame that took new input events and lets the pacer wait out the rest
+    // of the frame.
+    void framePresented() {
+      if (frame_input_time > 0.0) {
+        double latency = now() - frame_input_time;
+        stats.latency_total += latency;
+        stats.latency_max = std::max(stats.latency_max, latency);
+        ++stats.latency_frames;
+        frame_input_time = 0.0;
+      }
+      pacer.framePresented();
+    }
+
+    // after stop()
+    const Stats& getStats() const {
+      return stats;
+    }
+
+    void printStats() const {
+      std::cout << "INFO::RENDER_THREAD::" << pacer.frameCount() << " frames, " << stats.inputs_dropped
+                << " input snapshots dropped" << std::endl;
+      if (stats.latency_frames)
+        std::cout << "INFO::RENDER_THREAD::input to present latency "
+                  << stats.latency_total / stats.latency_frames * 1000.0 << " ms average, "
+                  << stats.latency_max * 1000.0 << " ms worst over " << stats.latency_frames << " frames with input"
+                  << std::endl;
+      pacer.printStats();
+    }
+
+  private:
+    GLFWwindow*       window {nullptr};
+    std::thread       thread;
+    std::atomic<bool> keep_running {false};
+    int               result {0};
+    SpscQueue<InputSnapshot, INPUT_QUEUE> input;
+    Stats             stats;
+
+    // main thread
+    double pending_event_time {0.0};
+
+    // render thread
+    FramePacer pacer;
+    double     frame_input_time {0.0};
+
+    static RenderThread* fromWindow(GLFWwindow* window) {
+      return (RenderThread*)glfwGetWindowUserPointer(window);
+    }
+};
+#endif
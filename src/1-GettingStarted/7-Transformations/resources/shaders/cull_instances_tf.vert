@@ -0,0 +1,28 @@
+#version 330 core
+
+// Transform feedback culling for contexts without compute shaders: one
+// point per instance, tested here; cull_instances_tf.geom only passes the
+// survivors on to the feedback buffer (see indirect_renderer.h).
+layout (location = 0) in mat4 model;         // 0..3
+layout (location = 4) in vec4 center_radius; // bounds center, bounding sphere radius
+layout (location = 5) in vec4 extent_mesh;   // box half size, mesh index
+
+out mat4 instance_model;
+flat out int instance_visible;
+
+uniform vec4 planes[6]; // inside: dot(plane.xyz, p) + plane.w >= 0
+uniform bool use_boxes;
+
+bool inside(vec3 center, float radius, vec3 extent) {
+  for (int p = 0; p < 6; ++p) {
+    float distance = dot(planes[p].xyz, center) + planes[p].w;
+    if (distance < -radius) return false;
+    if (use_boxes && distance + dot(abs(planes[p].xyz), extent) < 0.0) return false;
+  }
+  return true;
+}
+
+void main() {
+  instance_model   = model;
+  instance_visible = inside(center_radius.xyz, center_radius.w, extent_mesh.xyz) ? 1 : 0;
+}
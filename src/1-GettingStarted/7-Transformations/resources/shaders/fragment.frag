@@ -6,12 +6,22 @@ in vec3 our_color;
 in vec2 tex_coord;
 
 
-// texture sampler
-uniform sampler2D texture1; 
-uniform sampler2D texture2; 
+// every texture is a layer of one array, bound once; texture1/texture2 are
+// indices into the table of where each one sits (see texture_residency.h)
+uniform sampler2DArray textures;
+layout (std140) uniform TextureTable {
+  vec4 slots[256]; // xy: share of the layer the texture fills, z: layer
+};
+uniform int texture1; 
+uniform int texture2; 
+
+vec4 sampleTexture(int index, vec2 uv) {
+  vec4 slot = slots[index];
+  return texture(textures, vec3(uv * slot.xy, slot.z));
+}
 
 void main() {
   // linearly interpolate between both textures (80% texture1, 20% texture2)
-  frag_color = mix(texture(texture1, tex_coord), texture(texture2, tex_coord), 0.2);
+  frag_color = mix(sampleTexture(texture1, tex_coord), sampleTexture(texture2, tex_coord), 0.2);
 }
 
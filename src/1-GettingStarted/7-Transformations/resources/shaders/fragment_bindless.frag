@@ -0,0 +1,25 @@
+#version 400 core 
+#extension GL_ARB_bindless_texture : require
+
+out vec4 frag_color;
+
+in vec3 our_color;
+in vec2 tex_coord;
+
+
+// resident texture handles; texture1/texture2 are indices into the table
+// (see texture_residency.h)
+layout (std140) uniform TextureTable {
+  uvec4 slots[256]; // xy: 64-bit handle
+};
+uniform int texture1; 
+uniform int texture2; 
+
+vec4 sampleTexture(int index, vec2 uv) {
+  return texture(sampler2D(slots[index].xy), uv);
+}
+
+void main() {
+  // linearly interpolate between both textures (80% texture1, 20% texture2)
+  frag_color = mix(sampleTexture(texture1, tex_coord), sampleTexture(texture2, tex_coord), 0.2);
+}
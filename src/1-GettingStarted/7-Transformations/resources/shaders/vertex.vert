@@ -6,7 +6,10 @@ layout (location = 2) in vec2 texture_coord;
 out vec3 our_color;
 out vec2 tex_coord;
 
-uniform mat4 transform;
+// written by the CPU into this frame's copy of the block (see frames_in_flight.h)
+layout (std140) uniform FrameData {
+  mat4 transform;
+};
 
 void main() {
   gl_Position = transform * vec4(vertex_position, 1.0);
@@ -0,0 +1,16 @@
+#version 330 core 
+layout (location = 0) in vec3 vertex_position; 
+layout (location = 1) in vec3 vertex_color; 
+layout (location = 2) in vec2 texture_coord;
+layout (location = 3) in mat4 instance_model; // 3..6, one per instance (see indirect_renderer.h)
+
+out vec3 our_color;
+out vec2 tex_coord;
+
+uniform mat4 view_projection;
+
+void main() {
+  gl_Position = view_projection * instance_model * vec4(vertex_position, 1.0);
+  our_color = vertex_color;
+  tex_coord = vec2(texture_coord.x, texture_coord.y);
+}
@@ -2,6 +2,7 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include "asset_bundle.h"
 #include <ios>
 #include <string>
 #include <fstream>
@@ -24,21 +25,28 @@ class Shader {
       vertex_shader_ifs.exceptions(std::ifstream::failbit | std::ifstream::badbit);
       fragment_shader_ifs.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
-      try {
-        vertex_shader_ifs.open(vertex_shader_file_path, std::ios_base::in);
-        fragment_shader_ifs.open(fragment_shader_file_path, std::ios_base::in);
+      // a mounted asset bundle is looked in first
+      AssetBundle* bundle = AssetBundle::mounted();
+      if (bundle && bundle->readText(vertex_shader_file_path, vertex_shader_code) &&
+          bundle->readText(fragment_shader_file_path, fragment_shader_code)) {
+        std::cout << "SUCCESS::SHADER::READ_FROM_BUNDLE" << std::endl;
+      } else {
+        try {
+          vertex_shader_ifs.open(vertex_shader_file_path, std::ios_base::in);
+          fragment_shader_ifs.open(fragment_shader_file_path, std::ios_base::in);
 
-        std::stringstream vertex_shader_sstream, fragment_shader_sstream;
-        vertex_shader_sstream << vertex_shader_ifs.rdbuf();
-        fragment_shader_sstream << fragment_shader_ifs.rdbuf();
+          std::stringstream vertex_shader_sstream, fragment_shader_sstream;
+          vertex_shader_sstream << vertex_shader_ifs.rdbuf();
+          fragment_shader_sstream << fragment_shader_ifs.rdbuf();
 
-        vertex_shader_code   = vertex_shader_sstream.str();
-        fragment_shader_code = fragment_shader_sstream.str(); 
+          vertex_shader_code   = vertex_shader_sstream.str();
+          fragment_shader_code = fragment_shader_sstream.str(); 
 
-        std::cout << "SUCCESS::SHADER::FILE_READ_SUCCESSFULLY" << std::endl;
+          std::cout << "SUCCESS::SHADER::FILE_READ_SUCCESSFULLY" << std::endl;
 
-      } catch (std::ifstream::failure& exception) {
-        std::cerr << "ERROR::SHADER::FILE_NOT_READ_SUCCESSFULLY " << exception.what() << std::endl;
+        } catch (std::ifstream::failure& exception) {
+          std::cerr << "ERROR::SHADER::FILE_NOT_READ_SUCCESSFULLY " << exception.what() << std::endl;
+        }
       }
 
       const char* vertex_shader_csource_code   = vertex_shader_code.c_str();
@@ -0,0 +1,67 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. push() and pop() never block: a full queue refuses the push and an
+// empty one the pop. Each side keeps a cached copy of the other side's index
+// and only reloads it (a cache miss on the shared line) when the cached
+// value says full or empty.
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+    static_assert(std::is_default_constructible<T>::value, "T must be default constructible");
+
+  public:
+    SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer thread only
+    bool push(const T& value) {
+      size_t tail = producer.index.load(std::memory_order_relaxed);
+      if (tail - producer.cached_other == CAPACITY) {
+        producer.cached_other = consumer.index.load(std::memory_order_acquire);
+        if (tail - producer.cached_other == CAPACITY) return false;
+      }
+      slots[tail & (CAPACITY - 1)] = value;
+      producer.index.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // consumer thread only
+    bool pop(T& value) {
+      size_t head = consumer.index.load(std::memory_order_relaxed);
+      if (head == consumer.cached_other) {
+        consumer.cached_other = producer.index.load(std::memory_order_acquire);
+        if (head == consumer.cached_other) return false;
+      }
+      value = std::move(slots[head & (CAPACITY - 1)]);
+      consumer.index.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // a snapshot; exact only when called from one of the two threads while
+    // the other is idle
+    size_t size() const {
+      return producer.index.load(std::memory_order_acquire) - consumer.index.load(std::memory_order_acquire);
+    }
+
+  private:
+    // producer and consumer state on separate cache lines so the two threads
+    // don't invalidate each other's line on every operation
+    struct alignas(64) Side {
+      std::atomic<size_t> index        {0};
+      size_t              cached_other {0};
+    };
+
+    Side producer;
+    Side consumer;
+    T    slots[CAPACITY];
+};
+#endif
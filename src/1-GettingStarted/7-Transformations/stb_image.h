@@ -274,6 +274,11 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// The PNG decoder also uses SSE2 to undo the scanline filters. Where the
+// compiler supports per-function target attributes, an AVX2 kernel is
+// additionally selected by a run-time CPU test; define STBI_NO_AVX2 to
+// leave it out.
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -431,6 +436,55 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
+
+// frame-at-a-time GIF decoding: unlike stbi_load_gif_from_memory, only the
+// current canvas (plus two frames of history for disposal) is kept, whatever
+// the length of the animation.
+//
+// stbi_gif_stream_next writes the next composited frame as w*h RGBA into
+// 'rgba' (flipped if stbi_set_flip_vertically_on_load is set) and its delay
+// in milliseconds. It returns 1 for a frame, 0 after the last frame, and -1
+// on error (see stbi_failure_reason). stbi_gif_stream_rewind restarts at the
+// first frame. A memory stream keeps pointing at 'buffer'.
+typedef struct stbi__gif_stream stbi_gif_stream;
+
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open(char const *filename, int *x, int *y);
+#endif
+STBIDEF int              stbi_gif_stream_next  (stbi_gif_stream *gs, stbi_uc *rgba, int *delay_ms);
+STBIDEF int              stbi_gif_stream_rewind(stbi_gif_stream *gs);
+STBIDEF void             stbi_gif_stream_close (stbi_gif_stream *gs);
+#endif
+
+////////////////////////////////////
+//
+// row-band interface
+//
+// Same 8-bit output as stbi_load, but handed to a callback a band of rows
+// at a time (STBI_ROWS_PER_BAND, default 16) instead of as one allocation.
+// Non-interlaced PNGs are inflated and unfiltered incrementally, so peak memory
+// is a few rows plus the 32K deflate window. JPEGs still decode their
+// component planes up front but never allocate the interleaved output. Other
+// formats, and interlaced PNGs, are loaded whole and then handed out in bands.
+// Vertical flip on load is honored: band.y is where the rows go in the output.
+
+typedef struct
+{
+   int      w, h, comp;    // full image size; comp is channels per pixel in 'rows'
+   int      y, num_rows;   // output rows covered by this band
+   stbi_uc *rows;          // num_rows rows of w*comp bytes, lowest y first
+} stbi_row_band;
+
+// return 0 to stop decoding; the load then fails with "aborted"
+typedef int stbi_rows_callback(void *user, stbi_row_band const *band);
+
+STBIDEF int stbi_load_rows_from_memory   (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_callback *cb, void *user);
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *clbk_user, int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_callback *cb, void *user);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_rows          (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_callback *cb, void *user);
+STBIDEF int stbi_load_rows_from_file(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels, stbi_rows_callback *cb, void *user);
 #endif
 
 #ifdef STBI_WINDOWS_UTF8
@@ -462,6 +516,18 @@ STBIDEF stbi_us *stbi_load_from_file_16(FILE *f, int *x, int *y, int *channels_i
    STBIDEF float *stbi_loadf            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
    STBIDEF float *stbi_loadf_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
    #endif
+
+   // same values as stbi_loadf, as IEEE half floats (GL_HALF_FLOAT, for
+   // GL_RGB16F/GL_RGBA16F textures) at half the memory. Radiance files are
+   // converted a scanline at a time without a float copy of the image. Values
+   // beyond the half range are clamped to 65504 rather than made infinite.
+   STBIDEF stbi_us *stbi_loadh_from_memory   (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels);
+   STBIDEF stbi_us *stbi_loadh_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y,  int *channels_in_file, int desired_channels);
+
+   #ifndef STBI_NO_STDIO
+   STBIDEF stbi_us *stbi_loadh            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
+   STBIDEF stbi_us *stbi_loadh_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
+   #endif
 #endif
 
 #ifndef STBI_NO_HDR
@@ -517,6 +583,9 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// whether images loaded on this thread are flipped (the thread setting if any)
+STBIDEF int stbi_get_flip_vertically_on_load(void);
+
 // as above, but only applies to images loaded on the thread that calls the function
 // this function is only available if your compiler supports thread-local variables;
 // calling it will fail to link if your compiler doesn't
@@ -750,7 +819,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2 // the vertical flip and format conversions use it for every format
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -761,7 +830,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -771,9 +840,38 @@ static int stbi__sse2_available(void)
 }
 #endif
 
+#endif
+
+// AVX2 is never assumed; the kernels that use it are compiled with a
+// per-function target attribute and only called after a run-time check.
+#if !defined(STBI_NO_AVX2) && !defined(STBI_NO_PNG) && \
+    ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || \
+     (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define STBI__AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info, 1);
+   if ((info[2] & (3 << 27)) != (3 << 27)) return 0; // OSXSAVE and AVX
+   if ((_xgetbv(0) & 6) != 6) return 0;             // OS saves the YMM state
+   __cpuidex(info, 7, 0);
+   return (info[1] >> 5) & 1;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
 #endif
 #endif
 
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -817,6 +915,11 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // set while a flip-on-load is still owed; the first pass that writes the
+   // whole image (decoder or format conversion) places its rows bottom-up
+   // and clears it, so only images nothing rewrote get a separate flip
+   int flip_pending;
 } stbi__context;
 
 
@@ -830,6 +933,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->flip_pending = 0;
 }
 
 // initialize a callback-based context
@@ -840,6 +944,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
+   s->flip_pending = 0;
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
@@ -905,10 +1010,28 @@ typedef struct
    int channel_order;
 } stbi__result_info;
 
+#ifndef STBI_ROWS_PER_BAND
+#define STBI_ROWS_PER_BAND 16
+#endif
+
+// collects decoded rows for the row-band interface and passes them on to the
+// user's callback one band at a time
+typedef struct
+{
+   stbi_rows_callback *cb;
+   void *user;
+   int flip;
+   int filled;   // rows waiting in 'rows'
+   int next_y;   // source rows already handed out
+   stbi_uc *rows;
+   stbi_row_band band;
+} stbi__row_sink;
+
 #ifndef STBI_NO_JPEG
 static int      stbi__jpeg_test(stbi__context *s);
 static void    *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
 static int      stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp);
+static int      stbi__jpeg_load_rows(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__row_sink *sink);
 #endif
 
 #ifndef STBI_NO_PNG
@@ -916,6 +1039,7 @@ static int      stbi__png_test(stbi__context *s);
 static void    *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
 static int      stbi__png_info(stbi__context *s, int *x, int *y, int *comp);
 static int      stbi__png_is16(stbi__context *s);
+static int      stbi__png_load_rows(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__row_sink *sink);
 #endif
 
 #ifndef STBI_NO_BMP
@@ -940,6 +1064,7 @@ static int      stbi__psd_is16(stbi__context *s);
 #ifndef STBI_NO_HDR
 static int      stbi__hdr_test(stbi__context *s);
 static float   *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
+static void    *stbi__hdr_load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, int half);
 static int      stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
@@ -1105,6 +1230,7 @@ STBIDEF void stbi_image_free(void *retval_from_stbi_load)
 
 #ifndef STBI_NO_LINEAR
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
+static stbi__uint16 *stbi__ldr_to_half(stbi_uc *data, int x, int y, int comp);
 #endif
 
 #ifndef STBI_NO_HDR
@@ -1134,6 +1260,11 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+STBIDEF int stbi_get_flip_vertically_on_load(void)
+{
+   return stbi__vertically_flip_on_load;
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1187,60 +1318,120 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
-static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
+static void stbi__convert_16_to_8_row(stbi__uint16 const *src, stbi_uc *dest, int n)
 {
-   int i;
-   int img_len = w * h * channels;
+   int i = 0;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      for (; i + 16 <= n; i += 16) {
+         __m128i a = _mm_srli_epi16(_mm_loadu_si128((__m128i const *) (src + i)), 8);
+         __m128i b = _mm_srli_epi16(_mm_loadu_si128((__m128i const *) (src + i + 8)), 8);
+         _mm_storeu_si128((__m128i *) (dest + i), _mm_packus_epi16(a, b));
+      }
+   }
+#elif defined(STBI_NEON)
+   for (; i + 16 <= n; i += 16)
+      vst1q_u8(dest + i, vcombine_u8(vshrn_n_u16(vld1q_u16(src + i), 8), vshrn_n_u16(vld1q_u16(src + i + 8), 8)));
+#endif
+   for (; i < n; ++i)
+      dest[i] = (stbi_uc)((src[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
+}
+
+static void stbi__convert_8_to_16_row(stbi_uc const *src, stbi__uint16 *dest, int n)
+{
+   int i = 0;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      for (; i + 16 <= n; i += 16) {
+         __m128i v = _mm_loadu_si128((__m128i const *) (src + i));
+         _mm_storeu_si128((__m128i *) (dest + i),     _mm_unpacklo_epi8(v, v));
+         _mm_storeu_si128((__m128i *) (dest + i + 8), _mm_unpackhi_epi8(v, v));
+      }
+   }
+#elif defined(STBI_NEON)
+   for (; i + 16 <= n; i += 16) {
+      uint8x16x2_t v;
+      v.val[0] = v.val[1] = vld1q_u8(src + i);
+      vst2q_u8((stbi_uc *) (dest + i), v);
+   }
+#endif
+   for (; i < n; ++i)
+      dest[i] = (stbi__uint16)((src[i] << 8) + src[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
+}
+
+// these copy into a new buffer anyway, so they also do a pending flip
+static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels, int flip)
+{
+   int j;
+   size_t row_len = (size_t) w * channels;
    stbi_uc *reduced;
 
-   reduced = (stbi_uc *) stbi__malloc(img_len);
+   reduced = (stbi_uc *) stbi__malloc_mad3(w, h, channels, 0);
    if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
 
-   for (i = 0; i < img_len; ++i)
-      reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
+   for (j = 0; j < h; ++j)
+      stbi__convert_16_to_8_row(orig + j * row_len, reduced + (flip ? h - 1 - j : j) * row_len, (int) row_len);
 
    STBI_FREE(orig);
    return reduced;
 }
 
-static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int channels)
+static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int channels, int flip)
 {
-   int i;
-   int img_len = w * h * channels;
+   int j;
+   size_t row_len = (size_t) w * channels;
    stbi__uint16 *enlarged;
 
-   enlarged = (stbi__uint16 *) stbi__malloc(img_len*2);
+   enlarged = (stbi__uint16 *) stbi__malloc(row_len * h * 2);
    if (enlarged == NULL) return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
 
-   for (i = 0; i < img_len; ++i)
-      enlarged[i] = (stbi__uint16)((orig[i] << 8) + orig[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
+   for (j = 0; j < h; ++j)
+      stbi__convert_8_to_16_row(orig + j * row_len, enlarged + (flip ? h - 1 - j : j) * row_len, (int) row_len);
 
    STBI_FREE(orig);
    return enlarged;
 }
 
+static void stbi__swap_rows(stbi_uc *row0, stbi_uc *row1, size_t bytes_per_row)
+{
+   size_t i = 0;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      for (; i + 32 <= bytes_per_row; i += 32) {
+         __m128i a0 = _mm_loadu_si128((__m128i *) (row0 + i));
+         __m128i a1 = _mm_loadu_si128((__m128i *) (row0 + i + 16));
+         __m128i b0 = _mm_loadu_si128((__m128i *) (row1 + i));
+         __m128i b1 = _mm_loadu_si128((__m128i *) (row1 + i + 16));
+         _mm_storeu_si128((__m128i *) (row0 + i),      b0);
+         _mm_storeu_si128((__m128i *) (row0 + i + 16), b1);
+         _mm_storeu_si128((__m128i *) (row1 + i),      a0);
+         _mm_storeu_si128((__m128i *) (row1 + i + 16), a1);
+      }
+   }
+#elif defined(STBI_NEON)
+   for (; i + 16 <= bytes_per_row; i += 16) {
+      uint8x16_t a = vld1q_u8(row0 + i);
+      uint8x16_t b = vld1q_u8(row1 + i);
+      vst1q_u8(row0 + i, b);
+      vst1q_u8(row1 + i, a);
+   }
+#endif
+   for (; i < bytes_per_row; ++i) {
+      stbi_uc t = row0[i];
+      row0[i] = row1[i];
+      row1[i] = t;
+   }
+}
+
+// swaps rows in place, without the 3 copies of going through a temp buffer
 static void stbi__vertical_flip(void *image, int w, int h, int bytes_per_pixel)
 {
    int row;
    size_t bytes_per_row = (size_t)w * bytes_per_pixel;
-   stbi_uc temp[2048];
    stbi_uc *bytes = (stbi_uc *)image;
 
-   for (row = 0; row < (h>>1); row++) {
-      stbi_uc *row0 = bytes + row*bytes_per_row;
-      stbi_uc *row1 = bytes + (h - row - 1)*bytes_per_row;
-      // swap row0 with row1
-      size_t bytes_left = bytes_per_row;
-      while (bytes_left) {
-         size_t bytes_copy = (bytes_left < sizeof(temp)) ? bytes_left : sizeof(temp);
-         memcpy(temp, row0, bytes_copy);
-         memcpy(row0, row1, bytes_copy);
-         memcpy(row1, temp, bytes_copy);
-         row0 += bytes_copy;
-         row1 += bytes_copy;
-         bytes_left -= bytes_copy;
-      }
-   }
+   for (row = 0; row < (h>>1); row++)
+      stbi__swap_rows(bytes + row*bytes_per_row, bytes + (h - row - 1)*bytes_per_row, bytes_per_row);
 }
 
 #ifndef STBI_NO_GIF
@@ -1257,10 +1448,78 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 }
 #endif
 
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)
+static int stbi__row_sink_begin(stbi__row_sink *k, int w, int h, int comp)
+{
+   k->band.w = w;
+   k->band.h = h;
+   k->band.comp = comp;
+   k->filled = k->next_y = 0;
+   // +1: like stbi_load's buffer, leaves room for the jpeg writers' spare 4th byte
+   k->rows = (stbi_uc *) stbi__malloc_mad3(w, comp, STBI_ROWS_PER_BAND, 1);
+   if (!k->rows) return stbi__err("outofmem", "Out of memory");
+   return 1;
+}
+
+// where the decoder writes its next row; when flipping, the band is
+// filled from the bottom so it ends up in output order
+static stbi_uc *stbi__row_sink_next(stbi__row_sink *k)
+{
+   int slot = k->flip ? STBI_ROWS_PER_BAND-1 - k->filled : k->filled;
+   return k->rows + (size_t) slot * k->band.w * k->band.comp;
+}
+
+static int stbi__row_sink_flush(stbi__row_sink *k)
+{
+   size_t stride = (size_t) k->band.w * k->band.comp;
+   if (!k->filled) return 1;
+   k->band.num_rows = k->filled;
+   if (k->flip) {
+      k->band.y    = k->band.h - k->next_y - k->filled;
+      k->band.rows = k->rows + (STBI_ROWS_PER_BAND - k->filled) * stride;
+   } else {
+      k->band.y    = k->next_y;
+      k->band.rows = k->rows;
+   }
+   k->next_y += k->filled;
+   k->filled = 0;
+   if (!k->cb(k->user, &k->band)) return stbi__err("aborted", "Row callback stopped the load");
+   return 1;
+}
+
+// the row from stbi__row_sink_next has been written
+static int stbi__row_sink_commit(stbi__row_sink *k)
+{
+   if (++k->filled == STBI_ROWS_PER_BAND || k->next_y + k->filled == k->band.h)
+      return stbi__row_sink_flush(k);
+   return 1;
+}
+#endif
+
+// for decoders that only produce whole images; 'data' is already flipped
+static int stbi__row_sink_image(stbi__row_sink *k, stbi_uc *data, int w, int h, int comp)
+{
+   int y;
+   size_t stride = (size_t) w * comp;
+   k->band.w = w;
+   k->band.h = h;
+   k->band.comp = comp;
+   for (y=0; y < h; y += STBI_ROWS_PER_BAND) {
+      k->band.y = y;
+      k->band.num_rows = h - y < STBI_ROWS_PER_BAND ? h - y : STBI_ROWS_PER_BAND;
+      k->band.rows = data + y * stride;
+      if (!k->cb(k->user, &k->band)) return stbi__err("aborted", "Row callback stopped the load");
+   }
+   return 1;
+}
+
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   void *result;
+
+   s->flip_pending = stbi__vertically_flip_on_load;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
 
    if (result == NULL)
       return NULL;
@@ -1269,13 +1528,16 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
    STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
 
    if (ri.bits_per_channel != 8) {
-      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp == 0 ? *comp : req_comp);
+      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp == 0 ? *comp : req_comp, s->flip_pending);
+      if (result == NULL)
+         return NULL;
+      s->flip_pending = 0;
       ri.bits_per_channel = 8;
    }
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   if (s->flip_pending) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
@@ -1286,7 +1548,10 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
+   void *result;
+
+   s->flip_pending = stbi__vertically_flip_on_load;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
 
    if (result == NULL)
       return NULL;
@@ -1295,14 +1560,17 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
 
    if (ri.bits_per_channel != 16) {
-      result = stbi__convert_8_to_16((stbi_uc *) result, *x, *y, req_comp == 0 ? *comp : req_comp);
+      result = stbi__convert_8_to_16((stbi_uc *) result, *x, *y, req_comp == 0 ? *comp : req_comp, s->flip_pending);
+      if (result == NULL)
+         return NULL;
+      s->flip_pending = 0;
       ri.bits_per_channel = 16;
    }
 
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (s->flip_pending) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1440,6 +1708,79 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+static int stbi__load_rows_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi_rows_callback *cb, void *user)
+{
+   stbi__row_sink k;
+   stbi_uc *data;
+   int ok;
+
+   if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   memset(&k, 0, sizeof(k));
+   k.cb = cb;
+   k.user = user;
+   k.flip = stbi__vertically_flip_on_load;
+
+   #ifndef STBI_NO_PNG
+   if (stbi__png_test(s)) {
+      ok = stbi__png_load_rows(s, x, y, comp, req_comp, &k);
+      STBI_FREE(k.rows);
+      return ok;
+   }
+   #endif
+   #ifndef STBI_NO_JPEG
+   if (stbi__jpeg_test(s)) {
+      ok = stbi__jpeg_load_rows(s, x, y, comp, req_comp, &k);
+      STBI_FREE(k.rows);
+      return ok;
+   }
+   #endif
+
+   data = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+   if (data == NULL) return 0;
+   ok = stbi__row_sink_image(&k, data, *x, *y, req_comp ? req_comp : *comp);
+   STBI_FREE(data);
+   return ok;
+}
+
+STBIDEF int stbi_load_rows_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_rows_callback *cb, void *user)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_rows_main(&s,x,y,comp,req_comp,cb,user);
+}
+
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *clbk_user, int *x, int *y, int *comp, int req_comp, stbi_rows_callback *cb, void *user)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, clbk_user);
+   return stbi__load_rows_main(&s,x,y,comp,req_comp,cb,user);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_rows(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_rows_callback *cb, void *user)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_rows_from_file(f,x,y,comp,req_comp,cb,user);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_rows_from_file(FILE *f, int *x, int *y, int *comp, int req_comp, stbi_rows_callback *cb, void *user)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_rows_main(&s,x,y,comp,req_comp,cb,user);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+#endif //!STBI_NO_STDIO
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1475,6 +1816,62 @@ static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int
    return stbi__errpf("unknown image type", "Image not of any known type, or corrupt");
 }
 
+static stbi_us *stbi__loadh_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   unsigned char *data;
+   #ifndef STBI_NO_HDR
+   if (stbi__hdr_test(s)) {
+      stbi__uint16 *hdr_data = (stbi__uint16 *) stbi__hdr_load_main(s, x, y, comp, req_comp, 1);
+      if (hdr_data && stbi__vertically_flip_on_load)
+         stbi__vertical_flip(hdr_data, *x, *y, (req_comp ? req_comp : 3) * 2);
+      return hdr_data;
+   }
+   #endif
+   data = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+   if (data)
+      return stbi__ldr_to_half(data, *x, *y, req_comp ? req_comp : *comp);
+   return (stbi_us *) stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
+}
+
+STBIDEF stbi_us *stbi_loadh_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_us *stbi_loadh_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_us *stbi_loadh(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_us *result;
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
+   result = stbi_loadh_from_file(f,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF stbi_us *stbi_loadh_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_us *result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__loadh_main(&s,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+#endif
+
 STBIDEF float *stbi_loadf_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
@@ -1752,9 +2149,154 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
-static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+// the common conversions 16 pixels at a time (4-8 for SSE2's 3/4 channel
+// ones); returns how many pixels were converted, the rest are left to the
+// scalar loop
+static unsigned int stbi__convert_format_row_simd(unsigned char *src, unsigned char *dest, int img_n, int req_comp, unsigned int x)
 {
-   int i,j;
+   unsigned int i = 0;
+#ifdef STBI_SSE2
+   if (!stbi__sse2_available()) return 0;
+   switch (img_n*8 + req_comp) {
+      case 1*8+4: {
+         __m128i ff = _mm_set1_epi8((char) 255);
+         for (; i + 16 <= x; i += 16) {
+            __m128i g  = _mm_loadu_si128((__m128i *) (src + i));
+            __m128i gg = _mm_unpacklo_epi8(g, g), ga = _mm_unpacklo_epi8(g, ff);
+            _mm_storeu_si128((__m128i *) (dest + 4*i),      _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + 4*i + 16), _mm_unpackhi_epi16(gg, ga));
+            gg = _mm_unpackhi_epi8(g, g);
+            ga = _mm_unpackhi_epi8(g, ff);
+            _mm_storeu_si128((__m128i *) (dest + 4*i + 32), _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + 4*i + 48), _mm_unpackhi_epi16(gg, ga));
+         }
+         break;
+      }
+      case 2*8+4: {
+         __m128i lo = _mm_set1_epi16(0xff);
+         for (; i + 8 <= x; i += 8) {
+            __m128i ga = _mm_loadu_si128((__m128i *) (src + 2*i));
+            __m128i g  = _mm_and_si128(ga, lo);
+            __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+            _mm_storeu_si128((__m128i *) (dest + 4*i),      _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + 4*i + 16), _mm_unpackhi_epi16(gg, ga));
+         }
+         break;
+      }
+      // no byte shuffle in SSE2: shift the register along by a byte per
+      // pixel and mask out that pixel's bytes
+      case 3*8+4: {
+         __m128i m0 = _mm_setr_epi32(0xffffff, 0, 0, 0), m1 = _mm_setr_epi32(0, 0xffffff, 0, 0);
+         __m128i m2 = _mm_setr_epi32(0, 0, 0xffffff, 0), m3 = _mm_setr_epi32(0, 0, 0, 0xffffff);
+         __m128i alpha = _mm_set1_epi32((int) 0xff000000u);
+         // reads 16 bytes for 4 pixels, so stop 6 pixels short of the row end
+         for (; i + 6 <= x; i += 4) {
+            __m128i v = _mm_loadu_si128((__m128i *) (src + 3*i));
+            __m128i p = _mm_or_si128(_mm_and_si128(v, m0), _mm_and_si128(_mm_slli_si128(v, 1), m1));
+            p = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(v, 2), m2));
+            p = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(v, 3), m3));
+            _mm_storeu_si128((__m128i *) (dest + 4*i), _mm_or_si128(p, alpha));
+         }
+         break;
+      }
+      case 4*8+3: {
+         __m128i m0 = _mm_setr_epi32(0xffffff, 0, 0, 0), m1 = _mm_setr_epi32((int) 0xff000000u, 0xffff, 0, 0);
+         __m128i m2 = _mm_setr_epi32(0, (int) 0xffff0000u, 0xff, 0), m3 = _mm_setr_epi32(0, 0, (int) 0xffffff00u, 0);
+         // writes 16 bytes for 4 pixels; stopping 6 short keeps that in the row
+         for (; i + 6 <= x; i += 4) {
+            __m128i v = _mm_loadu_si128((__m128i *) (src + 4*i));
+            __m128i p = _mm_or_si128(_mm_and_si128(v, m0), _mm_and_si128(_mm_srli_si128(v, 1), m1));
+            p = _mm_or_si128(p, _mm_and_si128(_mm_srli_si128(v, 2), m2));
+            p = _mm_or_si128(p, _mm_and_si128(_mm_srli_si128(v, 3), m3));
+            _mm_storeu_si128((__m128i *) (dest + 3*i), p);
+         }
+         break;
+      }
+   }
+#elif defined(STBI_NEON)
+   uint8x16_t ff = vdupq_n_u8(255);
+   switch (img_n*8 + req_comp) {
+      case 1*8+4:
+         for (; i + 16 <= x; i += 16) {
+            uint8x16x4_t o;
+            o.val[0] = o.val[1] = o.val[2] = vld1q_u8(src + i);
+            o.val[3] = ff;
+            vst4q_u8(dest + 4*i, o);
+         }
+         break;
+      case 2*8+4:
+         for (; i + 16 <= x; i += 16) {
+            uint8x16x2_t ga = vld2q_u8(src + 2*i);
+            uint8x16x4_t o;
+            o.val[0] = o.val[1] = o.val[2] = ga.val[0];
+            o.val[3] = ga.val[1];
+            vst4q_u8(dest + 4*i, o);
+         }
+         break;
+      case 3*8+4:
+         for (; i + 16 <= x; i += 16) {
+            uint8x16x3_t rgb = vld3q_u8(src + 3*i);
+            uint8x16x4_t o;
+            o.val[0] = rgb.val[0];
+            o.val[1] = rgb.val[1];
+            o.val[2] = rgb.val[2];
+            o.val[3] = ff;
+            vst4q_u8(dest + 4*i, o);
+         }
+         break;
+      case 4*8+3:
+         for (; i + 16 <= x; i += 16) {
+            uint8x16x4_t rgba = vld4q_u8(src + 4*i);
+            uint8x16x3_t o;
+            o.val[0] = rgba.val[0];
+            o.val[1] = rgba.val[1];
+            o.val[2] = rgba.val[2];
+            vst3q_u8(dest + 3*i, o);
+         }
+         break;
+   }
+#else
+   STBI_NOTUSED(src); STBI_NOTUSED(dest); STBI_NOTUSED(img_n); STBI_NOTUSED(req_comp); STBI_NOTUSED(x);
+#endif
+   return i;
+}
+
+// converts one row of x pixels; returns 0 on an unsupported combination
+static int stbi__convert_format_row(unsigned char *src, unsigned char *dest, int img_n, int req_comp, unsigned int x)
+{
+   int i;
+   unsigned int done = stbi__convert_format_row_simd(src, dest, img_n, req_comp, x);
+   src  += done * img_n;
+   dest += done * req_comp;
+   x    -= done;
+
+   #define STBI__COMBO(a,b)  ((a)*8+(b))
+   #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+   // convert source image with img_n components to one with req_comp components;
+   // avoid switch per pixel, so use switch per scanline and massive macros
+   switch (STBI__COMBO(img_n, req_comp)) {
+      STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
+      STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
+      STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
+      STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
+      STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
+      STBI__CASE(3,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(3,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = 255;    } break;
+      STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
+      STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
+      default: STBI_ASSERT(0); return 0;
+   }
+   #undef STBI__CASE
+   return 1;
+}
+
+// converting writes every row anyway, so it also does the pending flip of s
+static unsigned char *stbi__convert_format(stbi__context *s, unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+   int j, flip;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
@@ -1766,30 +2308,14 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
       return stbi__errpuc("outofmem", "Out of memory");
    }
 
+   flip = s->flip_pending;
+   s->flip_pending = 0;
    for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
-
-      #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (STBI__COMBO(img_n, req_comp)) {
-         STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
-         STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
-         STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
-         STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
-         STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
-         STBI__CASE(3,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(3,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = 255;    } break;
-         STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
-         STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
+      unsigned int out_j = flip ? y - 1 - j : (unsigned int) j;
+      if (!stbi__convert_format_row(data + j * x * img_n, good + out_j * x * req_comp, img_n, req_comp, x)) {
+         STBI_FREE(data); STBI_FREE(good);
+         return stbi__errpuc("unsupported", "Unsupported format conversion");
       }
-      #undef STBI__CASE
    }
 
    STBI_FREE(data);
@@ -1809,9 +2335,36 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
 // nothing
 #else
-static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+static int stbi__convert_format16_row(stbi__uint16 *src, stbi__uint16 *dest, int img_n, int req_comp, unsigned int x)
 {
-   int i,j;
+   int i;
+
+   #define STBI__COMBO(a,b)  ((a)*8+(b))
+   #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+   // convert source image with img_n components to one with req_comp components;
+   // avoid switch per pixel, so use switch per scanline and massive macros
+   switch (STBI__COMBO(img_n, req_comp)) {
+      STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=0xffff;                                     } break;
+      STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
+      STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=0xffff;                     } break;
+      STBI__CASE(2,1) { dest[0]=src[0];                                                     } break;
+      STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
+      STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                     } break;
+      STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=0xffff;        } break;
+      STBI__CASE(3,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(3,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = 0xffff; } break;
+      STBI__CASE(4,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(4,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = src[3]; } break;
+      STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                       } break;
+      default: STBI_ASSERT(0); return 0;
+   }
+   #undef STBI__CASE
+   return 1;
+}
+
+static stbi__uint16 *stbi__convert_format16(stbi__context *s, stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+   int j, flip;
    stbi__uint16 *good;
 
    if (req_comp == img_n) return data;
@@ -1823,30 +2376,14 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
       return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
    }
 
+   flip = s->flip_pending;
+   s->flip_pending = 0;
    for (j=0; j < (int) y; ++j) {
-      stbi__uint16 *src  = data + j * x * img_n   ;
-      stbi__uint16 *dest = good + j * x * req_comp;
-
-      #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (STBI__COMBO(img_n, req_comp)) {
-         STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=0xffff;                                     } break;
-         STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
-         STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=0xffff;                     } break;
-         STBI__CASE(2,1) { dest[0]=src[0];                                                     } break;
-         STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
-         STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                     } break;
-         STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=0xffff;        } break;
-         STBI__CASE(3,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(3,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = 0xffff; } break;
-         STBI__CASE(4,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(4,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = src[3]; } break;
-         STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                       } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
+      unsigned int out_j = flip ? y - 1 - j : (unsigned int) j;
+      if (!stbi__convert_format16_row(data + j * x * img_n, good + out_j * x * req_comp, img_n, req_comp, x)) {
+         STBI_FREE(data); STBI_FREE(good);
+         return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
       }
-      #undef STBI__CASE
    }
 
    STBI_FREE(data);
@@ -1854,48 +2391,201 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 }
 #endif
 
+#if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR)
+// float to IEEE half, rounding to nearest even; saturates to the largest
+// finite half (65504) instead of producing infinities
+static stbi__uint16 stbi__float_to_half(float f)
+{
+   stbi__uint32 x, sign;
+   stbi__uint16 h;
+   memcpy(&x, &f, 4);
+   sign = x & 0x80000000u;
+   x ^= sign;
+   if (x > 0x477fe000u) x = 0x477fe000u;
+   if (x < 0x38800000u) {
+      // half denormal or zero: adding 0.5 lines the mantissa up with the
+      // denormal's bits and does the rounding
+      float d;
+      stbi__uint32 db;
+      memcpy(&d, &x, 4);
+      d += 0.5f;
+      memcpy(&db, &d, 4);
+      h = (stbi__uint16) (db - 0x3f000000u);
+   } else {
+      // rebias the exponent and round the 13 dropped bits to nearest even
+      h = (stbi__uint16) ((x + 0xc8000fffu + ((x >> 13) & 1)) >> 13);
+   }
+   return (stbi__uint16) (h | (sign >> 16));
+}
+
+#ifdef STBI_SSE2
+// stbi__float_to_half on 4 lanes; results come back sign-extended to 32 bits
+// so _mm_packs_epi32 narrows them without saturating
+static __m128i stbi__float_to_half_sse2(__m128 f)
+{
+   __m128i x    = _mm_castps_si128(f);
+   __m128i sign = _mm_and_si128(x, _mm_set1_epi32((int) 0x80000000u));
+   __m128i max  = _mm_set1_epi32(0x477fe000);
+   __m128i big, denorm, norm, is_denorm, h;
+
+   x   = _mm_xor_si128(x, sign);
+   big = _mm_cmpgt_epi32(x, max);
+   x   = _mm_or_si128(_mm_and_si128(big, max), _mm_andnot_si128(big, x));
+
+   denorm = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3f000000));
+   norm   = _mm_add_epi32(x, _mm_set1_epi32((int) 0xc8000fffu));
+   norm   = _mm_srli_epi32(_mm_add_epi32(norm, _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1))), 13);
+
+   is_denorm = _mm_cmplt_epi32(x, _mm_set1_epi32(0x38800000));
+   h = _mm_or_si128(_mm_and_si128(is_denorm, denorm), _mm_andnot_si128(is_denorm, norm));
+   h = _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+   return _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+}
+#endif
+
+static void stbi__float_to_half_row(stbi__uint16 *out, float const *in, int n)
+{
+   int i = 0;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      for (; i + 8 <= n; i += 8) {
+         __m128i a = stbi__float_to_half_sse2(_mm_loadu_ps(in + i));
+         __m128i b = stbi__float_to_half_sse2(_mm_loadu_ps(in + i + 4));
+         _mm_storeu_si128((__m128i *) (out + i), _mm_packs_epi32(a, b));
+      }
+   }
+#endif
+   for (; i < n; ++i)
+      out[i] = stbi__float_to_half(in[i]);
+}
+#endif
+
 #ifndef STBI_NO_LINEAR
+// the gamma curve is evaluated once per byte value rather than per channel
+static void stbi__ldr_to_hdr_table(float *color, float *alpha)
+{
+   int i;
+   for (i=0; i < 256; ++i) {
+      color[i] = (float) (pow(i/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+      alpha[i] = i/255.0f;
+   }
+}
+
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
    int i,k,n;
    float *output;
+   float color[256], alpha[256];
    if (!data) return NULL;
    output = (float *) stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
    if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+   stbi__ldr_to_hdr_table(color, alpha);
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
    for (i=0; i < x*y; ++i) {
       for (k=0; k < n; ++k) {
-         output[i*comp + k] = (float) (pow(data[i*comp+k]/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+         output[i*comp + k] = color[data[i*comp+k]];
       }
    }
    if (n < comp) {
       for (i=0; i < x*y; ++i) {
-         output[i*comp + n] = data[i*comp + n]/255.0f;
+         output[i*comp + n] = alpha[data[i*comp + n]];
       }
    }
    STBI_FREE(data);
    return output;
 }
+
+static stbi__uint16 *stbi__ldr_to_half(stbi_uc *data, int x, int y, int comp)
+{
+   int i,k,n;
+   stbi__uint16 *output;
+   stbi__uint16 color_h[256], alpha_h[256];
+   float color[256], alpha[256];
+   if (!data) return NULL;
+   output = (stbi__uint16 *) stbi__malloc_mad4(x, y, comp, 2, 0);
+   if (output == NULL) { STBI_FREE(data); return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory"); }
+   stbi__ldr_to_hdr_table(color, alpha);
+   stbi__float_to_half_row(color_h, color, 256);
+   stbi__float_to_half_row(alpha_h, alpha, 256);
+   if (comp & 1) n = comp; else n = comp-1;
+   for (i=0; i < x*y; ++i) {
+      for (k=0; k < n; ++k)
+         output[i*comp + k] = color_h[data[i*comp+k]];
+      if (n < comp)
+         output[i*comp + n] = alpha_h[data[i*comp + n]];
+   }
+   STBI_FREE(data);
+   return output;
+}
 #endif
 
 #ifndef STBI_NO_HDR
 #define stbi__float2int(x)   ((int) (x))
+static int stbi__hdr_to_ldr_value(float d)
+{
+   float z = (float) pow(d*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
+   if (z < 0) z = 0;
+   if (z > 255) z = 255;
+   return stbi__float2int(z);
+}
+
+// for a rising curve, threshold[v] is the smallest float that maps to at
+// least v; it is found by bisecting over the (ordered) bit patterns of
+// non-negative floats, so lookups match stbi__hdr_to_ldr_value exactly
+static void stbi__hdr_to_ldr_table(float *threshold)
+{
+   int v;
+   stbi__uint32 lo = 0;
+   threshold[0] = 0;
+   for (v=1; v < 256; ++v) {
+      stbi__uint32 hi = 0x7f800000u; // +inf maps to 255
+      while (lo < hi) {
+         stbi__uint32 mid = lo + (hi - lo) / 2;
+         float f;
+         memcpy(&f, &mid, 4);
+         if (stbi__hdr_to_ldr_value(f) >= v) hi = mid; else lo = mid + 1;
+      }
+      memcpy(&threshold[v], &lo, 4);
+   }
+}
+
+// branchless binary search; NaNs and negatives fall through to 0
+static stbi_uc stbi__hdr_to_ldr_lookup(float const *threshold, float d)
+{
+   int v = 0;
+   if (d >= threshold[v + 128]) v += 128;
+   if (d >= threshold[v +  64]) v +=  64;
+   if (d >= threshold[v +  32]) v +=  32;
+   if (d >= threshold[v +  16]) v +=  16;
+   if (d >= threshold[v +   8]) v +=   8;
+   if (d >= threshold[v +   4]) v +=   4;
+   if (d >= threshold[v +   2]) v +=   2;
+   if (d >= threshold[v +   1]) v +=   1;
+   return (stbi_uc) v;
+}
+
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 {
-   int i,k,n;
+   int i,k,n,use_table;
    stbi_uc *output;
+   float threshold[256];
    if (!data) return NULL;
    output = (stbi_uc *) stbi__malloc_mad3(x, y, comp, 0);
    if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
+   // building the table costs ~8k pow calls, so only for bigger images, and
+   // only while the curve is rising
+   use_table = (double) x*y*n >= 65536 && stbi__h2l_gamma_i > 0 && stbi__h2l_scale_i > 0;
+   if (use_table)
+      stbi__hdr_to_ldr_table(threshold);
    for (i=0; i < x*y; ++i) {
       for (k=0; k < n; ++k) {
-         float z = (float) pow(data[i*comp+k]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
+         if (use_table)
+            output[i*comp + k] = stbi__hdr_to_ldr_lookup(threshold, data[i*comp+k]);
+         else
+            output[i*comp + k] = (stbi_uc) stbi__hdr_to_ldr_value(data[i*comp+k]);
       }
       if (k < comp) {
          float z = data[i*comp+k] * 255 + 0.5f;
@@ -3862,7 +4552,9 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// with a sink, rows are converted straight into its bands and the returned
+// pointer is only a success flag (the sink's band buffer)
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp, stbi__row_sink *sink)
 {
    int n, decode_n, is_rgb;
    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
@@ -3889,9 +4581,9 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // resample and color-convert
    {
-      int k;
+      int k, flip = 0;
       unsigned int i,j;
-      stbi_uc *output;
+      stbi_uc *output, *spill_row = NULL;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
       stbi__resample res_comp[4];
@@ -3918,13 +4610,31 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      if (sink) {
+         if (!stbi__row_sink_begin(sink, z->s->img_x, z->s->img_y, n)) { stbi__cleanup_jpeg(z); return NULL; }
+         output = sink->rows;
+         // the 3-channel writers store a 4th byte past the end of the row, which
+         // lands on an already finished row when the band fills bottom-up
+         if (n == 3 && sink->flip) {
+            spill_row = (stbi_uc *) stbi__malloc_mad2(z->s->img_x, 4, 0);
+            if (!spill_row) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         }
+      } else {
+         // can't error after this so, this is safe
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         // write the rows bottom-up rather than flipping afterwards
+         flip = z->s->flip_pending;
+         z->s->flip_pending = 0;
+      }
 
       // now go ahead and resample
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         stbi_uc *out = spill_row ? spill_row : sink ? stbi__row_sink_next(sink) : output + n * z->s->img_x * (flip ? z->s->img_y - 1 - j : j);
+         // the 3-channel writers' spare 4th byte would land on the first
+         // byte of the row below, which is already done when going bottom-up
+         stbi_uc *row_end = out + n * z->s->img_x;
+         stbi_uc spilled_on = (flip && n == 3 && j) ? *row_end : 0;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -4016,7 +4726,13 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
             }
          }
+         if (flip && n == 3 && j)
+            *row_end = spilled_on;
+         if (spill_row)
+            memcpy(stbi__row_sink_next(sink), spill_row, n * z->s->img_x);
+         if (sink && !stbi__row_sink_commit(sink)) { STBI_FREE(spill_row); stbi__cleanup_jpeg(z); return NULL; }
       }
+      STBI_FREE(spill_row);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -4034,11 +4750,24 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
-   result = load_jpeg_image(j, x,y,comp,req_comp);
+   result = load_jpeg_image(j, x,y,comp,req_comp, NULL);
    STBI_FREE(j);
    return result;
 }
 
+static int stbi__jpeg_load_rows(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__row_sink *sink)
+{
+   stbi_uc *result;
+   stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
+   if (!j) return stbi__err("outofmem", "Out of memory");
+   memset(j, 0, sizeof(stbi__jpeg));
+   j->s = s;
+   stbi__setup_jpeg(j);
+   result = load_jpeg_image(j, x,y,comp,req_comp, sink);
+   STBI_FREE(j);
+   return result != NULL;
+}
+
 static int stbi__jpeg_test(stbi__context *s)
 {
    int r;
@@ -4174,7 +4903,7 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
 
-typedef struct
+typedef struct stbi__zbuf
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
@@ -4186,11 +4915,21 @@ typedef struct
    char *zout_end;
    int   z_expandable;
 
+   // row streaming (see stbi_load_rows): zrefill points zbuffer at more input
+   // once it runs dry; zflush takes decoded bytes before the output buffer
+   // is slid down to just the 32K deflate window
+   void (*zrefill)(struct stbi__zbuf *z);
+   int  (*zflush)(void *user, stbi_uc *data, int len);
+   void *zuser;
+   char *zflushed;
+
    stbi__zhuffman z_length, z_distance;
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
 {
+   if (z->zbuffer >= z->zbuffer_end && z->zrefill)
+      z->zrefill(z);
    return (z->zbuffer >= z->zbuffer_end);
 }
 
@@ -4204,6 +4943,7 @@ static void stbi__fill_bits(stbi__zbuf *z)
    do {
       if (z->code_buffer >= (1U << z->num_bits)) {
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+        z->zrefill = NULL;
         return;
       }
       z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
@@ -4270,11 +5010,30 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+// streaming: hand everything decoded so far to zflush, then keep only the
+// last 32K at the start of the buffer, which is all back-references can reach
+static int stbi__zslide(stbi__zbuf *z)
+{
+   int keep;
+   if (z->zout > z->zflushed)
+      if (!z->zflush(z->zuser, (stbi_uc *) z->zflushed, (int) (z->zout - z->zflushed))) return 0;
+   keep = (int) (z->zout - z->zout_start);
+   if (keep > 32768) keep = 32768;
+   memmove(z->zout_start, z->zout - keep, keep);
+   z->zout     = z->zout_start + keep;
+   z->zflushed = z->zout;
+   return 1;
+}
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
    unsigned int cur, limit, old_limit;
    z->zout = zout;
+   if (z->zflush) {
+      if (!stbi__zslide(z)) return 0;
+      if (z->zout + n <= z->zout_end) return 1;
+   }
    if (!z->z_expandable) return stbi__err("output buffer limit","Corrupt PNG");
    cur   = (unsigned int) (z->zout - z->zout_start);
    limit = old_limit = (unsigned) (z->zout_end - z->zout_start);
@@ -4426,9 +5185,23 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   if (a->zrefill) {
+      // streamed input; the stored bytes can span several refills
+      while (len > 0) {
+         int n;
+         if (stbi__zeof(a)) return stbi__err("read past buffer","Corrupt PNG");
+         n = (int) (a->zbuffer_end - a->zbuffer);
+         if (n > len) n = len;
+         memcpy(a->zout, a->zbuffer, n);
+         a->zbuffer += n;
+         a->zout += n;
+         len -= n;
+      }
+      return 1;
+   }
+   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4513,6 +5286,8 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->zrefill    = NULL;
+   a->zflush     = NULL;
 
    return stbi__parse_zlib(a, parse_header);
 }
@@ -4632,6 +5407,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi__row_sink *sink; // set for the row-band interface
 } stbi__png;
 
 
@@ -4645,68 +5421,365 @@ enum {
    STBI__F_avg_first
 };
 
-static stbi_uc first_row_filter[5] =
+static stbi_uc first_row_filter[5] =
+{
+   STBI__F_none,
+   STBI__F_sub,
+   STBI__F_none,
+   STBI__F_avg_first,
+   STBI__F_sub // Paeth with b=c=0 turns out to be equivalent to sub
+};
+
+static int stbi__paeth(int a, int b, int c)
+{
+   // This formulation looks very different from the reference in the PNG spec, but is
+   // actually equivalent and has favorable data dependencies and admits straightforward
+   // generation of branch-free code, which helps performance significantly.
+   int thresh = c*3 - (a + b);
+   int lo = a < b ? a : b;
+   int hi = a < b ? b : a;
+   int t0 = (hi <= thresh) ? lo : c;
+   int t1 = (thresh <= lo) ? hi : t0;
+   return t1;
+}
+
+static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
+
+// adds an extra all-255 alpha channel
+// dest == src is legal
+// img_n must be 1 or 3
+static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__uint32 x, int img_n)
+{
+   int i;
+   // must process data backwards since we allow dest==src
+   if (img_n == 1) {
+      for (i=x-1; i >= 0; --i) {
+         dest[i*2+1] = 255;
+         dest[i*2+0] = src[i];
+      }
+   } else {
+      STBI_ASSERT(img_n == 3);
+      for (i=x-1; i >= 0; --i) {
+         dest[i*4+3] = 255;
+         dest[i*4+2] = src[i*3+2];
+         dest[i*4+1] = src[i*3+1];
+         dest[i*4+0] = src[i*3+0];
+      }
+   }
+}
+
+#ifdef STBI_SSE2
+// Sub, Avg and Paeth depend on the unfiltered pixel to the left, so these
+// kernels vectorize across the bytes of one pixel (3..8 of them) and walk the
+// row pixel by pixel. Up has no such dependency and runs 16 bytes at a time.
+//
+// Pixels are moved with 8-byte loads and stores while at least 8 bytes of the
+// row remain ('room'); the bytes past the pixel are overwritten by the next one.
+static stbi_inline __m128i stbi__png_load_px(stbi_uc const *p, int n, int room)
+{
+   stbi_uc t[8] = { 0 };
+   if (room >= 8) return _mm_loadl_epi64((__m128i const *) p);
+   memcpy(t, p, n);
+   return _mm_loadl_epi64((__m128i const *) t);
+}
+
+static stbi_inline void stbi__png_store_px(stbi_uc *p, __m128i v, int n, int room)
+{
+   stbi_uc t[8];
+   if (room >= 8) {
+      _mm_storel_epi64((__m128i *) p, v);
+   } else {
+      _mm_storel_epi64((__m128i *) t, v);
+      memcpy(p, t, n);
+   }
+}
+
+// same formulation as stbi__paeth, on 16-bit lanes
+static __m128i stbi__paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a16 = _mm_unpacklo_epi8(a, zero);
+   __m128i b16 = _mm_unpacklo_epi8(b, zero);
+   __m128i c16 = _mm_unpacklo_epi8(c, zero);
+   __m128i thresh = _mm_sub_epi16(_mm_add_epi16(c16, _mm_add_epi16(c16, c16)), _mm_add_epi16(a16, b16));
+   __m128i lo = _mm_min_epi16(a16, b16);
+   __m128i hi = _mm_max_epi16(a16, b16);
+   __m128i use_c = _mm_cmpgt_epi16(hi, thresh);
+   __m128i t0 = _mm_or_si128(_mm_and_si128(use_c, c16), _mm_andnot_si128(use_c, lo));
+   __m128i use_t0 = _mm_cmpgt_epi16(thresh, lo);
+   __m128i t1 = _mm_or_si128(_mm_and_si128(use_t0, t0), _mm_andnot_si128(use_t0, hi));
+   return _mm_packus_epi16(t1, zero);
+}
+
+// floor((a+b)/2); pavgb rounds up, so take the carried bit back off
+static __m128i stbi__avg_sse2(__m128i a, __m128i b)
+{
+   __m128i round = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+   return _mm_sub_epi8(_mm_avg_epu8(a, b), round);
+}
+
+// if 'dest' is non-NULL, n must be 3 and each pixel is also written there with
+// an extra alpha=255 byte, doing the work of stbi__create_png_alpha_expand8
+// in the same pass
+static void stbi__png_unfilter_px_sse2(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int nk, int n, int filter, stbi_uc *dest)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i alpha = _mm_cvtsi32_si128((int) 0xff000000);
+   __m128i a = zero, b = zero, c = zero, x;
+   int k;
+
+   #define STBI__PNG_PX_LOOP(compute)                                 \
+      for (k=0; k < nk; k += n, a = x) {                            \
+         x = stbi__png_load_px(raw+k, n, nk-k);                     \
+         compute;                                                   \
+         stbi__png_store_px(cur+k, x, n, nk-k);                     \
+         if (dest) {                                                \
+            int px = _mm_cvtsi128_si32(_mm_or_si128(x, alpha));     \
+            memcpy(dest, &px, 4);                                   \
+            dest += 4;                                              \
+         }                                                          \
+      }
+
+   switch (filter) {
+   case STBI__F_none:      STBI__PNG_PX_LOOP((void) 0); break;
+   case STBI__F_sub:       STBI__PNG_PX_LOOP(x = _mm_add_epi8(x, a)); break;
+   case STBI__F_up:        STBI__PNG_PX_LOOP(x = _mm_add_epi8(x, stbi__png_load_px(prior+k, n, nk-k))); break;
+   case STBI__F_avg_first: STBI__PNG_PX_LOOP(x = _mm_add_epi8(x, stbi__avg_sse2(a, zero))); break;
+   case STBI__F_avg:
+      STBI__PNG_PX_LOOP(b = stbi__png_load_px(prior+k, n, nk-k); x = _mm_add_epi8(x, stbi__avg_sse2(a, b)));
+      break;
+   case STBI__F_paeth:
+      STBI__PNG_PX_LOOP(b = stbi__png_load_px(prior+k, n, nk-k); x = _mm_add_epi8(x, stbi__paeth_sse2(a, b, c)); c = b);
+      break;
+   }
+
+   #undef STBI__PNG_PX_LOOP
+}
+
+#ifdef STBI__AVX2
+STBI__AVX2_TARGET static int stbi__png_unfilter_up_avx2(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int nk)
+{
+   int k;
+   for (k=0; k+32 <= nk; k += 32) {
+      __m256i r = _mm256_loadu_si256((__m256i const *) (raw+k));
+      __m256i p = _mm256_loadu_si256((__m256i const *) (prior+k));
+      _mm256_storeu_si256((__m256i *) (cur+k), _mm256_add_epi8(r, p));
+   }
+   return k;
+}
+#endif
+
+// returns 0 if the row was left for the scalar code, 1 if it was unfiltered
+// into cur, 2 if it was also alpha-expanded into expand_dest
+static int stbi__png_unfilter_row_simd(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int nk, int filter_bytes, int filter, stbi_uc *expand_dest, int use_avx2)
+{
+   if (filter == STBI__F_up && !expand_dest) {
+      int k = 0;
+#ifdef STBI__AVX2
+      if (use_avx2) k = stbi__png_unfilter_up_avx2(cur, prior, raw, nk);
+#else
+      STBI_NOTUSED(use_avx2);
+#endif
+      for (; k+16 <= nk; k += 16) {
+         __m128i r = _mm_loadu_si128((__m128i const *) (raw+k));
+         __m128i p = _mm_loadu_si128((__m128i const *) (prior+k));
+         _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(r, p));
+      }
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+   // a plain copy is already as fast as it gets
+   if (filter == STBI__F_none && !expand_dest)
+      return 0;
+   if (filter_bytes >= 3) {
+      if (filter_bytes != 3) expand_dest = NULL;
+      stbi__png_unfilter_px_sse2(cur, prior, raw, nk, filter_bytes, filter, expand_dest);
+      return expand_dest ? 2 : 1;
+   }
+   return 0;
+}
+#endif // STBI_SSE2
+
+// everything needed to turn one filtered scanline into output pixels; shared by
+// the whole-image path below and the row streamer (stbi__png_stream)
+typedef struct
+{
+   stbi__uint32 x, img_width_bytes;
+   int img_n, out_n, depth, color;
+   int filter_bytes, nk;
+   int use_sse2, use_avx2;
+} stbi__png_rowfmt;
+
+static void stbi__png_init_rowfmt(stbi__png_rowfmt *f, stbi__uint32 x, int img_n, int out_n, int depth, int color)
+{
+   int bytes = (depth == 16 ? 2 : 1);
+   f->x = x;
+   f->img_n = img_n;
+   f->out_n = out_n;
+   f->depth = depth;
+   f->color = color;
+   f->img_width_bytes = (((img_n * x * depth) + 7) >> 3);
+   // Filtering for low-bit-depth images
+   if (depth < 8) {
+      f->filter_bytes = 1;
+      f->nk = f->img_width_bytes;
+   } else {
+      f->filter_bytes = img_n*bytes;
+      f->nk = x * f->filter_bytes;
+   }
+#ifdef STBI_SSE2
+   f->use_sse2 = stbi__sse2_available();
+#else
+   f->use_sse2 = 0;
+#endif
+#ifdef STBI__AVX2
+   f->use_avx2 = stbi__avx2_available();
+#else
+   f->use_avx2 = 0;
+#endif
+}
+
+// unfilters the scanline at 'raw' (filter byte first) into cur, then expands it
+// into dest. cur may be dest itself for 8-bit rows with out_n == img_n.
+static int stbi__png_decode_row(stbi__png_rowfmt const *f, stbi_uc *dest, stbi_uc *cur, stbi_uc *prior, stbi_uc const *raw, int first_row)
 {
-   STBI__F_none,
-   STBI__F_sub,
-   STBI__F_none,
-   STBI__F_avg_first,
-   STBI__F_sub // Paeth with b=c=0 turns out to be equivalent to sub
-};
+   stbi__uint32 i;
+   int k;
+   int img_n = f->img_n, out_n = f->out_n, depth = f->depth;
+   int filter_bytes = f->filter_bytes;
+   int nk = f->nk;
+   stbi__uint32 x = f->x;
+   int filter = *raw++;
+   int done = 0; // 1: unfiltered by the SIMD path, 2: that also expanded into dest
 
-static int stbi__paeth(int a, int b, int c)
-{
-   // This formulation looks very different from the reference in the PNG spec, but is
-   // actually equivalent and has favorable data dependencies and admits straightforward
-   // generation of branch-free code, which helps performance significantly.
-   int thresh = c*3 - (a + b);
-   int lo = a < b ? a : b;
-   int hi = a < b ? b : a;
-   int t0 = (hi <= thresh) ? lo : c;
-   int t1 = (thresh <= lo) ? hi : t0;
-   return t1;
-}
+   // check filter type
+   if (filter > 4)
+      return stbi__err("invalid filter","Corrupt PNG");
 
-static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
+   // if first row, use special filter that doesn't sample previous row
+   if (first_row) filter = first_row_filter[filter];
 
-// adds an extra all-255 alpha channel
-// dest == src is legal
-// img_n must be 1 or 3
-static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__uint32 x, int img_n)
-{
-   int i;
-   // must process data backwards since we allow dest==src
-   if (img_n == 1) {
-      for (i=x-1; i >= 0; --i) {
-         dest[i*2+1] = 255;
-         dest[i*2+0] = src[i];
+#ifdef STBI_SSE2
+   if (f->use_sse2)
+      done = stbi__png_unfilter_row_simd(cur, prior, raw, nk, filter_bytes, filter, (depth == 8 && img_n != out_n) ? dest : NULL, f->use_avx2);
+#endif
+
+   // perform actual filtering
+   if (!done) switch (filter) {
+   case STBI__F_none:
+      memcpy(cur, raw, nk);
+      break;
+   case STBI__F_sub:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
+      break;
+   case STBI__F_up:
+      for (k = 0; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      break;
+   case STBI__F_avg:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
+      break;
+   case STBI__F_paeth:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
+      break;
+   case STBI__F_avg_first:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
+      break;
+   }
+
+   // expand decoded bits in cur to dest, also adding an extra alpha channel if desired
+   if (depth < 8) {
+      stbi_uc scale = (f->color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
+      stbi_uc *in = cur;
+      stbi_uc *out = dest;
+      stbi_uc inb = 0;
+      stbi__uint32 nsmp = x*img_n;
+
+      // expand bits to bytes first
+      if (depth == 4) {
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 1) == 0) inb = *in++;
+            *out++ = scale * (inb >> 4);
+            inb <<= 4;
+         }
+      } else if (depth == 2) {
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 3) == 0) inb = *in++;
+            *out++ = scale * (inb >> 6);
+            inb <<= 2;
+         }
+      } else {
+         STBI_ASSERT(depth == 1);
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 7) == 0) inb = *in++;
+            *out++ = scale * (inb >> 7);
+            inb <<= 1;
+         }
       }
-   } else {
-      STBI_ASSERT(img_n == 3);
-      for (i=x-1; i >= 0; --i) {
-         dest[i*4+3] = 255;
-         dest[i*4+2] = src[i*3+2];
-         dest[i*4+1] = src[i*3+1];
-         dest[i*4+0] = src[i*3+0];
+
+      // insert alpha=255 values if desired
+      if (img_n != out_n)
+         stbi__create_png_alpha_expand8(dest, dest, x, img_n);
+   } else if (depth == 8) {
+      if (img_n != out_n) {
+         if (done != 2)
+            stbi__create_png_alpha_expand8(dest, cur, x, img_n);
+      } else if (cur != dest) {
+         memcpy(dest, cur, x*img_n);
+      }
+   } else if (depth == 16) {
+      // convert the image data from big-endian to platform-native
+      stbi__uint16 *dest16 = (stbi__uint16*)dest;
+      stbi__uint32 nsmp = x*img_n;
+
+      if (img_n == out_n) {
+         for (i = 0; i < nsmp; ++i, ++dest16, cur += 2)
+            *dest16 = (cur[0] << 8) | cur[1];
+      } else {
+         STBI_ASSERT(img_n+1 == out_n);
+         if (img_n == 1) {
+            for (i = 0; i < x; ++i, dest16 += 2, cur += 2) {
+               dest16[0] = (cur[0] << 8) | cur[1];
+               dest16[1] = 0xffff;
+            }
+         } else {
+            STBI_ASSERT(img_n == 3);
+            for (i = 0; i < x; ++i, dest16 += 4, cur += 6) {
+               dest16[0] = (cur[0] << 8) | cur[1];
+               dest16[1] = (cur[2] << 8) | cur[3];
+               dest16[2] = (cur[4] << 8) | cur[5];
+               dest16[3] = 0xffff;
+            }
+         }
       }
    }
+   return 1;
 }
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// create the png data from post-deflated data, bottom row first if flip
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip)
 {
    int bytes = (depth == 16 ? 2 : 1);
    stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
+   stbi__uint32 j,stride = x*out_n*bytes;
    stbi__uint32 img_len, img_width_bytes;
    stbi_uc *filter_buf;
+   stbi__png_rowfmt f;
    int all_ok = 1;
-   int k;
    int img_n = s->img_n; // copy it into a local for later
 
    int output_bytes = out_n*bytes;
-   int filter_bytes = img_n*bytes;
-   int width = x;
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4728,128 +5801,26 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, 0);
    if (!filter_buf) return stbi__err("outofmem", "Out of memory");
 
-   // Filtering for low-bit-depth images
-   if (depth < 8) {
-      filter_bytes = 1;
-      width = img_width_bytes;
-   }
+   stbi__png_init_rowfmt(&f, x, img_n, out_n, depth, color);
 
    for (j=0; j < y; ++j) {
       // cur/prior filter buffers alternate
       stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
       stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
-      stbi_uc *dest = a->out + stride*j;
-      int nk = width * filter_bytes;
-      int filter = *raw++;
+      stbi_uc *dest = a->out + stride*(flip ? y - 1 - j : j);
 
-      // check filter type
-      if (filter > 4) {
-         all_ok = stbi__err("invalid filter","Corrupt PNG");
-         break;
+      // 8-bit rows that need no conversion are unfiltered straight into the
+      // output, with the previous output row as the prior scanline
+      if (depth == 8 && img_n == out_n) {
+         cur = dest;
+         if (j) prior = flip ? dest + stride : dest - stride;
       }
 
-      // if first row, use special filter that doesn't sample previous row
-      if (j == 0) filter = first_row_filter[filter];
-
-      // perform actual filtering
-      switch (filter) {
-      case STBI__F_none:
-         memcpy(cur, raw, nk);
-         break;
-      case STBI__F_sub:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
-         break;
-      case STBI__F_up:
-         for (k = 0; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      if (!stbi__png_decode_row(&f, dest, cur, prior, raw, j == 0)) {
+         all_ok = 0;
          break;
-      case STBI__F_avg:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
-         break;
-      case STBI__F_paeth:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
-         break;
-      case STBI__F_avg_first:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
-         break;
-      }
-
-      raw += nk;
-
-      // expand decoded bits in cur to dest, also adding an extra alpha channel if desired
-      if (depth < 8) {
-         stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
-         stbi_uc *in = cur;
-         stbi_uc *out = dest;
-         stbi_uc inb = 0;
-         stbi__uint32 nsmp = x*img_n;
-
-         // expand bits to bytes first
-         if (depth == 4) {
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 1) == 0) inb = *in++;
-               *out++ = scale * (inb >> 4);
-               inb <<= 4;
-            }
-         } else if (depth == 2) {
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 3) == 0) inb = *in++;
-               *out++ = scale * (inb >> 6);
-               inb <<= 2;
-            }
-         } else {
-            STBI_ASSERT(depth == 1);
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 7) == 0) inb = *in++;
-               *out++ = scale * (inb >> 7);
-               inb <<= 1;
-            }
-         }
-
-         // insert alpha=255 values if desired
-         if (img_n != out_n)
-            stbi__create_png_alpha_expand8(dest, dest, x, img_n);
-      } else if (depth == 8) {
-         if (img_n == out_n)
-            memcpy(dest, cur, x*img_n);
-         else
-            stbi__create_png_alpha_expand8(dest, cur, x, img_n);
-      } else if (depth == 16) {
-         // convert the image data from big-endian to platform-native
-         stbi__uint16 *dest16 = (stbi__uint16*)dest;
-         stbi__uint32 nsmp = x*img_n;
-
-         if (img_n == out_n) {
-            for (i = 0; i < nsmp; ++i, ++dest16, cur += 2)
-               *dest16 = (cur[0] << 8) | cur[1];
-         } else {
-            STBI_ASSERT(img_n+1 == out_n);
-            if (img_n == 1) {
-               for (i = 0; i < x; ++i, dest16 += 2, cur += 2) {
-                  dest16[0] = (cur[0] << 8) | cur[1];
-                  dest16[1] = 0xffff;
-               }
-            } else {
-               STBI_ASSERT(img_n == 3);
-               for (i = 0; i < x; ++i, dest16 += 4, cur += 6) {
-                  dest16[0] = (cur[0] << 8) | cur[1];
-                  dest16[1] = (cur[2] << 8) | cur[3];
-                  dest16[2] = (cur[4] << 8) | cur[5];
-                  dest16[3] = 0xffff;
-               }
-            }
-         }
       }
+      raw += f.nk + 1;
    }
 
    STBI_FREE(filter_buf);
@@ -4864,8 +5835,11 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    int out_bytes = out_n * bytes;
    stbi_uc *final;
    int p;
+   // rows are placed in their final order as they are decoded
+   int flip = a->s->flip_pending;
+   a->s->flip_pending = 0;
    if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, flip);
 
    // de-interlacing
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4881,7 +5855,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
             STBI_FREE(final);
             return 0;
          }
@@ -4889,6 +5863,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
                int out_x = i*xspc[p]+xorig[p];
+               if (flip) out_y = a->s->img_y - 1 - out_y;
                memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
             }
@@ -4903,11 +5878,9 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+static int stbi__compute_transparency(stbi_uc *p, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
+   stbi__uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 255 as the alpha value in the output
@@ -4928,11 +5901,9 @@ static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
    return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int out_n)
+static int stbi__compute_transparency16(stbi__uint16 *p, stbi__uint32 pixel_count, stbi__uint16 tc[3], int out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi__uint16 *p = (stbi__uint16*) z->out;
+   stbi__uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 65535 as the alpha value in the output
@@ -4953,17 +5924,9 @@ static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int ou
    return 1;
 }
 
-static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+static void stbi__expand_palette_pixels(stbi_uc *p, stbi_uc const *orig, stbi__uint32 pixel_count, stbi_uc const *palette, int pal_img_n)
 {
-   stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-   stbi_uc *p, *temp_out, *orig = a->out;
-
-   p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
-   if (p == NULL) return stbi__err("outofmem", "Out of memory");
-
-   // between here and free(out) below, exitting would leak
-   temp_out = p;
-
+   stbi__uint32 i;
    if (pal_img_n == 3) {
       for (i=0; i < pixel_count; ++i) {
          int n = orig[i]*4;
@@ -4982,8 +5945,19 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
          p += 4;
       }
    }
+}
+
+static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+{
+   stbi__uint32 pixel_count = a->s->img_x * a->s->img_y;
+   stbi_uc *p;
+
+   p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
+   if (p == NULL) return stbi__err("outofmem", "Out of memory");
+
+   stbi__expand_palette_pixels(p, a->out, pixel_count, palette, pal_img_n);
    STBI_FREE(a->out);
-   a->out = temp_out;
+   a->out = p;
 
    STBI_NOTUSED(len);
 
@@ -5030,13 +6004,11 @@ STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_conve
                                 : stbi__de_iphone_flag_global)
 #endif // STBI_THREAD_LOCAL
 
-static void stbi__de_iphone(stbi__png *z)
+static void stbi__de_iphone(stbi_uc *p, stbi__uint32 pixel_count, int img_out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
+   stbi__uint32 i;
 
-   if (s->img_out_n == 3) {  // convert bgr to rgb
+   if (img_out_n == 3) {  // convert bgr to rgb
       for (i=0; i < pixel_count; ++i) {
          stbi_uc t = p[0];
          p[0] = p[2];
@@ -5044,7 +6016,7 @@ static void stbi__de_iphone(stbi__png *z)
          p += 3;
       }
    } else {
-      STBI_ASSERT(s->img_out_n == 4);
+      STBI_ASSERT(img_out_n == 4);
       if (stbi__unpremultiply_on_load) {
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
@@ -5075,6 +6047,203 @@ static void stbi__de_iphone(stbi__png *z)
 
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
+// row-band decoding of a non-interlaced PNG: the IDAT chunks are read as the
+// inflater asks for input, and each scanline is finished and handed to the
+// sink as soon as it has been inflated
+#ifndef STBI_PNG_STREAM_WINDOW
+#define STBI_PNG_STREAM_WINDOW (128*1024) // inflate output buffer; must exceed 32K
+#endif
+
+typedef struct
+{
+   stbi__png *z;
+   stbi__png_rowfmt f;
+   int req_comp, is_iphone, has_trans, pal_n; // pal_n: channels after palette lookup, 0 if not paletted
+   stbi_uc *palette, *tc;
+   stbi__uint16 *tc16;
+
+   stbi__uint32 y, have, row_bytes;
+   stbi_uc *raw, *filter_buf, *out, *pal, *conv;
+
+   stbi__uint32 idat_left;
+   int idat_done;
+   stbi__pngchunk next;   // first chunk after the IDAT run, once idat_done
+   stbi_uc in[4096];
+} stbi__png_stream;
+
+// last steps stbi_load applies to the whole image: conversion to req_comp, then
+// 16 to 8 bits, written straight into the sink's band
+static int stbi__png_emit_row(stbi__png_stream *st, stbi_uc *row, int n)
+{
+   stbi__row_sink *k = st->z->sink;
+   stbi_uc *dest = stbi__row_sink_next(k);
+   int out_n = st->req_comp ? st->req_comp : n;
+   stbi__uint32 i, x = st->f.x;
+
+   if (st->f.depth == 16) {
+      stbi__uint16 *src16 = (stbi__uint16 *) row;
+      if (out_n != n) {
+         if (!stbi__convert_format16_row(src16, (stbi__uint16 *) st->conv, n, out_n, x))
+            return stbi__err("unsupported", "Unsupported format conversion");
+         src16 = (stbi__uint16 *) st->conv;
+      }
+      for (i=0; i < x*out_n; ++i)
+         dest[i] = (stbi_uc) ((src16[i] >> 8) & 0xFF);
+   } else if (out_n != n) {
+      if (!stbi__convert_format_row(row, dest, n, out_n, x))
+         return stbi__err("unsupported", "Unsupported format conversion");
+   } else {
+      memcpy(dest, row, x*n);
+   }
+   return stbi__row_sink_commit(k);
+}
+
+static int stbi__png_stream_row(stbi__png_stream *st, stbi_uc const *raw)
+{
+   stbi__png_rowfmt *f = &st->f;
+   stbi_uc *cur   = st->filter_buf + (st->y & 1)*f->img_width_bytes;
+   stbi_uc *prior = st->filter_buf + (~st->y & 1)*f->img_width_bytes;
+   stbi_uc *row = st->out;
+   int n = f->out_n;
+
+   if (!stbi__png_decode_row(f, row, cur, prior, raw, st->y == 0)) return 0;
+   if (st->has_trans) {
+      if (f->depth == 16)
+         stbi__compute_transparency16((stbi__uint16 *) row, f->x, st->tc16, n);
+      else
+         stbi__compute_transparency(row, f->x, st->tc, n);
+   }
+   if (st->is_iphone && stbi__de_iphone_flag && n > 2)
+      stbi__de_iphone(row, f->x, n);
+   if (st->pal_n) {
+      stbi__expand_palette_pixels(st->pal, row, f->x, st->palette, st->pal_n);
+      row = st->pal;
+      n = st->pal_n;
+   }
+   ++st->y;
+   return stbi__png_emit_row(st, row, n);
+}
+
+// zflush callback: cut the inflated bytes into scanlines
+static int stbi__png_stream_bytes(void *user, stbi_uc *data, int len)
+{
+   stbi__png_stream *st = (stbi__png_stream *) user;
+   while (len > 0 && st->y < st->z->s->img_y) {
+      if (st->have == 0 && (stbi__uint32) len >= st->row_bytes) {
+         // whole scanline in the inflate buffer, no need to copy it out
+         if (!stbi__png_stream_row(st, data)) return 0;
+         data += st->row_bytes;
+         len  -= st->row_bytes;
+      } else {
+         stbi__uint32 n = st->row_bytes - st->have;
+         if (n > (stbi__uint32) len) n = len;
+         memcpy(st->raw + st->have, data, n);
+         st->have += n;
+         data += n;
+         len  -= n;
+         if (st->have == st->row_bytes) {
+            st->have = 0;
+            if (!stbi__png_stream_row(st, st->raw)) return 0;
+         }
+      }
+   }
+   // like the whole-image path, ignore extra data after the last row
+   return 1;
+}
+
+// zrefill callback: next piece of the current IDAT, or of the IDAT after it
+static void stbi__png_stream_refill(stbi__zbuf *a)
+{
+   stbi__png_stream *st = (stbi__png_stream *) a->zuser;
+   stbi__context *s = st->z->s;
+   stbi__uint32 n;
+
+   while (st->idat_left == 0) {
+      if (st->idat_done) return;
+      stbi__get32be(s); // CRC of the finished IDAT
+      st->next = stbi__get_chunk_header(s);
+      if (st->next.type != STBI__PNG_TYPE('I','D','A','T')) {
+         st->idat_done = 1;
+         return;
+      }
+      st->idat_left = st->next.length;
+   }
+   n = st->idat_left < sizeof(st->in) ? st->idat_left : (stbi__uint32) sizeof(st->in);
+   if (!stbi__getn(s, st->in, n)) {
+      st->idat_left = 0;
+      st->idat_done = 1;
+      st->next.type = st->next.length = 0;
+      return;
+   }
+   st->idat_left -= n;
+   a->zbuffer = st->in;
+   a->zbuffer_end = st->in + n;
+}
+
+// decodes the IDAT run starting with a chunk of idat_len bytes; on success the
+// context is positioned after the header of the following chunk, st->next
+static int stbi__png_stream_idat(stbi__png_stream *st, stbi__uint32 idat_len, int parse_header)
+{
+   stbi__context *s = st->z->s;
+   stbi__png_rowfmt *f = &st->f;
+   stbi__zbuf a;
+   char *window;
+   int ok = 0;
+
+   if (!stbi__mad3sizes_valid(f->img_n, f->x, f->depth, 7)) return stbi__err("too large", "Corrupt PNG");
+   if (!stbi__row_sink_begin(st->z->sink, s->img_x, s->img_y, st->req_comp ? st->req_comp : (st->pal_n ? st->pal_n : f->out_n)))
+      return 0;
+
+   st->row_bytes  = f->img_width_bytes + 1;
+   st->raw        = (stbi_uc *) stbi__malloc(st->row_bytes);
+   st->filter_buf = (stbi_uc *) stbi__malloc_mad2(f->img_width_bytes, 2, 0);
+   st->out        = (stbi_uc *) stbi__malloc_mad2(f->x, 8, 0); // any row is at most 4 channels of 16 bits
+   st->pal        = (stbi_uc *) stbi__malloc_mad2(f->x, 4, 0);
+   st->conv       = (stbi_uc *) stbi__malloc_mad2(f->x, 8, 0);
+   window         = (char *) stbi__malloc(STBI_PNG_STREAM_WINDOW);
+
+   if (st->raw && st->filter_buf && st->out && st->pal && st->conv && window) {
+      memset(&a, 0, sizeof(a));
+      a.zbuffer = a.zbuffer_end = st->in;
+      a.zout_start = a.zout = a.zflushed = window;
+      a.zout_end = window + STBI_PNG_STREAM_WINDOW;
+      a.z_expandable = 1;
+      a.zrefill = stbi__png_stream_refill;
+      a.zflush  = stbi__png_stream_bytes;
+      a.zuser   = st;
+      st->idat_left = idat_len;
+      if (stbi__parse_zlib(&a, parse_header) && stbi__png_stream_bytes(st, (stbi_uc *) a.zflushed, (int) (a.zout - a.zflushed))) {
+         if (st->y < s->img_y)
+            (void) stbi__err("not enough pixels","Corrupt PNG");
+         else
+            ok = 1;
+      }
+      window = a.zout_start; // stbi__zexpand may have moved it
+   } else {
+      (void) stbi__err("outofmem", "Out of memory");
+   }
+
+   STBI_FREE(window);
+   STBI_FREE(st->raw);
+   STBI_FREE(st->filter_buf);
+   STBI_FREE(st->out);
+   STBI_FREE(st->pal);
+   STBI_FREE(st->conv);
+   if (!ok) return 0;
+
+   // skip the rest of the IDAT run so the chunk loop can carry on after it
+   stbi__skip(s, st->idat_left);
+   while (!st->idat_done) {
+      stbi__get32be(s); // CRC
+      st->next = stbi__get_chunk_header(s);
+      if (st->next.type != STBI__PNG_TYPE('I','D','A','T'))
+         st->idat_done = 1;
+      else
+         stbi__skip(s, st->next.length);
+   }
+   return 1;
+}
+
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 {
    stbi_uc palette[1024], pal_img_n=0;
@@ -5082,6 +6251,8 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    stbi__uint16 tc16[3];
    stbi__uint32 ioff=0, idata_limit=0, i, pal_len=0;
    int first=1,k,interlace=0, color=0, is_iphone=0;
+   int streamed=0, has_pending=0;
+   stbi__pngchunk pending;
    stbi__context *s = z->s;
 
    z->expanded = NULL;
@@ -5093,7 +6264,14 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    if (scan == STBI__SCAN_type) return 1;
 
    for (;;) {
-      stbi__pngchunk c = stbi__get_chunk_header(s);
+      stbi__pngchunk c;
+      if (has_pending) {
+         // the row streamer already read this chunk's header, and the CRC before it
+         c = pending;
+         has_pending = 0;
+      } else {
+         c = stbi__get_chunk_header(s);
+      }
       switch (c.type) {
          case STBI__PNG_TYPE('C','g','B','I'):
             is_iphone = 1;
@@ -5180,6 +6358,30 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                return 1;
             }
             if (c.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
+            if (streamed) { stbi__skip(s, c.length); break; }
+            if (z->sink && !interlace && scan == STBI__SCAN_load) {
+               stbi__png_stream st;
+               memset(&st, 0, sizeof(st));
+               st.z = z;
+               st.req_comp = req_comp;
+               st.is_iphone = is_iphone;
+               st.has_trans = has_trans;
+               st.palette = palette;
+               st.tc = tc;
+               st.tc16 = tc16;
+               if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
+                  s->img_out_n = s->img_n+1;
+               else
+                  s->img_out_n = s->img_n;
+               if (pal_img_n)
+                  st.pal_n = req_comp >= 3 ? req_comp : pal_img_n;
+               stbi__png_init_rowfmt(&st.f, s->img_x, s->img_n, s->img_out_n, z->depth, color);
+               if (!stbi__png_stream_idat(&st, c.length, !is_iphone)) return 0;
+               streamed = 1;
+               pending = st.next;
+               has_pending = 1;
+               continue;
+            }
             if ((int)(ioff + c.length) < (int)ioff) return 0;
             if (ioff + c.length > idata_limit) {
                stbi__uint32 idata_limit_old = idata_limit;
@@ -5200,6 +6402,16 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             stbi__uint32 raw_len, bpl;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
+            if (streamed) {
+               if (pal_img_n) {
+                  s->img_n = pal_img_n;
+                  s->img_out_n = req_comp >= 3 ? req_comp : pal_img_n;
+               } else if (has_trans) {
+                  ++s->img_n;
+               }
+               stbi__get32be(s);
+               return 1;
+            }
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
@@ -5214,13 +6426,13 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
-                  if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency16((stbi__uint16 *) z->out, s->img_x * s->img_y, tc16, s->img_out_n)) return 0;
                } else {
-                  if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency(z->out, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
                }
             }
             if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
-               stbi__de_iphone(z);
+               stbi__de_iphone(z->out, s->img_x * s->img_y, s->img_out_n);
             if (pal_img_n) {
                // pal_img_n == 3 or 4
                s->img_n = pal_img_n; // record the actual colors we had
@@ -5275,9 +6487,9 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
       p->out = NULL;
       if (req_comp && req_comp != p->s->img_out_n) {
          if (ri->bits_per_channel == 8)
-            result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
+            result = stbi__convert_format(p->s, (unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
          else
-            result = stbi__convert_format16((stbi__uint16 *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
+            result = stbi__convert_format16(p->s, (stbi__uint16 *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
          p->s->img_out_n = req_comp;
          if (result == NULL) return result;
       }
@@ -5296,9 +6508,47 @@ static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req
 {
    stbi__png p;
    p.s = s;
+   p.sink = NULL;
    return stbi__do_png(&p, x,y,comp,req_comp, ri);
 }
 
+static int stbi__png_load_rows(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__row_sink *sink)
+{
+   stbi__png p;
+   int ok = 0;
+   p.s = s;
+   p.sink = sink;
+   if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   if (stbi__parse_png_file(&p, STBI__SCAN_load, req_comp)) {
+      ok = 1;
+      if (p.out) {
+         // interlaced, so it went through the whole-image path; hand its rows
+         // through the same final conversion the streamed rows get
+         stbi__png_stream st;
+         stbi__uint32 j, n = s->img_out_n, row_bytes = s->img_x * n * (p.depth == 16 ? 2 : 1);
+         memset(&st, 0, sizeof(st));
+         st.z = &p;
+         st.req_comp = req_comp;
+         st.f.x = s->img_x;
+         st.f.depth = p.depth;
+         st.conv = (stbi_uc *) stbi__malloc_mad2(s->img_x, 8, 0);
+         ok = st.conv && stbi__row_sink_begin(sink, s->img_x, s->img_y, req_comp ? req_comp : (int) n);
+         for (j=0; ok && j < s->img_y; ++j)
+            ok = stbi__png_emit_row(&st, p.out + j*row_bytes, n);
+         STBI_FREE(st.conv);
+      }
+      if (ok) {
+         *x = s->img_x;
+         *y = s->img_y;
+         if (comp) *comp = s->img_n;
+      }
+   }
+   STBI_FREE(p.out);      p.out      = NULL;
+   STBI_FREE(p.expanded); p.expanded = NULL;
+   STBI_FREE(p.idata);    p.idata    = NULL;
+   return ok;
+}
+
 static int stbi__png_test(stbi__context *s)
 {
    int r;
@@ -5323,6 +6573,7 @@ static int stbi__png_info(stbi__context *s, int *x, int *y, int *comp)
 {
    stbi__png p;
    p.s = s;
+   p.sink = NULL;
    return stbi__png_info_raw(&p, x, y, comp);
 }
 
@@ -5330,6 +6581,7 @@ static int stbi__png_is16(stbi__context *s)
 {
    stbi__png p;
    p.s = s;
+   p.sink = NULL;
    if (!stbi__png_info_raw(&p, NULL, NULL, NULL))
 	   return 0;
    if (p.depth != 16) {
@@ -5721,7 +6973,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    }
 
    if (req_comp && req_comp != target) {
-      out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
+      out = stbi__convert_format(s, out, target, req_comp, s->img_x, s->img_y);
       if (out == NULL) return out; // stbi__convert_format frees input on failure
    }
 
@@ -6062,7 +7314,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 
    // convert to target component count
    if (req_comp && req_comp != tga_comp)
-      tga_data = stbi__convert_format(tga_data, tga_comp, req_comp, tga_width, tga_height);
+      tga_data = stbi__convert_format(s, tga_data, tga_comp, req_comp, tga_width, tga_height);
 
    //   the things I do to get rid of an error message, and yet keep
    //   Microsoft's C compilers happy... [8^(
@@ -6311,9 +7563,9 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
    // convert to desired output format
    if (req_comp && req_comp != 4) {
       if (ri->bits_per_channel == 16)
-         out = (stbi_uc *) stbi__convert_format16((stbi__uint16 *) out, 4, req_comp, w, h);
+         out = (stbi_uc *) stbi__convert_format16(s, (stbi__uint16 *) out, 4, req_comp, w, h);
       else
-         out = stbi__convert_format(out, 4, req_comp, w, h);
+         out = stbi__convert_format(s, out, 4, req_comp, w, h);
       if (out == NULL) return out; // stbi__convert_format frees input on failure
    }
 
@@ -6533,7 +7785,7 @@ static void *stbi__pic_load(stbi__context *s,int *px,int *py,int *comp,int req_c
    *px = x;
    *py = y;
    if (req_comp == 0) req_comp = *comp;
-   result=stbi__convert_format(result,4,req_comp,x,y);
+   result=stbi__convert_format(s, result,4,req_comp,x,y);
 
    return result;
 }
@@ -7020,7 +8272,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
             }
             memcpy( out + ((layers - 1) * stride), u, stride );
             if (layers >= 2) {
-               two_back = out - 2 * stride;
+               two_back = out + (layers - 2) * stride; // the frame before the one just added
             }
 
             if (delays) {
@@ -7036,7 +8288,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
 
       // do the final conversion after loading everything;
       if (req_comp && req_comp != 4)
-         out = stbi__convert_format(out, 4, req_comp, layers * g.w, g.h);
+         out = stbi__convert_format(s, out, 4, req_comp, layers * g.w, g.h);
 
       *z = layers;
       return out;
@@ -7061,7 +8313,7 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req
       // moved conversion to after successful load so that the same
       // can be done for multiple frames.
       if (req_comp && req_comp != 4)
-         u = stbi__convert_format(u, 4, req_comp, g.w, g.h);
+         u = stbi__convert_format(s, u, 4, req_comp, g.w, g.h);
    } else if (g.out) {
       // if there was an error and we allocated an image buffer, free it!
       STBI_FREE(g.out);
@@ -7078,6 +8330,140 @@ static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
    return stbi__gif_info_raw(s,x,y,comp);
 }
+
+struct stbi__gif_stream
+{
+   stbi__context s;
+   stbi__gif g;
+   stbi_uc *prev, *prev2; // the last two frames returned, for "restore to previous" disposal
+   int frames, done;
+
+   stbi_uc const *buffer; // source, for rewinding
+   int len;
+   #ifndef STBI_NO_STDIO
+   FILE *f;
+   long f_start;
+   #endif
+};
+
+static void stbi__gif_stream_reset(stbi_gif_stream *gs)
+{
+   STBI_FREE(gs->g.out);
+   STBI_FREE(gs->g.background);
+   STBI_FREE(gs->g.history);
+   memset(&gs->g, 0, sizeof(gs->g));
+   gs->frames = gs->done = 0;
+
+   #ifndef STBI_NO_STDIO
+   if (gs->f) {
+      fseek(gs->f, gs->f_start, SEEK_SET);
+      stbi__start_file(&gs->s, gs->f);
+      return;
+   }
+   #endif
+   stbi__start_mem(&gs->s, gs->buffer, gs->len);
+}
+
+// gs->s must already be started on the source
+static stbi_gif_stream *stbi__gif_stream_open(stbi_gif_stream *gs, int *x, int *y)
+{
+   int w, h;
+   if (!stbi__gif_info_raw(&gs->s, &w, &h, NULL)) {
+      stbi_gif_stream_close(gs);
+      return NULL;
+   }
+   // stbi__gif_info_raw leaves the header consumed; start over for the first frame
+   stbi__gif_stream_reset(gs);
+   gs->prev  = (stbi_uc *) stbi__malloc_mad3(w, h, 4, 0);
+   gs->prev2 = (stbi_uc *) stbi__malloc_mad3(w, h, 4, 0);
+   if (!gs->prev || !gs->prev2) {
+      stbi_gif_stream_close(gs);
+      return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   if (x) *x = w;
+   if (y) *y = h;
+   return gs;
+}
+
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y)
+{
+   stbi_gif_stream *gs = (stbi_gif_stream *) stbi__malloc(sizeof(stbi_gif_stream));
+   if (!gs) return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(gs, 0, sizeof(*gs));
+   gs->buffer = buffer;
+   gs->len = len;
+   stbi__start_mem(&gs->s, buffer, len);
+   return stbi__gif_stream_open(gs, x, y);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open(char const *filename, int *x, int *y)
+{
+   stbi_gif_stream *gs;
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return (stbi_gif_stream *) stbi__errpuc("can't fopen", "Unable to open file");
+   gs = (stbi_gif_stream *) stbi__malloc(sizeof(stbi_gif_stream));
+   if (!gs) {
+      fclose(f);
+      return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   memset(gs, 0, sizeof(*gs));
+   gs->f = f;
+   gs->f_start = ftell(f);
+   stbi__start_file(&gs->s, f);
+   return stbi__gif_stream_open(gs, x, y);
+}
+#endif
+
+STBIDEF int stbi_gif_stream_next(stbi_gif_stream *gs, stbi_uc *rgba, int *delay_ms)
+{
+   stbi_uc *u, *t;
+   size_t stride;
+   int comp;
+
+   if (gs->done) return 0;
+   u = stbi__gif_load_next(&gs->s, &gs->g, &comp, 4, gs->frames >= 2 ? gs->prev2 : NULL);
+   if (u == (stbi_uc *) &gs->s) { // end of animated gif marker
+      gs->done = 1;
+      return 0;
+   }
+   if (!u) {
+      gs->done = 1;
+      return -1;
+   }
+
+   // keep this frame as history; the older one becomes two back
+   stride = (size_t) gs->g.w * gs->g.h * 4;
+   t = gs->prev2; gs->prev2 = gs->prev; gs->prev = t;
+   memcpy(gs->prev, u, stride);
+   ++gs->frames;
+
+   memcpy(rgba, u, stride);
+   if (stbi__vertically_flip_on_load)
+      stbi__vertical_flip(rgba, gs->g.w, gs->g.h, 4);
+   if (delay_ms) *delay_ms = gs->g.delay;
+   return 1;
+}
+
+STBIDEF int stbi_gif_stream_rewind(stbi_gif_stream *gs)
+{
+   stbi__gif_stream_reset(gs);
+   return 1;
+}
+
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *gs)
+{
+   if (!gs) return;
+   STBI_FREE(gs->g.out);
+   STBI_FREE(gs->g.background);
+   STBI_FREE(gs->g.history);
+   STBI_FREE(gs->prev);
+   STBI_FREE(gs->prev2);
+   #ifndef STBI_NO_STDIO
+   if (gs->f) fclose(gs->f);
+   #endif
+   STBI_FREE(gs);
+}
 #endif
 
 // *************************************************************************************************
@@ -7128,12 +8514,22 @@ static char *stbi__hdr_gettoken(stbi__context *z, char *buffer)
    return buffer;
 }
 
+// 2^(e-136), the factor that turns an RGBE mantissa byte into a float, built
+// from its bits instead of calling ldexp; e=1..9 give denormals
+static float stbi__hdr_scale(int e)
+{
+   stbi__uint32 bits = e >= 10 ? (stbi__uint32) (e - 9) << 23 : (stbi__uint32) 1 << (e + 13);
+   float f;
+   memcpy(&f, &bits, 4);
+   return f;
+}
+
 static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
 {
    if ( input[3] != 0 ) {
       float f1;
       // Exponent
-      f1 = (float) ldexp(1.0f, input[3] - (int)(128 + 8));
+      f1 = stbi__hdr_scale(input[3]);
       if (req_comp <= 2)
          output[0] = (input[0] + input[1] + input[2]) * f1 / 3;
       else {
@@ -7155,7 +8551,60 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
    }
 }
 
-static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+// converts a decoded RGBE scanline of n pixels
+static void stbi__hdr_convert_row(float *output, stbi_uc *input, int n, int req_comp)
+{
+   int i = 0;
+#ifdef STBI_SSE2
+   if (req_comp >= 3 && stbi__sse2_available()) {
+      __m128i zero = _mm_setzero_si128();
+      __m128  rgb  = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+      __m128  one  = req_comp == 4 ? _mm_setr_ps(0, 0, 0, 1.0f) : _mm_setzero_ps();
+      // 3-channel stores write one float past the pixel, which the next
+      // store fixes; keep at least one pixel back for the scalar tail
+      int end = req_comp == 4 ? n - 3 : n - 4;
+      for (; i < end; i += 4) {
+         __m128i px = _mm_loadu_si128((__m128i const *) (input + i*4));
+         __m128i e  = _mm_srli_epi32(px, 24);
+         __m128i e0 = _mm_cmpeq_epi32(e, zero);
+         __m128i lo = _mm_unpacklo_epi8(px, zero);
+         __m128i hi = _mm_unpackhi_epi8(px, zero);
+         __m128 scale, p0, p1, p2, p3;
+         float *o = output + i*req_comp;
+
+         // denormal scales (e=1..9) take the scalar path
+         if (_mm_movemask_epi8(_mm_andnot_si128(e0, _mm_cmplt_epi32(e, _mm_set1_epi32(10))))) {
+            int k;
+            for (k=0; k < 4; ++k)
+               stbi__hdr_convert(o + k*req_comp, input + (i+k)*4, req_comp);
+            continue;
+         }
+         // e=0 pixels are black: zero their scale
+         scale = _mm_castsi128_ps(_mm_andnot_si128(e0, _mm_slli_epi32(_mm_sub_epi32(e, _mm_set1_epi32(9)), 23)));
+
+         p0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), _mm_shuffle_ps(scale, scale, 0x00));
+         p1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), _mm_shuffle_ps(scale, scale, 0x55));
+         p2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), _mm_shuffle_ps(scale, scale, 0xAA));
+         p3 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), _mm_shuffle_ps(scale, scale, 0xFF));
+         p0 = _mm_or_ps(_mm_and_ps(p0, rgb), one);
+         p1 = _mm_or_ps(_mm_and_ps(p1, rgb), one);
+         p2 = _mm_or_ps(_mm_and_ps(p2, rgb), one);
+         p3 = _mm_or_ps(_mm_and_ps(p3, rgb), one);
+
+         _mm_storeu_ps(o, p0);
+         _mm_storeu_ps(o + req_comp, p1);
+         _mm_storeu_ps(o + 2*req_comp, p2);
+         _mm_storeu_ps(o + 3*req_comp, p3);
+      }
+   }
+#endif
+   for (; i < n; ++i)
+      stbi__hdr_convert(output + i*req_comp, input + i*4, req_comp);
+}
+
+// decodes to floats, or with 'half' set straight to half floats a scanline at
+// a time, never holding the whole image as floats
+static void *stbi__hdr_load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, int half)
 {
    char buffer[STBI__HDR_BUFLEN];
    char *token;
@@ -7163,11 +8612,13 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    int width, height;
    stbi_uc *scanline;
    float *hdr_data;
+   float *row;       // where the current scanline's floats go
+   float *row_buf = NULL;
+   stbi__uint16 *half_data = NULL;
    int len;
    unsigned char count, value;
    int i, j, k, c1,c2, z;
    const char *headerToken;
-   STBI_NOTUSED(ri);
 
    // Check identifier
    headerToken = stbi__hdr_gettoken(s,buffer);
@@ -7207,21 +8658,36 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
       return stbi__errpf("too large", "HDR image is too large");
 
    // Read data
-   hdr_data = (float *) stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
-   if (!hdr_data)
-      return stbi__errpf("outofmem", "Out of memory");
+   if (half) {
+      half_data = (stbi__uint16 *) stbi__malloc_mad4(width, height, req_comp, 2, 0);
+      row_buf = (float *) stbi__malloc_mad3(width, req_comp, sizeof(float), 0);
+      if (!half_data || !row_buf) {
+         STBI_FREE(half_data); STBI_FREE(row_buf);
+         return stbi__errpf("outofmem", "Out of memory");
+      }
+      hdr_data = NULL;
+   } else {
+      hdr_data = (float *) stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
+      if (!hdr_data)
+         return stbi__errpf("outofmem", "Out of memory");
+   }
+   #define STBI__HDR_ROW(j)       (half ? row_buf : hdr_data + (j) * width * req_comp)
+   #define STBI__HDR_ROW_DONE(j)  if (half) stbi__float_to_half_row(half_data + (j) * width * req_comp, row_buf, width * req_comp)
+   #define STBI__HDR_FAIL()       { STBI_FREE(hdr_data); STBI_FREE(half_data); STBI_FREE(row_buf); }
 
    // Load image data
    // image data is stored as some number of sca
    if ( width < 8 || width >= 32768) {
       // Read flat data
       for (j=0; j < height; ++j) {
+         row = STBI__HDR_ROW(j);
          for (i=0; i < width; ++i) {
             stbi_uc rgbe[4];
            main_decode_loop:
             stbi__getn(s, rgbe, 4);
-            stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
+            stbi__hdr_convert(row + i * req_comp, rgbe, req_comp);
          }
+         STBI__HDR_ROW_DONE(j);
       }
    } else {
       // Read RLE-encoded data
@@ -7239,7 +8705,8 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             rgbe[1] = (stbi_uc) c2;
             rgbe[2] = (stbi_uc) len;
             rgbe[3] = (stbi_uc) stbi__get8(s);
-            stbi__hdr_convert(hdr_data, rgbe, req_comp);
+            row = STBI__HDR_ROW(0);
+            stbi__hdr_convert(row, rgbe, req_comp);
             i = 1;
             j = 0;
             STBI_FREE(scanline);
@@ -7247,11 +8714,11 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
          }
          len <<= 8;
          len |= stbi__get8(s);
-         if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
+         if (len != width) { STBI__HDR_FAIL(); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
          if (scanline == NULL) {
             scanline = (stbi_uc *) stbi__malloc_mad2(width, 4, 0);
             if (!scanline) {
-               STBI_FREE(hdr_data);
+               STBI__HDR_FAIL();
                return stbi__errpf("outofmem", "Out of memory");
             }
          }
@@ -7265,27 +8732,40 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
                   // Run
                   value = stbi__get8(s);
                   count -= 128;
-                  if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+                  if ((count == 0) || (count > nleft)) { STBI__HDR_FAIL(); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
                   for (z = 0; z < count; ++z)
                      scanline[i++ * 4 + k] = value;
                } else {
                   // Dump
-                  if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+                  if ((count == 0) || (count > nleft)) { STBI__HDR_FAIL(); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
                   for (z = 0; z < count; ++z)
                      scanline[i++ * 4 + k] = stbi__get8(s);
                }
             }
          }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+         stbi__hdr_convert_row(STBI__HDR_ROW(j), scanline, width, req_comp);
+         STBI__HDR_ROW_DONE(j);
       }
       if (scanline)
          STBI_FREE(scanline);
    }
+   #undef STBI__HDR_ROW
+   #undef STBI__HDR_ROW_DONE
+   #undef STBI__HDR_FAIL
 
+   if (half) {
+      STBI_FREE(row_buf);
+      return half_data;
+   }
    return hdr_data;
 }
 
+static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+{
+   STBI_NOTUSED(ri);
+   return (float *) stbi__hdr_load_main(s, x, y, comp, req_comp, 0);
+}
+
 static int stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp)
 {
    char buffer[STBI__HDR_BUFLEN];
@@ -7531,9 +9011,9 @@ static void *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int req
 
    if (req_comp && req_comp != s->img_n) {
       if (ri->bits_per_channel == 16) {
-         out = (stbi_uc *) stbi__convert_format16((stbi__uint16 *) out, s->img_n, req_comp, s->img_x, s->img_y);
+         out = (stbi_uc *) stbi__convert_format16(s, (stbi__uint16 *) out, s->img_n, req_comp, s->img_x, s->img_y);
       } else {
-         out = stbi__convert_format(out, s->img_n, req_comp, s->img_x, s->img_y);
+         out = stbi__convert_format(s, out, s->img_n, req_comp, s->img_x, s->img_y);
       }
       if (out == NULL) return out; // stbi__convert_format frees input on failure
    }
@@ -7629,8 +9109,52 @@ static int stbi__pnm_is16(stbi__context *s)
 }
 #endif
 
+// routes to the one header parser the leading magic bytes name, instead of
+// letting each format's info routine reject the file in turn. returns -1 when
+// the bytes name no format (TGA has no magic) or that parser failed, so the
+// caller can still fall back to trying every format
+static int stbi__info_by_magic(stbi__context *s, int *x, int *y, int *comp)
+{
+   stbi_uc const *m = s->img_buffer;
+   int r = -1;
+   if (s->img_buffer_end - s->img_buffer < 4) return -1;
+
+   switch (m[0]) {
+      #ifndef STBI_NO_JPEG
+      case 0xFF: r = stbi__jpeg_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_PNG
+      case 0x89: if (m[1] == 'P' && m[2] == 'N' && m[3] == 'G') r = stbi__png_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_GIF
+      case 'G':  if (m[1] == 'I' && m[2] == 'F' && m[3] == '8') r = stbi__gif_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_BMP
+      case 'B':  if (m[1] == 'M') r = stbi__bmp_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_PSD
+      case '8':  if (m[1] == 'B' && m[2] == 'P' && m[3] == 'S') r = stbi__psd_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_PIC
+      case 0x53: if (m[1] == 0x80 && m[2] == 0xF6 && m[3] == 0x34) r = stbi__pic_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_PNM
+      case 'P':  if (m[1] == '5' || m[1] == '6') r = stbi__pnm_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_HDR
+      case '#':  if (m[1] == '?') r = stbi__hdr_info(s, x, y, comp); break;
+      #endif
+      default: break;
+   }
+   if (r > 0) return 1; // pnm_info returns the bit depth
+   if (r == 0) stbi__rewind(s);
+   return -1;
+}
+
 static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
 {
+   if (stbi__info_by_magic(s, x, y, comp) == 1) return 1;
+
    #ifndef STBI_NO_JPEG
    if (stbi__jpeg_info(s, x, y, comp)) return 1;
    #endif
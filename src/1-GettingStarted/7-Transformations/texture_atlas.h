@@ -0,0 +1,349 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+// Packs many small RGBA images (sprites, UI icons) into a few large pages so
+// they can all be drawn from one texture bind instead of one texture each.
+//
+// Sprites are placed with MaxRects (best short side fit), largest first, and
+// each one gets a border of its own edge texels ("bleeding") so bilinear
+// filtering never pulls in a neighbour. With mip_levels > 0 every sprite cell
+// is also aligned to 2^mip_levels texels, so the first mip_levels mips of a
+// page still keep each sprite's texels apart. The pages become the layers of
+// one GL_TEXTURE_2D_ARRAY:
+//
+//   TextureAtlas atlas(2048, 2, 2);
+//   int icon = atlas.add("./resources/textures/awesomeface.png");
+//   atlas.build();
+//   atlas.upload();
+//   atlas.remapTexcoords(icon, vertices, vertex_count, 8, 6); // uv at float 6 of 8
+//   // sample with a sampler2DArray at layer atlas.rect(icon).page
+//
+// Needs stb_image.h compiled somewhere with STB_IMAGE_IMPLEMENTATION.
+
+#include <glad/glad.h>
+#include "stb_image.h"
+#include "asset_bundle.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// where a sprite ended up: its texels on the page and the matching UVs
+struct AtlasRect {
+  int   page {-1}; // -1 when the sprite could not be placed
+  int   x {0};
+  int   y {0};
+  int   width  {0};
+  int   height {0};
+  float u0 {0.0f};
+  float v0 {0.0f};
+  float u1 {0.0f};
+  float v1 {0.0f};
+};
+
+class TextureAtlas {
+  public:
+    unsigned int texture_array {0};
+    double       seconds {0.0}; // wall time of the last build
+
+    // page_size should be a power of two; padding is the bled border, in
+    // texels, around every sprite
+    explicit TextureAtlas(int page_size = 2048, int padding = 2, int mip_levels = 0)
+      : page_size(page_size), padding(padding), alignment(1 << std::max(0, mip_levels)) {}
+
+    ~TextureAtlas() {
+      if (texture_array) glDeleteTextures(1, &texture_array);
+    }
+
+    TextureAtlas(const TextureAtlas&) = delete;
+    TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+    // Decode an image (from the mounted bundle if it has it; stb's flip
+    // setting applies) as RGBA and queue it for the next build. Returns its
+    // sprite index, or -1 if it failed to load.
+    int add(const char* path) {
+      int width, height, file_channels;
+      AssetData bundled;
+      unsigned char* data = AssetBundle::readMounted(path, bundled)
+        ? stbi_load_from_memory(bundled.data, (int)bundled.size, &width, &height, &file_channels, 4)
+        : stbi_load(path, &width, &height, &file_channels, 4);
+      if (!data) {
+        std::cerr << "ERROR::TEXTURE_ATLAS::IMAGE_NOT_LOADED " << path << " " << stbi_failure_reason() << std::endl;
+        return -1;
+      }
+      int sprite = add(data, width, height);
+      stbi_image_free(data);
+      return sprite;
+    }
+
+    // queue tightly packed RGBA pixels (copied)
+    int add(const unsigned char* rgba, int width, int height) {
+      if (!rgba || width <= 0 || height <= 0) {
+        std::cerr << "ERROR::TEXTURE_ATLAS::INVALID_IMAGE" << std::endl;
+        return -1;
+      }
+      Sprite sprite;
+      sprite.width  = width;
+      sprite.height = height;
+      sprite.pixels.assign(rgba, rgba + (size_t)width * height * 4);
+      sprites.push_back(std::move(sprite));
+      rects.push_back(AtlasRect());
+      return (int)sprites.size() - 1;
+    }
+
+    // Pack every queued sprite and compose the pages. Sprites too big for a
+    // page are reported and left with page -1. Returns false if any were.
+    bool build() {
+      auto start = std::chrono::steady_clock::now();
+      pages.clear();
+
+      // largest first: the big ones are hardest to fit later on
+      std::vector<int> order(sprites.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        int side_a = std::max(cellWidth(a), cellHeight(a));
+        int side_b = std::max(cellWidth(b), cellHeight(b));
+        if (side_a != side_b) return side_a > side_b;
+        return cellWidth(a) * cellHeight(a) > cellWidth(b) * cellHeight(b);
+      });
+
+      bool all_placed = true;
+      for (int sprite : order) {
+        int w = cellWidth(sprite), h = cellHeight(sprite);
+        AtlasRect& rect = rects[sprite];
+        rect = AtlasRect();
+        if (w > page_size || h > page_size) {
+          std::cerr << "ERROR::TEXTURE_ATLAS::SPRITE_TOO_LARGE " << sprites[sprite].width << "x"
+                    << sprites[sprite].height << " for pages of " << page_size << std::endl;
+          all_placed = false;
+          continue;
+        }
+
+        // try the existing pages in order, then open a new one
+        int x = 0, y = 0;
+        size_t page = 0;
+        for (; page < pages.size(); ++page)
+          if (pages[page].insert(w, h, x, y)) break;
+        if (page == pages.size()) {
+          pages.emplace_back(page_size);
+          pages.back().insert(w, h, x, y);
+        }
+
+        rect.page   = (int)page;
+        rect.x      = x + padding;
+        rect.y      = y + padding;
+        rect.width  = sprites[sprite].width;
+        rect.height = sprites[sprite].height;
+        rect.u0 = (float)rect.x / page_size;
+        rect.v0 = (float)rect.y / page_size;
+        rect.u1 = (float)(rect.x + rect.width) / page_size;
+        rect.v1 = (float)(rect.y + rect.height) / page_size;
+        blit(sprite, pages[page], x, y, w, h);
+      }
+
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      return all_placed;
+    }
+
+    // Upload the pages as the layers of a GL_TEXTURE_2D_ARRAY (bound on the
+    // active unit) with a full mip chain.
+    void upload() {
+      if (pages.empty()) return;
+      if (!texture_array) glGenTextures(1, &texture_array);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, page_size, page_size, (GLsizei)pages.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      for (size_t i = 0; i < pages.size(); ++i)
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, page_size, page_size, 1, GL_RGBA, GL_UNSIGNED_BYTE, pages[i].pixels.data());
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      if (alignment > 1) {
+        // only the mips the cells were aligned for are free of neighbours
+        int max_level = 0;
+        while ((2 << max_level) <= alignment) ++max_level;
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, max_level);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+      } else {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      }
+    }
+
+    void bind(unsigned int texture_unit) const {
+      glActiveTexture(GL_TEXTURE0 + texture_unit);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+    }
+
+    const AtlasRect& rect(int sprite) const {
+      return rects[sprite];
+    }
+
+    // the UV-rect table, indexed by sprite
+    const std::vector<AtlasRect>& uvTable() const {
+      return rects;
+    }
+
+    // Map the 0..1 texcoords of vertex_count vertices onto sprite's rect.
+    // stride and uv_offset are counted in floats, like the attribute pointers.
+    void remapTexcoords(int sprite, float* vertices, size_t vertex_count, size_t stride, size_t uv_offset) const {
+      const AtlasRect& r = rects[sprite];
+      float du = r.u1 - r.u0, dv = r.v1 - r.v0;
+      float* uv = vertices + uv_offset;
+      for (size_t i = 0; i < vertex_count; ++i, uv += stride) {
+        uv[0] = r.u0 + uv[0] * du;
+        uv[1] = r.v0 + uv[1] * dv;
+      }
+    }
+
+    int pageCount() const {
+      return (int)pages.size();
+    }
+
+    // share of the page texels covered by sprite texels (padding excluded)
+    double efficiency() const {
+      if (pages.empty()) return 0.0;
+      double used = 0.0;
+      for (const AtlasRect& r : rects)
+        if (r.page >= 0) used += (double)r.width * r.height;
+      return used / ((double)page_size * page_size * pages.size());
+    }
+
+    void printStats() const {
+      std::cout << "INFO::TEXTURE_ATLAS::" << sprites.size() << " sprites on " << pages.size() << " pages of "
+                << page_size << "x" << page_size << ", " << efficiency() * 100.0 << "% used, built in "
+                << seconds * 1000.0 << " ms" << std::endl;
+    }
+
+  private:
+    struct Sprite {
+      int width  {0};
+      int height {0};
+      std::vector<unsigned char> pixels;
+    };
+
+    struct Rect {
+      int x, y, width, height;
+    };
+
+    // one page and the MaxRects free list of where it still has room
+    struct Page {
+      std::vector<Rect> free_rects;
+      std::vector<Rect> pieces; // scratch for place()
+      std::vector<unsigned char> pixels;
+
+      explicit Page(int size) : pixels((size_t)size * size * 4, 0) {
+        free_rects.push_back({0, 0, size, size});
+      }
+
+      // best short side fit: the free rect that leaves the least slack on
+      // its tighter side, ties broken by the other side
+      bool insert(int width, int height, int& x, int& y) {
+        int best_short = INT_MAX, best_long = INT_MAX;
+        for (const Rect& free : free_rects) {
+          if (free.width < width || free.height < height) continue;
+          int slack_w = free.width - width, slack_h = free.height - height;
+          int slack_short = std::min(slack_w, slack_h), slack_long = std::max(slack_w, slack_h);
+          if (slack_short < best_short || (slack_short == best_short && slack_long < best_long)) {
+            best_short = slack_short;
+            best_long  = slack_long;
+            x = free.x;
+            y = free.y;
+          }
+        }
+        if (best_short == INT_MAX) return false;
+
+        place({x, y, width, height});
+        return true;
+      }
+
+      // split every free rect the placed one overlaps into the (up to four)
+      // maximal rects around it; a piece inside another free rect is dropped,
+      // as is any free rect inside a piece. Only the pieces need checking,
+      // the rest of the list was already free of nested rects.
+      void place(const Rect& used) {
+        pieces.clear();
+        for (size_t i = 0; i < free_rects.size();) {
+          Rect free = free_rects[i];
+          if (used.x >= free.x + free.width || used.x + used.width <= free.x ||
+              used.y >= free.y + free.height || used.y + used.height <= free.y) {
+            ++i;
+            continue;
+          }
+          if (used.x > free.x)
+            pieces.push_back({free.x, free.y, used.x - free.x, free.height});
+          if (used.x + used.width < free.x + free.width)
+            pieces.push_back({used.x + used.width, free.y, free.x + free.width - used.x - used.width, free.height});
+          if (used.y > free.y)
+            pieces.push_back({free.x, free.y, free.width, used.y - free.y});
+          if (used.y + used.height < free.y + free.height)
+            pieces.push_back({free.x, used.y + used.height, free.width, free.y + free.height - used.y - used.height});
+
+          free_rects[i] = free_rects.back();
+          free_rects.pop_back();
+        }
+
+        for (const Rect& piece : pieces) {
+          bool nested = std::any_of(free_rects.begin(), free_rects.end(), [&piece](const Rect& free) { return contains(free, piece); });
+          if (nested) continue;
+          for (size_t i = 0; i < free_rects.size();) {
+            if (contains(piece, free_rects[i])) {
+              free_rects[i] = free_rects.back();
+              free_rects.pop_back();
+            } else {
+              ++i;
+            }
+          }
+          free_rects.push_back(piece);
+        }
+      }
+
+      static bool contains(const Rect& outer, const Rect& inner) {
+        return inner.x >= outer.x && inner.y >= outer.y &&
+               inner.x + inner.width <= outer.x + outer.width &&
+               inner.y + inner.height <= outer.y + outer.height;
+      }
+    };
+
+    int page_size;
+    int padding;
+    int alignment; // cell sizes (and so positions) are multiples of this
+    std::vector<Sprite>    sprites;
+    std::vector<AtlasRect> rects;
+    std::vector<Page>      pages;
+
+    int cellWidth(int sprite) const {
+      return roundUp(sprites[sprite].width + 2 * padding);
+    }
+
+    int cellHeight(int sprite) const {
+      return roundUp(sprites[sprite].height + 2 * padding);
+    }
+
+    int roundUp(int size) const {
+      return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // copy a sprite into its cell, filling the rest of the cell with the
+    // nearest edge texel so filtering across the border sees the sprite
+    void blit(int sprite, Page& page, int cell_x, int cell_y, int cell_w, int cell_h) const {
+      const Sprite& s = sprites[sprite];
+      for (int y = 0; y < cell_h; ++y) {
+        int sy = std::min(std::max(y - padding, 0), s.height - 1);
+        const unsigned char* src = s.pixels.data() + (size_t)sy * s.width * 4;
+        unsigned char* dst = page.pixels.data() + ((size_t)(cell_y + y) * page_size + cell_x) * 4;
+
+        int left = std::min(padding, cell_w);
+        for (int x = 0; x < left; ++x)
+          std::memcpy(dst + x * 4, src, 4);
+        std::memcpy(dst + left * 4, src, (size_t)s.width * 4);
+        for (int x = left + s.width; x < cell_w; ++x)
+          std::memcpy(dst + x * 4, src + (size_t)(s.width - 1) * 4, 4);
+      }
+    }
+};
+#endif
@@ -0,0 +1,391 @@
+#ifndef TEXTURE_BUDGET_H
+#define TEXTURE_BUDGET_H
+
+// GL_TEXTURE_2D textures kept under a video memory budget.
+//
+// Every bind() stamps the texture with the current frame. update(), once per
+// frame, brings the textures back under budget, least recently used first:
+// their top mip levels are dropped down to a small resident tail (the
+// dropped levels are re-specified as 0x0 so the driver can free them, and
+// GL_TEXTURE_BASE_LEVEL keeps the texture complete without them), and only
+// when every idle texture is down to its tail are whole textures evicted.
+// Textures bound during the frame are never touched.
+//
+// When a texture that lost levels is bound again, its chain is re-read on a
+// worker thread (from the "<image>.mips" cache MipChain keeps) and the missing
+// levels are uploaded by a later update(), as many as fit in the budget.
+// Until then it is sampled from the levels it still has, or, when evicted,
+// not at all (texture 0 is bound). A chain that fails to load (say the
+// image was deleted) is retried after a number of frames that doubles with
+// each failure, and isn't counted as demand in the meantime.
+//
+//   TextureBudget textures(256 * 1024 * 1024);
+//   int crate = textures.add("./resources/textures/container.jpg");
+//   // each frame:
+//   textures.bind(crate, 0);
+//   ...draw...
+//   textures.update();
+//
+// Needs stb_image.h compiled somewhere with STB_IMAGE_IMPLEMENTATION.
+
+#include <glad/glad.h>
+#include "mip_chain.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TextureBudget {
+  public:
+    struct Stats {
+      size_t budget_bytes      {0};
+      size_t resident_bytes    {0};
+      size_t peak_bytes        {0};
+      size_t textures          {0};
+      size_t evicted_textures  {0}; // currently evicted
+      size_t level_drops       {0}; // top levels given up, in total
+      size_t evictions         {0}; // whole textures given up, in total
+      size_t levels_streamed   {0}; // levels uploaded back, in total
+      size_t pending_loads     {0}; // chains being re-read right now
+      size_t failed_loads      {0}; // chains that couldn't be re-read, in total
+      bool   over_budget       {false}; // last update() could not get under budget
+    };
+
+    static constexpr size_t RETRY_FRAMES     = 60;  // after a first failed load
+    static constexpr size_t MAX_RETRY_FRAMES = 3840;
+
+    // min_resident_size: levels at or below this size are never dropped
+    explicit TextureBudget(size_t budget_bytes, int min_resident_size = 64)
+      : min_resident_size(min_resident_size) {
+      stats.budget_bytes = budget_bytes;
+    }
+
+    ~TextureBudget() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      wake.notify_all();
+      if (worker.joinable()) worker.join();
+      release();
+    }
+
+    TextureBudget(const TextureBudget&) = delete;
+    TextureBudget& operator=(const TextureBudget&) = delete;
+
+    // Load path through MipChain (which also writes the cache that streaming
+    // reads back) and upload every level. Returns its id, or -1.
+    int add(const char* path, bool srgb = true) {
+      MipChain mips;
+      if (!mips.load(path, srgb)) return -1;
+
+      Entry entry;
+      entry.path      = path;
+      entry.srgb      = srgb;
+      entry.width     = mips.levels[0].width;
+      entry.height    = mips.levels[0].height;
+      entry.channels  = mips.channels;
+      entry.levels    = (int)mips.levels.size();
+      entry.last_used = frame;
+
+      glGenTextures(1, &entry.texture);
+      glBindTexture(GL_TEXTURE_2D, entry.texture);
+      mips.upload(GL_TEXTURE_2D);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+      entries.push_back(entry);
+      addResident(bytesFrom(entries.back(), 0));
+      ++stats.textures;
+      return (int)entries.size() - 1;
+    }
+
+    // Mark the texture used this frame and bind it to texture_unit.
+    void bind(int id, unsigned int texture_unit) {
+      Entry& entry = entries[id];
+      entry.last_used = frame;
+      glActiveTexture(GL_TEXTURE0 + texture_unit);
+      glBindTexture(GL_TEXTURE_2D, entry.texture);
+    }
+
+    // Once per frame, after the frame's draws: upload finished loads, get
+    // back under budget and start loads for textures used while degraded.
+    void update() {
+      uploadFinished();
+
+      // idle textures make way for the levels the used ones are missing
+      size_t demand = std::min(missingBytes(), stats.budget_bytes);
+      enforceBudget(stats.budget_bytes - demand);
+      stats.over_budget = stats.resident_bytes > stats.budget_bytes;
+
+      requestMissing();
+      ++frame;
+    }
+
+    void setBudget(size_t budget_bytes) {
+      stats.budget_bytes = budget_bytes;
+    }
+
+    // first level currently resident (0 when complete), or -1 when evicted
+    int residentBaseLevel(int id) const {
+      return entries[id].texture ? entries[id].base : -1;
+    }
+
+    const Stats& getStats() const { return stats; }
+
+    void printStats() const {
+      std::cout << "INFO::TEXTURE_BUDGET::" << stats.resident_bytes / 1024 << " / " << stats.budget_bytes / 1024
+                << " KB resident (peak " << stats.peak_bytes / 1024 << " KB) in " << stats.textures << " textures, "
+                << stats.evicted_textures << " evicted; " << stats.level_drops << " levels dropped, "
+                << stats.evictions << " evictions, " << stats.levels_streamed << " levels streamed back, "
+                << stats.pending_loads << " loads pending, " << stats.failed_loads << " failed"
+                << (stats.over_budget ? ", OVER BUDGET" : "") << std::endl;
+    }
+
+    // Delete every texture; call before the context goes away if this outlives it.
+    void release() {
+      for (Entry& entry : entries) {
+        if (entry.texture) glDeleteTextures(1, &entry.texture);
+        entry.texture = 0;
+      }
+      stats.resident_bytes = 0;
+    }
+
+  private:
+    struct Entry {
+      std::string  path;
+      bool         srgb      {true};
+      unsigned int texture   {0};   // 0 while evicted
+      int          width     {0};
+      int          height    {0};
+      int          channels  {0};
+      int          levels    {0};
+      int          base      {0};   // first resident level
+      bool         pending   {false};
+      size_t       last_used {0};   // frame of the last bind
+      size_t       retry_at  {0};   // frame a failed load may be tried again
+      size_t       backoff   {0};   // frames to wait after the next failure
+    };
+
+    struct Load {
+      int         id;
+      int         first_level; // levels to upload: first_level up to the resident ones
+      std::string path;
+      bool        srgb;
+      std::unique_ptr<MipChain> mips;
+    };
+
+    std::vector<Entry> entries;
+    size_t frame {0};
+    int    min_resident_size;
+    Stats  stats;
+
+    // worker thread re-reading chains; it only touches the queues (and the
+    // paths copied into them)
+    std::thread             worker;
+    std::mutex              mutex;
+    std::condition_variable wake;
+    std::deque<Load>        requests;
+    std::vector<Load>       finished;
+    bool                    stopping {false};
+
+    // texels of level as stored; RGB is assumed padded to RGBA
+    static size_t levelBytes(const Entry& entry, int level) {
+      size_t w = std::max(1, entry.width >> level), h = std::max(1, entry.height >> level);
+      return w * h * (entry.channels == 3 ? 4 : entry.channels);
+    }
+
+    static size_t bytesFrom(const Entry& entry, int first_level) {
+      size_t bytes = 0;
+      for (int level = first_level; level < entry.levels; ++level)
+        bytes += levelBytes(entry, level);
+      return bytes;
+    }
+
+    // the first level the tail starts at: the biggest no larger than min_resident_size
+    int tailLevel(const Entry& entry) const {
+      int level = 0;
+      while (level < entry.levels - 1 && std::max(entry.width >> level, entry.height >> level) > min_resident_size)
+        ++level;
+      return level;
+    }
+
+    void addResident(size_t bytes) {
+      stats.resident_bytes += bytes;
+      if (stats.resident_bytes > stats.peak_bytes) stats.peak_bytes = stats.resident_bytes;
+    }
+
+    // whether the texture was used this frame and may start a load
+    bool wantsLoad(const Entry& entry) const {
+      return !entry.pending && entry.last_used == frame && frame >= entry.retry_at;
+    }
+
+    // bytes of the levels that textures used this frame are missing
+    size_t missingBytes() const {
+      size_t bytes = 0;
+      for (const Entry& entry : entries)
+        if (wantsLoad(entry))
+          bytes += bytesFrom(entry, 0) - (entry.texture ? bytesFrom(entry, entry.base) : 0);
+      return bytes;
+    }
+
+    // drop levels of, then evict, idle textures until resident fits in limit
+    void enforceBudget(size_t limit) {
+      if (stats.resident_bytes <= limit) return;
+
+      // idle textures, least recently used first
+      std::vector<int> idle;
+      for (size_t i = 0; i < entries.size(); ++i)
+        if (entries[i].texture && entries[i].last_used < frame) idle.push_back((int)i);
+      std::stable_sort(idle.begin(), idle.end(), [this](int a, int b) { return entries[a].last_used < entries[b].last_used; });
+
+      // first their top levels, down to the tail
+      for (int id : idle) {
+        Entry& entry = entries[id];
+        int tail = tailLevel(entry);
+        if (entry.base >= tail) continue;
+        glBindTexture(GL_TEXTURE_2D, entry.texture);
+        while (entry.base < tail && stats.resident_bytes > limit) {
+          dropLevel(entry);
+          ++stats.level_drops;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.base);
+        if (stats.resident_bytes <= limit) return;
+      }
+
+      // then the textures themselves
+      for (int id : idle) {
+        Entry& entry = entries[id];
+        stats.resident_bytes -= bytesFrom(entry, entry.base);
+        glDeleteTextures(1, &entry.texture);
+        entry.texture = 0;
+        ++stats.evictions;
+        ++stats.evicted_textures;
+        if (stats.resident_bytes <= limit) return;
+      }
+    }
+
+    // free the image of the top resident level (texture bound)
+    void dropLevel(Entry& entry) {
+      GLenum format;
+      GLint internal_format;
+      MipChain::glFormats(entry.channels, false, format, internal_format);
+      glTexImage2D(GL_TEXTURE_2D, entry.base, internal_format, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+      stats.resident_bytes -= levelBytes(entry, entry.base);
+      ++entry.base;
+    }
+
+    // textures used this frame without all their levels: ask for as many
+    // as fit in what the budget has left
+    void requestMissing() {
+      size_t room = stats.resident_bytes < stats.budget_bytes ? stats.budget_bytes - stats.resident_bytes : 0;
+      for (size_t i = 0; i < entries.size(); ++i) {
+        Entry& entry = entries[i];
+        if (!wantsLoad(entry)) continue;
+        if (entry.texture && entry.base == 0) continue;
+
+        int resident_from = entry.texture ? entry.base : entry.levels;
+        int first = resident_from;
+        size_t need = 0;
+        while (first > 0 && need + levelBytes(entry, first - 1) <= room) {
+          --first;
+          need += levelBytes(entry, first);
+        }
+        // an evicted texture comes back with at least its tail
+        if (!entry.texture) first = std::min(first, tailLevel(entry));
+        if (first == resident_from) continue;
+
+        room -= std::min(room, need);
+        entry.pending = true;
+        ++stats.pending_loads;
+        startWorker();
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          requests.push_back(Load{(int)i, first, entry.path, entry.srgb, nullptr});
+        }
+        wake.notify_one();
+      }
+    }
+
+    void uploadFinished() {
+      std::vector<Load> done;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(finished);
+      }
+
+      for (Load& load : done) {
+        Entry& entry = entries[load.id];
+        entry.pending = false;
+        --stats.pending_loads;
+        if (!load.mips || (int)load.mips->levels.size() != entry.levels) {
+          entry.backoff  = entry.backoff ? std::min(entry.backoff * 2, MAX_RETRY_FRAMES) : RETRY_FRAMES;
+          entry.retry_at = frame + entry.backoff;
+          ++stats.failed_loads;
+          std::cerr << "ERROR::TEXTURE_BUDGET::STREAM_FAILED " << entry.path << ", retrying in " << entry.backoff
+                    << " frames" << std::endl;
+          continue;
+        }
+        entry.backoff = 0;
+
+        // an evicted texture is recreated from its tail upwards
+        int resident_from = entry.base;
+        if (!entry.texture) {
+          glGenTextures(1, &entry.texture);
+          glBindTexture(GL_TEXTURE_2D, entry.texture);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levels - 1);
+          if (entry.channels <= 2) {
+            GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, entry.channels == 2 ? GL_GREEN : GL_ONE };
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+          }
+          resident_from = entry.levels;
+          --stats.evicted_textures;
+        } else {
+          glBindTexture(GL_TEXTURE_2D, entry.texture);
+        }
+
+        for (int level = load.first_level; level < resident_from; ++level) {
+          load.mips->uploadLevel(GL_TEXTURE_2D, level);
+          addResident(levelBytes(entry, level));
+          ++stats.levels_streamed;
+        }
+        entry.base = std::min(load.first_level, resident_from);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.base);
+      }
+    }
+
+    void startWorker() {
+      if (worker.joinable()) return;
+      worker = std::thread([this]() {
+        for (;;) {
+          Load load;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !requests.empty(); });
+            if (stopping) return;
+            load = std::move(requests.front());
+            requests.pop_front();
+          }
+
+          std::unique_ptr<MipChain> mips(new MipChain());
+          if (mips->load(load.path.c_str(), load.srgb, MipFilter::Box, 1))
+            load.mips = std::move(mips);
+
+          std::lock_guard<std::mutex> lock(mutex);
+          finished.push_back(std::move(load));
+        }
+      });
+    }
+};
+#endif
@@ -0,0 +1,302 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+// Keeps every texture a shader may sample reachable at once, so switching
+// textures between draws is a glUniform1i of an index instead of a
+// glActiveTexture/glBindTexture pair.
+//
+// With ARB_bindless_texture (and a 4.0+ context) each texture gets a resident
+// 64-bit handle, stored in the TextureTable uniform block; the shader turns
+// the handle for its index back into a sampler2D. Everywhere else all
+// textures become layers of one GL_TEXTURE_2D_ARRAY, and the table holds
+// each one's layer and the part of the layer it fills:
+//
+//   TextureResidency residency((GLADloadproc)glfwGetProcAddress);
+//   Shader shader("vertex.vert", residency.isBindless() ? "fragment_bindless.frag" : "fragment.frag");
+//   int container = residency.add(container_mips);
+//   residency.build();
+//   residency.bind(shader.shader_program, 0);  // once, not per draw
+//   glUniform1i(glGetUniformLocation(shader.shader_program, "texture1"), container);
+//
+// Layers are as big as the largest texture; smaller textures are padded
+// with their edge texels and only repeat cleanly with GL_REPEAT if they
+// fill their layer. Each layer's mips are the texture's own chain, padded
+// the same way; only when some texture's chain stops short of 1x1 does the
+// driver generate the array's mips instead.
+//
+// The table's scale is the texture's share of level 0. It stays exact at
+// level l only while the texture's sides and the layer's both divide by
+// 2^l (or the texture is down to 1x1): a 37 wide texture is 18 texels of a
+// 32 wide layer level at level 1, not 18.5, so lower mips of a smaller,
+// odd-sized texture are sampled up to a texel of that level off, towards
+// its padding. Power-of-two sides, or textures all the same size, are
+// exact at every level.
+
+#include <glad/glad.h>
+#include "mip_chain.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+class TextureResidency {
+  public:
+    static const int    MAX_TEXTURES  = 256; // TextureTable entries (16 bytes each)
+    static const GLuint TABLE_BINDING = 0;   // uniform buffer binding point of the table
+
+    // Pass a GL loader (e.g. glfwGetProcAddress) to use bindless handles when
+    // the driver has them; without one the texture array is always used.
+    explicit TextureResidency(GLADloadproc load = nullptr) {
+      if (load && hasBindless())
+        bindless = loadBindless(load);
+    }
+
+    ~TextureResidency() {
+      release();
+    }
+
+    TextureResidency(const TextureResidency&) = delete;
+    TextureResidency& operator=(const TextureResidency&) = delete;
+
+    bool isBindless() const {
+      return bindless;
+    }
+
+    // Add a texture built from mips; returns its index for the shader, or -1.
+    // Bindless textures are created and made resident straight away, array
+    // layers are uploaded by build().
+    int add(const MipChain& mips) {
+      if (mips.levels.empty()) {
+        std::cerr << "ERROR::TEXTURE_RESIDENCY::EMPTY_TEXTURE" << std::endl;
+        return -1;
+      }
+      if ((int)textures.size() == MAX_TEXTURES) {
+        std::cerr << "ERROR::TEXTURE_RESIDENCY::TABLE_FULL " << MAX_TEXTURES << " textures" << std::endl;
+        return -1;
+      }
+
+      Texture texture;
+      texture.width  = mips.levels[0].width;
+      texture.height = mips.levels[0].height;
+
+      if (bindless) {
+        // sampler state is baked into the handle, so set it all up first
+        glGenTextures(1, &texture.texture);
+        glBindTexture(GL_TEXTURE_2D, texture.texture);
+        mips.upload(GL_TEXTURE_2D);
+        setSamplerState(GL_TEXTURE_2D);
+        texture.handle = getTextureHandle(texture.texture);
+        makeHandleResident(texture.handle);
+      } else {
+        texture.levels.resize(mips.levels.size());
+        for (size_t l = 0; l < mips.levels.size(); ++l) {
+          const MipLevel& level = mips.levels[l];
+          MipLevel& rgba = texture.levels[l];
+          rgba.width  = level.width;
+          rgba.height = level.height;
+          rgba.pixels.resize((size_t)level.width * level.height * 4);
+          toRgba(level.pixels.data(), mips.channels, rgba.pixels.data(), (size_t)level.width * level.height);
+        }
+      }
+
+      textures.push_back(std::move(texture));
+      return (int)textures.size() - 1;
+    }
+
+    // Upload the table (and in array mode the texture array) after the last add().
+    void build() {
+      if (!bindless && !textures.empty())
+        buildArray();
+
+      // std140 uvec4/vec4 per texture: the handle in xy, or layer scale in
+      // xy and layer index in z
+      std::vector<uint32_t> slots(textures.size() * 4, 0);
+      for (size_t i = 0; i < textures.size(); ++i) {
+        uint32_t* slot = &slots[i * 4];
+        if (bindless) {
+          slot[0] = (uint32_t)(textures[i].handle & 0xFFFFFFFFu);
+          slot[1] = (uint32_t)(textures[i].handle >> 32);
+        } else {
+          // level 0's share; see the header comment for where lower levels drift
+          float scale_u = (float)textures[i].width / layer_width;
+          float scale_v = (float)textures[i].height / layer_height;
+          float layer   = (float)i;
+          std::memcpy(&slot[0], &scale_u, 4);
+          std::memcpy(&slot[1], &scale_v, 4);
+          std::memcpy(&slot[2], &layer, 4);
+        }
+      }
+
+      if (!table) glGenBuffers(1, &table);
+      glBindBuffer(GL_UNIFORM_BUFFER, table);
+      glBufferData(GL_UNIFORM_BUFFER, MAX_TEXTURES * 16, NULL, GL_STATIC_DRAW);
+      if (!slots.empty())
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)(slots.size() * 4), slots.data());
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Hook the table (and the array, on texture_unit) up to shader_program;
+    // its draws then pick textures by index alone.
+    void bind(unsigned int shader_program, unsigned int texture_unit) const {
+      GLuint block = glGetUniformBlockIndex(shader_program, "TextureTable");
+      if (block == GL_INVALID_INDEX) {
+        std::cerr << "ERROR::TEXTURE_RESIDENCY::NO_TEXTURE_TABLE_BLOCK" << std::endl;
+        return;
+      }
+      glUniformBlockBinding(shader_program, block, TABLE_BINDING);
+      glBindBufferBase(GL_UNIFORM_BUFFER, TABLE_BINDING, table);
+
+      if (!bindless) {
+        glActiveTexture(GL_TEXTURE0 + texture_unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+        glUseProgram(shader_program);
+        glUniform1i(glGetUniformLocation(shader_program, "textures"), (GLint)texture_unit);
+      }
+    }
+
+    // Drop every texture; call before the context goes away if this outlives it.
+    void release() {
+      for (size_t i = 0; i < textures.size(); ++i) {
+        if (textures[i].handle) makeHandleNonResident(textures[i].handle);
+        if (textures[i].texture) glDeleteTextures(1, &textures[i].texture);
+      }
+      textures.clear();
+      if (texture_array) glDeleteTextures(1, &texture_array);
+      if (table) glDeleteBuffers(1, &table);
+      texture_array = table = 0;
+    }
+
+    void printStats() const {
+      if (bindless)
+        std::cout << "INFO::TEXTURE_RESIDENCY::" << textures.size() << " textures resident as bindless handles" << std::endl;
+      else
+        std::cout << "INFO::TEXTURE_RESIDENCY::" << textures.size() << " textures in a " << layer_width << "x"
+                  << layer_height << " texture array (no ARB_bindless_texture)" << std::endl;
+    }
+
+  private:
+    typedef GLuint64 (APIENTRYP GetTextureHandleProc)(GLuint texture);
+    typedef void (APIENTRYP HandleResidencyProc)(GLuint64 handle);
+
+    struct Texture {
+      GLuint   texture {0};
+      GLuint64 handle  {0};
+      int      width   {0};
+      int      height  {0};
+      std::vector<MipLevel> levels; // the chain in RGBA until the array is built
+    };
+
+    bool   bindless      {false};
+    GLuint table         {0};
+    GLuint texture_array {0};
+    int    layer_width   {0};
+    int    layer_height  {0};
+    std::vector<Texture> textures;
+    GetTextureHandleProc getTextureHandle      {nullptr};
+    HandleResidencyProc  makeHandleResident    {nullptr};
+    HandleResidencyProc  makeHandleNonResident {nullptr};
+
+    // handles need GLSL 4.00 as well as the extension
+    static bool hasBindless() {
+      GLint major = 0, count = 0;
+      glGetIntegerv(GL_MAJOR_VERSION, &major);
+      if (major < 4) return false;
+      glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+      for (GLint i = 0; i < count; ++i) {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (name && std::strcmp(name, "GL_ARB_bindless_texture") == 0) return true;
+      }
+      return false;
+    }
+
+    bool loadBindless(GLADloadproc load) {
+      getTextureHandle      = (GetTextureHandleProc)load("glGetTextureHandleARB");
+      makeHandleResident    = (HandleResidencyProc)load("glMakeTextureHandleResidentARB");
+      makeHandleNonResident = (HandleResidencyProc)load("glMakeTextureHandleNonResidentARB");
+      return getTextureHandle && makeHandleResident && makeHandleNonResident;
+    }
+
+    static void setSamplerState(GLenum target) {
+      glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+
+    static void toRgba(const unsigned char* in, int channels, unsigned char* out, size_t pixels) {
+      for (size_t i = 0; i < pixels; ++i, in += channels, out += 4) {
+        switch (channels) {
+          case 1: out[0] = out[1] = out[2] = in[0]; out[3] = 255;   break;
+          case 2: out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+          case 3: out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255; break;
+          default: std::memcpy(out, in, 4); break;
+        }
+      }
+    }
+
+    // one layer per texture, each level padded out with its edge texels so
+    // the array's mips don't pull in black around the smaller ones
+    void buildArray() {
+      layer_width = layer_height = 0;
+      for (const Texture& texture : textures) {
+        layer_width  = std::max(layer_width, texture.width);
+        layer_height = std::max(layer_height, texture.height);
+      }
+
+      // the chains are reused as they are if every one goes down to 1x1;
+      // a level past the end of a smaller texture's chain repeats its 1x1
+      bool chains = true;
+      for (const Texture& texture : textures)
+        chains = chains && (int)texture.levels.size() >= MipChain::levelCount(texture.width, texture.height);
+      int level_count = chains ? MipChain::levelCount(layer_width, layer_height) : 1;
+
+      if (!texture_array) glGenTextures(1, &texture_array);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+      GLint alignment;
+      glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+      std::vector<unsigned char> layer((size_t)layer_width * layer_height * 4);
+      for (int l = 0; l < level_count; ++l) {
+        int width  = std::max(layer_width >> l, 1);
+        int height = std::max(layer_height >> l, 1);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA8, width, height, (GLsizei)textures.size(), 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, NULL);
+        for (size_t i = 0; i < textures.size(); ++i) {
+          const Texture& texture = textures[i];
+          const MipLevel& level = texture.levels[std::min((size_t)l, texture.levels.size() - 1)];
+          const unsigned char* pixels = level.pixels.data();
+          if (level.width != width || level.height != height) {
+            pad(level, width, height, layer.data());
+            pixels = layer.data();
+          }
+          glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, (GLint)i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        }
+      }
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+      for (Texture& texture : textures)
+        std::vector<MipLevel>().swap(texture.levels);
+
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+      if (chains)
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+      else
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+      setSamplerState(GL_TEXTURE_2D_ARRAY);
+    }
+
+    // copy an RGBA level into the top left of a width x height one, repeating
+    // its last column and row into the rest
+    static void pad(const MipLevel& level, int width, int height, unsigned char* out) {
+      int columns = std::min(level.width, width);
+      for (int y = 0; y < height; ++y) {
+        const unsigned char* src = level.pixels.data() + (size_t)std::min(y, level.height - 1) * level.width * 4;
+        unsigned char* dst = out + (size_t)y * width * 4;
+        std::memcpy(dst, src, (size_t)columns * 4);
+        for (int x = columns; x < width; ++x)
+          std::memcpy(dst + (size_t)x * 4, src + (size_t)(columns - 1) * 4, 4);
+      }
+    }
+};
+#endif
@@ -0,0 +1,190 @@
+// Streamed GIF playback (see animated_texture.h).
+//
+//   animated_texture_check
+//
+// Writes a small GIF of solid-color frames with different delays into a
+// temporary directory, plays it through an AnimatedTexture and reads the
+// ring of layers back after each step. The first frame must be up straight
+// away, a frame must only advance once its delay has passed, each new frame
+// must go into the next layer and leave the others alone, and after a long
+// hitch playback must only catch up AnimatedTexture::MAX_CATCH_UP frames,
+// looping past the last one, and upload just the frame it stops on. A
+// missing file must leave the texture invalid.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "gl_check_context.h"
+#include "../animated_texture.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+const int SIZE   = 8;
+const int FRAMES = 4;
+const int RING   = 3;
+
+const unsigned char PALETTE[FRAMES][3] = {{255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 255}};
+const int DELAYS_CS[FRAMES] = {2, 3, 4, 5}; // centiseconds, as GIF stores them
+
+// LSB-first codes of a fixed width, in GIF's 255-byte sub-blocks
+class CodeWriter {
+  public:
+    void put(int code, int width) {
+      bits |= (unsigned int)code << count;
+      count += width;
+      while (count >= 8) {
+        bytes.push_back((unsigned char)bits);
+        bits >>= 8;
+        count -= 8;
+      }
+    }
+
+    void write(std::vector<unsigned char>& out) {
+      if (count) bytes.push_back((unsigned char)bits);
+      for (size_t i = 0; i < bytes.size(); i += 255) {
+        size_t block = std::min<size_t>(255, bytes.size() - i);
+        out.push_back((unsigned char)block);
+        out.insert(out.end(), bytes.begin() + i, bytes.begin() + i + block);
+      }
+      out.push_back(0);
+    }
+
+  private:
+    std::vector<unsigned char> bytes;
+    unsigned int bits  {0};
+    int          count {0};
+};
+
+// a GIF whose frame i is PALETTE[i] for DELAYS_CS[i]. The pixels are coded
+// with a clear code before every pair, so the LZW table never grows past
+// 3-bit codes and no compressor is needed.
+std::vector<unsigned char> makeGif() {
+  std::vector<unsigned char> gif = {'G', 'I', 'F', '8', '9', 'a', SIZE, 0, SIZE, 0, 0x91, 0, 0};
+  for (int i = 0; i < FRAMES; ++i)
+    gif.insert(gif.end(), PALETTE[i], PALETTE[i] + 3);
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    const unsigned char control[] = {0x21, 0xF9, 4, 0x04, (unsigned char)DELAYS_CS[frame], 0, 0, 0};
+    const unsigned char descriptor[] = {0x2C, 0, 0, 0, 0, SIZE, 0, SIZE, 0, 0};
+    gif.insert(gif.end(), control, control + sizeof(control));
+    gif.insert(gif.end(), descriptor, descriptor + sizeof(descriptor));
+    gif.push_back(2); // minimum code size: clear is 4, end 5
+    CodeWriter codes;
+    for (int pixel = 0; pixel < SIZE * SIZE; ++pixel) {
+      if (pixel % 2 == 0) codes.put(4, 3);
+      codes.put(frame, 3);
+    }
+    codes.put(5, 3);
+    codes.write(gif);
+  }
+  gif.push_back(0x3B);
+  return gif;
+}
+
+// the color frame had, or -1 if layer isn't one solid palette color
+int layerFrame(const std::vector<unsigned char>& layers, int layer) {
+  const unsigned char* pixels = layers.data() + (size_t)layer * SIZE * SIZE * 4;
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    bool match = true;
+    for (int i = 0; i < SIZE * SIZE && match; ++i)
+      match = pixels[i * 4] == PALETTE[frame][0] && pixels[i * 4 + 1] == PALETTE[frame][1] &&
+              pixels[i * 4 + 2] == PALETTE[frame][2] && pixels[i * 4 + 3] == 255;
+    if (match) return frame;
+  }
+  return -1;
+}
+
+// Playback as AnimatedTexture times it: the frame shown and how far into it.
+struct Model {
+  int    frame {0};
+  double time  {0.0};
+
+  // the frames uploaded by advancing dt; only the last reaches the GPU
+  int advance(double dt) {
+    int decoded = 0;
+    time += dt;
+    while (time >= DELAYS_CS[frame] * 10 / 1000.0) {
+      if (decoded == AnimatedTexture::MAX_CATCH_UP) {
+        time = 0.0;
+        break;
+      }
+      time -= DELAYS_CS[frame] * 10 / 1000.0;
+      frame = (frame + 1) % FRAMES;
+      ++decoded;
+    }
+    return decoded;
+  }
+};
+
+}  // namespace
+
+int main() {
+  GlCheckContext context("animated_texture_check");
+  if (!context.isValid()) return 1;
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "animated_texture_check";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "frames.gif").string();
+  std::vector<unsigned char> gif = makeGif();
+  std::ofstream(path, std::ios::binary).write((const char*)gif.data(), (std::streamsize)gif.size());
+
+  int failures = 0;
+  {
+    AnimatedTexture texture(path.c_str(), RING);
+    if (!texture.isValid() || texture.width != SIZE || texture.height != SIZE) {
+      context.error("GIF_NOT_OPENED", path.c_str());
+      return 1;
+    }
+
+    // expected frame in each layer, -1 while never written
+    std::vector<int> expected(RING, -1);
+    expected[0] = 0;
+    int layer = 0;
+    Model model;
+
+    // steps that stay inside a delay, end right on one, and one long hitch
+    const double steps[] = {0.019, 0.001, 0.029, 0.002, 0.5, 0.016, 0.016, 0.016, 1.0};
+    std::vector<unsigned char> layers((size_t)SIZE * SIZE * 4 * RING);
+    for (size_t step = 0; step <= sizeof(steps) / sizeof(steps[0]); ++step) {
+      if (step > 0) {
+        texture.update(steps[step - 1]);
+        if (model.advance(steps[step - 1]) > 0) {
+          layer = (layer + 1) % RING;
+          expected[layer] = model.frame;
+        }
+      }
+
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture.texture_array);
+      glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, layers.data());
+      std::printf("after %5.3f s: layer %d shows frame %d |", step ? steps[step - 1] : 0.0, texture.currentLayer(),
+                  model.frame);
+      bool ok = texture.currentLayer() == layer;
+      for (int l = 0; l < RING; ++l) {
+        int frame = layerFrame(layers, l);
+        std::printf(" %d", frame);
+        if (expected[l] >= 0 && frame != expected[l]) ok = false;
+      }
+      std::printf("%s\n", ok ? "" : "  <- expected another frame");
+      if (!ok) ++failures;
+    }
+  }
+
+  {
+    AnimatedTexture missing((dir / "missing.gif").string().c_str());
+    if (missing.isValid()) {
+      std::printf("FAIL: a missing file gave a valid texture\n");
+      ++failures;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+// Asset bundle round trip and index checks (see asset_bundle.h).
+//
+//   asset_bundle_check
+//
+// Writes a bundle into a temporary directory with a repetitive text entry
+// (LZ4), random bytes (stored, as LZ4 doesn't pay off), an empty entry and
+// a long run that compresses far below its size, then opens and mounts it
+// and reads every entry back through readMounted(), by its name and by an
+// unnormalized spelling of it. Stored entries must also come back in place
+// through view(). Last, copies of the bundle with one index record damaged
+// must fail to open: an LZ4 entry claiming more than 255x its stored size,
+// and two entries swapped so the names are out of order.
+
+#include "../asset_bundle.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Source {
+  const char* name;
+  const char* spelled; // how a loader might name it
+  std::vector<unsigned char> bytes;
+  uint32_t compression;
+};
+
+std::vector<unsigned char> readFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+bool writeFile(const std::string& path, const std::vector<unsigned char>& bytes) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+  return (bool)file;
+}
+
+AssetBundle::Entry* indexEntry(std::vector<unsigned char>& bundle, size_t i) {
+  return (AssetBundle::Entry*)(bundle.data() + sizeof(AssetBundle::Header) + i * sizeof(AssetBundle::Entry));
+}
+
+}  // namespace
+
+int main() {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "asset_bundle_check";
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "check.bundle").string();
+
+  std::vector<Source> sources;
+  std::string text;
+  for (int i = 0; i < 200; ++i)
+    text += "uniform mat4 transform; // line " + std::to_string(i % 7) + "\n";
+  sources.push_back({"shaders/text.vert", "./shaders//text.vert", std::vector<unsigned char>(text.begin(), text.end()),
+                     AssetBundle::LZ4});
+  std::mt19937 random(1);
+  std::vector<unsigned char> noise(10000);
+  for (unsigned char& byte : noise) byte = (unsigned char)random();
+  sources.push_back({"textures/noise.bin", "textures\\noise.bin", noise, AssetBundle::STORED});
+  sources.push_back({"empty.txt", "./empty.txt", std::vector<unsigned char>(), AssetBundle::STORED});
+  sources.push_back({"zeros.bin", "././zeros.bin", std::vector<unsigned char>(100000, 0), AssetBundle::LZ4});
+
+  AssetBundleWriter writer;
+  for (const Source& source : sources)
+    writer.add(source.name, source.bytes.data(), source.bytes.size(), source.compression == AssetBundle::LZ4);
+  if (!writer.write(path.c_str())) return 1;
+
+  int failures = 0;
+  {
+    AssetBundle bundle;
+    if (!bundle.open(path.c_str())) {
+      std::printf("FAIL: the bundle written doesn't open\n");
+      return 1;
+    }
+    bundle.mount();
+    bundle.printStats();
+    if (bundle.entryCount() != sources.size()) {
+      std::printf("FAIL: %zu entries, expected %zu\n", bundle.entryCount(), sources.size());
+      ++failures;
+    }
+    for (const Source& source : sources) {
+      const AssetBundle::Entry* entry = bundle.find(source.name);
+      if (!entry || entry->compression != source.compression) {
+        std::printf("FAIL: %s missing or not %s\n", source.name,
+                    source.compression == AssetBundle::LZ4 ? "LZ4" : "stored");
+        ++failures;
+        continue;
+      }
+      const char* names[2] = {source.name, source.spelled};
+      for (const char* name : names) {
+        AssetData data;
+        if (!AssetBundle::readMounted(name, data) || data.size != source.bytes.size() ||
+            (data.size && std::memcmp(data.data, source.bytes.data(), data.size) != 0)) {
+          std::printf("FAIL: %s read back as %s differs\n", source.name, name);
+          ++failures;
+        }
+      }
+      size_t size = 0;
+      const unsigned char* in_place = bundle.view(source.name, size);
+      if ((source.compression == AssetBundle::STORED) != (in_place != nullptr)) {
+        std::printf("FAIL: view() of %s should %s\n", source.name,
+                    source.compression == AssetBundle::STORED ? "point into the mapping" : "fail for LZ4");
+        ++failures;
+      }
+    }
+    AssetData data;
+    if (AssetBundle::readMounted("missing.txt", data) || AssetBundle::readMounted("shaders/text", data)) {
+      std::printf("FAIL: a name not in the bundle was read\n");
+      ++failures;
+    }
+  }
+  if (AssetBundle::mounted()) {
+    std::printf("FAIL: the bundle stayed mounted after it was destroyed\n");
+    ++failures;
+  }
+
+  // damaged copies; entries are sorted by name: empty.txt, shaders/text.vert, ...
+  std::vector<unsigned char> original = readFile(path);
+  std::string damaged = (dir / "damaged.bundle").string();
+  for (int damage = 0; damage < 2; ++damage) {
+    std::vector<unsigned char> bundle = original;
+    AssetBundle::Entry* lz4 = indexEntry(bundle, 1);
+    if (damage == 0) {
+      lz4->size = lz4->stored_size * 255 + 17;
+    } else {
+      std::swap(*indexEntry(bundle, 0), *lz4);
+    }
+    AssetBundle opened;
+    if (!writeFile(damaged, bundle) || opened.open(damaged.c_str())) {
+      std::printf("FAIL: a bundle with %s opened\n", damage == 0 ? "an oversized LZ4 entry" : "unsorted names");
+      ++failures;
+    }
+  }
+
+  std::filesystem::remove_all(dir, error);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+// Packs files into an asset bundle (see asset_bundle.h).
+//
+//   asset_bundler <bundle> [--lz4] <file or directory>...
+//
+// Run it from the directory the program is started in, with paths as the
+// program names them, e.g. from 7-Transformations:
+//
+//   asset_bundler resources.bundle --lz4 resources
+//
+// --lz4 compresses the entries it helps (shaders, not JPEG/PNG); entries
+// added before it are stored as they are.
+
+#include "../asset_bundle.h"
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: asset_bundler <bundle> [--lz4] <file or directory>..." << std::endl;
+    return 1;
+  }
+
+  AssetBundleWriter writer;
+  bool compress = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--lz4") {
+      compress = true;
+      continue;
+    }
+
+    std::error_code error;
+    if (std::filesystem::is_directory(arg, error)) {
+      for (std::filesystem::recursive_directory_iterator it(arg, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_regular_file(error) && !writer.addFile(it->path().generic_string().c_str(), compress))
+          return 1;
+      }
+      if (error) {
+        std::cerr << "ERROR::ASSET_BUNDLER::DIRECTORY_NOT_READ " << arg << " " << error.message() << std::endl;
+        return 1;
+      }
+    } else if (!writer.addFile(arg.c_str(), compress)) {
+      return 1;
+    }
+  }
+
+  if (!writer.write(argv[1])) return 1;
+
+  AssetBundle bundle;
+  if (!bundle.open(argv[1])) return 1;
+  bundle.printStats();
+  return 0;
+}
@@ -0,0 +1,83 @@
+// Packing speed and page use of TextureAtlas (see texture_atlas.h).
+//
+//   atlas_pack_bench [sprites] [page size]
+//
+// Queues [sprites] random sprites (2000 by default) and times build(),
+// which packs them with MaxRects and copies them, with their bled
+// borders, onto [page size] pages (2048 by default). Two mixes: UI icons
+// of 8-64 texels a side, and icons with one sprite in ten up to 256
+// texels. Each is packed without mips and with cells aligned for 2 mips.
+// Prints the best of several builds, in ms and sprites/sec, with the
+// pages used and the share of their texels the sprites cover. No GL
+// context is needed; nothing is uploaded.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "../texture_atlas.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+const int RUNS = 5;
+
+struct Sprite {
+  int width, height;
+};
+
+std::vector<Sprite> makeSprites(int count, bool with_large, unsigned int seed) {
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int> icon(8, 64), large(64, 256);
+  std::vector<Sprite> sprites((size_t)count);
+  for (int i = 0; i < count; ++i) {
+    bool big = with_large && i % 10 == 0;
+    sprites[i].width  = big ? large(random) : icon(random);
+    sprites[i].height = big ? large(random) : icon(random);
+  }
+  return sprites;
+}
+
+void bench(const char* name, const std::vector<Sprite>& sprites, int page_size, int mip_levels) {
+  std::vector<unsigned char> pixels(256 * 256 * 4, 128);
+  double best_ms = 1e30;
+  int pages = 0;
+  double efficiency = 0.0;
+  for (int run = 0; run < RUNS; ++run) {
+    TextureAtlas atlas(page_size, 2, mip_levels);
+    for (const Sprite& sprite : sprites)
+      atlas.add(pixels.data(), sprite.width, sprite.height);
+    if (!atlas.build()) {
+      std::fprintf(stderr, "ERROR::ATLAS_PACK_BENCH::NOT_PACKED %s\n", name);
+      std::exit(1);
+    }
+    best_ms = std::min(best_ms, atlas.seconds * 1000.0);
+    pages = atlas.pageCount();
+    efficiency = atlas.efficiency();
+  }
+  std::printf("%-22s %5d %10.2f %14.0f %6d %9.1f%%\n", name, mip_levels, best_ms, sprites.size() / (best_ms / 1000.0),
+              pages, efficiency * 100.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int count     = argc > 1 ? std::atoi(argv[1]) : 2000;
+  int page_size = argc > 2 ? std::atoi(argv[2]) : 2048;
+  count = std::max(count, 1);
+  page_size = std::max(page_size, 512);
+
+  std::vector<Sprite> icons = makeSprites(count, false, 1);
+  std::vector<Sprite> mixed = makeSprites(count, true, 2);
+
+  std::printf("%d sprites on %dx%d pages, best of %d builds:\n", count, page_size, page_size, RUNS);
+  std::printf("mix                     mips   build ms    sprites/sec  pages      used\n");
+  bench("icons 8-64", icons, page_size, 0);
+  bench("icons 8-64", icons, page_size, 2);
+  bench("icons, 1 in 10 to 256", mixed, page_size, 0);
+  bench("icons, 1 in 10 to 256", mixed, page_size, 2);
+  return 0;
+}
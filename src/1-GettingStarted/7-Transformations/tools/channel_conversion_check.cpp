@@ -0,0 +1,338 @@
+// Channel conversion and the fused vertical flip against a plain scalar
+// reference (see stbi__convert_format_row and the 16/8-bit converters in
+// stb_image.h).
+//
+//   channel_conversion_check
+//
+// Run it from 7-Transformations. Two parts:
+//   - the row converters called directly, for every img_n/req_comp pair and
+//     both 16->8 and 8->16, on random rows of every width from 1 to 64 and a
+//     long one, so the SIMD loops and their scalar tails all run; output
+//     must match the reference and nothing past the row may be written
+//   - whole loads, for vertical flip off and on and every desired_channels
+//     from 0 to 4, through stbi_load and stbi_load_16: 8-bit and 16-bit PNGs
+//     made here in gray, gray+alpha, RGB and RGBA (random row filters, one
+//     of each interlaced), a TGA and the textures. Each must equal the
+//     image's own channels (flip off, desired_channels 0) converted and
+//     flipped by the reference. The JPEG makes gray from its Y plane rather
+//     than from RGB, so for it 1 and 2 channels are only checked against
+//     their own unflipped load.
+// Build it with -DSTBI_NO_SIMD too to check the scalar path the same way.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const unsigned char GUARD = 0xA5;
+
+struct Image {
+  std::string name;
+  std::vector<unsigned char> bytes;
+  bool gray_from_rgb; // desired_channels 1 and 2 follow the reference
+};
+
+// a pixel of n channels as one of c: gray is (77 r + 150 g + 29 b) >> 8,
+// a missing alpha is max
+void referencePixel(const uint32_t* src, int n, uint32_t* dest, int c, uint32_t max) {
+  uint32_t gray = n >= 3 ? (src[0] * 77 + src[1] * 150 + src[2] * 29) >> 8 : src[0];
+  uint32_t alpha = n == 2 || n == 4 ? src[n - 1] : max;
+  if (c <= 2) {
+    dest[0] = gray;
+    if (c == 2) dest[1] = alpha;
+  } else {
+    for (int k = 0; k < 3; ++k) dest[k] = n >= 3 ? src[k] : gray;
+    if (c == 4) dest[3] = alpha;
+  }
+}
+
+// pixels of n channels at in_bits converted to c channels at out_bits,
+// rows flipped if asked; 16->8 keeps the high byte, 8->16 repeats the byte
+std::vector<uint32_t> reference(const std::vector<uint32_t>& pixels, int width, int height, int n, int in_bits,
+                                int c, int out_bits, bool flip) {
+  std::vector<uint32_t> out((size_t)width * height * c);
+  for (int y = 0; y < height; ++y) {
+    int out_y = flip ? height - 1 - y : y;
+    for (int x = 0; x < width; ++x) {
+      uint32_t* dest = &out[((size_t)out_y * width + x) * c];
+      const uint32_t* src = &pixels[((size_t)y * width + x) * n];
+      if (c == n)
+        std::copy(src, src + n, dest);
+      else
+        referencePixel(src, n, dest, c, in_bits == 16 ? 0xFFFF : 0xFF);
+      for (int k = 0; k < c; ++k) {
+        if (in_bits == 16 && out_bits == 8) dest[k] >>= 8;
+        if (in_bits == 8 && out_bits == 16) dest[k] *= 257;
+      }
+    }
+  }
+  return out;
+}
+
+std::vector<uint32_t> widen(const void* pixels, size_t count, int bits) {
+  std::vector<uint32_t> out(count);
+  for (size_t i = 0; i < count; ++i)
+    out[i] = bits == 16 ? ((const stbi_us*)pixels)[i] : ((const stbi_uc*)pixels)[i];
+  return out;
+}
+
+// every row converter on random rows of many widths; returns failures
+int checkRows(std::mt19937& random) {
+  std::vector<unsigned int> widths;
+  for (unsigned int x = 1; x <= 64; ++x) widths.push_back(x);
+  widths.push_back(1000);
+
+  int failures = 0;
+  for (int n = 1; n <= 4; ++n) {
+    for (int c = 1; c <= 4; ++c) {
+      if (c == n) continue;
+      for (unsigned int x : widths) {
+        // exactly sized source, so a sanitizer sees any read past it
+        std::vector<unsigned char> src((size_t)x * n);
+        for (unsigned char& byte : src) byte = (unsigned char)random();
+        std::vector<unsigned char> dest((size_t)x * c + 64, GUARD);
+        stbi__convert_format_row(src.data(), dest.data(), n, c, x);
+        std::vector<uint32_t> expected = reference(widen(src.data(), src.size(), 8), (int)x, 1, n, 8, c, 8, false);
+        bool same = std::equal(expected.begin(), expected.end(), dest.begin());
+        bool guarded = std::all_of(dest.begin() + expected.size(), dest.end(),
+                                   [](unsigned char byte) { return byte == GUARD; });
+        if (!same || !guarded) {
+          std::printf("FAIL: converting %u pixels from %d to %d channels %s\n", x, n, c,
+                      same ? "writes past the row" : "differs");
+          ++failures;
+          break;
+        }
+      }
+    }
+  }
+
+  for (unsigned int x : widths) {
+    for (int channels = 1; channels <= 4; ++channels) {
+      int count = (int)x * channels;
+      std::vector<stbi_us> wide((size_t)count);
+      std::vector<unsigned char> narrow((size_t)count);
+      for (stbi_us& value : wide) value = (stbi_us)random();
+      for (unsigned char& byte : narrow) byte = (unsigned char)random();
+      std::vector<unsigned char> to8((size_t)count + 64, GUARD);
+      std::vector<stbi_us> to16((size_t)count + 32, (stbi_us)(GUARD * 257));
+      stbi__convert_16_to_8_row(wide.data(), to8.data(), count);
+      stbi__convert_8_to_16_row(narrow.data(), to16.data(), count);
+      bool ok = true;
+      for (int i = 0; i < count; ++i)
+        ok = ok && to8[i] == wide[i] >> 8 && to16[i] == narrow[i] * 257;
+      for (size_t i = count; i < to8.size(); ++i) ok = ok && to8[i] == GUARD;
+      for (size_t i = count; i < to16.size(); ++i) ok = ok && to16[i] == GUARD * 257;
+      if (!ok) {
+        std::printf("FAIL: 16<->8 bit conversion of %d values differs or writes past the row\n", count);
+        ++failures;
+        break;
+      }
+    }
+  }
+  std::printf("%-36s %s\n", "row converters", failures ? "differ" : "match, widths 1-64 and 1000");
+  return failures;
+}
+
+void put32(std::vector<unsigned char>& out, uint32_t value) {
+  out.push_back((unsigned char)(value >> 24));
+  out.push_back((unsigned char)(value >> 16));
+  out.push_back((unsigned char)(value >> 8));
+  out.push_back((unsigned char)value);
+}
+
+uint32_t crc32(const unsigned char* bytes, size_t size) {
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= bytes[i];
+    for (int k = 0; k < 8; ++k) crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+void chunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data) {
+  put32(png, (uint32_t)data.size());
+  size_t start = png.size();
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data.begin(), data.end());
+  put32(png, crc32(png.data() + start, png.size() - start));
+}
+
+// a PNG of random rows, each with a random filter byte, in stored zlib
+// blocks; interlaced, the rows are those of the seven Adam7 passes
+std::vector<unsigned char> makePng(int width, int height, int channels, int bits, bool interlaced,
+                                   std::mt19937& random) {
+  const unsigned char COLOR_TYPES[5] = {0, 0, 4, 2, 6};
+  const int PASSES[7][4] = {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4},
+                            {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}}; // x, y, x step, y step
+  std::vector<unsigned char> rows;
+  for (int pass = 0; pass < (interlaced ? 7 : 1); ++pass) {
+    const int* p = interlaced ? PASSES[pass] : nullptr;
+    int pass_width = p ? (width - p[0] + p[2] - 1) / p[2] : width;
+    int pass_height = p ? (height - p[1] + p[3] - 1) / p[3] : height;
+    if (pass_width <= 0 || pass_height <= 0) continue;
+    for (int y = 0; y < pass_height; ++y) {
+      rows.push_back((unsigned char)(random() % 5));
+      for (int i = 0; i < pass_width * channels * bits / 8; ++i) rows.push_back((unsigned char)random());
+    }
+  }
+
+  std::vector<unsigned char> zlib = {0x78, 0x01};
+  const size_t BLOCK = 1000;
+  for (size_t i = 0; i < rows.size(); i += BLOCK) {
+    size_t block = std::min(BLOCK, rows.size() - i);
+    zlib.push_back(i + block == rows.size() ? 1 : 0);
+    zlib.push_back((unsigned char)block);
+    zlib.push_back((unsigned char)(block >> 8));
+    zlib.push_back((unsigned char)~block);
+    zlib.push_back((unsigned char)(~block >> 8));
+    zlib.insert(zlib.end(), rows.begin() + i, rows.begin() + i + block);
+  }
+  uint32_t a = 1, b = 0;
+  for (unsigned char byte : rows) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  put32(zlib, (b << 16) | a);
+
+  std::vector<unsigned char> header;
+  put32(header, (uint32_t)width);
+  put32(header, (uint32_t)height);
+  header.push_back((unsigned char)bits);
+  header.push_back(COLOR_TYPES[channels]);
+  header.insert(header.end(), {0, 0, (unsigned char)(interlaced ? 1 : 0)});
+
+  std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  chunk(png, "IHDR", header);
+  chunk(png, "IDAT", zlib);
+  chunk(png, "IEND", std::vector<unsigned char>());
+  return png;
+}
+
+// an uncompressed 24-bit TGA of random pixels
+std::vector<unsigned char> makeTga(int width, int height, std::mt19937& random) {
+  std::vector<unsigned char> tga(18, 0);
+  tga[2]  = 2; // uncompressed true color
+  tga[12] = (unsigned char)width;
+  tga[13] = (unsigned char)(width >> 8);
+  tga[14] = (unsigned char)height;
+  tga[15] = (unsigned char)(height >> 8);
+  tga[16] = 24;
+  for (int i = 0; i < width * height * 3; ++i) tga.push_back((unsigned char)random());
+  return tga;
+}
+
+// one load at out_bits against the reference; returns failures
+int compare(const Image& image, const std::vector<uint32_t>& native, int width, int height, int channels, int bits,
+            int out_bits, int flip, int desired_channels) {
+  stbi_set_flip_vertically_on_load(flip);
+  const stbi_uc* bytes = image.bytes.data();
+  int size = (int)image.bytes.size();
+  int w, h, c;
+  void* pixels = out_bits == 16 ? (void*)stbi_load_16_from_memory(bytes, size, &w, &h, &c, desired_channels)
+                                : (void*)stbi_load_from_memory(bytes, size, &w, &h, &c, desired_channels);
+  int out_channels = desired_channels ? desired_channels : channels;
+  if (!pixels || w != width || h != height || c != channels) {
+    std::printf("FAIL: %s, %d-bit, flip %d, %d channels: %s\n", image.name.c_str(), out_bits, flip, desired_channels,
+                pixels ? "size differs" : stbi_failure_reason());
+    stbi_image_free(pixels);
+    return 1;
+  }
+  std::vector<uint32_t> got = widen(pixels, (size_t)w * h * out_channels, out_bits);
+  stbi_image_free(pixels);
+
+  std::vector<uint32_t> expected;
+  if (image.gray_from_rgb || out_channels >= 3 || channels < 3) {
+    expected = reference(native, width, height, channels, bits, out_channels, out_bits, flip != 0);
+  } else {
+    // the loader's own gray, unflipped, flipped here
+    stbi_set_flip_vertically_on_load(0);
+    void* unflipped = out_bits == 16 ? (void*)stbi_load_16_from_memory(bytes, size, &w, &h, &c, desired_channels)
+                                     : (void*)stbi_load_from_memory(bytes, size, &w, &h, &c, desired_channels);
+    expected = reference(widen(unflipped, got.size(), out_bits), width, height, out_channels, out_bits,
+                         out_channels, out_bits, flip != 0);
+    stbi_image_free(unflipped);
+  }
+  if (got != expected) {
+    size_t i = std::mismatch(got.begin(), got.end(), expected.begin()).first - got.begin();
+    std::printf("FAIL: %s, %d-bit, flip %d, %d channels: value %zu is %u, expected %u\n", image.name.c_str(),
+                out_bits, flip, desired_channels, i, got[i], expected[i]);
+    return 1;
+  }
+  return 0;
+}
+
+bool readFile(const char* path, std::vector<unsigned char>& bytes) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !bytes.empty();
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 random(1);
+  int failures = checkRows(random);
+
+  std::vector<Image> images;
+  const char* textures[2] = {"./resources/textures/container.jpg", "./resources/textures/awesomeface.png"};
+  for (int t = 0; t < 2; ++t) {
+    Image image {textures[t], {}, t == 1};
+    if (!readFile(textures[t], image.bytes)) {
+      std::fprintf(stderr, "ERROR::CHANNEL_CONVERSION_CHECK::TEXTURES_NOT_FOUND run it from 7-Transformations\n");
+      return 1;
+    }
+    images.push_back(image);
+  }
+  const char* channel_names[5] = {nullptr, "gray", "gray+alpha", "RGB", "RGBA"};
+  for (int bits = 8; bits <= 16; bits += 8) {
+    for (int channels = 1; channels <= 4; ++channels) {
+      std::string name = std::to_string(bits) + "-bit " + channel_names[channels] + " PNG";
+      images.push_back(Image {name, makePng(37 + channels * 20, 23 + channels * 17, channels, bits, false, random),
+                              true});
+      images.push_back(Image {name + ", interlaced", makePng(29 + channels, 13 + channels, channels, bits, true,
+                                                             random), true});
+    }
+  }
+  images.push_back(Image {"TGA", makeTga(45, 29, random), true});
+
+  for (const Image& image : images) {
+    // the image's own channels at its own depth, unflipped
+    stbi_set_flip_vertically_on_load(0);
+    const stbi_uc* bytes = image.bytes.data();
+    int size = (int)image.bytes.size();
+    int bits = stbi_is_16_bit_from_memory(bytes, size) ? 16 : 8;
+    int width, height, channels;
+    void* pixels = bits == 16 ? (void*)stbi_load_16_from_memory(bytes, size, &width, &height, &channels, 0)
+                              : (void*)stbi_load_from_memory(bytes, size, &width, &height, &channels, 0);
+    if (!pixels) {
+      std::printf("FAIL: %s not decoded: %s\n", image.name.c_str(), stbi_failure_reason());
+      ++failures;
+      continue;
+    }
+    std::vector<uint32_t> native = widen(pixels, (size_t)width * height * channels, bits);
+    stbi_image_free(pixels);
+
+    int failed = 0;
+    for (int out_bits = 8; out_bits <= 16; out_bits += 8)
+      for (int flip = 0; flip <= 1; ++flip)
+        for (int desired_channels = 0; desired_channels <= 4; ++desired_channels)
+          failed += compare(image, native, width, height, channels, bits, out_bits, flip, desired_channels);
+    std::printf("%-36s %s\n", image.name.c_str(), failed ? "differs" : "matches, 8/16-bit, flip 0/1, 0-4 channels");
+    failures += failed;
+  }
+  stbi_set_flip_vertically_on_load(0);
+
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+// Records 100k draws into per-thread command buffers and replays them, to
+// see how recording scales with threads and what the merged replay costs.
+//
+//   command_buffer_bench [threads] [draws]
+//
+// Each draw is what main.cpp records per object: program, vertex array, a
+// transform and a texture index uniform, and the draw itself. Replay walks
+// every buffer in order the way CommandBuffer::execute does, but counts
+// commands instead of calling GL, so no context is needed.
+
+#include "../command_buffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// the part of a frame the workers split between them
+void recordDraws(CommandBuffer& commands, size_t first, size_t last) {
+  commands.reset();
+  for (size_t i = first; i < last; ++i) {
+    float angle = (float)i * 0.001f, scale = 0.5f;
+    float c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+    float transform[16] = { c, s, 0, 0,  -s, c, 0, 0,  0, 0, scale, 0,  (float)(i % 100) * 0.01f, 0, 0, 1 };
+    commands.useProgram(1);
+    commands.bindVertexArray(1);
+    commands.uniformMatrix4(0, transform);
+    commands.uniform1i(1, (GLint)(i & 1));
+    commands.drawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  }
+}
+
+struct CountingVisitor {
+  size_t commands {0};
+  size_t draws    {0};
+  float  checksum {0.0f}; // keeps the payload reads from being optimized out
+
+  void operator()(const CommandBuffer::Header& header) {
+    ++commands;
+    if (header.type == CommandBuffer::Type::DrawElements) {
+      draws += (size_t)reinterpret_cast<const CommandBuffer::DrawElementsCommand&>(header).count / 6;
+    } else if (header.type == CommandBuffer::Type::UniformMatrix4) {
+      checksum += reinterpret_cast<const CommandBuffer::UniformMatrix4Command&>(header).value[12];
+    }
+  }
+};
+
+double milliseconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t threads = argc > 1 ? (size_t)std::atoi(argv[1]) : (size_t)std::thread::hardware_concurrency();
+  size_t draws   = argc > 2 ? (size_t)std::atoll(argv[2]) : 100000;
+  threads = std::max<size_t>(threads, 1);
+  const int RUNS = 20;
+
+  std::vector<CommandBuffer> buffers(threads);
+  double single_ms = 1e30, parallel_ms = 1e30, replay_ms = 1e30;
+  CountingVisitor counted;
+
+  for (int run = 0; run < RUNS; ++run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    recordDraws(buffers[0], 0, draws);
+    single_ms = std::min(single_ms, milliseconds(start));
+
+    start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t)
+      workers.emplace_back(recordDraws, std::ref(buffers[t]), draws * t / threads, draws * (t + 1) / threads);
+    recordDraws(buffers[0], 0, draws / threads);
+    for (std::thread& worker : workers) worker.join();
+    parallel_ms = std::min(parallel_ms, milliseconds(start));
+
+    start = std::chrono::steady_clock::now();
+    counted = CountingVisitor();
+    for (CommandBuffer& buffer : buffers) buffer.forEach(counted);
+    replay_ms = std::min(replay_ms, milliseconds(start));
+  }
+
+  size_t reserved = 0;
+  for (const CommandBuffer& buffer : buffers) reserved += buffer.reservedBytes();
+  if (counted.draws != draws) {
+    std::cerr << "ERROR::COMMAND_BUFFER_BENCH::REPLAYED " << counted.draws << " of " << draws << " draws" << std::endl;
+    return 1;
+  }
+
+  std::cout << draws << " draws, " << counted.commands << " commands, " << reserved / 1024 << " KB of blocks, best of "
+            << RUNS << " runs (checksum " << counted.checksum << ")" << std::endl;
+  std::cout << "  record, 1 thread:   " << single_ms << " ms (" << single_ms * 1e6 / counted.commands << " ns/command)" << std::endl;
+  std::cout << "  record, " << threads << " threads:  " << parallel_ms << " ms (" << single_ms / parallel_ms
+            << "x, thread start included)" << std::endl;
+  std::cout << "  merged replay walk: " << replay_ms << " ms (" << replay_ms * 1e6 / counted.commands << " ns/command)" << std::endl;
+  return 0;
+}
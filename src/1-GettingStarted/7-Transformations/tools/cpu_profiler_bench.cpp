@@ -0,0 +1,120 @@
+// Cost of a CPU_PROFILE_SCOPE (see cpu_profiler.h).
+//
+//   cpu_profiler_bench [threads] [scopes]
+//
+// Times [scopes] (1M by default) empty scopes back to back on one thread,
+// three nested scopes, the same on [threads] threads at once (default:
+// all hardware threads; each has its own ring, so the cost per scope
+// should hold), then one thread again while another exports the rings
+// over and over (on a single core the two just take turns). Reading the
+// cycle counter alone is timed as well; a scope reads it twice. Prints the
+// best of several runs in ns per scope, then how long one export of every
+// ring takes. Threads keep their rings after they exit, so the export
+// covers every thread the runs started.
+
+#include "../cpu_profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int RUNS = 7;
+
+double nanoseconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+double counterReads(size_t count) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; ++i)
+    sum += CpuProfiler::ticks();
+  double ns = nanoseconds(start) / count;
+  return sum ? ns : 0.0;
+}
+
+double flatScopes(size_t count) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; ++i) {
+    CPU_PROFILE_SCOPE("flat");
+  }
+  return nanoseconds(start) / count;
+}
+
+double nestedScopes(size_t count) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count / 3; ++i) {
+    CPU_PROFILE_SCOPE("outer");
+    {
+      CPU_PROFILE_SCOPE("middle");
+      {
+        CPU_PROFILE_SCOPE("inner");
+      }
+    }
+  }
+  return nanoseconds(start) / (count / 3 * 3);
+}
+
+// worst ns/scope of flatScopes on every thread at once
+double parallelScopes(int threads, size_t count) {
+  std::vector<double> results((size_t)threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t)
+    workers.emplace_back([&results, t, count]() { results[t] = flatScopes(count); });
+  for (std::thread& worker : workers) worker.join();
+  return *std::max_element(results.begin(), results.end());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int threads  = argc > 1 ? std::atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+  size_t count = argc > 2 ? (size_t)std::atoll(argv[2]) : 1000000;
+  threads = std::max(threads, 1);
+  count = std::max<size_t>(count, 3);
+
+  CpuProfiler::setThreadName("bench");
+  double read_ns = 1e30, flat_ns = 1e30, nested_ns = 1e30, parallel_ns = 1e30, exporting_ns = 1e30;
+  for (int run = 0; run < RUNS; ++run) {
+    read_ns     = std::min(read_ns, counterReads(count));
+    flat_ns     = std::min(flat_ns, flatScopes(count));
+    nested_ns   = std::min(nested_ns, nestedScopes(count));
+    parallel_ns = std::min(parallel_ns, parallelScopes(threads, count));
+  }
+
+  // one thread recording while another keeps exporting what the rings hold
+  std::string path = (std::filesystem::temp_directory_path() / "cpu_profiler_bench.json").string();
+  std::atomic<bool> recording {true};
+  size_t exports = 0;
+  double export_ms = 1e30;
+  std::thread exporter([&]() {
+    while (recording.load()) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      if (!CpuProfiler::writeTrace(path.c_str())) break;
+      export_ms = std::min(export_ms, nanoseconds(start) / 1e6);
+      ++exports;
+    }
+  });
+  for (int run = 0; run < RUNS; ++run)
+    exporting_ns = std::min(exporting_ns, flatScopes(count));
+  recording = false;
+  exporter.join();
+  std::error_code error;
+  std::filesystem::remove(path, error);
+
+  std::printf("%zu scopes per run, best of %d runs, ns per scope:\n", count, RUNS);
+  std::printf("  cycle counter read:          %6.1f\n", read_ns);
+  std::printf("  flat, 1 thread:              %6.1f\n", flat_ns);
+  std::printf("  3 nested, 1 thread:          %6.1f\n", nested_ns);
+  std::printf("  flat, %2d threads (slowest):  %6.1f\n", threads, parallel_ns);
+  std::printf("  flat, while exporting:       %6.1f (%zu exports, best %.1f ms)\n", exporting_ns, exports, export_ms);
+  return 0;
+}
@@ -0,0 +1,192 @@
+// Decode arena bookkeeping and reuse (see decode_arena.h).
+//
+//   decode_arena_check
+//
+// Run it from 7-Transformations. Checks, in order:
+//   - stats after a few allocations, an in-place realloc and frees, and
+//     that freeing the newest block or every block hands its space back
+//   - a batch spilling over small chunks is merged into one chunk of the
+//     batch's high-water size on the next rewind
+//   - the textures decoded through the arena match plain malloc decodes,
+//     and decoding them again and again reuses the same memory
+//   - reset() with an image never freed, then trim(): nothing reserved
+//     afterwards and the arena still usable
+//   - malloc blocks made with no arena bound can be freed with one bound
+
+#include "../decode_arena.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char* TEXTURES[2] = {"./resources/textures/container.jpg", "./resources/textures/awesomeface.png"};
+
+void expect(int& failures, bool ok, const char* what) {
+  if (ok) return;
+  std::printf("FAIL: %s\n", what);
+  ++failures;
+}
+
+int checkBookkeeping() {
+  int failures = 0;
+  DecodeArena arena;
+  const DecodeArena::Stats& stats = arena.getStats();
+  void* a = arena.allocate(100);
+  void* b = arena.allocate(1000);
+  expect(failures, stats.allocations == 2 && stats.bytes_in_use == 1100 && stats.chunks == 1,
+         "stats after two allocations");
+
+  void* grown = arena.reallocate(b, 5000);
+  expect(failures, grown == b && stats.in_place_reallocs == 1 && stats.bytes_in_use == 5100,
+         "the newest block grows in place");
+  arena.release(grown);
+  void* again = arena.allocate(10);
+  expect(failures, again == b && stats.bytes_in_use == 110 && stats.peak_bytes == 5100,
+         "freeing the newest block hands its space back");
+
+  void* moved = arena.reallocate(a, 200); // not the newest: copied
+  expect(failures, moved != a && stats.in_place_reallocs == 1 && stats.bytes_in_use == 210,
+         "an older block moves to grow");
+  arena.release(moved);
+  arena.release(again);
+  expect(failures, stats.frees == 4 && stats.bytes_in_use == 0, "stats after every block was freed");
+  expect(failures, arena.allocate(100) == a, "freeing every block rewinds the arena");
+  std::printf("bookkeeping: ");
+  std::fflush(stdout);
+  arena.printStats();
+  return failures;
+}
+
+int checkMerge() {
+  int failures = 0;
+  const size_t CHUNK = 64 * 1024;
+  DecodeArena arena(CHUNK);
+  const DecodeArena::Stats& stats = arena.getStats();
+  std::vector<void*> blocks;
+  for (int i = 0; i < 10; ++i)
+    blocks.push_back(arena.allocate(20 * 1024));
+  expect(failures, stats.chunks > 1, "a batch larger than a chunk spills into more");
+  for (void* block : blocks)
+    arena.release(block);
+  expect(failures, stats.chunks == 1 && stats.reserved_bytes >= 10 * 20 * 1024,
+         "a rewind merges the chunks into one");
+
+  size_t reserved = stats.reserved_bytes;
+  blocks.clear();
+  for (int i = 0; i < 10; ++i)
+    blocks.push_back(arena.allocate(20 * 1024));
+  expect(failures, stats.chunks == 1 && stats.reserved_bytes == reserved,
+         "the merged chunk holds the same batch again");
+  for (void* block : blocks)
+    arena.release(block);
+  std::printf("merge:       ");
+  std::fflush(stdout);
+  arena.printStats();
+  return failures;
+}
+
+int checkDecodes() {
+  int failures = 0;
+  std::vector<std::vector<unsigned char>> plain;
+  for (const char* path : TEXTURES) {
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(path, &width, &height, &channels, 0);
+    if (!pixels) {
+      std::printf("FAIL: %s not decoded; run it from 7-Transformations\n", path);
+      return failures + 1;
+    }
+    plain.emplace_back(pixels, pixels + (size_t)width * height * channels);
+    stbi_image_free(pixels);
+  }
+
+  DecodeArena arena;
+  const DecodeArena::Stats& stats = arena.getStats();
+  size_t reserved = 0, chunks = 0;
+  void* first_image = nullptr;
+  const int ROUNDS = 3;
+  for (int round = 0; round < ROUNDS; ++round) {
+    DecodeArena::Scope scope(arena);
+    for (size_t t = 0; t < plain.size(); ++t) {
+      int width, height, channels;
+      unsigned char* pixels = stbi_load(TEXTURES[t], &width, &height, &channels, 0);
+      size_t size = (size_t)width * height * channels;
+      expect(failures, pixels && size == plain[t].size() && std::memcmp(pixels, plain[t].data(), size) == 0,
+             "a decode through the arena matches the malloc one");
+      if (round > 0 && t == 0)
+        expect(failures, pixels == first_image, "the next decode starts where the last one did");
+      if (t == 0) first_image = pixels;
+      stbi_image_free(pixels);
+    }
+    if (round == 0) {
+      reserved = stats.reserved_bytes;
+      chunks = stats.chunks;
+    }
+  }
+  expect(failures, stats.bytes_in_use == 0 && stats.reserved_bytes == reserved && stats.chunks == chunks,
+         "decoding again reserves nothing more");
+  std::printf("decodes:     ");
+  std::fflush(stdout);
+  arena.printStats();
+
+  // an image never freed, then reset() and trim()
+  unsigned char* kept;
+  {
+    DecodeArena::Scope scope(arena);
+    int width, height, channels;
+    kept = stbi_load(TEXTURES[0], &width, &height, &channels, 0);
+  }
+  expect(failures, kept && stats.bytes_in_use > 0, "an image kept stays in use");
+  arena.reset();
+  expect(failures, stats.bytes_in_use == 0 && stats.reserved_bytes == reserved, "reset() keeps the memory");
+  {
+    DecodeArena::Scope scope(arena);
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(TEXTURES[0], &width, &height, &channels, 0);
+    expect(failures, pixels == kept, "after reset() a decode starts at the beginning");
+    stbi_image_free(pixels);
+  }
+  arena.trim();
+  expect(failures, stats.reserved_bytes == 0 && stats.chunks == 0 && stats.bytes_in_use == 0,
+         "trim() frees every chunk");
+  void* after = arena.allocate(100);
+  expect(failures, after && stats.chunks == 1, "the arena works again after trim()");
+  arena.release(after);
+  return failures;
+}
+
+int checkBinding() {
+  int failures = 0;
+  DecodeArena arena;
+  void* plain = DecodeArena::stbMalloc(100); // no arena bound: malloc
+  {
+    DecodeArena::Scope scope(arena);
+    expect(failures, DecodeArena::current() == &arena, "a scope binds the arena");
+    {
+      DecodeArena inner_arena;
+      DecodeArena::Scope inner(inner_arena);
+      expect(failures, DecodeArena::current() == &inner_arena, "a nested scope binds its arena");
+    }
+    expect(failures, DecodeArena::current() == &arena, "leaving a nested scope restores the outer arena");
+    plain = DecodeArena::stbRealloc(plain, 200);
+    DecodeArena::stbFree(plain);
+  }
+  expect(failures, DecodeArena::current() == nullptr, "leaving every scope unbinds the arena");
+  const DecodeArena::Stats& stats = arena.getStats();
+  expect(failures, stats.allocations == 0 && stats.frees == 0, "malloc blocks bypass the bound arena");
+  return failures;
+}
+
+}  // namespace
+
+int main() {
+  int failures = checkBookkeeping();
+  failures += checkMerge();
+  failures += checkDecodes();
+  failures += checkBinding();
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+// Dynamic resolution under a changing load (see dynamic_resolution.h).
+//
+//   dynamic_resolution_check [frames per phase] [budget ms]
+//
+// Opens a hidden window and presents into an offscreen "window" target,
+// since a hidden window has no visible back buffer to check. The scene is
+// one full-screen draw whose fragment shader loops a given number of times,
+// so its GPU cost grows with the pixel count. It runs three phases: light,
+// heavy (4 times the work per pixel), then light again. Each phase prints
+// the scale it settled at and the scene's GPU time over its second half.
+// Expected: full scale while light, a lower scale near the budget while
+// heavy, and back to full scale once light again. With no budget given,
+// the budget is 1.5 times the light scene's cost at full scale.
+//
+// The scene is timed with glFinish on both sides rather than with
+// GpuProfiler. llvmpipe rasterizes at flush time, after the timer queries
+// around the draw have already been resolved. Each time is handed to the
+// controller GpuProfiler::FRAMES_IN_FLIGHT frames late, as the profiler's
+// would be.
+//
+// At the end the presented image is checked. Its far corner must hold
+// scene pixels, or the upscale didn't cover the window.
+
+#include "gl_check_context.h"
+#include "../gpu_profiler.h"
+#include "../dynamic_resolution.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+const int WINDOW_WIDTH  = 800;
+const int WINDOW_HEIGHT = 600;
+const int LIGHT_LOOPS   = 4;
+const int HEAVY_LOOPS   = 16;
+
+const char* VERTEX_SOURCE =
+  "#version 330 core\n"
+  "void main() {\n"
+  "  vec2 corner = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);\n"
+  "  gl_Position = vec4(corner, 0.0, 1.0);\n"
+  "}\n";
+
+const char* FRAGMENT_SOURCE =
+  "#version 330 core\n"
+  "uniform int loops;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  float v = gl_FragCoord.x * 0.01;\n"
+  "  for (int i = 0; i < loops; ++i) v = fract(sin(v) * 43758.5453 + gl_FragCoord.y * 0.001);\n"
+  "  frag_color = vec4(0.5 + v * 0.5, 0.5, 0.25, 1.0);\n"
+  "}\n";
+
+struct Phase {
+  const char* name;
+  int         loops;
+};
+
+// scene times waiting to be "read back"
+struct Timings {
+  double   ms[GpuProfiler::FRAMES_IN_FLIGHT] {};
+  uint64_t frame {0};
+};
+
+// Run frames of the scene; returns the average scene ms over the second half.
+double run(Timings& timings, DynamicResolution& resolution, GLuint program, GLuint window_framebuffer, int loops,
+           int frames, double& scale_average) {
+  const int LATENCY = GpuProfiler::FRAMES_IN_FLIGHT;
+  double ms_total = 0.0, scale_total = 0.0;
+  for (int frame = 0; frame < frames; ++frame, ++timings.frame) {
+    if (timings.frame >= (uint64_t)LATENCY) {
+      uint64_t measured = timings.frame - LATENCY;
+      resolution.update(timings.ms[measured % LATENCY], measured, timings.frame);
+    }
+
+    glFinish();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    resolution.beginScene();
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "loops"), loops);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glFinish();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    timings.ms[timings.frame % LATENCY] = ms;
+
+    resolution.present(window_framebuffer);
+    if (frame >= frames / 2) {
+      ms_total += ms;
+      scale_total += resolution.currentScale();
+    }
+  }
+  scale_average = scale_total / (frames - frames / 2);
+  return ms_total / (frames - frames / 2);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? std::atoi(argv[1]) : 150;
+  if (frames < 20) frames = 150;
+  double budget_ms = argc > 2 ? std::atof(argv[2]) : 0.0;
+
+  GlCheckContext context("dynamic_resolution_check");
+  if (!context.isValid()) return 1;
+
+  GLuint window_framebuffer = context.createTarget(WINDOW_WIDTH, WINDOW_HEIGHT);
+  glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  GLuint program = context.link(VERTEX_SOURCE, FRAGMENT_SOURCE);
+  if (!program) return 1;
+
+  GLuint vertex_array;
+  glGenVertexArrays(1, &vertex_array);
+  glBindVertexArray(vertex_array);
+
+  int failures = 0;
+  {
+    Timings timings;
+    DynamicResolution resolution;
+    if (!resolution.resize(WINDOW_WIDTH, WINDOW_HEIGHT)) return 1;
+
+    // calibrate: the light scene at full scale, with the budget out of reach
+    double scale;
+    resolution.budget_ms = 1e9;
+    double light_ms = run(timings, resolution, program, window_framebuffer, LIGHT_LOOPS, 40, scale);
+    resolution.budget_ms = budget_ms > 0.0 ? budget_ms : light_ms * 1.5;
+    std::printf("light scene %.2f ms at full scale, budget %.2f ms\n", light_ms, resolution.budget_ms);
+
+    const Phase phases[] = {{"light", LIGHT_LOOPS}, {"heavy", HEAVY_LOOPS}, {"light", LIGHT_LOOPS}};
+    double settled[3];
+    for (int p = 0; p < 3; ++p) {
+      double ms = run(timings, resolution, program, window_framebuffer, phases[p].loops, frames, settled[p]);
+      std::printf("%-5s (%2d loops): scale %.2f (%dx%d), %.2f average over the second half, scene %.2f ms\n",
+                  phases[p].name, phases[p].loops, resolution.currentScale(), resolution.renderWidth(),
+                  resolution.renderHeight(), settled[p], ms);
+    }
+    resolution.printStats();
+
+    if (!(settled[1] < settled[0] - 0.01f)) {
+      std::printf("FAIL: the scale didn't drop under the heavy load\n");
+      ++failures;
+    }
+    if (!(settled[2] > settled[1] + 0.01f)) {
+      std::printf("FAIL: the scale didn't recover after the heavy load\n");
+      ++failures;
+    }
+
+    unsigned char corner[4] = {0, 0, 0, 0};
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, window_framebuffer);
+    glReadPixels(WINDOW_WIDTH - 1, WINDOW_HEIGHT - 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, corner);
+    if (corner[0] < 100 || corner[2] > 100) {  // scene pixels are orange-ish, the cleared window magenta
+      std::printf("FAIL: the window's far corner is (%d, %d, %d), not scene\n", corner[0], corner[1], corner[2]);
+      ++failures;
+    }
+
+    resolution.release();
+  }
+
+  glDeleteVertexArrays(1, &vertex_array);
+  glDeleteProgram(program);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
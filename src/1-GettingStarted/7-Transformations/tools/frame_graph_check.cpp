@@ -0,0 +1,435 @@
+// Ordering, culling, barriers and cost of a FrameGraph (see frame_graph.h).
+//
+//   frame_graph_check [frames]
+//
+// Opens a hidden window (4.3 if it can, for the barrier check) and checks:
+//
+// - ordering: a scene -> blur -> composite chain added backwards runs in
+//   dependency order and draws the same image as when added in order;
+// - culling: two debug passes whose output nothing reads don't run, and
+//   their targets are never allocated;
+// - errors: a cycle and a read of a target nothing writes fail to compile;
+// - barriers (4.3 only): a compute pass stores into an image and a
+//   storage buffer, a draw samples the image and reads the buffer, and a
+//   copy reads the buffer back. The graph must put exactly the right
+//   barrier bits before the draw and the copy, and the results must be
+//   right;
+// - cost: the CPU time of compile() and execute() for a 24-pass frame,
+//   every frame rebuilt from scratch as main.cpp does; once drawing, and
+//   once with empty passes for the graph's own share.
+
+#include "gl_check_context.h"
+#include "../render_target_pool.h"
+#include "../frame_graph.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+namespace {
+
+const int SIZE = 256; // of the "window"
+
+const char* VERTEX_SOURCE =
+  "#version 330 core\n"
+  "out vec2 uv;\n"
+  "void main() {\n"
+  "  vec2 corner = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);\n"
+  "  uv = corner * 0.5 + 0.5;\n"
+  "  gl_Position = vec4(corner, 0.0, 1.0);\n"
+  "}\n";
+
+const char* SCENE_SOURCE =
+  "#version 330 core\n"
+  "in vec2 uv;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  frag_color = vec4(step(0.5, fract(uv * 8.0)), 0.25, 1.0);\n"
+  "}\n";
+
+const char* BLUR_SOURCE =
+  "#version 330 core\n"
+  "in vec2 uv;\n"
+  "uniform sampler2D source;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  vec2 texel = 1.0 / vec2(textureSize(source, 0));\n"
+  "  vec4 sum = vec4(0.0);\n"
+  "  for (int y = -2; y <= 2; ++y)\n"
+  "    for (int x = -2; x <= 2; ++x) sum += texture(source, uv + vec2(x, y) * texel);\n"
+  "  frag_color = sum / 25.0;\n"
+  "}\n";
+
+const char* COMPOSITE_SOURCE =
+  "#version 330 core\n"
+  "in vec2 uv;\n"
+  "uniform sampler2D source;\n"
+  "uniform sampler2D blurred;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  frag_color = mix(texture(source, uv), texture(blurred, uv), 0.5);\n"
+  "}\n";
+
+// writes the image and sums its texels' green into the buffer
+const char* GENERATE_SOURCE =
+  "#version 430 core\n"
+  "layout (local_size_x = 8, local_size_y = 8) in;\n"
+  "layout (rgba8, binding = 0) uniform writeonly image2D target;\n"
+  "layout (std430, binding = 0) buffer Counts { uint total; uint texels; };\n"
+  "void main() {\n"
+  "  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);\n"
+  "  uint green = uint(texel.x & 255);\n"
+  "  imageStore(target, texel, vec4(0.0, float(green) / 255.0, 1.0, 1.0));\n"
+  "  atomicAdd(total, green);\n"
+  "  atomicAdd(texels, 1u);\n"
+  "}\n";
+
+// shows the image, tinted red if the buffer didn't see every texel
+const char* SHADE_SOURCE =
+  "#version 430 core\n"
+  "in vec2 uv;\n"
+  "uniform sampler2D source;\n"
+  "layout (std430, binding = 0) buffer Counts { uint total; uint texels; };\n"
+  "uniform uint expected_texels;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  frag_color = texture(source, uv);\n"
+  "  if (texels != expected_texels) frag_color.r = 1.0;\n"
+  "}\n";
+
+typedef void (APIENTRYP DispatchComputeProc)(GLuint groups_x, GLuint groups_y, GLuint groups_z);
+typedef void (APIENTRYP BindImageTextureProc)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer,
+                                               GLenum access, GLenum format);
+
+GLuint link(const GlCheckContext& context, const char* fragment_source) {
+  GLuint program = context.link(VERTEX_SOURCE, fragment_source);
+  if (!program) return 0;
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "source"), 0);
+  glUniform1i(glGetUniformLocation(program, "blurred"), 1);
+  return program;
+}
+
+void drawFullScreen(GLuint program, GLuint source, GLuint second = 0) {
+  glUseProgram(program);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, second);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, source);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+std::vector<unsigned char> readWindow(GLuint window_framebuffer) {
+  std::vector<unsigned char> pixels((size_t)SIZE * SIZE * 4);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, window_framebuffer);
+  glReadPixels(0, 0, SIZE, SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  return pixels;
+}
+
+struct Programs {
+  GLuint scene, blur, composite;
+};
+
+// scene -> blur -> composite into the window, plus two debug passes
+// nothing reads; backwards adds them in reverse
+void buildChain(FrameGraph& graph, const Programs& programs, GLuint window_framebuffer, bool backwards) {
+  typedef FrameGraph::Resource Resource;
+  graph.reset();
+  Resource color   = graph.create("color", RenderTargetDesc(SIZE, SIZE, GL_RGBA8));
+  Resource depth   = graph.create("depth", RenderTargetDesc(SIZE, SIZE, GL_DEPTH_COMPONENT24));
+  Resource blurred = graph.create("blurred", RenderTargetDesc(SIZE / 2, SIZE / 2, GL_RGBA8));
+  Resource mask    = graph.create("debug_mask", RenderTargetDesc(SIZE, SIZE, GL_R8));
+  Resource view    = graph.create("debug_view", RenderTargetDesc(SIZE, SIZE, GL_RGBA16F));
+  Resource window  = graph.importFramebuffer("window", window_framebuffer, SIZE, SIZE);
+
+  std::function<void()> adds[5] = {
+    [&]() {
+      graph.addPass("scene", {}, {color, depth}, [&programs](FrameGraph&) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawFullScreen(programs.scene, 0);
+      });
+    },
+    [&]() {
+      graph.addPass("debug_mask", {color}, {mask}, [](FrameGraph&) { glClear(GL_COLOR_BUFFER_BIT); });
+    },
+    [&]() {
+      graph.addPass("blur", {color}, {blurred}, [&programs, color](FrameGraph& g) {
+        drawFullScreen(programs.blur, g.texture(color));
+      });
+    },
+    [&]() {
+      graph.addPass("debug_view", {color, mask}, {view}, [](FrameGraph&) { glClear(GL_COLOR_BUFFER_BIT); });
+    },
+    [&]() {
+      graph.addPass("composite", {color, blurred}, {window}, [&programs, color, blurred](FrameGraph& g) {
+        drawFullScreen(programs.composite, g.texture(color), g.texture(blurred));
+      });
+    },
+  };
+  for (int i = 0; i < 5; ++i) adds[backwards ? 4 - i : i]();
+}
+
+int checkOrderAndCulling(const Programs& programs, GLuint window_framebuffer) {
+  int failures = 0;
+  RenderTargetPool pool;
+  FrameGraph graph(pool);
+
+  pool.beginFrame();
+  buildChain(graph, programs, window_framebuffer, false);
+  if (!graph.compile()) return 1;
+  graph.execute();
+  std::vector<unsigned char> expected = readWindow(window_framebuffer);
+
+  pool.beginFrame();
+  buildChain(graph, programs, window_framebuffer, true);
+  if (!graph.compile()) return 1;
+  graph.execute();
+  std::vector<unsigned char> image = readWindow(window_framebuffer);
+  graph.printStats();
+
+  std::string order;
+  for (int pass : graph.executionOrder()) order += (order.empty() ? "" : " ") + graph.passName(pass);
+  std::printf("added backwards, runs as: %s\n", order.c_str());
+  if (order != "scene blur composite") {
+    std::printf("FAIL: expected \"scene blur composite\"\n");
+    ++failures;
+  }
+  size_t differing = 0;
+  for (size_t i = 0; i < image.size(); ++i)
+    if (image[i] != expected[i]) ++differing;
+  if (differing) {
+    std::printf("FAIL: %zu bytes differ from the chain added in order\n", differing);
+    ++failures;
+  }
+  if (pool.getStats().allocations != 3) {
+    std::printf("FAIL: %llu targets created, expected 3 (the debug targets must not be)\n",
+                (unsigned long long)pool.getStats().allocations);
+    ++failures;
+  }
+
+  // errors, which also print their ERROR:: lines
+  std::printf("two expected errors follow:\n");
+  typedef FrameGraph::Resource Resource;
+  graph.reset();
+  Resource a = graph.create("a", RenderTargetDesc(8, 8, GL_RGBA8));
+  Resource b = graph.create("b", RenderTargetDesc(8, 8, GL_RGBA8));
+  graph.addPass("ping", {b}, {a}, [](FrameGraph&) {});
+  graph.addPass("pong", {a}, {b}, [](FrameGraph&) {});
+  if (graph.compile()) {
+    std::printf("FAIL: a cycle compiled\n");
+    ++failures;
+  }
+  graph.reset();
+  Resource never = graph.create("never_written", RenderTargetDesc(8, 8, GL_RGBA8));
+  Resource out = graph.importFramebuffer("window", window_framebuffer, SIZE, SIZE);
+  graph.addPass("reader", {never}, {out}, [](FrameGraph&) {});
+  if (graph.compile()) {
+    std::printf("FAIL: a read of an unwritten target compiled\n");
+    ++failures;
+  }
+  pool.release();
+  return failures;
+}
+
+int checkBarriers(const GlCheckContext& context, GLuint window_framebuffer) {
+  DispatchComputeProc dispatchCompute = (DispatchComputeProc)glfwGetProcAddress("glDispatchCompute");
+  BindImageTextureProc bindImageTexture = (BindImageTextureProc)glfwGetProcAddress("glBindImageTexture");
+  GLuint generate = context.link(nullptr, nullptr, GENERATE_SOURCE);
+  GLuint shade = link(context, SHADE_SOURCE);
+  if (!dispatchCompute || !bindImageTexture || !generate || !shade) return 1;
+  glUseProgram(shade);
+  glUniform1ui(glGetUniformLocation(shade, "expected_texels"), SIZE * SIZE);
+
+  GLuint counts, readback;
+  glGenBuffers(1, &counts);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, counts);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, 8, NULL, GL_DYNAMIC_COPY);
+  glGenBuffers(1, &readback);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, readback);
+  glBufferData(GL_COPY_WRITE_BUFFER, 8, NULL, GL_STREAM_READ);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  typedef FrameGraph::Resource Resource;
+  RenderTargetPool pool;
+  FrameGraph graph(pool, (GLADloadproc)glfwGetProcAddress);
+  Resource image   = graph.create("generated", RenderTargetDesc(SIZE, SIZE, GL_RGBA8));
+  Resource storage = graph.importBuffer("counts", counts);
+  Resource copy    = graph.importBuffer("readback", readback);
+  Resource window  = graph.importFramebuffer("window", window_framebuffer, SIZE, SIZE);
+
+  int generate_pass = graph.addPass("generate", {},
+    {FrameGraph::Access(image, FrameGraph::IMAGE), FrameGraph::Access(storage, FrameGraph::STORAGE)},
+    [&](FrameGraph& g) {
+      GLuint zero[2] = {0, 0};
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, g.texture(storage));
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, 8, zero);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g.texture(storage));
+      bindImageTexture(0, g.texture(image), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+      glUseProgram(generate);
+      dispatchCompute(SIZE / 8, SIZE / 8, 1);
+    });
+  int shade_pass = graph.addPass("shade", {image, FrameGraph::Access(storage, FrameGraph::STORAGE)}, {window},
+    [&](FrameGraph& g) {
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g.texture(storage));
+      drawFullScreen(shade, g.texture(image));
+    });
+  int copy_pass = graph.addPass("read_back", {FrameGraph::Access(storage, FrameGraph::COPY)},
+    {FrameGraph::Access(copy, FrameGraph::COPY)}, [&](FrameGraph& g) {
+      glBindBuffer(GL_COPY_READ_BUFFER, g.texture(storage));
+      glBindBuffer(GL_COPY_WRITE_BUFFER, g.texture(copy));
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 8);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    });
+
+  int failures = 0;
+  pool.beginFrame();
+  if (!graph.compile()) return 1;
+  graph.execute();
+  graph.printStats();
+
+  GLbitfield expected[3] = {
+    0,
+    GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT,
+    GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT,
+  };
+  int checked[3] = {generate_pass, shade_pass, copy_pass};
+  for (int i = 0; i < 3; ++i) {
+    GLbitfield bits = graph.passBarriers(checked[i]);
+    std::printf("barrier before %-9s 0x%04x\n", graph.passName(checked[i]).c_str(), bits);
+    if (bits != expected[i]) {
+      std::printf("FAIL: expected 0x%04x\n", expected[i]);
+      ++failures;
+    }
+  }
+
+  GLuint values[2] = {0, 0};
+  glBindBuffer(GL_COPY_READ_BUFFER, readback);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, 0, 8, values);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  GLuint expected_total = 0;
+  for (int x = 0; x < SIZE; ++x) expected_total += (GLuint)(x & 255) * SIZE;
+  std::vector<unsigned char> pixels = readWindow(window_framebuffer);
+  size_t wrong = 0;
+  for (int y = 0; y < SIZE; ++y)
+    for (int x = 0; x < SIZE; ++x) {
+      const unsigned char* p = &pixels[((size_t)y * SIZE + x) * 4];
+      if (p[0] != 0 || p[1] != (unsigned char)(x & 255) || p[2] != 255) ++wrong;
+    }
+  std::printf("read back %u texels, total %u (expected %u); %zu of %d pixels wrong\n", values[1], values[0],
+              expected_total, wrong, SIZE * SIZE);
+  if (values[1] != (GLuint)(SIZE * SIZE) || values[0] != expected_total || wrong) {
+    std::printf("FAIL: the compute results didn't arrive\n");
+    ++failures;
+  }
+
+  pool.release();
+  glDeleteBuffers(1, &counts);
+  glDeleteBuffers(1, &readback);
+  glDeleteProgram(generate);
+  glDeleteProgram(shade);
+  return failures;
+}
+
+// A 24-pass frame: four chains of scene -> 4 blurs -> composite, each
+// into its own quarter of the window. Without draw the passes only get
+// their framebuffers bound, which leaves the graph's own cost.
+void buildLarge(FrameGraph& graph, const Programs& programs, GLuint window_framebuffer, bool draw) {
+  typedef FrameGraph::Resource Resource;
+  graph.reset();
+  Resource window = graph.importFramebuffer("window", window_framebuffer, SIZE, SIZE);
+  static const char* names[4][6] = {
+    {"scene0", "blur0a", "blur0b", "blur0c", "blur0d", "composite0"},
+    {"scene1", "blur1a", "blur1b", "blur1c", "blur1d", "composite1"},
+    {"scene2", "blur2a", "blur2b", "blur2c", "blur2d", "composite2"},
+    {"scene3", "blur3a", "blur3b", "blur3c", "blur3d", "composite3"},
+  };
+  for (int chain = 0; chain < 4; ++chain) {
+    Resource current = graph.create(names[chain][0], RenderTargetDesc(SIZE / 2, SIZE / 2, GL_RGBA8));
+    graph.addPass(names[chain][0], {}, {current}, [&programs, draw](FrameGraph&) {
+      if (draw) drawFullScreen(programs.scene, 0);
+    });
+    for (int blur = 1; blur <= 4; ++blur) {
+      Resource next = graph.create(names[chain][blur], RenderTargetDesc(SIZE / 4, SIZE / 4, GL_RGBA8));
+      graph.addPass(names[chain][blur], {current}, {next}, [&programs, current, draw](FrameGraph& g) {
+        if (draw) drawFullScreen(programs.blur, g.texture(current));
+      });
+      current = next;
+    }
+    graph.addPass(names[chain][5], {current}, {window}, [&programs, current, chain, draw](FrameGraph& g) {
+      glViewport((chain % 2) * SIZE / 2, (chain / 2) * SIZE / 2, SIZE / 2, SIZE / 2);
+      if (draw) drawFullScreen(programs.blur, g.texture(current));
+    });
+  }
+}
+
+void measure(const Programs& programs, GLuint window_framebuffer, int frames, bool draw) {
+  RenderTargetPool pool;
+  FrameGraph graph(pool);
+  double build_seconds = 0.0;
+  for (int frame = 0; frame < frames; ++frame) {
+    pool.beginFrame();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    buildLarge(graph, programs, window_framebuffer, draw);
+    build_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!graph.compile()) return;
+    graph.execute();
+    glFinish();
+  }
+  std::printf("--- %d passes, %d frames%s\n", graph.passCount(), frames, draw ? "" : ", empty passes");
+  if (draw) {
+    graph.printStats();
+    pool.printStats();
+  }
+  std::printf("declaring %.2f us, compile %.2f us, execute %.2f us per frame (CPU)\n", build_seconds / frames * 1e6,
+              graph.averageCompile() * 1e6, graph.averageExecute() * 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+  if (frames < 1) frames = 200;
+
+  GlCheckContext context("frame_graph_check", 4, 3);  // 4.3 for the barrier check
+  if (!context.isValid()) return 1;
+
+  Programs programs = {link(context, SCENE_SOURCE), link(context, BLUR_SOURCE), link(context, COMPOSITE_SOURCE)};
+  if (!programs.scene || !programs.blur || !programs.composite) return 1;
+
+  GLuint window_framebuffer = context.createTarget(SIZE, SIZE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  GLuint vertex_array;
+  glGenVertexArrays(1, &vertex_array);
+  glBindVertexArray(vertex_array);
+
+  int failures = 0;
+  std::printf("--- ordering and culling\n");
+  failures += checkOrderAndCulling(programs, window_framebuffer);
+  if (context.atLeast(4, 3)) {
+    std::printf("--- barriers\n");
+    failures += checkBarriers(context, window_framebuffer);
+  } else {
+    std::printf("--- barriers skipped: no 4.3 context\n");
+  }
+  measure(programs, window_framebuffer, frames, true);
+  measure(programs, window_framebuffer, frames, false);
+
+  glDeleteVertexArrays(1, &vertex_array);
+  glDeleteProgram(programs.scene);
+  glDeleteProgram(programs.blur);
+  glDeleteProgram(programs.composite);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
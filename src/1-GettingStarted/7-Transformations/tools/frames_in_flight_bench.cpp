@@ -0,0 +1,136 @@
+// CPU/GPU overlap with 1, 2 and 3 frames in flight (see frames_in_flight.h).
+//
+//   frames_in_flight_bench [frames per run]
+//
+// Opens a hidden window. Each frame spends 4 ms of CPU time "building the
+// frame", then writes the frame number into its copy of a uniform block
+// through DynamicBuffer. Its GPU work is a fragment-heavy draw that reads
+// the block, followed by a copy of the block into a per-frame log. At the
+// end the log is read back. An entry that doesn't hold its own frame number
+// means the CPU overwrote data the GPU hadn't used yet.
+//
+// Each run prints the frame time, how long the CPU waited on fences, and
+// how many log entries were wrong. The last run skips the fence wait, to
+// show what the wait protects against. On a driver that really runs the
+// GPU apart from the CPU, that run is where wrong entries turn up.
+
+#include "gl_check_context.h"
+#include "../frames_in_flight.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const int    SIZE        = 512;   // of the offscreen target
+const double CPU_SECONDS = 0.004; // of simulated frame building
+
+const char* VERTEX_SOURCE =
+  "#version 330 core\n"
+  "void main() {\n"
+  "  vec2 corner = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);\n"
+  "  gl_Position = vec4(corner, 0.0, 1.0);\n"
+  "}\n";
+
+// enough arithmetic per pixel to make the GPU's share of a frame last
+const char* FRAGMENT_SOURCE =
+  "#version 330 core\n"
+  "layout (std140) uniform FrameData { uvec4 frame; };\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  float v = float(frame.x) * 0.001 + gl_FragCoord.x * 0.01;\n"
+  "  for (int i = 0; i < 4; ++i) v = fract(sin(v) * 43758.5453 + gl_FragCoord.y * 0.001);\n"
+  "  frag_color = vec4(v, float(frame.x & 255u) / 255.0, 0.0, 1.0);\n"
+  "}\n";
+
+void busy(double seconds) {
+  std::chrono::steady_clock::time_point until =
+    std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+  while (std::chrono::steady_clock::now() < until) {}
+}
+
+void run(GLuint program, int frames_in_flight_count, bool wait_for_fences, int frames) {
+  FramesInFlight frames_in_flight(frames_in_flight_count);
+  DynamicBuffer frame_data;
+  frame_data.create(GL_UNIFORM_BUFFER, 16, frames_in_flight.frames());
+
+  GLuint log;
+  glGenBuffers(1, &log);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, log);
+  glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)frames * 16, NULL, GL_STREAM_COPY);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  glFinish();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < frames; ++frame) {
+    // without the wait, sets are still cycled but reused blindly
+    int set = wait_for_fences ? frames_in_flight.beginFrame() : frame % frames_in_flight.frames();
+    busy(CPU_SECONDS);
+
+    uint32_t* data = static_cast<uint32_t*>(frame_data.map(set));
+    if (data) {
+      data[0] = (uint32_t)frame;
+      data[1] = data[2] = data[3] = 0;
+      frame_data.unmap();
+    }
+
+    glUseProgram(program);
+    frame_data.bindRange(0, set);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, frame_data.id());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, log);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, frame_data.offset(set), (GLintptr)frame * 16, 16);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (wait_for_fences) frames_in_flight.endFrame();
+    else glFlush();
+  }
+  glFinish();
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<uint32_t> entries((size_t)frames * 4);
+  glBindBuffer(GL_COPY_READ_BUFFER, log);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)entries.size() * 4, entries.data());
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  int wrong = 0;
+  for (int frame = 0; frame < frames; ++frame)
+    if (entries[(size_t)frame * 4] != (uint32_t)frame) ++wrong;
+
+  std::printf("%d in flight%s: %.2f ms per frame, %.2f ms per frame waiting on fences, %d of %d entries wrong\n",
+              frames_in_flight.frames(), wait_for_fences ? "" : " (no fence wait)", ms / frames,
+              frames_in_flight.totalStall() * 1000.0 / frames, wrong, frames);
+  if (wait_for_fences) frames_in_flight.printStats();
+
+  glDeleteBuffers(1, &log);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+  if (frames < 1) frames = 200;
+
+  GlCheckContext context("frames_in_flight_bench");
+  if (!context.isValid()) return 1;
+  context.createTarget(SIZE, SIZE);
+
+  GLuint program = context.link(VERTEX_SOURCE, FRAGMENT_SOURCE);
+  if (!program) return 1;
+  glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameData"), 0);
+
+  GLuint vertex_array;
+  glGenVertexArrays(1, &vertex_array);
+  glBindVertexArray(vertex_array);
+
+  for (int count = 1; count <= FramesInFlight::MAX_FRAMES; ++count)
+    run(program, count, true, frames);
+  run(program, FramesInFlight::MAX_FRAMES, false, frames);
+
+  glDeleteVertexArrays(1, &vertex_array);
+  glDeleteProgram(program);
+  return 0;
+}
@@ -0,0 +1,155 @@
+#ifndef GL_CHECK_CONTEXT_H
+#define GL_CHECK_CONTEXT_H
+
+// The GL setup the tools that draw share: a hidden window with a core
+// context, GLAD loaded, offscreen targets to draw into (a hidden window
+// may have no back buffer to read) and shader programs:
+//
+//   GlCheckContext context("frame_graph_check", 4, 3);  // else 3.3
+//   if (!context.isValid()) return 1;
+//   GLuint target  = context.createTarget(64, 64);
+//   GLuint program = context.link(vertex_source, fragment_source);
+//
+// Failures print ERROR::<TOOL NAME>::... to stderr. The targets are
+// deleted, and GLFW terminated, when the context goes out of scope.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+
+class GlCheckContext {
+  public:
+    // A major.minor context, or 3.3 if the driver has no major.minor.
+    GlCheckContext(const char* tool_name, int major = 3, int minor = 3) {
+      for (const char* c = tool_name; *c; ++c)
+        name += (char)std::toupper((unsigned char)*c);
+
+      if (!glfwInit()) {
+        error("GLFW_INIT_FAILED");
+        return;
+      }
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+      glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+      glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+      window = glfwCreateWindow(64, 64, tool_name, NULL, NULL);
+      if (!window && (major != 3 || minor != 3)) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(64, 64, tool_name, NULL, NULL);
+      }
+      if (!window) {
+        error("NO_CONTEXT");
+        glfwTerminate();
+        return;
+      }
+      glfwMakeContextCurrent(window);
+      if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        error("GLAD_INIT_FAILED");
+        glfwTerminate();
+        window = NULL;
+        return;
+      }
+      glGetIntegerv(GL_MAJOR_VERSION, &version_major);
+      glGetIntegerv(GL_MINOR_VERSION, &version_minor);
+      std::printf("%s | %s\n", (const char*)glGetString(GL_VERSION), (const char*)glGetString(GL_RENDERER));
+    }
+
+    ~GlCheckContext() {
+      if (!window) return;
+      for (size_t i = 0; i < framebuffers.size(); ++i)
+        glDeleteFramebuffers(1, &framebuffers[i]);
+      for (size_t i = 0; i < renderbuffers.size(); ++i)
+        glDeleteRenderbuffers(1, &renderbuffers[i]);
+      glfwTerminate();
+    }
+
+    GlCheckContext(const GlCheckContext&) = delete;
+    GlCheckContext& operator=(const GlCheckContext&) = delete;
+
+    bool isValid() const {
+      return window != NULL;
+    }
+
+    bool atLeast(int major, int minor) const {
+      return version_major > major || (version_major == major && version_minor >= minor);
+    }
+
+    // An RGBA8 framebuffer (with a 24-bit depth buffer if asked), left bound.
+    GLuint createTarget(int width, int height, bool depth = false) {
+      GLuint framebuffer, color;
+      glGenFramebuffers(1, &framebuffer);
+      glGenRenderbuffers(1, &color);
+      glBindRenderbuffer(GL_RENDERBUFFER, color);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+      renderbuffers.push_back(color);
+      if (depth) {
+        GLuint depth_buffer;
+        glGenRenderbuffers(1, &depth_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+        renderbuffers.push_back(depth_buffer);
+      }
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+      glViewport(0, 0, width, height);
+      framebuffers.push_back(framebuffer);
+      return framebuffer;
+    }
+
+    // Compile and link a program from the stages given (nullptr skips one);
+    // 0 if it doesn't link.
+    GLuint link(const char* vertex_source, const char* fragment_source, const char* compute_source = nullptr) const {
+      GLuint program = glCreateProgram();
+      std::vector<GLuint> shaders;
+      const GLenum types[3] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_COMPUTE_SHADER};
+      const char* sources[3] = {vertex_source, fragment_source, compute_source};
+      for (int i = 0; i < 3; ++i) {
+        if (!sources[i]) continue;
+        GLuint shader = glCreateShader(types[i]);
+        glShaderSource(shader, 1, &sources[i], NULL);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        shaders.push_back(shader);
+      }
+      glLinkProgram(program);
+      for (size_t i = 0; i < shaders.size(); ++i)
+        glDeleteShader(shaders[i]);
+      GLint linked = 0;
+      glGetProgramiv(program, GL_LINK_STATUS, &linked);
+      if (!linked) {
+        char log[1024] = "";
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        error("PROGRAM_NOT_LINKED", log);
+        glDeleteProgram(program);
+        return 0;
+      }
+      return program;
+    }
+
+    // ERROR::<TOOL NAME>::what [detail]
+    void error(const char* what, const char* detail = "") const {
+      std::fprintf(stderr, "ERROR::%s::%s%s%s\n", name.c_str(), what, *detail ? " " : "", detail);
+    }
+
+  private:
+    std::string name;
+    GLFWwindow* window        {NULL};
+    GLint       version_major {0};
+    GLint       version_minor {0};
+    std::vector<GLuint> framebuffers;
+    std::vector<GLuint> renderbuffers;
+};
+#endif
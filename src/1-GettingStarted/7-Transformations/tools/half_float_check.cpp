@@ -0,0 +1,194 @@
+// Half-float loading against float loading (see stbi_loadh in
+// stb_image.h).
+//
+//   half_float_check
+//
+// Run it from 7-Transformations. Every value stbi_loadh_* returns must be
+// the half of what stbi_loadf_* returns for the same image, clamped to
+// 65504 and rounded to nearest even by a plain reference conversion
+// written here, bit for bit. Covered, for vertical flip off and on and
+// every desired_channels from 0 to 4: Radiance files made here, one flat
+// and one run-length encoded, with exponents from zero through half
+// denormals to well past the half range, the same RLE file through
+// stbi_loadh() from disk, and the JPEG and PNG textures (8-bit, converted
+// with the LDR gamma).
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+const double HALF_MAX = 65504.0;
+
+struct Image {
+  std::string name;
+  std::vector<unsigned char> bytes;
+};
+
+// IEEE half of f: clamped to the largest finite half, rounded to nearest
+// even (nearbyint in the default rounding mode)
+uint16_t referenceHalf(float f) {
+  double a = std::min(std::fabs((double)f), HALF_MAX);
+  uint16_t sign = std::signbit(f) ? 0x8000 : 0;
+  if (a < std::ldexp(1.0, -14)) // denormal: multiples of 2^-24, 1024 rounds up to the smallest normal
+    return (uint16_t)(sign | (uint16_t)std::nearbyint(std::ldexp(a, 24)));
+  int exponent;
+  double mantissa = std::frexp(a, &exponent); // a = mantissa * 2^exponent, mantissa in [0.5, 1)
+  double bits = std::nearbyint(std::ldexp(mantissa, 11)); // 1.xxx with 10 fraction bits
+  if (bits == 2048.0) {
+    bits = 1024.0;
+    ++exponent;
+  }
+  return (uint16_t)(sign | ((exponent - 1 + 15) << 10) | ((uint16_t)bits - 1024));
+}
+
+// a Radiance file of random RGBE pixels, exponent 0 (black) in one in ten,
+// the rest between 2^-30 and 2^20; scanlines flat or new-style run-length
+// encoded, all literals
+std::vector<unsigned char> makeHdr(int width, int height, bool rle, std::mt19937& random) {
+  std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " +
+                       std::to_string(width) + "\n";
+  std::vector<unsigned char> hdr(header.begin(), header.end());
+  std::vector<unsigned char> line((size_t)width * 4);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      unsigned char* pixel = &line[(size_t)x * 4];
+      for (int c = 0; c < 3; ++c) pixel[c] = (unsigned char)random();
+      pixel[3] = random() % 10 == 0 ? 0 : (unsigned char)(128 - 30 + random() % 51);
+    }
+    if (!rle) {
+      if (line[0] == 2 && line[1] == 2) line[0] = 3; // would read as an RLE marker
+      hdr.insert(hdr.end(), line.begin(), line.end());
+      continue;
+    }
+    hdr.insert(hdr.end(), {2, 2, (unsigned char)(width >> 8), (unsigned char)width});
+    for (int c = 0; c < 4; ++c) {
+      for (int x = 0; x < width; x += 128) {
+        int count = std::min(128, width - x);
+        hdr.push_back((unsigned char)count);
+        for (int i = 0; i < count; ++i) hdr.push_back(line[(size_t)(x + i) * 4 + c]);
+      }
+    }
+  }
+  return hdr;
+}
+
+// loadh against loadf of one image; returns failures
+int compare(const char* name, float* floats, stbi_us* halves, int fw, int fh, int fc, int hw, int hh, int hc,
+            int flip, int desired_channels, size_t& clamped) {
+  int failures = 0;
+  if (!floats || !halves || fw != hw || fh != hh || fc != hc) {
+    std::printf("FAIL: %s, flip %d, %d channels: %s\n", name, flip, desired_channels,
+                !floats || !halves ? stbi_failure_reason() : "sizes differ");
+    failures = 1;
+  } else {
+    size_t count = (size_t)fw * fh * (desired_channels ? desired_channels : fc);
+    for (size_t i = 0; i < count; ++i) {
+      if (std::fabs(floats[i]) > HALF_MAX) ++clamped;
+      if (halves[i] != referenceHalf(floats[i])) {
+        std::printf("FAIL: %s, flip %d, %d channels: value %zu is %04x, the half of %g is %04x\n", name, flip,
+                    desired_channels, i, halves[i], floats[i], referenceHalf(floats[i]));
+        failures = 1;
+        break;
+      }
+    }
+  }
+  stbi_image_free(floats);
+  stbi_image_free(halves);
+  return failures;
+}
+
+int compareMemory(const Image& image, int flip, int desired_channels, size_t& clamped) {
+  stbi_set_flip_vertically_on_load(flip);
+  int fw, fh, fc, hw, hh, hc;
+  const stbi_uc* bytes = image.bytes.data();
+  int size = (int)image.bytes.size();
+  float* floats = stbi_loadf_from_memory(bytes, size, &fw, &fh, &fc, desired_channels);
+  stbi_us* halves = stbi_loadh_from_memory(bytes, size, &hw, &hh, &hc, desired_channels);
+  return compare(image.name.c_str(), floats, halves, fw, fh, fc, hw, hh, hc, flip, desired_channels, clamped);
+}
+
+int compareFile(const std::string& path, int flip, int desired_channels, size_t& clamped) {
+  stbi_set_flip_vertically_on_load(flip);
+  int fw, fh, fc, hw, hh, hc;
+  float* floats = stbi_loadf(path.c_str(), &fw, &fh, &fc, desired_channels);
+  stbi_us* halves = stbi_loadh(path.c_str(), &hw, &hh, &hc, desired_channels);
+  return compare("HDR file", floats, halves, fw, fh, fc, hw, hh, hc, flip, desired_channels, clamped);
+}
+
+bool readFile(const char* path, std::vector<unsigned char>& bytes) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !bytes.empty();
+}
+
+}  // namespace
+
+int main() {
+  // the reference itself, on values with known halves
+  const float known[] = {0.0f, 1.0f, -2.0f, 65504.0f, 65519.0f, 1e9f, 6.103515625e-05f, 5.9604645e-08f, 2.9802322e-08f,
+                         1.0f + 1.0f / 2048.0f, 1.0f + 3.0f / 2048.0f};
+  const uint16_t halves[] = {0x0000, 0x3c00, 0xc000, 0x7bff, 0x7bff, 0x7bff, 0x0400, 0x0001, 0x0000, 0x3c00, 0x3c02};
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); ++i) {
+    if (referenceHalf(known[i]) != halves[i]) {
+      std::printf("FAIL: the reference gives %04x for %g, not %04x\n", referenceHalf(known[i]), known[i], halves[i]);
+      ++failures;
+    }
+  }
+
+  std::mt19937 random(1);
+  std::vector<Image> images;
+  images.push_back(Image {"flat HDR", makeHdr(5, 7, false, random)});
+  images.push_back(Image {"RLE HDR", makeHdr(200, 19, true, random)});
+  const char* textures[2] = {"./resources/textures/container.jpg", "./resources/textures/awesomeface.png"};
+  for (const char* path : textures) {
+    Image image;
+    image.name = path;
+    if (!readFile(path, image.bytes)) {
+      std::fprintf(stderr, "ERROR::HALF_FLOAT_CHECK::TEXTURES_NOT_FOUND run it from 7-Transformations\n");
+      return 1;
+    }
+    images.push_back(image);
+  }
+
+  for (const Image& image : images) {
+    int failed = 0;
+    size_t clamped = 0;
+    for (int flip = 0; flip <= 1; ++flip)
+      for (int desired_channels = 0; desired_channels <= 4; ++desired_channels)
+        failed += compareMemory(image, flip, desired_channels, clamped);
+    std::printf("%-36s %s, %zu values clamped\n", image.name.c_str(), failed ? "differs" : "halves match", clamped);
+    failures += failed;
+  }
+
+  std::string path = (std::filesystem::temp_directory_path() / "half_float_check.hdr").string();
+  std::ofstream(path, std::ios::binary)
+      .write((const char*)images[1].bytes.data(), (std::streamsize)images[1].bytes.size());
+  int failed = 0;
+  size_t clamped = 0;
+  for (int flip = 0; flip <= 1; ++flip)
+    for (int desired_channels = 0; desired_channels <= 4; ++desired_channels)
+      failed += compareFile(path, flip, desired_channels, clamped);
+  std::printf("%-36s %s, %zu values clamped\n", "RLE HDR from a file", failed ? "differs" : "halves match", clamped);
+  failures += failed;
+  std::error_code error;
+  std::filesystem::remove(path, error);
+  stbi_set_flip_vertically_on_load(0);
+
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
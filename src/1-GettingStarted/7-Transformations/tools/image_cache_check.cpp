@@ -0,0 +1,149 @@
+// Decoded-image cache hits, misses and contents (see image_cache.h).
+//
+//   image_cache_check
+//
+// Run it from 7-Transformations. It copies two textures into a temporary
+// directory, gives the cache an empty directory next to them and loads:
+//   - a JPEG twice: a miss, then a hit mapped from the entry
+//   - a copy of it under another name: a hit, as entries go by content
+//   - the JPEG as RGBA without mips: a miss, a different entry
+//   - the same with linear Kaiser mip options, which don't apply: a hit
+//   - the JPEG after it was overwritten with a PNG: a miss
+//   - the copy after every entry was truncated: a miss that rewrites it
+//   - a file that doesn't exist: a failure
+// Every level loaded must match what stb_image and MipChain make of the
+// source, and upload() must put each level into the bound texture.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "gl_check_context.h"
+#include "../image_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+// whether every level of image is what decoding path directly gives
+bool matchesSource(const char* path, const CachedImage& image, int desired_channels, bool mips) {
+  int width, height, file_channels;
+  unsigned char* pixels = stbi_load(path, &width, &height, &file_channels, desired_channels);
+  if (!pixels) return false;
+  int channels = desired_channels ? desired_channels : file_channels;
+  bool match = image.width == width && image.height == height && image.channels == channels;
+  if (match && mips) {
+    MipChain chain;
+    chain.generate(pixels, width, height, channels);
+    match = image.level_count == (int)chain.levels.size();
+    for (int i = 0; match && i < image.level_count; ++i)
+      match = std::memcmp(image.level(i), chain.levels[i].pixels.data(), chain.levels[i].pixels.size()) == 0;
+  } else if (match) {
+    match = image.level_count == 1 && std::memcmp(image.level(0), pixels, (size_t)width * height * channels) == 0;
+  }
+  stbi_image_free(pixels);
+  return match;
+}
+
+// whether upload() put every level of image into a texture unchanged
+bool uploadsIntact(const CachedImage& image) {
+  const GLenum formats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  image.upload();
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  bool intact = true;
+  std::vector<unsigned char> pixels;
+  for (int i = 0; intact && i < image.level_count; ++i) {
+    size_t size = (size_t)image.levelWidth(i) * image.levelHeight(i) * image.channels;
+    pixels.assign(size, 0);
+    glGetTexImage(GL_TEXTURE_2D, i, formats[image.channels - 1], GL_UNSIGNED_BYTE, pixels.data());
+    intact = std::memcmp(pixels.data(), image.level(i), size) == 0;
+  }
+  glDeleteTextures(1, &texture);
+  return intact;
+}
+
+}  // namespace
+
+int main() {
+  GlCheckContext context("image_cache_check");
+  if (!context.isValid()) return 1;
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "image_cache_check";
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  std::filesystem::create_directories(dir);
+  std::string photo = (dir / "photo.jpg").string();
+  std::string copy  = (dir / "copy.jpg").string();
+  std::string cache_dir = (dir / "cache").string();
+  std::filesystem::copy_file("./resources/textures/container.jpg", photo, error);
+  if (!error) std::filesystem::copy_file(photo, copy, error);
+  if (error) {
+    context.error("TEXTURES_NOT_FOUND", "run it from 7-Transformations");
+    return 1;
+  }
+
+  enum Before { NOTHING, OVERWRITE_PHOTO, TRUNCATE_ENTRIES };
+  struct Step {
+    const char* what;
+    Before before;
+    std::string path;
+    int  channels;
+    bool mips;
+    bool srgb;
+    MipFilter filter;
+    bool hit;
+  };
+
+  int failures = 0;
+  ImageCache cache(cache_dir.c_str());
+  const Step steps[] = {
+    {"JPEG, first load",         NOTHING,          photo, 0, true,  true,  MipFilter::Box,    false},
+    {"JPEG again",               NOTHING,          photo, 0, true,  true,  MipFilter::Box,    true},
+    {"copy of the JPEG",         NOTHING,          copy,  0, true,  true,  MipFilter::Box,    true},
+    {"JPEG as RGBA, no mips",    NOTHING,          photo, 4, false, true,  MipFilter::Box,    false},
+    {"the same, linear Kaiser",  NOTHING,          photo, 4, false, false, MipFilter::Kaiser, true},
+    {"JPEG overwritten by PNG",  OVERWRITE_PHOTO,  photo, 0, true,  true,  MipFilter::Box,    false},
+    {"copy, entries truncated",  TRUNCATE_ENTRIES, copy,  0, true,  true,  MipFilter::Box,    false},
+    {"copy again",               NOTHING,          copy,  0, true,  true,  MipFilter::Box,    true},
+  };
+  for (const Step& step : steps) {
+    if (step.before == OVERWRITE_PHOTO) {
+      std::filesystem::copy_file("./resources/textures/awesomeface.png", photo,
+                                 std::filesystem::copy_options::overwrite_existing, error);
+    } else if (step.before == TRUNCATE_ENTRIES) {
+      for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(cache_dir))
+        if (entry.path().extension() == ".img") std::filesystem::resize_file(entry.path(), 100, error);
+    }
+
+    size_t hits = cache.hits;
+    CachedImage image;
+    bool loaded = cache.load(step.path.c_str(), image, step.channels, step.mips, step.srgb, step.filter);
+    bool hit = cache.hits > hits;
+    bool match = loaded && matchesSource(step.path.c_str(), image, step.channels, step.mips);
+    bool intact = loaded && uploadsIntact(image);
+    std::printf("%-26s %dx%dx%d, %d levels, %s%s%s\n", step.what, image.width, image.height, image.channels,
+                image.level_count, hit ? "hit" : "miss", match ? "" : ", CONTENTS DIFFER",
+                intact ? "" : ", UPLOAD DIFFERS");
+    if (!loaded || hit != step.hit || hit != image.from_cache || !match || !intact) {
+      std::printf("FAIL: expected a %s with the source's contents\n", step.hit ? "hit" : "miss");
+      ++failures;
+    }
+  }
+
+  CachedImage image;
+  if (cache.load((dir / "missing.jpg").string().c_str(), image)) {
+    std::printf("FAIL: a missing file loaded\n");
+    ++failures;
+  }
+  cache.printStats();
+
+  std::filesystem::remove_all(dir, error);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+// Files per second of ImageProbe (see image_probe.h).
+//
+//   image_probe_bench [files] [threads]
+//
+// Run it from 7-Transformations; it copies the textures in
+// resources/textures into a temporary directory until there are [files]
+// files (2000 by default): the JPEG, the PNG, the JPEG behind a 64 KB APP1
+// block (its header runs past the first read, so it has to be mapped) and
+// 64 KB files that aren't images at all. Each kind is probed on its own,
+// then the whole mix with 1 and with [threads] threads (default: all
+// hardware threads). As a reference, the mix is also probed by reading
+// every file whole into memory and calling stbi_info_from_memory. Best of
+// several runs, with the files in the page cache.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "../image_probe.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int RUNS = 5;
+
+struct Kind {
+  const char* name;
+  std::vector<char> bytes;
+  int width;  // 0 for files that aren't images
+  std::vector<std::string> paths;
+};
+
+bool readFile(const char* path, std::vector<char>& bytes) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+// the JPEG with an APP1 block of size bytes right after its SOI marker
+std::vector<char> withApp1(const std::vector<char>& jpeg, size_t size) {
+  std::vector<char> out(jpeg.begin(), jpeg.begin() + 2);
+  size_t left = size;
+  while (left) {
+    size_t length = std::min<size_t>(left, 65533);
+    out.push_back((char)0xFF);
+    out.push_back((char)0xE1);
+    out.push_back((char)((length + 2) >> 8));
+    out.push_back((char)((length + 2) & 0xFF));
+    out.insert(out.end(), length, 'x');
+    left -= length;
+  }
+  out.insert(out.end(), jpeg.begin() + 2, jpeg.end());
+  return out;
+}
+
+// best files/sec of probing paths, checking every result
+double probeRate(const std::vector<std::string>& paths, unsigned int threads, const std::vector<Kind>& kinds) {
+  double best = 0.0;
+  for (int run = 0; run < RUNS; ++run) {
+    ImageProbe probe;
+    probe.probeFiles(paths, threads);
+    best = std::max(best, probe.filesPerSecond());
+    for (const ImageProbeResult& result : probe.results) {
+      for (const Kind& kind : kinds) {
+        if (result.path.find(kind.name) == std::string::npos) continue;
+        if (result.ok != (kind.width != 0) || (result.ok && result.width != kind.width)) {
+          std::cerr << "ERROR::IMAGE_PROBE_BENCH::WRONG_RESULT " << result.path << std::endl;
+          std::exit(1);
+        }
+      }
+    }
+  }
+  return best;
+}
+
+// files/sec of reading each file whole and asking stb about it
+double readWholeRate(const std::vector<std::string>& paths) {
+  double best = 0.0;
+  std::vector<char> bytes;
+  for (int run = 0; run < RUNS; ++run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int x, y, n, images = 0;
+    for (const std::string& path : paths) {
+      readFile(path.c_str(), bytes);
+      images += stbi_info_from_memory((const stbi_uc*)bytes.data(), (int)bytes.size(), &x, &y, &n);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::max(best, paths.size() / seconds);
+    if (images == 0) std::cerr << "ERROR::IMAGE_PROBE_BENCH::NO_IMAGES" << std::endl;
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t files = argc > 1 ? (size_t)std::atoll(argv[1]) : 2000;
+  unsigned int threads = argc > 2 ? (unsigned int)std::atoi(argv[2]) : std::thread::hardware_concurrency();
+  threads = std::max(threads, 1u);
+
+  std::vector<Kind> kinds(4);
+  kinds[0].name = "photo";
+  kinds[1].name = "icon";
+  kinds[2].name = "exif";
+  kinds[3].name = "blob";
+  if (!readFile("./resources/textures/container.jpg", kinds[0].bytes) ||
+      !readFile("./resources/textures/awesomeface.png", kinds[1].bytes)) {
+    std::cerr << "ERROR::IMAGE_PROBE_BENCH::TEXTURES_NOT_FOUND run it from 7-Transformations" << std::endl;
+    return 1;
+  }
+  int height, channels;
+  stbi_info_from_memory((const stbi_uc*)kinds[0].bytes.data(), (int)kinds[0].bytes.size(), &kinds[0].width, &height, &channels);
+  stbi_info_from_memory((const stbi_uc*)kinds[1].bytes.data(), (int)kinds[1].bytes.size(), &kinds[1].width, &height, &channels);
+  kinds[2].bytes = withApp1(kinds[0].bytes, 64 * 1024);
+  kinds[2].width = kinds[0].width;
+  kinds[3].bytes.assign(64 * 1024, 'b');
+  kinds[3].width = 0;
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "image_probe_bench";
+  std::filesystem::create_directories(dir);
+  std::vector<std::string> all;
+  for (size_t i = 0; i < files; ++i) {
+    Kind& kind = kinds[i % kinds.size()];
+    std::string path = (dir / (kind.name + std::to_string(i))).string();
+    std::ofstream(path, std::ios::binary).write(kind.bytes.data(), (std::streamsize)kind.bytes.size());
+    kind.paths.push_back(path);
+    all.push_back(path);
+  }
+
+  std::cout << files << " files, best of " << RUNS << " runs, files/sec:" << std::endl;
+  for (const Kind& kind : kinds)
+    std::cout << "  " << kind.name << " (" << kind.bytes.size() / 1024 << " KB"
+              << (kind.width ? "" : ", not an image") << "), 1 thread: " << probeRate(kind.paths, 1, kinds) << std::endl;
+  double single = probeRate(all, 1, kinds);
+  std::cout << "  mix, 1 thread:          " << single << std::endl;
+  if (threads > 1) {
+    double parallel = probeRate(all, threads, kinds);
+    std::cout << "  mix, " << threads << " threads:         " << parallel << " (" << parallel / single << "x)" << std::endl;
+  }
+  std::cout << "  mix, read whole files:  " << readWholeRate(all) << std::endl;
+
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  return 0;
+}
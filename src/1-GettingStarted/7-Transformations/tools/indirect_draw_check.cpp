@@ -0,0 +1,279 @@
+// Checks IndirectRenderer (see indirect_renderer.h) against the CPU culler
+// and measures what it costs the CPU per frame.
+//
+//   indirect_draw_check [instances]
+//
+// Run from the example's directory, so ./resources/shaders/ is found. It
+// opens a hidden window (4.3 if the driver has it, else 3.3; llvmpipe does
+// fine) and, for compute culling when there is 4.3 and for transform
+// feedback always:
+//   - compares the GPU's visible count with Culler's on the same scene
+//   - renders the scene into an offscreen target and compares it pixel for
+//     pixel with CPU culling + glDrawElementsInstanced
+//   - times finished frames against the CPU-culled draw, for 1k instances
+//     and for all of them
+// The scene is culling_bench's: a field of cubes and quads seen from one
+// edge (100k by default).
+
+#include "gl_check_context.h"
+#include "../indirect_renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int SIZE   = 128; // of the offscreen target
+const int FRAMES = 20;  // timed per instance count
+
+// column major, like glm
+void multiply(const float* a, const float* b, float* out) {
+  for (int column = 0; column < 4; ++column)
+    for (int row = 0; row < 4; ++row) {
+      float sum = 0.0f;
+      for (int k = 0; k < 4; ++k) sum += a[k * 4 + row] * b[column * 4 + k];
+      out[column * 4 + row] = sum;
+    }
+}
+
+// glm::perspective(fov_y, aspect, near, far) * glm::lookAt(eye, eye + forward, up)
+// for forward along +z and up along +y
+void viewProjection(const float eye[3], float fov_y, float aspect, float near_plane, float far_plane, float* out) {
+  float f = 1.0f / std::tan(fov_y / 2.0f);
+  float projection[16] = {f / aspect, 0, 0, 0,  0, f, 0, 0,
+                          0, 0, (far_plane + near_plane) / (near_plane - far_plane), -1,
+                          0, 0, 2.0f * far_plane * near_plane / (near_plane - far_plane), 0};
+  float view[16] = {-1, 0, 0, 0,  0, 1, 0, 0,  0, 0, -1, 0,  eye[0], -eye[1], eye[2], 1};
+  multiply(projection, view, out);
+}
+
+struct Scene {
+  std::vector<uint32_t> meshes;
+  std::vector<float>    models;
+  InstanceBounds        bounds;
+  float view_projection[16];
+};
+
+// instances on a square grid 2 units apart, alternately cubes and quads, of
+// half size 0.5 and scaled by 1 + (i % 3) / 4, so none touch
+Scene buildScene(size_t count) {
+  Scene scene;
+  size_t side = (size_t)std::ceil(std::sqrt((double)count));
+  scene.bounds.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    float scale  = 1.0f + (float)(i % 3) * 0.25f;
+    float center[3] = {(float)(i % side) * 2.0f - (float)side, 0.0f, (float)(i / side) * 2.0f};
+    float extent[3] = {0.5f * scale, 0.5f * scale, 0.5f * scale};
+    float model[16] = {scale, 0, 0, 0,  0, scale, 0, 0,  0, 0, scale, 0,  center[0], center[1], center[2], 1};
+    scene.models.insert(scene.models.end(), model, model + 16);
+    scene.meshes.push_back((uint32_t)(i % 2));
+    scene.bounds.push(center, extent);
+  }
+  float eye[3] = {0.0f, 3.0f, -5.0f};
+  viewProjection(eye, 1.0f, 1.0f, 0.1f, 400.0f, scene.view_projection);
+  return scene;
+}
+
+// vertex_instanced.vert, coloured by vertex colour alone
+GLuint drawProgram(const GlCheckContext& context) {
+  std::string vertex_source;
+  std::ifstream file("./resources/shaders/vertex_instanced.vert");
+  std::stringstream stream;
+  stream << file.rdbuf();
+  vertex_source = stream.str();
+  const char* fragment_source =
+    "#version 330 core\n"
+    "in vec3 our_color; in vec2 tex_coord; out vec4 frag_color;\n"
+    "void main() { frag_color = vec4(our_color, 1.0); }\n";
+  return context.link(vertex_source.c_str(), fragment_source);
+}
+
+// a cube (36 indices from 0) and a quad (6 indices from 36, vertices from 8),
+// position, color and texture coordinate like the example's quad
+GLuint meshVertexArray(IndirectRenderer* renderer, int* cube, int* quad) {
+  const float vertices[] = {
+    -0.5f, -0.5f, -0.5f,  1, 0, 0,  0, 0,    0.5f, -0.5f, -0.5f,  0, 1, 0,  1, 0,
+    -0.5f,  0.5f, -0.5f,  0, 0, 1,  0, 1,    0.5f,  0.5f, -0.5f,  1, 1, 0,  1, 1,
+    -0.5f, -0.5f,  0.5f,  1, 0, 1,  0, 0,    0.5f, -0.5f,  0.5f,  0, 1, 1,  1, 0,
+    -0.5f,  0.5f,  0.5f,  1, 1, 1,  0, 1,    0.5f,  0.5f,  0.5f,  1, .5f, 0, 1, 1,
+    -0.5f, -0.5f,  0.0f,  .5f, 0, 1, 0, 0,   0.5f, -0.5f,  0.0f,  0, .5f, 1, 1, 0,
+    -0.5f,  0.5f,  0.0f,  1, 0, .5f, 0, 1,   0.5f,  0.5f,  0.0f,  .5f, 1, 0, 1, 1,
+  };
+  const GLuint indices[] = {
+    0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5,  0, 1, 4, 1, 5, 4,  2, 6, 3, 3, 6, 7,
+    0, 1, 2, 1, 3, 2,
+  };
+  GLuint vertex_array, vertex_buffer, element_buffer;
+  glGenVertexArrays(1, &vertex_array);
+  glGenBuffers(1, &vertex_buffer);
+  glGenBuffers(1, &element_buffer);
+  glBindVertexArray(vertex_array);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glBindVertexArray(0);
+  if (renderer) {
+    *cube = renderer->addMesh(36, 0, 0);
+    *quad = renderer->addMesh(6, 36, 8);
+  }
+  return vertex_array;
+}
+
+// Culler + gather into an instance buffer, one glDrawElementsInstanced per mesh
+void drawReference(const Scene& scene, GLuint vertex_array, size_t* visible_count) {
+  Culler culler;
+  const std::vector<uint32_t>& visible = culler.cull(scene.bounds, scene.view_projection);
+  *visible_count = visible.size();
+  std::vector<float> by_mesh[2];
+  for (uint32_t index : visible)
+    by_mesh[scene.meshes[index]].insert(by_mesh[scene.meshes[index]].end(), &scene.models[index * 16],
+                                        &scene.models[index * 16] + 16);
+
+  GLuint instance_buffer;
+  glGenBuffers(1, &instance_buffer);
+  glBindVertexArray(vertex_array);
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+  for (GLuint c = 0; c < 4; ++c) {
+    glEnableVertexAttribArray(IndirectRenderer::MODEL_ATTRIBUTE + c);
+    glVertexAttribDivisor(IndirectRenderer::MODEL_ATTRIBUTE + c, 1);
+    glVertexAttribPointer(IndirectRenderer::MODEL_ATTRIBUTE + c, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+                          (void*)(c * 4 * sizeof(float)));
+  }
+  const GLsizei counts[2] = {36, 6};
+  const size_t firsts[2] = {0, 36};
+  const GLint bases[2] = {0, 8};
+  for (int m = 0; m < 2; ++m) {
+    if (by_mesh[m].empty()) continue;
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(by_mesh[m].size() * sizeof(float)), by_mesh[m].data(), GL_STREAM_DRAW);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, counts[m], GL_UNSIGNED_INT, (void*)(firsts[m] * sizeof(GLuint)),
+                                      (GLsizei)(by_mesh[m].size() / 16), bases[m]);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &instance_buffer);
+}
+
+std::vector<unsigned char> readTarget() {
+  std::vector<unsigned char> pixels((size_t)SIZE * SIZE * 4);
+  glReadPixels(0, 0, SIZE, SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  return pixels;
+}
+
+void clearTarget() {
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// false if any check failed
+bool check(bool allow_compute, size_t count, GLuint program) {
+  Scene scene = buildScene(count);
+  IndirectRenderer renderer((GLADloadproc)glfwGetProcAddress, allow_compute);
+  if (allow_compute && !renderer.isCompute()) {
+    std::printf("compute culling: not available (needs GL 4.3)\n");
+    return true;
+  }
+  const char* name = renderer.isCompute() ? "compute + multi-draw indirect" : "transform feedback";
+  if (!renderer.init("./resources/shaders/")) return false;
+
+  int cube = 0, quad = 0;
+  GLuint vertex_array = meshVertexArray(&renderer, &cube, &quad);
+  if (!renderer.setInstances(scene.meshes.data(), scene.models.data(), scene.bounds)) return false;
+  GLint view_projection_location = glGetUniformLocation(program, "view_projection");
+
+  // reference image and count
+  clearTarget();
+  glUseProgram(program);
+  glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, scene.view_projection);
+  size_t cpu_visible = 0;
+  drawReference(scene, vertex_array, &cpu_visible);
+  std::vector<unsigned char> reference = readTarget();
+
+  // transform feedback draws the frame before's results, so cull twice
+  renderer.cull(scene.view_projection);
+  renderer.cull(scene.view_projection);
+  size_t gpu_visible = renderer.visibleCount();
+  clearTarget();
+  glUseProgram(program);
+  renderer.draw(vertex_array);
+  std::vector<unsigned char> image = readTarget();
+
+  size_t different = 0, covered = 0;
+  for (size_t p = 0; p < reference.size(); p += 4) {
+    if (std::memcmp(&reference[p], &image[p], 4) != 0) ++different;
+    if (reference[p] || reference[p + 1] || reference[p + 2]) ++covered;
+  }
+  bool passed = gpu_visible == cpu_visible && different == 0 && covered > 0;
+  std::printf("%s: %zu of %zu visible (CPU culler: %zu), %zu of %d pixels differ from the CPU-culled draw -> %s\n",
+              name, gpu_visible, count, cpu_visible, different, SIZE * SIZE, passed ? "ok" : "FAILED");
+
+  // frame time, GPU culled against CPU culled, small scene and full one;
+  // finished frames, since a software rasterizer does the GPU's share on
+  // the CPU as well
+  size_t counts[2] = {1000, count};
+  double gpu_us[2], cpu_us[2];
+  for (int c = 0; c < 2; ++c) {
+    Scene timed = c == 0 ? buildScene(counts[0]) : scene;
+    renderer.setInstances(timed.meshes.data(), timed.models.data(), timed.bounds);
+    gpu_us[c] = cpu_us[c] = 1e30;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+      glFinish();
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      renderer.cull(timed.view_projection);
+      glUseProgram(program);
+      renderer.draw(vertex_array);
+      glFinish();
+      std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+      size_t visible = 0;
+      drawReference(timed, vertex_array, &visible);
+      glFinish();
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+      gpu_us[c] = std::min(gpu_us[c], std::chrono::duration<double, std::micro>(middle - start).count());
+      cpu_us[c] = std::min(cpu_us[c], std::chrono::duration<double, std::micro>(end - middle).count());
+    }
+  }
+  for (int c = 0; c < 2; ++c)
+    std::printf("%s: %zu instances, frame %.0f us GPU culled, %.0f us CPU culled\n", name, counts[c], gpu_us[c],
+                cpu_us[c]);
+  renderer.printStats();
+
+  glDeleteVertexArrays(1, &vertex_array);
+  return passed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? (size_t)std::strtoul(argv[1], NULL, 10) : 100000;
+  if (count < 2) count = 2;
+
+  GlCheckContext context("indirect_draw_check", 4, 3);
+  if (!context.isValid()) return 1;
+
+  // offscreen target, so the hidden window's framebuffer doesn't matter
+  context.createTarget(SIZE, SIZE, true);
+  glEnable(GL_DEPTH_TEST);
+
+  GLuint program = drawProgram(context);
+  bool passed = program != 0;
+  if (passed) {
+    passed = check(true, count, program) && passed;
+    passed = check(false, count, program) && passed;
+  }
+
+  glDeleteProgram(program);
+  return passed ? 0 : 1;
+}
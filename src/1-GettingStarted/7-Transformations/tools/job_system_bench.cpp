@@ -0,0 +1,88 @@
+// Scheduler overhead and core scaling of JobSystem (see job_system.h).
+//
+//   job_system_bench [max threads]
+//
+// For 1..max threads (default: all hardware threads) it measures
+//   - empty jobs:  create + run + finish of 100k children of one root
+//   - chain:       a 1000-long chain of continuations, i.e. wake-up latency
+//   - parallelFor: 1M transform updates like main.cpp's, in batches of 1024
+// and prints the best of several runs and the speed-up over one thread.
+
+#include "../job_system.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const int RUNS = 7;
+
+double nanoseconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+double emptyJobs(JobSystem& jobs, int count) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  JobSystem::Job* root = jobs.create([](JobSystem::Job&) {});
+  for (int i = 0; i < count; ++i)
+    jobs.run(jobs.create([](JobSystem::Job&) {}, root));
+  jobs.run(root);
+  jobs.wait(root);
+  return nanoseconds(start) / count;
+}
+
+double chain(JobSystem& jobs, int length) {
+  std::vector<JobSystem::Job*> links((size_t)length);
+  for (int i = 0; i < length; ++i) {
+    links[i] = jobs.create([](JobSystem::Job&) {});
+    if (i) jobs.addContinuation(links[i - 1], links[i]);
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  jobs.run(links[0]);
+  jobs.wait(links[length - 1]);
+  return nanoseconds(start) / length;
+}
+
+double transforms(JobSystem& jobs, std::vector<float>& out) {
+  size_t count = out.size() / 16;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  jobs.parallelFor(count, 1024, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      float angle = (float)i * 0.001f, scale = 0.5f;
+      float c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+      float* m = &out[i * 16];
+      m[0] = c;  m[1] = s; m[2] = 0;      m[3] = 0;
+      m[4] = -s; m[5] = c; m[6] = 0;      m[7] = 0;
+      m[8] = 0;  m[9] = 0; m[10] = scale; m[11] = 0;
+      m[12] = (float)(i % 100) * 0.01f; m[13] = 0; m[14] = 0; m[15] = 1;
+    }
+  });
+  return nanoseconds(start) / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int max_threads = argc > 1 ? std::atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+  max_threads = std::max(max_threads, 1);
+  std::vector<float> matrices(1000000 * 16);
+
+  std::printf("threads  empty job (ns)  chain hop (ns)  parallelFor 1M (ms)  speed-up\n");
+  double single_ms = 0.0;
+  for (int threads = 1; threads <= max_threads; ++threads) {
+    JobSystem jobs(threads - 1);
+    double empty_ns = 1e30, hop_ns = 1e30, for_ms = 1e30;
+    for (int run = 0; run < RUNS; ++run) {
+      empty_ns = std::min(empty_ns, emptyJobs(jobs, 100000));
+      hop_ns   = std::min(hop_ns, chain(jobs, 1000));
+      for_ms   = std::min(for_ms, transforms(jobs, matrices));
+    }
+    if (threads == 1) single_ms = for_ms;
+    std::printf("%7d  %14.1f  %14.1f  %19.3f  %7.2fx\n", threads, empty_ns, hop_ns, for_ms, single_ms / for_ms);
+    jobs.printStats();
+  }
+  return 0;
+}
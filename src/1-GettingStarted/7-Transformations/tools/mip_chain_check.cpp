@@ -0,0 +1,346 @@
+// Mip chain levels, filtering and cache (see mip_chain.h).
+//
+//   mip_chain_check
+//
+// No window or context: only generate() and load() run. Checks, in order:
+//   - level sizes, halving each side down to 1x1, for square, odd, thin
+//     and single-pixel images
+//   - known values: black and white averaging to the sRGB byte of 0.5
+//     linear (188, not 128), and a transparent texel not bleeding into its
+//     opaque neighbour
+//   - every level of random images in 1-4 channels, box and Kaiser, sRGB
+//     and linear, against a reference written here in doubles (exact sRGB
+//     curves, each output texel summed straight from the float level above
+//     over the 2D footprint); within one step of rounding
+//   - the same chain whatever the thread count
+//   - load() and the ".mips" cache: a miss, then a hit with the same
+//     levels; misses again after the filter, the flip setting, the
+//     source's contents or size change, and after the cache is truncated
+//     (each rewriting it, so the next load hits)
+
+#include "../mip_chain.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+void expect(int& failures, bool ok, const char* what) {
+  if (ok) return;
+  std::printf("FAIL: %s\n", what);
+  ++failures;
+}
+
+std::vector<unsigned char> randomPixels(int width, int height, int channels, std::mt19937& random) {
+  std::vector<unsigned char> pixels((size_t)width * height * channels);
+  for (unsigned char& byte : pixels) byte = (unsigned char)random();
+  // alpha no lower than 64, so colour divided by it keeps its precision
+  if (channels == 2 || channels == 4)
+    for (size_t i = channels - 1; i < pixels.size(); i += channels) pixels[i] = (unsigned char)(64 + pixels[i] % 192);
+  return pixels;
+}
+
+double srgbToLinear(double v) {
+  return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+}
+
+double linearToSrgb(double v) {
+  return v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+}
+
+double kaiserWeight(double x) {
+  const double LOBES = 3.0, BETA = 4.0;
+  if (std::fabs(x) >= LOBES) return 0.0;
+  auto i0 = [](double v) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 40; ++k) {
+      term *= (v / (2.0 * k)) * (v / (2.0 * k));
+      sum += term;
+    }
+    return sum;
+  };
+  double sinc = x == 0.0 ? 1.0 : std::sin(PI * x) / (PI * x);
+  return sinc * i0(BETA * std::sqrt(1.0 - (x / LOBES) * (x / LOBES))) / i0(BETA);
+}
+
+// normalized weights of source pixels [first, first + count) for output
+// pixel d of src -> dst; pixels past the edges are clamped by the caller
+std::vector<double> weights(int src, int dst, int d, MipFilter filter, int& first) {
+  double scale = (double)src / dst, center = (d + 0.5) * scale;
+  double radius = filter == MipFilter::Box ? 0.5 * scale : 3.0 * scale;
+  first = (int)std::floor(center - radius);
+  int last = (int)std::ceil(center + radius);
+  std::vector<double> w;
+  double total = 0.0;
+  for (int i = first; i < last; ++i) {
+    double weight = filter == MipFilter::Box
+                        ? std::max(0.0, std::min(i + 1.0, center + radius) - std::max((double)i, center - radius))
+                        : kaiserWeight((i + 0.5 - center) / scale);
+    w.push_back(weight);
+    total += weight;
+  }
+  for (double& weight : w) weight /= total;
+  return w;
+}
+
+// the chain of pixels by the reference, 8-bit levels
+std::vector<std::vector<unsigned char>> referenceChain(const std::vector<unsigned char>& pixels, int width,
+                                                       int height, int channels, bool srgb, MipFilter filter) {
+  int colour = channels >= 3 ? 3 : 1, alpha = channels == 2 || channels == 4 ? channels - 1 : -1;
+  // linear, premultiplied
+  std::vector<double> current(pixels.size());
+  for (size_t p = 0; p < pixels.size(); p += channels) {
+    double a = alpha >= 0 ? pixels[p + alpha] / 255.0 : 1.0;
+    for (int c = 0; c < colour; ++c)
+      current[p + c] = (srgb ? srgbToLinear(pixels[p + c] / 255.0) : pixels[p + c] / 255.0) * a;
+    if (alpha >= 0) current[p + alpha] = a;
+  }
+
+  std::vector<std::vector<unsigned char>> chain(1, pixels);
+  while (width > 1 || height > 1) {
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    std::vector<double> next((size_t)w * h * channels, 0.0);
+    for (int y = 0; y < h; ++y) {
+      int first_y = y, first_x;
+      std::vector<double> wy = h == height ? std::vector<double>(1, 1.0) : weights(height, h, y, filter, first_y);
+      for (int x = 0; x < w; ++x) {
+        first_x = x;
+        std::vector<double> wx = w == width ? std::vector<double>(1, 1.0) : weights(width, w, x, filter, first_x);
+        double* out = &next[((size_t)y * w + x) * channels];
+        for (size_t j = 0; j < wy.size(); ++j) {
+          int sy = std::min(std::max(first_y + (int)j, 0), height - 1);
+          for (size_t i = 0; i < wx.size(); ++i) {
+            int sx = std::min(std::max(first_x + (int)i, 0), width - 1);
+            const double* in = &current[((size_t)sy * width + sx) * channels];
+            for (int c = 0; c < channels; ++c) out[c] += wy[j] * wx[i] * in[c];
+          }
+        }
+      }
+    }
+
+    std::vector<unsigned char> level(next.size());
+    for (size_t p = 0; p < next.size(); p += channels) {
+      double a = alpha >= 0 ? std::min(std::max(next[p + alpha], 0.0), 1.0) : 1.0;
+      for (int c = 0; c < colour; ++c) {
+        double v = std::min(std::max(a > 0.0 ? next[p + c] / a : 0.0, 0.0), 1.0);
+        level[p + c] = (unsigned char)std::lround((srgb ? linearToSrgb(v) : v) * 255.0);
+      }
+      if (alpha >= 0) level[p + alpha] = (unsigned char)std::lround(a * 255.0);
+    }
+    chain.push_back(level);
+    current.swap(next);
+    width = w;
+    height = h;
+  }
+  return chain;
+}
+
+int checkSizes(std::mt19937& random) {
+  const int SIZES[][2] = {{1, 1}, {256, 256}, {257, 31}, {5, 3}, {1, 7}, {640, 1}};
+  int failures = 0;
+  for (const int* size : SIZES) {
+    std::vector<unsigned char> pixels = randomPixels(size[0], size[1], 3, random);
+    MipChain mips;
+    bool ok = mips.generate(pixels.data(), size[0], size[1], 3) &&
+              (int)mips.levels.size() == MipChain::levelCount(size[0], size[1]);
+    int width = size[0], height = size[1];
+    for (size_t i = 0; ok && i < mips.levels.size(); ++i) {
+      const MipLevel& level = mips.levels[i];
+      ok = level.width == width && level.height == height && level.pixels.size() == (size_t)width * height * 3;
+      width = std::max(1, width / 2);
+      height = std::max(1, height / 2);
+    }
+    ok = ok && mips.levels.back().width == 1 && mips.levels.back().height == 1;
+    if (!ok) {
+      std::printf("FAIL: levels of %dx%d\n", size[0], size[1]);
+      ++failures;
+    }
+  }
+  expect(failures, MipChain::levelCount(1, 1) == 1 && MipChain::levelCount(256, 256) == 9 &&
+                       MipChain::levelCount(257, 31) == 9 && MipChain::levelCount(1, 7) == 3,
+         "levelCount()");
+  std::printf("%-28s %s\n", "level sizes", failures ? "wrong" : "halve down to 1x1");
+  return failures;
+}
+
+int checkKnownValues() {
+  int failures = 0;
+  const unsigned char checker[4] = {0, 255, 255, 0};
+  MipChain grey;
+  grey.generate(checker, 2, 2, 1, true, MipFilter::Box);
+  expect(failures, grey.levels[1].pixels[0] == 188, "black and white average to sRGB 188");
+  MipChain linear;
+  linear.generate(checker, 2, 2, 1, false, MipFilter::Box);
+  expect(failures, linear.levels[1].pixels[0] == 128, "black and white average to 128 when linear");
+
+  // opaque red next to transparent green: the green must not show
+  const unsigned char pair[8] = {255, 0, 0, 255, 0, 255, 0, 0};
+  MipChain rgba;
+  rgba.generate(pair, 2, 1, 4, true, MipFilter::Box);
+  const std::vector<unsigned char>& mixed = rgba.levels[1].pixels;
+  expect(failures, mixed[0] == 255 && mixed[1] == 0 && mixed[2] == 0 && mixed[3] == 128,
+         "a transparent texel bleeds into its neighbour");
+  std::printf("%-28s %s\n", "known values", failures ? "wrong" : "sRGB 188, no bleeding");
+  return failures;
+}
+
+int checkReference(std::mt19937& random) {
+  const int SIZES[][2] = {{64, 64}, {37, 23}, {9, 1}};
+  const char* FILTERS[2] = {"box", "Kaiser"};
+  int failures = 0;
+  for (int channels = 1; channels <= 4; ++channels) {
+    for (int f = 0; f < 2; ++f) {
+      for (int srgb = 0; srgb <= 1; ++srgb) {
+        int worst = 0;
+        for (const int* size : SIZES) {
+          std::vector<unsigned char> pixels = randomPixels(size[0], size[1], channels, random);
+          MipFilter filter = f ? MipFilter::Kaiser : MipFilter::Box;
+          MipChain mips;
+          mips.generate(pixels.data(), size[0], size[1], channels, srgb != 0, filter, 1);
+          std::vector<std::vector<unsigned char>> expected =
+              referenceChain(pixels, size[0], size[1], channels, srgb != 0, filter);
+          if (mips.levels.size() != expected.size()) {
+            worst = 256;
+            break;
+          }
+          for (size_t i = 0; i < expected.size(); ++i)
+            for (size_t b = 0; b < expected[i].size(); ++b)
+              worst = std::max(worst, std::abs((int)mips.levels[i].pixels[b] - (int)expected[i][b]));
+        }
+        std::printf("%-28s %d channels, %-6s %-6s off by at most %d\n", "against the reference", channels,
+                    FILTERS[f], srgb ? "sRGB," : "linear,", worst);
+        if (worst > 1) {
+          std::printf("FAIL: %d channels, %s, %s differs from the reference\n", channels, FILTERS[f],
+                      srgb ? "sRGB" : "linear");
+          ++failures;
+        }
+      }
+    }
+  }
+  return failures;
+}
+
+int checkThreads(std::mt19937& random) {
+  int failures = 0;
+  std::vector<unsigned char> pixels = randomPixels(301, 203, 4, random);
+  for (int f = 0; f < 2; ++f) {
+    MipFilter filter = f ? MipFilter::Kaiser : MipFilter::Box;
+    MipChain one, four;
+    one.generate(pixels.data(), 301, 203, 4, true, filter, 1);
+    four.generate(pixels.data(), 301, 203, 4, true, filter, 4);
+    bool same = one.levels.size() == four.levels.size();
+    for (size_t i = 0; same && i < one.levels.size(); ++i) same = one.levels[i].pixels == four.levels[i].pixels;
+    expect(failures, same, "the chain depends on the thread count");
+  }
+  std::printf("%-28s %s\n", "threads", failures ? "differ" : "1 and 4 give the same chain");
+  return failures;
+}
+
+// an uncompressed 24-bit TGA of random pixels
+void writeTga(const std::string& path, int width, int height, std::mt19937& random) {
+  std::vector<unsigned char> tga(18, 0);
+  tga[2]  = 2; // uncompressed true color
+  tga[12] = (unsigned char)width;
+  tga[13] = (unsigned char)(width >> 8);
+  tga[14] = (unsigned char)height;
+  tga[15] = (unsigned char)(height >> 8);
+  tga[16] = 24;
+  for (int i = 0; i < width * height * 3; ++i) tga.push_back((unsigned char)random());
+  std::ofstream(path, std::ios::binary | std::ios::trunc).write((const char*)tga.data(), (std::streamsize)tga.size());
+}
+
+// whether level 0 of mips is what stb_image makes of path
+bool matchesSource(const std::string& path, const MipChain& mips) {
+  int width, height, channels;
+  unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+  bool match = pixels && mips.levels[0].width == width && mips.levels[0].height == height &&
+               mips.channels == channels &&
+               std::equal(mips.levels[0].pixels.begin(), mips.levels[0].pixels.end(), pixels);
+  stbi_image_free(pixels);
+  return match;
+}
+
+int checkCache(std::mt19937& random) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "mip_chain_check";
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "image.tga").string(), cache_path = path + ".mips";
+  writeTga(path, 40, 30, random);
+
+  struct Step {
+    const char* what;
+    MipFilter   filter;
+    bool        hit;
+  };
+  int failures = 0;
+  auto load = [&](const Step& step) {
+    MipChain mips;
+    bool ok = mips.load(path.c_str(), true, step.filter, 1);
+    bool right = ok && mips.from_cache == step.hit && matchesSource(path, mips);
+    if (right && step.hit) {
+      MipChain generated;
+      right = generated.generate(mips.levels[0].pixels.data(), mips.levels[0].width, mips.levels[0].height,
+                                 mips.channels, true, step.filter, 1);
+      for (size_t i = 0; right && i < mips.levels.size(); ++i)
+        right = i < generated.levels.size() && mips.levels[i].pixels == generated.levels[i].pixels;
+    }
+    std::printf("%-28s %-36s %s\n", "cache", step.what, ok ? (mips.from_cache ? "hit" : "miss") : "failed");
+    if (!right) {
+      std::printf("FAIL: expected a %s with the source's levels\n", step.hit ? "hit" : "miss");
+      ++failures;
+    }
+  };
+  // a rewrite must look newer even where timestamps are coarse
+  auto touch = [&]() {
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(10));
+  };
+
+  load({"first load", MipFilter::Box, false});
+  expect(failures, std::filesystem::exists(cache_path), "load() writes the cache");
+  load({"again", MipFilter::Box, true});
+  load({"Kaiser", MipFilter::Kaiser, false});
+  load({"Kaiser again", MipFilter::Kaiser, true});
+  stbi_set_flip_vertically_on_load(1);
+  load({"flipped", MipFilter::Kaiser, false});
+  stbi_set_flip_vertically_on_load(0);
+  load({"unflipped", MipFilter::Kaiser, false});
+  writeTga(path, 40, 30, random);
+  touch();
+  load({"new contents, same size", MipFilter::Kaiser, false});
+  load({"new contents again", MipFilter::Kaiser, true});
+  writeTga(path, 17, 9, random);
+  touch();
+  load({"new size", MipFilter::Kaiser, false});
+  std::filesystem::resize_file(cache_path, std::filesystem::file_size(cache_path) / 2);
+  load({"truncated cache", MipFilter::Kaiser, false});
+  load({"rewritten cache", MipFilter::Kaiser, true});
+
+  std::filesystem::remove_all(dir, error);
+  return failures;
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 random(1);
+  int failures = checkSizes(random);
+  failures += checkKnownValues();
+  failures += checkReference(random);
+  failures += checkThreads(random);
+  failures += checkCache(random);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+// PNG decode throughput where the scanline unfilter dominates (see the SIMD
+// notes at the top of stb_image.h).
+//
+//   png_unfilter_bench [size]
+//
+// Builds [size]x[size] (512 by default) PNGs in memory from random pixels:
+// RGB and RGBA with every row using one filter (none, sub, up, avg, paeth),
+// and with a random filter per row. The zlib stream uses stored blocks, so
+// inflating is little more than a copy and the time left is the unfilter
+// and the channel conversion. Each is decoded as it is and, for RGB, to
+// RGBA, and the best of several runs is printed in megapixels/sec.
+//
+// Build it twice to see what the kernels buy, once as usual and once with
+// -DSTBI_NO_SIMD for the scalar loops, and compare the two tables.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int RUNS = 9;
+
+const char* FILTERS[6] = {"none", "sub", "up", "avg", "paeth", "mixed"};
+
+void put32(std::vector<unsigned char>& out, uint32_t value) {
+  out.push_back((unsigned char)(value >> 24));
+  out.push_back((unsigned char)(value >> 16));
+  out.push_back((unsigned char)(value >> 8));
+  out.push_back((unsigned char)value);
+}
+
+uint32_t crc32(const unsigned char* bytes, size_t size) {
+  static uint32_t table[256];
+  if (!table[1]) {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+  }
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < size; ++i) crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFFu;
+}
+
+void chunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data) {
+  put32(png, (uint32_t)data.size());
+  size_t start = png.size();
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data.begin(), data.end());
+  put32(png, crc32(png.data() + start, png.size() - start));
+}
+
+// an 8-bit PNG of random filtered rows, filter 5 picking one per row
+std::vector<unsigned char> makePng(int size, int channels, int filter, std::mt19937& random) {
+  std::vector<unsigned char> rows;
+  size_t row_bytes = (size_t)size * channels;
+  for (int y = 0; y < size; ++y) {
+    rows.push_back((unsigned char)(filter < 5 ? filter : random() % 5));
+    for (size_t i = 0; i < row_bytes; ++i) rows.push_back((unsigned char)random());
+  }
+
+  // zlib of stored blocks, then the Adler-32 of the rows
+  std::vector<unsigned char> zlib = {0x78, 0x01};
+  for (size_t i = 0; i < rows.size(); i += 65535) {
+    size_t block = std::min<size_t>(65535, rows.size() - i);
+    zlib.push_back(i + block == rows.size() ? 1 : 0);
+    zlib.push_back((unsigned char)block);
+    zlib.push_back((unsigned char)(block >> 8));
+    zlib.push_back((unsigned char)~block);
+    zlib.push_back((unsigned char)(~block >> 8));
+    zlib.insert(zlib.end(), rows.begin() + i, rows.begin() + i + block);
+  }
+  uint32_t a = 1, b = 0;
+  for (unsigned char byte : rows) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  put32(zlib, (b << 16) | a);
+
+  std::vector<unsigned char> header;
+  put32(header, (uint32_t)size);
+  put32(header, (uint32_t)size);
+  header.push_back(8);
+  header.push_back(channels == 3 ? 2 : 6);
+  header.insert(header.end(), {0, 0, 0});
+
+  std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  chunk(png, "IHDR", header);
+  chunk(png, "IDAT", zlib);
+  chunk(png, "IEND", std::vector<unsigned char>());
+  return png;
+}
+
+// best megapixels/sec of decoding png as desired_channels
+double decodeRate(const std::vector<unsigned char>& png, int desired_channels) {
+  double best = 0.0;
+  for (int run = 0; run < RUNS; ++run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load_from_memory(png.data(), (int)png.size(), &width, &height, &channels, desired_channels);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!pixels) {
+      std::fprintf(stderr, "ERROR::PNG_UNFILTER_BENCH::NOT_DECODED %s\n", stbi_failure_reason());
+      std::exit(1);
+    }
+    stbi_image_free(pixels);
+    best = std::max(best, (double)width * height / seconds / 1e6);
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int size = argc > 1 ? std::atoi(argv[1]) : 512;
+  size = std::max(size, 1);
+
+#if defined(STBI__AVX2)
+  const char* kernels = stbi__sse2_available() && stbi__avx2_available() ? "SSE2 + AVX2" : "SSE2";
+#elif defined(STBI_SSE2)
+  const char* kernels = "SSE2";
+#elif defined(STBI_NEON)
+  const char* kernels = "NEON";
+#else
+  const char* kernels = "scalar";
+#endif
+
+  std::mt19937 random(1);
+  std::printf("%dx%d, stored zlib, %s unfilter, best of %d runs, MP/s:\n", size, size, kernels, RUNS);
+  std::printf("filter      RGB  RGB->RGBA       RGBA\n");
+  for (int filter = 0; filter < 6; ++filter) {
+    std::vector<unsigned char> rgb  = makePng(size, 3, filter, random);
+    std::vector<unsigned char> rgba = makePng(size, 4, filter, random);
+    std::printf("%-6s %8.1f %10.1f %10.1f\n", FILTERS[filter], decodeRate(rgb, 0), decodeRate(rgb, 4),
+                decodeRate(rgba, 0));
+  }
+  return 0;
+}
@@ -0,0 +1,239 @@
+// Render target recycling and aliasing (see render_target_pool.h and
+// frame_graph.h).
+//
+//   render_target_pool_check [frames]
+//
+// Opens a hidden window and renders a bloom chain through a FrameGraph
+// into an offscreen "window" target. The chain is: scene (color and
+// depth), bright pass at half size, two rounds of horizontal and vertical
+// blur, then composite. It runs with an aliasing pool and again with one
+// that keeps every target to itself for the frame. The two final images
+// must be identical, and the aliasing pool must hold less. Then the size
+// changes: the old targets must be deleted once idle, and after the first
+// frame of a size nothing may be created.
+
+#include "gl_check_context.h"
+#include "../render_target_pool.h"
+#include "../frame_graph.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const int SIZE       = 512; // of the "window"
+const int SMALL_SIZE = 384; // after the resize
+
+const char* VERTEX_SOURCE =
+  "#version 330 core\n"
+  "out vec2 uv;\n"
+  "void main() {\n"
+  "  vec2 corner = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);\n"
+  "  uv = corner * 0.5 + 0.5;\n"
+  "  gl_Position = vec4(corner, 0.0, 1.0);\n"
+  "}\n";
+
+// a few bright dots on a dim gradient
+const char* SCENE_SOURCE =
+  "#version 330 core\n"
+  "in vec2 uv;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  vec2 cell = fract(uv * 4.0) - 0.5;\n"
+  "  float dot_light = dot(cell, cell) < 0.004 ? 4.0 : 0.0;\n"
+  "  frag_color = vec4(uv * 0.3 + dot_light, 0.1 + dot_light, 1.0);\n"
+  "}\n";
+
+const char* BRIGHT_SOURCE =
+  "#version 330 core\n"
+  "in vec2 uv;\n"
+  "uniform sampler2D source;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  frag_color = max(texture(source, uv) - 1.0, 0.0);\n"
+  "}\n";
+
+const char* BLUR_SOURCE =
+  "#version 330 core\n"
+  "in vec2 uv;\n"
+  "uniform sampler2D source;\n"
+  "uniform vec2 direction;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  vec2 step = direction / vec2(textureSize(source, 0));\n"
+  "  vec4 sum = texture(source, uv) * 0.227;\n"
+  "  sum += (texture(source, uv + step) + texture(source, uv - step)) * 0.195;\n"
+  "  sum += (texture(source, uv + step * 2.0) + texture(source, uv - step * 2.0)) * 0.122;\n"
+  "  sum += (texture(source, uv + step * 3.0) + texture(source, uv - step * 3.0)) * 0.054;\n"
+  "  sum += (texture(source, uv + step * 4.0) + texture(source, uv - step * 4.0)) * 0.016;\n"
+  "  frag_color = sum;\n"
+  "}\n";
+
+const char* COMPOSITE_SOURCE =
+  "#version 330 core\n"
+  "in vec2 uv;\n"
+  "uniform sampler2D source;\n"
+  "uniform sampler2D bloom;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  vec3 color = texture(source, uv).rgb + texture(bloom, uv).rgb;\n"
+  "  frag_color = vec4(color / (color + 1.0), 1.0);\n"
+  "}\n";
+
+struct Programs {
+  GLuint scene, bright, blur, composite;
+};
+
+GLuint link(const GlCheckContext& context, const char* fragment_source) {
+  GLuint program = context.link(VERTEX_SOURCE, fragment_source);
+  if (!program) return 0;
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "source"), 0);
+  glUniform1i(glGetUniformLocation(program, "bloom"), 1);
+  return program;
+}
+
+void drawFullScreen(GLuint program, GLuint source, GLuint bloom = 0) {
+  glUseProgram(program);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, source);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, bloom);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// one frame of the bloom chain into window_framebuffer
+void buildFrame(FrameGraph& graph, const Programs& programs, GLuint window_framebuffer, int size) {
+  typedef FrameGraph::Resource Resource;
+  graph.reset();
+  Resource color  = graph.create("color", RenderTargetDesc(size, size, GL_RGBA16F));
+  Resource depth  = graph.create("depth", RenderTargetDesc(size, size, GL_DEPTH24_STENCIL8));
+  Resource window = graph.importFramebuffer("window", window_framebuffer, size, size);
+  RenderTargetDesc half(size / 2, size / 2, GL_RGBA16F);
+  Resource bloom = graph.create("bright", half);
+
+  graph.addPass("scene", {}, {color, depth}, [&programs](FrameGraph&) {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    drawFullScreen(programs.scene, 0);
+  });
+  graph.addPass("bright", {color}, {bloom}, [&programs, color](FrameGraph& g) {
+    drawFullScreen(programs.bright, g.texture(color));
+  });
+  const char* names[4] = {"blur_h1", "blur_v1", "blur_h2", "blur_v2"};
+  for (int i = 0; i < 4; ++i) {
+    Resource blurred = graph.create(names[i], half);
+    bool horizontal = i % 2 == 0;
+    graph.addPass(names[i], {bloom}, {blurred}, [&programs, bloom, horizontal](FrameGraph& g) {
+      glUseProgram(programs.blur);
+      glUniform2f(glGetUniformLocation(programs.blur, "direction"), horizontal ? 1.0f : 0.0f, horizontal ? 0.0f : 1.0f);
+      drawFullScreen(programs.blur, g.texture(bloom));
+    });
+    bloom = blurred;
+  }
+  graph.addPass("composite", {color, bloom}, {window}, [&programs, color, bloom](FrameGraph& g) {
+    drawFullScreen(programs.composite, g.texture(color), g.texture(bloom));
+  });
+}
+
+std::vector<unsigned char> readWindow(GLuint window_framebuffer, int size) {
+  std::vector<unsigned char> pixels((size_t)size * size * 4);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, window_framebuffer);
+  glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  return pixels;
+}
+
+// frames of the chain at size through pool; returns the last image
+std::vector<unsigned char> run(RenderTargetPool& pool, const Programs& programs, GLuint window_framebuffer, int size,
+                               int frames) {
+  FrameGraph graph(pool);
+  for (int frame = 0; frame < frames; ++frame) {
+    pool.beginFrame();
+    buildFrame(graph, programs, window_framebuffer, size);
+    if (!graph.compile()) break;
+    graph.execute();
+  }
+  return readWindow(window_framebuffer, size);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? std::atoi(argv[1]) : 10;
+  if (frames < 5) frames = 10;
+
+  GlCheckContext context("render_target_pool_check");
+  if (!context.isValid()) return 1;
+
+  Programs programs = {link(context, SCENE_SOURCE), link(context, BRIGHT_SOURCE), link(context, BLUR_SOURCE),
+                       link(context, COMPOSITE_SOURCE)};
+  if (!programs.scene || !programs.bright || !programs.blur || !programs.composite) return 1;
+
+  GLuint window_framebuffer = context.createTarget(SIZE, SIZE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  GLuint vertex_array;
+  glGenVertexArrays(1, &vertex_array);
+  glBindVertexArray(vertex_array);
+
+  int failures = 0;
+  {
+    RenderTargetPool separate(3, false);
+    std::vector<unsigned char> expected = run(separate, programs, window_framebuffer, SIZE, frames);
+    std::printf("--- without aliasing\n");
+    separate.printStats();
+
+    RenderTargetPool pool;
+    std::vector<unsigned char> image = run(pool, programs, window_framebuffer, SIZE, frames);
+    std::printf("--- with aliasing\n");
+    pool.printStats();
+    {
+      FrameGraph graph(pool);
+      buildFrame(graph, programs, window_framebuffer, SIZE);
+      graph.compile();
+      graph.printStats();
+    }
+
+    size_t differing = 0;
+    for (size_t i = 0; i < image.size(); ++i)
+      if (image[i] != expected[i]) ++differing;
+    std::printf("%zu of %zu bytes differ between the two\n", differing, image.size());
+    if (differing) {
+      std::printf("FAIL: aliasing changed the image\n");
+      ++failures;
+    }
+    if (pool.getStats().peak_bytes >= separate.getStats().peak_bytes) {
+      std::printf("FAIL: aliasing didn't lower the peak\n");
+      ++failures;
+    }
+    if (pool.getStats().allocations != 4) {
+      // color, depth, and two half-size targets taking turns for all five
+      std::printf("FAIL: %llu targets created with aliasing\n", (unsigned long long)pool.getStats().allocations);
+      ++failures;
+    }
+
+    // resize: new targets once, the old ones deleted when idle
+    RenderTargetPool::Stats before = pool.getStats();
+    run(pool, programs, window_framebuffer, SMALL_SIZE, frames);
+    std::printf("--- after resizing to %d\n", SMALL_SIZE);
+    pool.printStats();
+    const RenderTargetPool::Stats& after = pool.getStats();
+    if (after.allocations - before.allocations != before.targets || after.deletions - before.deletions != before.targets ||
+        after.targets != before.targets) {
+      std::printf("FAIL: expected %zu targets created and %zu deleted on resize\n", before.targets, before.targets);
+      ++failures;
+    }
+
+    separate.release();
+    pool.release();
+  }
+
+  glDeleteVertexArrays(1, &vertex_array);
+  glDeleteProgram(programs.scene);
+  glDeleteProgram(programs.bright);
+  glDeleteProgram(programs.blur);
+  glDeleteProgram(programs.composite);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
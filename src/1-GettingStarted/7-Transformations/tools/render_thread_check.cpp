@@ -0,0 +1,187 @@
+// Input handoff and latency stats of RenderThread (see render_thread.h and
+// spsc_queue.h).
+//
+//   render_thread_check
+//
+// No window or context: the check plays both the main thread and the
+// render thread itself, without start().
+//   - SpscQueue: a producer thread pushes a counter as fast as it can and
+//     the consumer must pop every value once, in order, through full and
+//     empty queues.
+//   - pushInput/latestInput across threads: the render side must only ever
+//     see newer snapshots and end on the last one pushed.
+//   - latency: frames taking snapshots without events, or no snapshots,
+//     record nothing; a frame taking events records the time since the
+//     oldest of them, also when its snapshot was dropped on a full queue
+//     and the event went with the next one.
+
+#include "../render_thread.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+const int HANDOFF_VALUES = 200000;
+
+void sleepSeconds(double seconds) {
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+// every value pushed is popped once, in order
+int checkQueue() {
+  SpscQueue<int, 64> queue;
+  std::thread producer([&queue]() {
+    for (int i = 0; i < HANDOFF_VALUES; ++i)
+      while (!queue.push(i)) std::this_thread::yield();
+  });
+  int expected = 0, failures = 0, value;
+  while (expected < HANDOFF_VALUES) {
+    if (!queue.pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (value != expected) {
+      std::printf("FAIL: popped %d, expected %d\n", value, expected);
+      ++failures;
+      break;
+    }
+    ++expected;
+  }
+  producer.join();
+  if (!failures && (queue.pop(value) || queue.size() != 0)) {
+    std::printf("FAIL: the queue isn't empty after every value was popped\n");
+    ++failures;
+  }
+  std::printf("queue: %d values handed over\n", expected);
+  return failures;
+}
+
+// the render side sees snapshots in order and ends on the newest
+int checkHandoff() {
+  RenderThread render_thread;
+  std::thread main_side([&render_thread]() {
+    const RenderThread::Stats& stats = render_thread.getStats();
+    for (int i = 1; i <= HANDOFF_VALUES; ++i) {
+      InputSnapshot snapshot;
+      snapshot.framebuffer_width = i;
+      uint64_t dropped = stats.inputs_dropped;
+      render_thread.pushInput(snapshot);
+      // the last one must get through for the render side to end on it
+      while (i == HANDOFF_VALUES && stats.inputs_dropped != dropped) {
+        std::this_thread::yield();
+        dropped = stats.inputs_dropped;
+        render_thread.pushInput(snapshot);
+      }
+      if (i % 100 == 0) std::this_thread::yield(); // as if waiting for events
+    }
+  });
+  int failures = 0, seen = 0, takes = 0;
+  InputSnapshot latest;
+  while (seen < HANDOFF_VALUES) {
+    if (!render_thread.latestInput(latest)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ++takes;
+    if (latest.framebuffer_width <= seen) {
+      std::printf("FAIL: snapshot %d taken after %d\n", latest.framebuffer_width, seen);
+      ++failures;
+      break;
+    }
+    seen = latest.framebuffer_width;
+  }
+  main_side.join();
+  const RenderThread::Stats& stats = render_thread.getStats();
+  std::printf("handoff: %d snapshots pushed, %d frames took new ones, %llu dropped\n", HANDOFF_VALUES, takes,
+              (unsigned long long)stats.inputs_dropped);
+  if (!failures && seen != HANDOFF_VALUES) {
+    std::printf("FAIL: the last snapshot taken was %d\n", seen);
+    ++failures;
+  }
+  return failures;
+}
+
+// one frame on a single thread: push snapshots, some after input events,
+// wait, take them and present
+struct Frame {
+  const char* what;
+  int    snapshots;     // pushed this frame
+  int    first_event;   // index of the first snapshot after an event, -1: none
+  double between;       // seconds between pushes
+  double before_present;
+  bool   measured;
+  double min_latency;   // when measured
+};
+
+int checkLatency() {
+  const double LATE = 0.5; // no frame here should take this long
+  const Frame frames[] = {
+    {"snapshots without events",   3, -1, 0.002, 0.005, false, 0.0},
+    {"an event",                   1,  0, 0.0,   0.010, true,  0.010},
+    {"no new snapshots",           0, -1, 0.0,   0.005, false, 0.0},
+    {"events in two snapshots",    2,  0, 0.010, 0.005, true,  0.015},
+    {"an event after a plain one", 2,  1, 0.010, 0.005, true,  0.005},
+  };
+
+  RenderThread render_thread;
+  const RenderThread::Stats& stats = render_thread.getStats();
+  InputSnapshot latest;
+  int failures = 0;
+  for (const Frame& frame : frames) {
+    uint64_t measured_before = stats.latency_frames;
+    double total_before = stats.latency_total;
+    for (int i = 0; i < frame.snapshots; ++i) {
+      if (frame.first_event >= 0 && i >= frame.first_event) render_thread.inputEvent();
+      render_thread.pushInput(InputSnapshot());
+      if (i + 1 < frame.snapshots) sleepSeconds(frame.between);
+    }
+    sleepSeconds(frame.before_present);
+    render_thread.latestInput(latest);
+    render_thread.framePresented();
+
+    bool measured = stats.latency_frames > measured_before;
+    double latency = stats.latency_total - total_before;
+    std::printf("latency: %-28s %s", frame.what, measured ? "measured" : "not measured");
+    if (measured) std::printf(", %.1f ms", latency * 1000.0);
+    std::printf("\n");
+    if (measured != frame.measured || (measured && (latency < frame.min_latency || latency > LATE)) ||
+        (!measured && latency != 0.0)) {
+      std::printf("FAIL: expected %s\n", frame.measured ? "a latency from the oldest event" : "nothing recorded");
+      ++failures;
+    }
+  }
+
+  // an event whose snapshot is dropped goes with the next one
+  for (size_t i = 0; i < RenderThread::INPUT_QUEUE; ++i)
+    render_thread.pushInput(InputSnapshot());
+  render_thread.inputEvent();
+  render_thread.pushInput(InputSnapshot());
+  uint64_t dropped = stats.inputs_dropped;
+  render_thread.latestInput(latest);
+  render_thread.framePresented();
+  uint64_t measured_before = stats.latency_frames;
+  double total_before = stats.latency_total;
+  sleepSeconds(0.030);
+  render_thread.pushInput(InputSnapshot());
+  render_thread.latestInput(latest);
+  render_thread.framePresented();
+  double latency = stats.latency_total - total_before;
+  std::printf("latency: %-28s %llu dropped, %s, %.1f ms\n", "an event on a full queue", (unsigned long long)dropped,
+              stats.latency_frames > measured_before ? "measured" : "not measured", latency * 1000.0);
+  if (dropped != 1 || stats.latency_frames != measured_before + 1 || latency < 0.030 || latency > LATE) {
+    std::printf("FAIL: expected the dropped event measured with the next snapshot\n");
+    ++failures;
+  }
+  return failures;
+}
+
+}  // namespace
+
+int main() {
+  int failures = checkQueue();
+  failures += checkHandoff();
+  failures += checkLatency();
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+// Row-band decoding against whole-image decoding (see the row-band
+// interface in stb_image.h).
+//
+//   row_band_check
+//
+// Run it from 7-Transformations. Decodes each image with stbi_load_rows_*
+// into a buffer, placing every band at band.y, and compares it with what
+// stbi_load_from_memory gives, for vertical flip off and on and every
+// desired_channels from 0 to 4. The images are the JPEG and PNG textures
+// (the streamed paths), 8-bit PNGs made here in gray, gray+alpha, RGB and
+// RGBA with a random filter on each row and heights that don't fill the
+// last band, and a TGA (loaded whole, then handed out in bands). The size,
+// channels and band layout must agree too: each band within the image and
+// with the expected channels, every row written exactly once. Last, a
+// callback returning 0 must make the load fail.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Image {
+  std::string name;
+  std::vector<unsigned char> bytes;
+};
+
+void put32(std::vector<unsigned char>& out, uint32_t value) {
+  out.push_back((unsigned char)(value >> 24));
+  out.push_back((unsigned char)(value >> 16));
+  out.push_back((unsigned char)(value >> 8));
+  out.push_back((unsigned char)value);
+}
+
+uint32_t crc32(const unsigned char* bytes, size_t size) {
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= bytes[i];
+    for (int k = 0; k < 8; ++k) crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+void chunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data) {
+  put32(png, (uint32_t)data.size());
+  size_t start = png.size();
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data.begin(), data.end());
+  put32(png, crc32(png.data() + start, png.size() - start));
+}
+
+// an 8-bit PNG of random rows, each with a random filter byte, in stored
+// zlib blocks small enough that rows straddle them
+std::vector<unsigned char> makePng(int width, int height, int channels, std::mt19937& random) {
+  const unsigned char COLOR_TYPES[5] = {0, 0, 4, 2, 6};
+  std::vector<unsigned char> rows;
+  for (int y = 0; y < height; ++y) {
+    rows.push_back((unsigned char)(random() % 5));
+    for (int i = 0; i < width * channels; ++i) rows.push_back((unsigned char)random());
+  }
+
+  std::vector<unsigned char> zlib = {0x78, 0x01};
+  const size_t BLOCK = 1000;
+  for (size_t i = 0; i < rows.size(); i += BLOCK) {
+    size_t block = std::min(BLOCK, rows.size() - i);
+    zlib.push_back(i + block == rows.size() ? 1 : 0);
+    zlib.push_back((unsigned char)block);
+    zlib.push_back((unsigned char)(block >> 8));
+    zlib.push_back((unsigned char)~block);
+    zlib.push_back((unsigned char)(~block >> 8));
+    zlib.insert(zlib.end(), rows.begin() + i, rows.begin() + i + block);
+  }
+  uint32_t a = 1, b = 0;
+  for (unsigned char byte : rows) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  put32(zlib, (b << 16) | a);
+
+  std::vector<unsigned char> header;
+  put32(header, (uint32_t)width);
+  put32(header, (uint32_t)height);
+  header.push_back(8);
+  header.push_back(COLOR_TYPES[channels]);
+  header.insert(header.end(), {0, 0, 0});
+
+  std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  chunk(png, "IHDR", header);
+  chunk(png, "IDAT", zlib);
+  chunk(png, "IEND", std::vector<unsigned char>());
+  return png;
+}
+
+// an uncompressed 24-bit TGA of random pixels
+std::vector<unsigned char> makeTga(int width, int height, std::mt19937& random) {
+  std::vector<unsigned char> tga(18, 0);
+  tga[2]  = 2; // uncompressed true color
+  tga[12] = (unsigned char)width;
+  tga[13] = (unsigned char)(width >> 8);
+  tga[14] = (unsigned char)height;
+  tga[15] = (unsigned char)(height >> 8);
+  tga[16] = 24;
+  for (int i = 0; i < width * height * 3; ++i) tga.push_back((unsigned char)random());
+  return tga;
+}
+
+struct Collected {
+  std::vector<unsigned char> pixels;
+  std::vector<int> writes; // per output row
+  int  bands {0};
+  bool layout_ok {true};
+  bool stop {false};
+};
+
+int collect(void* user, const stbi_row_band* band) {
+  Collected& out = *(Collected*)user;
+  if (out.stop) return 0;
+  size_t row_bytes = (size_t)band->w * band->comp;
+  if (out.pixels.empty()) {
+    out.pixels.assign(row_bytes * band->h, 0);
+    out.writes.assign((size_t)band->h, 0);
+  }
+  if (band->y < 0 || band->num_rows <= 0 || band->y + band->num_rows > band->h ||
+      out.pixels.size() != row_bytes * band->h) {
+    out.layout_ok = false;
+    return 0;
+  }
+  std::memcpy(out.pixels.data() + band->y * row_bytes, band->rows, row_bytes * band->num_rows);
+  for (int r = 0; r < band->num_rows; ++r) ++out.writes[band->y + r];
+  ++out.bands;
+  return 1;
+}
+
+// band reassembly of image against stbi_load_from_memory; returns failures
+int compare(const Image& image, int flip, int desired_channels) {
+  stbi_set_flip_vertically_on_load(flip);
+  int width, height, channels;
+  unsigned char* whole = stbi_load_from_memory(image.bytes.data(), (int)image.bytes.size(), &width, &height, &channels,
+                                               desired_channels);
+  if (!whole) {
+    std::printf("FAIL: %s not decoded: %s\n", image.name.c_str(), stbi_failure_reason());
+    return 1;
+  }
+  int out_channels = desired_channels ? desired_channels : channels;
+
+  Collected bands;
+  int band_width = 0, band_height = 0, band_channels = 0;
+  int ok = stbi_load_rows_from_memory(image.bytes.data(), (int)image.bytes.size(), &band_width, &band_height,
+                                      &band_channels, desired_channels, collect, &bands);
+  bool every_row_once = true;
+  for (int writes : bands.writes)
+    every_row_once = every_row_once && writes == 1;
+  bool same = ok && band_width == width && band_height == height && band_channels == channels && bands.layout_ok &&
+              (int)bands.writes.size() == height && every_row_once &&
+              bands.pixels.size() == (size_t)width * height * out_channels &&
+              std::memcmp(bands.pixels.data(), whole, bands.pixels.size()) == 0;
+  stbi_image_free(whole);
+  if (!same) {
+    std::printf("FAIL: %s, flip %d, %d channels: bands differ from the whole image%s%s\n", image.name.c_str(), flip,
+                desired_channels, ok ? "" : ": ", ok ? "" : stbi_failure_reason());
+    return 1;
+  }
+  return 0;
+}
+
+bool readFile(const char* path, std::vector<unsigned char>& bytes) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !bytes.empty();
+}
+
+}  // namespace
+
+int main() {
+  std::vector<Image> images;
+  const char* textures[2] = {"./resources/textures/container.jpg", "./resources/textures/awesomeface.png"};
+  for (const char* path : textures) {
+    Image image;
+    image.name = path;
+    if (!readFile(path, image.bytes)) {
+      std::fprintf(stderr, "ERROR::ROW_BAND_CHECK::TEXTURES_NOT_FOUND run it from 7-Transformations\n");
+      return 1;
+    }
+    images.push_back(image);
+  }
+  std::mt19937 random(1);
+  const char* png_names[5] = {nullptr, "gray PNG", "gray+alpha PNG", "RGB PNG", "RGBA PNG"};
+  for (int channels = 1; channels <= 4; ++channels)
+    images.push_back(Image {png_names[channels], makePng(37 + channels * 20, 23 + channels * 17, channels, random)});
+  images.push_back(Image {"TGA", makeTga(45, 29, random)});
+
+  int failures = 0;
+  for (const Image& image : images) {
+    int failed = 0;
+    for (int flip = 0; flip <= 1; ++flip)
+      for (int desired_channels = 0; desired_channels <= 4; ++desired_channels)
+        failed += compare(image, flip, desired_channels);
+    std::printf("%-36s %s\n", image.name.c_str(), failed ? "differs" : "bands match, flip 0/1, 0-4 channels");
+    failures += failed;
+  }
+  stbi_set_flip_vertically_on_load(0);
+
+  // a callback that stops the load on its first band
+  Collected stopped;
+  stopped.stop = true;
+  int width, height, channels;
+  if (stbi_load_rows_from_memory(images[1].bytes.data(), (int)images[1].bytes.size(), &width, &height, &channels, 0,
+                                 collect, &stopped)) {
+    std::printf("FAIL: a load the callback stopped succeeded\n");
+    ++failures;
+  }
+
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
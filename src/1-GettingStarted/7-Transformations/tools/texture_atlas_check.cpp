@@ -0,0 +1,185 @@
+// Sprite packing, bleeding and mip alignment (see texture_atlas.h).
+//
+//   texture_atlas_check [sprites] [seed]
+//
+// Packs [sprites] (200 by default, at most 255) random sprites of 1-40
+// texels a side, plus one too large for a page, into 256x256 pages, once
+// without mips and once with cells aligned for 2 mips. Each sprite's red
+// channel is its own index and its green and blue are its texel
+// coordinates, so every texel read back says where it came from. The
+// pages are uploaded and read back, and:
+//   - the oversized sprite must be reported and left off the pages
+//   - no two cells may overlap or leave the page
+//   - each sprite's texels must be where its rect says, with the border
+//     around it repeating its nearest edge texel
+//   - with mips, cells must sit on the 4-texel grid and the first two mips
+//     must only hold the sprite's own red inside each cell
+//   - remapTexcoords must map 0..1 onto the rect's UVs
+
+#include "gl_check_context.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "../texture_atlas.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+const int PAGE_SIZE = 256;
+const int PADDING   = 2;
+
+struct Sprite {
+  int width, height;
+};
+
+std::vector<unsigned char> spritePixels(int index, const Sprite& sprite) {
+  std::vector<unsigned char> pixels((size_t)sprite.width * sprite.height * 4);
+  for (int y = 0; y < sprite.height; ++y) {
+    for (int x = 0; x < sprite.width; ++x) {
+      unsigned char* texel = &pixels[((size_t)y * sprite.width + x) * 4];
+      texel[0] = (unsigned char)index;
+      texel[1] = (unsigned char)x;
+      texel[2] = (unsigned char)y;
+      texel[3] = 255;
+    }
+  }
+  return pixels;
+}
+
+// level of the atlas's texture array, every page one after the other
+std::vector<unsigned char> readLevel(const TextureAtlas& atlas, int level) {
+  int size = PAGE_SIZE >> level;
+  std::vector<unsigned char> pixels((size_t)size * size * 4 * atlas.pageCount());
+  glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.texture_array);
+  glGetTexImage(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  return pixels;
+}
+
+// failures found in an atlas built with mip_levels
+int check(const std::vector<Sprite>& sprites, int mip_levels) {
+  TextureAtlas atlas(PAGE_SIZE, PADDING, mip_levels);
+  for (size_t i = 0; i < sprites.size(); ++i) {
+    std::vector<unsigned char> pixels = spritePixels((int)i, sprites[i]);
+    atlas.add(pixels.data(), sprites[i].width, sprites[i].height);
+  }
+  std::vector<unsigned char> big((size_t)(PAGE_SIZE + 1) * 4 * 4, 255);
+  int oversized = atlas.add(big.data(), PAGE_SIZE + 1, 4);
+
+  int failures = 0;
+  if (atlas.build()) {
+    std::printf("FAIL: build() didn't report the oversized sprite\n");
+    ++failures;
+  }
+  atlas.upload();
+  atlas.printStats();
+  if (atlas.rect(oversized).page != -1) {
+    std::printf("FAIL: the oversized sprite was placed\n");
+    ++failures;
+  }
+
+  int alignment = 1 << mip_levels;
+  std::vector<unsigned char> level0 = readLevel(atlas, 0);
+  size_t page_bytes = (size_t)PAGE_SIZE * PAGE_SIZE * 4;
+  for (size_t i = 0; i < sprites.size(); ++i) {
+    const AtlasRect& r = atlas.rect((int)i);
+    int cell_x = r.x - PADDING, cell_y = r.y - PADDING;
+    if (r.page < 0 || r.width != sprites[i].width || r.height != sprites[i].height || cell_x < 0 || cell_y < 0 ||
+        r.x + r.width + PADDING > PAGE_SIZE || r.y + r.height + PADDING > PAGE_SIZE) {
+      std::printf("FAIL: sprite %zu placed at page %d (%d, %d) %dx%d\n", i, r.page, r.x, r.y, r.width, r.height);
+      ++failures;
+      continue;
+    }
+    if (cell_x % alignment || cell_y % alignment) {
+      std::printf("FAIL: sprite %zu's cell at (%d, %d) is off the %d-texel grid\n", i, cell_x, cell_y, alignment);
+      ++failures;
+    }
+
+    // no overlap with any later sprite's cell on the same page
+    for (size_t j = i + 1; j < sprites.size(); ++j) {
+      const AtlasRect& o = atlas.rect((int)j);
+      if (o.page != r.page) continue;
+      if (o.x - PADDING < r.x + r.width + PADDING && r.x - PADDING < o.x + o.width + PADDING &&
+          o.y - PADDING < r.y + r.height + PADDING && r.y - PADDING < o.y + o.height + PADDING) {
+        std::printf("FAIL: the cells of sprites %zu and %zu overlap\n", i, j);
+        ++failures;
+      }
+    }
+
+    // the sprite and its bled border
+    const unsigned char* page = level0.data() + page_bytes * r.page;
+    size_t wrong = 0;
+    for (int y = -PADDING; y < r.height + PADDING; ++y) {
+      for (int x = -PADDING; x < r.width + PADDING; ++x) {
+        const unsigned char* texel = page + ((size_t)(r.y + y) * PAGE_SIZE + r.x + x) * 4;
+        int sx = std::min(std::max(x, 0), r.width - 1), sy = std::min(std::max(y, 0), r.height - 1);
+        if (texel[0] != i || texel[1] != sx || texel[2] != sy || texel[3] != 255) ++wrong;
+      }
+    }
+    if (wrong) {
+      std::printf("FAIL: %zu texels of sprite %zu or its border are wrong\n", wrong, i);
+      ++failures;
+    }
+
+    float quad[4 * 2] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    atlas.remapTexcoords((int)i, quad, 4, 2, 0);
+    if (quad[0] != r.u0 || quad[1] != r.v0 || std::fabs(quad[6] - r.u1) > 1e-6f || std::fabs(quad[7] - r.v1) > 1e-6f ||
+        std::fabs(r.u0 * PAGE_SIZE - r.x) > 1e-3f || std::fabs(r.v1 * PAGE_SIZE - (r.y + r.height)) > 1e-3f) {
+      std::printf("FAIL: sprite %zu's texcoords don't match its rect\n", i);
+      ++failures;
+    }
+  }
+
+  // filtered mips inside a cell only ever average the sprite's own texels
+  for (int level = 1; level <= mip_levels; ++level) {
+    int size = PAGE_SIZE >> level;
+    std::vector<unsigned char> pixels = readLevel(atlas, level);
+    size_t wrong = 0;
+    for (size_t i = 0; i < sprites.size(); ++i) {
+      const AtlasRect& r = atlas.rect((int)i);
+      if (r.page < 0) continue;
+      const unsigned char* page = pixels.data() + (size_t)size * size * 4 * r.page;
+      int x0 = (r.x - PADDING) >> level, y0 = (r.y - PADDING) >> level;
+      int x1 = (r.x + r.width + PADDING + (1 << level) - 1) >> level;
+      int y1 = (r.y + r.height + PADDING + (1 << level) - 1) >> level;
+      for (int y = y0; y < y1; ++y)
+        for (int x = x0; x < x1; ++x)
+          if (page[((size_t)y * size + x) * 4] != i) ++wrong;
+    }
+    if (wrong) {
+      std::printf("FAIL: %zu texels of mip %d mix in other sprites\n", wrong, level);
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? std::atoi(argv[1]) : 200;
+  unsigned int seed = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 1;
+  count = std::min(std::max(count, 1), 255);
+
+  GlCheckContext context("texture_atlas_check");
+  if (!context.isValid()) return 1;
+
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int> side(1, 40);
+  std::vector<Sprite> sprites(count);
+  for (Sprite& sprite : sprites)
+    sprite = {side(random), side(random)};
+
+  int failures = 0;
+  std::printf("--- without mips\n");
+  failures += check(sprites, 0);
+  std::printf("--- cells aligned for 2 mips\n");
+  failures += check(sprites, 2);
+
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+// Texture residency under a memory budget (see texture_budget.h).
+//
+//   texture_budget_check
+//
+// Run it from 7-Transformations. It copies resources/textures into a
+// temporary directory and adds three textures with room for all of them,
+// then steps frames with one texture bound and the budget lowered:
+//   - to a little under everything: only the idle textures may lose top
+//     levels, none may be evicted, and the bound one must stay complete
+//   - to texture 0 alone: the idle ones must be evicted
+// Raised again with every texture bound, the dropped levels must stream
+// back until all three are complete and match what MipChain loads. Last,
+// one texture is evicted and its files deleted while it stays bound: its
+// reloads must fail, back off instead of retrying every frame, and leave
+// it evicted.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include "gl_check_context.h"
+#include "../texture_budget.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int TEXTURES = 3;
+
+// frames binding the textures in bound each frame, waiting a little between
+// them so the loads started along the way can finish
+void step(TextureBudget& budget, const std::vector<int>& bound, int frames) {
+  for (int frame = 0; frame < frames; ++frame) {
+    for (size_t i = 0; i < bound.size(); ++i)
+      budget.bind(bound[i], (unsigned int)i);
+    budget.update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// whether the bound level 0 is what MipChain makes of path
+bool matchesSource(const std::string& path) {
+  MipChain mips;
+  if (!mips.load(path.c_str())) return false;
+  const GLenum formats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+  std::vector<unsigned char> pixels(mips.levels[0].pixels.size());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glGetTexImage(GL_TEXTURE_2D, 0, formats[mips.channels - 1], GL_UNSIGNED_BYTE, pixels.data());
+  return pixels == mips.levels[0].pixels;
+}
+
+void printBases(const TextureBudget& budget) {
+  std::printf("  first resident levels:");
+  for (int id = 0; id < TEXTURES; ++id)
+    std::printf(" %d", budget.residentBaseLevel(id));
+  std::printf("\n  ");
+  std::fflush(stdout);
+  budget.printStats();
+}
+
+}  // namespace
+
+int main() {
+  GlCheckContext context("texture_budget_check");
+  if (!context.isValid()) return 1;
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "texture_budget_check";
+  std::filesystem::create_directories(dir);
+  const char* sources[TEXTURES] = {"container.jpg", "awesomeface.png", "container.jpg"};
+  std::vector<std::string> paths;
+  for (int i = 0; i < TEXTURES; ++i) {
+    std::string path = (dir / (std::to_string(i) + "_" + sources[i])).string();
+    std::error_code error;
+    std::filesystem::copy_file(std::string("./resources/textures/") + sources[i], path,
+                               std::filesystem::copy_options::overwrite_existing, error);
+    if (error) {
+      context.error("TEXTURES_NOT_FOUND", "run it from 7-Transformations");
+      return 1;
+    }
+    std::filesystem::remove(path + ".mips", error);
+    paths.push_back(path);
+  }
+
+  int failures = 0;
+  {
+    TextureBudget budget(256 * 1024 * 1024);
+    size_t first_bytes = 0; // of texture 0, complete
+    for (const std::string& path : paths) {
+      if (budget.add(path.c_str()) < 0) return 1;
+      if (!first_bytes) first_bytes = budget.getStats().resident_bytes;
+    }
+    size_t everything = budget.getStats().resident_bytes;
+    std::printf("--- all resident\n");
+    printBases(budget);
+
+    std::vector<int> first = {0};
+    budget.setBudget(everything * 9 / 10);
+    step(budget, first, 3);
+    std::printf("--- budget at 90%%, texture 0 bound\n");
+    printBases(budget);
+    const TextureBudget::Stats& stats = budget.getStats();
+    if (stats.over_budget || stats.evictions || stats.level_drops == 0 || budget.residentBaseLevel(0) != 0) {
+      std::printf("FAIL: expected only top levels of idle textures dropped\n");
+      ++failures;
+    }
+
+    budget.setBudget(first_bytes);
+    step(budget, first, 3);
+    std::printf("--- budget fits texture 0 alone, texture 0 bound\n");
+    printBases(budget);
+    if (stats.over_budget || budget.residentBaseLevel(0) != 0 || budget.residentBaseLevel(1) != -1 ||
+        budget.residentBaseLevel(2) != -1) {
+      std::printf("FAIL: expected the idle textures evicted and texture 0 complete\n");
+      ++failures;
+    }
+
+    std::vector<int> all = {0, 1, 2};
+    budget.setBudget(256 * 1024 * 1024);
+    for (int frame = 0; frame < 2000; ++frame) {
+      step(budget, all, 1);
+      if (stats.pending_loads == 0 && budget.residentBaseLevel(1) == 0 && budget.residentBaseLevel(2) == 0) break;
+    }
+    std::printf("--- budget raised, all bound\n");
+    printBases(budget);
+    if (stats.resident_bytes != everything || stats.evicted_textures || stats.levels_streamed == 0) {
+      std::printf("FAIL: expected every level streamed back\n");
+      ++failures;
+    }
+    for (int id = 0; id < TEXTURES; ++id) {
+      budget.bind(id, 0);
+      if (!matchesSource(paths[id])) {
+        std::printf("FAIL: texture %d doesn't match its image after streaming\n", id);
+        ++failures;
+      }
+    }
+
+    // texture 2 evicted (the binds above count as this frame's use, so one
+    // more frame), then its files gone while it is bound every frame
+    budget.setBudget(first_bytes);
+    step(budget, first, 2);
+    std::error_code error;
+    std::filesystem::remove(paths[2], error);
+    std::filesystem::remove(paths[2] + ".mips", error);
+    std::vector<int> missing = {0, 2};
+    budget.setBudget(256 * 1024 * 1024);
+    size_t failed_before = stats.failed_loads;
+    const int frames = 500;
+    std::printf("--- texture 2 deleted, bound for %d frames\n", frames);
+    step(budget, missing, frames);
+    printBases(budget);
+    size_t attempts = stats.failed_loads - failed_before;
+    // RETRY_FRAMES doubling: tried at about 0, 60, 180 and 420 frames in
+    if (attempts == 0 || attempts > 5 || budget.residentBaseLevel(2) != -1) {
+      std::printf("FAIL: %zu failed loads in %d frames, expected a few backed-off retries\n", attempts, frames);
+      ++failures;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}
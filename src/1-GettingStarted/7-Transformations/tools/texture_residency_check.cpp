@@ -0,0 +1,189 @@
+// Sampling every texture through its table slot (see texture_residency.h).
+//
+//   texture_residency_check
+//
+// Opens a hidden window (4.0 if the driver has it, for bindless handles)
+// and adds three textures of random texels: 64x64 RGB, which sets the
+// layer size, 32x16 grey+alpha and 37x23 RGBA. For each slot and each mip
+// level it draws the level's size, looking the texture up the way
+// fragment.frag and fragment_bindless.frag do (with the level pinned by
+// textureLod), at every texel centre, and compares what comes back with
+// the texture's own level in RGBA:
+//   - texture array: level 0 of every slot must match, and so must every
+//     level where the slot's scale is exact (sides dividing by 2^level);
+//     the odd-sized texture's other levels are only reported, as the
+//     header documents they drift
+//   - bindless handles: every level of every slot must match. Skipped with
+//     a note when the driver has no ARB_bindless_texture (llvmpipe hasn't)
+
+#include "gl_check_context.h"
+#include "../texture_residency.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+const int SIZES[3][3] = {{64, 64, 3}, {32, 16, 2}, {37, 23, 4}}; // width, height, channels
+
+const char* VERTEX_SOURCE =
+  "#version 330 core\n"
+  "void main() {\n"
+  "  vec2 corner = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);\n"
+  "  gl_Position = vec4(corner, 0.0, 1.0);\n"
+  "}\n";
+
+// fragment.frag's lookup, at a fixed level
+const char* ARRAY_SOURCE =
+  "#version 330 core\n"
+  "uniform sampler2DArray textures;\n"
+  "layout (std140) uniform TextureTable {\n"
+  "  vec4 slots[256];\n"
+  "};\n"
+  "uniform int index;\n"
+  "uniform int level;\n"
+  "uniform vec2 size;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  vec4 slot = slots[index];\n"
+  "  frag_color = textureLod(textures, vec3(gl_FragCoord.xy / size * slot.xy, slot.z), float(level));\n"
+  "}\n";
+
+// fragment_bindless.frag's lookup, at a fixed level
+const char* BINDLESS_SOURCE =
+  "#version 400 core\n"
+  "#extension GL_ARB_bindless_texture : require\n"
+  "layout (std140) uniform TextureTable {\n"
+  "  uvec4 slots[256];\n"
+  "};\n"
+  "uniform int index;\n"
+  "uniform int level;\n"
+  "uniform vec2 size;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  frag_color = textureLod(sampler2D(slots[index].xy), gl_FragCoord.xy / size, float(level));\n"
+  "}\n";
+
+std::vector<unsigned char> toRgba(const MipLevel& level, int channels) {
+  std::vector<unsigned char> rgba;
+  for (size_t p = 0; p < level.pixels.size(); p += channels) {
+    const unsigned char* in = &level.pixels[p];
+    unsigned char grey = in[0];
+    unsigned char pixel[4] = {grey, grey, grey, 255};
+    if (channels >= 3) std::copy(in, in + 3, pixel);
+    if (channels == 2 || channels == 4) pixel[3] = in[channels - 1];
+    rgba.insert(rgba.end(), pixel, pixel + 4);
+  }
+  return rgba;
+}
+
+// draws every level of every slot through program and compares it with the
+// chains; returns failures
+int checkPath(const char* path, TextureResidency& residency, GLuint program, const std::vector<MipChain>& chains,
+              int layer_width, int layer_height) {
+  std::vector<int> indices;
+  for (const MipChain& chain : chains)
+    indices.push_back(residency.add(chain));
+  residency.build();
+  residency.bind(program, 0);
+  glUseProgram(program);
+  residency.printStats();
+
+  int failures = 0;
+  std::vector<unsigned char> pixels;
+  for (size_t t = 0; t < chains.size(); ++t) {
+    const MipChain& chain = chains[t];
+    // the array has the layer's levels; past its own chain a texture repeats its 1x1
+    int level_count = residency.isBindless() ? (int)chain.levels.size()
+                                             : MipChain::levelCount(layer_width, layer_height);
+    int exact_levels = 0, drift = 0;
+    for (int l = 0; l < level_count; ++l) {
+      const MipLevel& level = chain.levels[std::min((size_t)l, chain.levels.size() - 1)];
+      int divisor = 1 << l;
+      bool exact = residency.isBindless() || (level.width == 1 && level.height == 1) ||
+                   (chain.levels[0].width % divisor == 0 && chain.levels[0].height % divisor == 0 &&
+                    layer_width % divisor == 0 && layer_height % divisor == 0);
+
+      glUniform1i(glGetUniformLocation(program, "index"), indices[t]);
+      glUniform1i(glGetUniformLocation(program, "level"), l);
+      glUniform2f(glGetUniformLocation(program, "size"), (float)level.width, (float)level.height);
+      glViewport(0, 0, level.width, level.height);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+      pixels.assign((size_t)level.width * level.height * 4, 0);
+      glReadPixels(0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+      std::vector<unsigned char> expected = toRgba(level, chain.channels);
+      int worst = 0;
+      for (size_t i = 0; i < expected.size(); ++i)
+        worst = std::max(worst, std::abs((int)pixels[i] - (int)expected[i]));
+      if (worst <= 1) {
+        ++exact_levels;
+      } else if (exact) {
+        std::printf("FAIL: %s, %dx%d texture, level %d: off by up to %d\n", path, chain.levels[0].width,
+                    chain.levels[0].height, l, worst);
+        ++failures;
+      } else {
+        drift = std::max(drift, worst);
+      }
+    }
+    std::printf("%-8s %2dx%-2d %d of %d levels match", path, chain.levels[0].width, chain.levels[0].height,
+                exact_levels, level_count);
+    if (drift) std::printf(", the rest off by up to %d (unaligned, as documented)", drift);
+    std::printf("\n");
+  }
+  return failures;
+}
+
+}  // namespace
+
+int main() {
+  GlCheckContext context("texture_residency_check", 4, 0);
+  if (!context.isValid()) return 1;
+  context.createTarget(64, 64);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  GLuint vertex_array;
+  glGenVertexArrays(1, &vertex_array);
+  glBindVertexArray(vertex_array);
+
+  std::mt19937 random(1);
+  std::vector<MipChain> chains(3);
+  int layer_width = 0, layer_height = 0;
+  for (int t = 0; t < 3; ++t) {
+    const int* size = SIZES[t];
+    std::vector<unsigned char> pixels((size_t)size[0] * size[1] * size[2]);
+    for (unsigned char& byte : pixels) byte = (unsigned char)random();
+    chains[t].generate(pixels.data(), size[0], size[1], size[2]);
+    layer_width = std::max(layer_width, size[0]);
+    layer_height = std::max(layer_height, size[1]);
+  }
+
+  int failures = 0;
+  {
+    GLuint program = context.link(VERTEX_SOURCE, ARRAY_SOURCE);
+    if (!program) return 1;
+    TextureResidency residency; // no loader: always the array
+    failures += checkPath("array", residency, program, chains, layer_width, layer_height);
+    glDeleteProgram(program);
+  }
+
+  {
+    TextureResidency residency((GLADloadproc)glfwGetProcAddress);
+    if (!residency.isBindless()) {
+      std::printf("bindless skipped: no ARB_bindless_texture on this driver\n");
+    } else {
+      GLuint program = context.link(VERTEX_SOURCE, BINDLESS_SOURCE);
+      if (!program) return 1;
+      failures += checkPath("bindless", residency, program, chains, layer_width, layer_height);
+      glDeleteProgram(program);
+    }
+  }
+
+  glDeleteVertexArrays(1, &vertex_array);
+  std::printf(failures ? "FAILED\n" : "OK\n");
+  return failures ? 1 : 0;
+}